@@ -23,6 +23,7 @@
 #define DCConfig_h
 
 #include <inttypes.h>
+#include "CANBitTiming.h"
 
 #define DCM_BOARD_VER	32		// v3.2
 //#define DCM_SW_VER		100	// v1.0	Initial version Jan 2021
@@ -114,12 +115,24 @@ namespace DCConfig
 	const uint32_t	kFilterLoadedMessage = 0x4C4344;	// DCL (big endian)
 	
 	// CAN
+	const uint32_t	kCANOscFreq = 8000000;	// MCP2515 crystal
+	const CANBitTiming::EProfile	kCANProfile = CANBitTiming::e40kbps;	// Same as the sensors
 	const uint8_t	kCANQueueSize		= 64;
+	const uint8_t	kCANRxRingSize		= 16;	// Received frames, 13 bytes each
 	const uint32_t	kControllerID = 0x20000;// b 0010 0000 0000 0000 0000
 	const uint32_t	kBroadcastID = 0x20001;
 	const uint32_t	kBaseIDMask = 0x3FFE0;	// b 0011 1111 1111 1110 0000
 	const uint32_t	kGateIndexMask = 0x1F;	// b				   1 1111
-	const uint32_t	kCANBusyPeriod = 200;			// in milliseconds
+	const uint32_t	kCANQuietPeriod = 10;			// in milliseconds, see CANOverflowRisk
+	const uint32_t	kCANSettlePeriod = 200;			// in milliseconds, see SendQueuedMessages
+	const uint32_t	kCANMinResponseWindow = 20;		// in milliseconds
+	const uint32_t	kCANMaxResponseWindow = 200;	// in milliseconds
+	const uint8_t	kCANPollSlot = 4;				// in ms per gate index, see ePollGateStates
+	const uint8_t	kCANMaxRequests = 8;			// In flight, see CheckCANRequests
+	const uint8_t	kCANMaxRetries = 2;				// Per request, see CheckCANRequests
+	const uint32_t	kGateHeartbeatTimeout = 100000;	// in milliseconds, see CheckHeartbeats
+	const uint32_t	kHeartbeatCheckPeriod = 1000;	// in milliseconds
+	const uint32_t	kCalibrateTimeout = 12000;		// in milliseconds, the sensor's 10 s plus the reply
 
 	const uint8_t	kTextInset			= 3; // Makes room for drawing the selection frame
 	const uint8_t	kTextVOffset		= 6; // Makes room for drawing the selection frame
@@ -134,6 +147,8 @@ namespace DCConfig
 	// Gates & Gate Sets
 	const uint8_t	kMaxGates = 32;
 	const uint8_t	kMaxGateSets = 32;
+	// The time a poll of every gate takes, see SetGateState
+	const uint32_t	kGateSetLookupDelay = kCANPollSlot * kMaxGates;	// in milliseconds
 	const uint32_t	kDefaultCleanDelta = 249; // Pa = ~1" water
 	/*
 	*	The dirty delta is set high so that the collector doesn't go into an
@@ -32,6 +32,7 @@
 #include <Wire.h>
 #include "DS3231SN.h"
 #include "ATmega644RTC.h"
+#include "EEPROMTracer.h"
 
 #define BAUD_RATE	19200
 
@@ -46,6 +47,18 @@ DustCollectorUI	dustCollectorUI;
 
 DustCollector		dustCollector;
 DS3231SN			externalRTC;
+#ifdef PROFILE_LOOP
+MSPeriod			profileDumpPeriod(10000);
+#endif
+#ifdef TRACE_SPI	// See SPITracer.h
+MSPeriod			spiTraceDumpPeriod(10000);
+#endif
+#ifdef TRACE_EEPROM	// See EEPROMTracer.h
+MSPeriod			eepromTraceDumpPeriod(60000);
+#endif
+#ifdef REPORT_DEADLINES	// See DustCollector.h
+MSPeriod			deadlineDumpPeriod(60000);
+#endif
 
 
 /*********************************** setup ************************************/
@@ -79,6 +92,23 @@ void setup(void)
 							&MyriadPro_Regular_36_1b::font,
 								&MyriadPro_Regular_18::font,
 									&DC_Icons::font);	
+#ifdef PROFILE_LOOP
+	profileDumpPeriod.Start();
+#endif
+#ifdef TRACE_SPI
+	SPITracer::SetName(DCConfig::kDispCSPin, F("TFT"));
+	SPITracer::SetName(DCConfig::kCANCSPin, F("MCP2515"));
+	SPITracer::SetName(DCConfig::kBMP1CSPin, F("BMP280 ambient"));
+	SPITracer::SetName(DCConfig::kBMP0CSPin, F("BMP280 duct"));
+	SPITracer::Reset();
+	spiTraceDumpPeriod.Start();
+#endif
+#ifdef TRACE_EEPROM
+	eepromTraceDumpPeriod.Start();
+#endif
+#ifdef REPORT_DEADLINES
+	deadlineDumpPeriod.Start();
+#endif
 }
 
 /************************************ loop ************************************/
@@ -88,10 +118,44 @@ void loop(void)
 	*	If the dust collector isn't in a time critical state THEN
 	*	allow the UI time to update.
 	*/
+	PROFILE_BEGIN(DustCollector::eLoopSection);
 	if (dustCollector.Update())
 	{
 		dustCollectorUI.Update();	
 	}
+	PROFILE_END(DustCollector::eLoopSection);
+#ifdef PROFILE_LOOP
+	if (profileDumpPeriod.Passed())
+	{
+		profileDumpPeriod.Start();
+		DustCollector::DumpLoopProfile();
+		LoopProfiler::Reset();
+	}
+#endif
+#ifdef TRACE_SPI
+	if (spiTraceDumpPeriod.Passed())
+	{
+		spiTraceDumpPeriod.Start();
+		SPITracer::Dump();
+		SPITracer::Reset();
+	}
+#endif
+#ifdef TRACE_EEPROM
+	// The EEPROM counts aren't reset, the heat maps are since startup.
+	if (eepromTraceDumpPeriod.Passed())
+	{
+		eepromTraceDumpPeriod.Start();
+		EEPROMTracer::Dump();
+	}
+#endif
+#ifdef REPORT_DEADLINES
+	// The deadline counts aren't reset, the info field shows them too.
+	if (deadlineDumpPeriod.Passed())
+	{
+		deadlineDumpPeriod.Start();
+		DustCollector::DumpDeadlines();
+	}
+#endif
 
 #if 0
 	if (Serial.available())
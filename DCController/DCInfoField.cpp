@@ -38,6 +38,11 @@ const char kGateSetPrefixStr[] PROGMEM = "GS:";
 const char kMotorPrefixStr[] PROGMEM = "M:";
 const char kWarnPrefixStr[] PROGMEM = "WARN:";
 const char kVersionPrefixStr[] PROGMEM = "SW VER: ";
+const char kPressureLatePrefixStr[] PROGMEM = "P:";
+const char kCANLatePrefixStr[] PROGMEM = "C:";
+const char kCANErrorPrefixStr[] PROGMEM = "E:";
+const char kBusOffPrefixStr[] PROGMEM = "B:";
+const char kOverflowPrefixStr[] PROGMEM = "O:";
 
 
 /******************************** DCInfoField *********************************/
@@ -151,6 +156,38 @@ void DCInfoField::DrawItemP(
 	mXFont->DrawStr(textStr);
 }
 
+/******************************** DrawLateness ********************************/
+/*
+*	Draws the maximum lateness in ms (at most 999), green if the deadline was
+*	never missed, otherwise red.
+*/
+void DCInfoField::DrawLateness(
+	uint16_t	inMaxLate,
+	bool		inMissed,
+	uint8_t		inColumn)
+{
+	char	valueStr[15];
+	UnixTime::Uint16ToDecStr(inMaxLate, valueStr);
+	mXFont->GetDisplay()->MoveToColumn(inColumn);
+	mXFont->SetTextColor(inMissed ? XFont::eRed : XFont::eGreen);
+	mXFont->DrawStr(valueStr);
+	mXFont->EraseTillColumn(inColumn + 70);
+}
+
+/********************************* DrawCount **********************************/
+void DCInfoField::DrawCount(
+	uint8_t		inCount,
+	uint16_t	inColor,
+	uint8_t		inColumn)
+{
+	char	valueStr[15];
+	UInt8ToDecStr(inCount, valueStr);
+	mXFont->GetDisplay()->MoveToColumn(inColumn);
+	mXFont->SetTextColor(inColor);
+	mXFont->DrawStr(valueStr);
+	mXFont->EraseTillColumn(inColumn + 46);
+}
+
 /*********************************** Update ***********************************/
 void DCInfoField::Update(
 	bool	inUpdateAll)
@@ -184,7 +221,7 @@ void DCInfoField::Update(
 		{
 			{
 				char titleStr[3];
-				char titleChars[6];
+				char titleChars[sizeof(kTitleChars)];
 				strcpy_P(titleChars, kTitleChars);
 				titleStr[0] = titleChars[mDCInfo];
 				titleStr[1] = ':';
@@ -224,6 +261,20 @@ void DCInfoField::Update(
 			versStr[5] = 0;
 			mXFont->SetTextColor(0xBDA9);
 			mXFont->DrawStr(versStr, true);
+		} else if (mDCInfo == eDeadlineInfo)
+		{
+			mXFont->GetDisplay()->MoveToColumn(DCConfig::kTextInset);
+			DrawItemP(kPressureLatePrefixStr);
+			mXFont->GetDisplay()->MoveToColumn(DCConfig::kTextInset + 120);
+			DrawItemP(kCANLatePrefixStr);
+		} else if (mDCInfo == eCANErrorsInfo)
+		{
+			mXFont->GetDisplay()->MoveToColumn(DCConfig::kTextInset);
+			DrawItemP(kCANErrorPrefixStr);
+			mXFont->GetDisplay()->MoveToColumn(DCConfig::kTextInset + 80);
+			DrawItemP(kBusOffPrefixStr);
+			mXFont->GetDisplay()->MoveToColumn(DCConfig::kTextInset + 160);
+			DrawItemP(kOverflowPrefixStr);
 		}
 	}
 	switch (mDCInfo)
@@ -404,6 +455,68 @@ void DCInfoField::Update(
 			}
 			break;
 		}
+		case eDeadlineInfo:
+		{
+			/*
+			*	The maximum lateness of the pressure reads and of the CAN
+			*	receive/send, see DeadlineMonitor.h.  The counts only increase
+			*	so a change in their packed values means a redraw is needed.
+			*/
+			const DeadlineMonitor::STask&	pressure = DeadlineMonitor::Get(DustCollector::ePressureTask);
+			const DeadlineMonitor::STask&	canReceive = DeadlineMonitor::Get(DustCollector::eCANReceiveTask);
+			const DeadlineMonitor::STask&	canSend = DeadlineMonitor::Get(DustCollector::eCANSendTask);
+			uint16_t	pressureLate = pressure.maxLate < 999 ? pressure.maxLate : 999;
+			uint16_t	canLate = canReceive.maxLate > canSend.maxLate ? canReceive.maxLate : canSend.maxLate;
+			if (canLate > 999)
+			{
+				canLate = 999;
+			}
+			bool	pressureMissed = pressure.misses != 0;
+			bool	canMissed = (canReceive.misses + canSend.misses) != 0;
+			uint32_t	deadlines = pressureLate | ((uint32_t)canLate << 10) |
+									((uint32_t)pressureMissed << 20) | ((uint32_t)canMissed << 21);
+			if (inUpdateAll ||
+				mPrevDeadlines != deadlines)
+			{
+				mPrevDeadlines = deadlines;
+				MoveToTextTopLeft();
+				DrawLateness(pressureLate, pressureMissed, DCConfig::kTextInset + 31);
+				DrawLateness(canLate, canMissed, DCConfig::kTextInset + 151);
+			}
+			break;
+		}
+		case eCANErrorsInfo:
+		{
+			/*
+			*	The larger of TEC and REC, green when error active, yellow at
+			*	the warning level (96) and red when error passive (128) or
+			*	held after a bus off.  Then the bus off count and the number
+			*	of frames lost to receive buffer overflows, see MCP2515.h.
+			*/
+			const MCP2515::SErrorCounters&	counters = mDustCollector->GetErrorCounters();
+			uint8_t	errorCount = counters.tec > counters.rec ? counters.tec : counters.rec;
+			uint16_t	overflows = counters.rx0Overflows + counters.rx1Overflows;
+			if (overflows > 255)
+			{
+				overflows = 255;
+			}
+			uint8_t	level = mDustCollector->BusOffHold() || errorCount >= 128 ? 2 : (errorCount >= 96 ? 1 : 0);
+			uint32_t	canErrors = errorCount | ((uint32_t)counters.busOffs << 8) |
+									((uint32_t)overflows << 16) | ((uint32_t)level << 24);
+			if (inUpdateAll ||
+				mPrevCANErrors != canErrors)
+			{
+				mPrevCANErrors = canErrors;
+				MoveToTextTopLeft();
+				DrawCount(errorCount, level == 2 ? XFont::eRed :
+							(level ? XFont::eYellow : XFont::eGreen), DCConfig::kTextInset + 31);
+				DrawCount(counters.busOffs, counters.busOffs ? XFont::eRed : XFont::eGreen,
+							DCConfig::kTextInset + 111);
+				DrawCount(overflows, overflows ? XFont::eYellow : XFont::eGreen,
+							DCConfig::kTextInset + 191);
+			}
+			break;
+		}
 	}
 }
 
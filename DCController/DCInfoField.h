@@ -61,6 +61,8 @@ public:
 		eGateSetInfo,
 		eMotorInfo,
 		eSoftwareInfo,
+		eDeadlineInfo,
+		eCANErrorsInfo,
 		eInfoCount
 	};
 	
@@ -80,6 +82,8 @@ protected:
 	uint32_t			mPrevDuctPressure;
 	time32_t			mPrevDate;
 	time32_t			mPrevTime;
+	uint32_t			mPrevDeadlines;
+	uint32_t			mPrevCANErrors;
 
 	void					DrawPressure(
 								int32_t					inPressure,
@@ -89,6 +93,14 @@ protected:
 	void					DrawWaiting(void);
 	void					DrawItemP(
 								const char*				inTextStrP);
+	void					DrawLateness(
+								uint16_t				inMaxLate,
+								bool					inMissed,
+								uint8_t					inColumn);
+	void					DrawCount(
+								uint8_t					inCount,
+								uint16_t				inColor,
+								uint8_t					inColumn);
 };
 
 #endif // DCInfoField_h
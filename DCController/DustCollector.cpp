@@ -28,6 +28,7 @@
 #include "UnixTimeEditor.h"
 #include <EEPROM.h>
 #include "DCMessages.h"
+#include "SdFat.h"
 /*
 	There were issues with the 16 MHz MCU consuming the CAN messages too slowly.
 	This resulted in receive overflow errors.  This happened when a request for
@@ -39,19 +40,58 @@
 	queried individually, with a delay between each message sent to limit the
 	traffic on the bus.  The message queue is now the default mechanism for
 	sending messages when one or more sensors are expected to respond.
+
+	Received frames are now read from the MCP2515 by the INT2 interrupt
+	(ExtIntReq2) into mCANRxRing and handled from the main loop.  The ISR uses
+	the SPI bus, SPI.usingInterrupt() keeps it from running while another SPI
+	transaction is in progress, so it only runs between transactions.
+	TFT_ST77XX ends its transaction every ePixelsPerTransaction pixels (about
+	256us) so that the ISR can run during a long display update.  A display
+	update in one transaction (a full screen fill is over 100 ms) would still
+	let both receive buffers overflow.
+
+	Queued messages are no longer spaced by a fixed delay.  mCANRxRing absorbs
+	the responses, so SendQueuedMessages keeps all 3 MCP2515 Tx buffers loaded
+	(ExtIntReq2 also sees the TXnIF interrupts, so the free buffers are known
+	without polling.)  Each frame gets a Tx priority by command class, see
+	TxPriority.  Sending only waits after eSetID, to give the sensor time to
+	save its new ID, and before eCheckGateStateResponses, to give the sensors
+	time to respond.
+
+	The pacing adapts to the bus.  The gate state requests in flight are
+	limited to half of mCANRxRing, eCheckGateStateResponses waits for the
+	responses due or a response window sized from the measured response
+	latency, and sending backs off to one message per kCANSettlePeriod while
+	the MCP2515's error counters are at the warning level.  The pressure and
+	bin motor checks no longer wait for the bus, only the display update does
+	(see CANOverflowRisk.)
 */
-//					The timing config is written CNF3, CNF2, CNF1
-const uint8_t	DustCollector::kTimingConfig[] = {0x07, 0xAC, 0x04}; // 40kHz CAN baud rate
-volatile bool	sMCP2515IntTriggered;
+static_assert(CANBitTiming::Valid(DCConfig::kCANOscFreq, DCConfig::kCANProfile),
+	"No CAN bit timing for the oscillator frequency and bit rate");
+const CANBitTiming::SConfig	DustCollector::kTimingConfig =
+	CANBitTiming::Config(DCConfig::kCANOscFreq, DCConfig::kCANProfile);
+static DustCollector*	sDustCollector;	// For ExtIntReq2
+static volatile uint32_t	sCANRxTime;	// millis() when a frame was put in the empty mCANRxRing
 
 /******************************* DustCollector ********************************/
 DustCollector::DustCollector(void)
   : MCP2515(DCConfig::kCANCSPin, DCConfig::kCANResetPin),
+	mCANQuietPeriod(DCConfig::kCANQuietPeriod),
+	mCANSettlePeriod(DCConfig::kCANSettlePeriod),
+	mCANResponseWindow(DCConfig::kCANMaxResponseWindow),
+	mCANResponseLatency(DCConfig::kCANMaxResponseWindow/2), mCANResponsesDue(0),
+	mCANErrorWarning(false), mCANQueueWaiting(false),
+	mCANTxSettling(false), mCANRequestCount(0), mCANTxBusy(0),
+	mLastUpdate(0), mPressureUpdatePeriod(DCConfig::kPressureUpdatePeriod),
+	mDeltaAverageIndex(0), mDeltaAveragesLoaded(false), mGateCheckDone(true),
 	mBMP280Ambient(DCConfig::kBMP1CSPin), mBMP280Duct(DCConfig::kBMP0CSPin),
 	mRadio(DCConfig::kRadioNSSPin, DCConfig::kRadioIRQPin),
-	mPressureUpdatePeriod(DCConfig::kPressureUpdatePeriod), mMotorSensePeriod(DCConfig::kMotorSensePeriod),
-	mFlashingGates(0), mCANBusyPeriod(DCConfig::kCANBusyPeriod), mDeltaAveragesLoaded(false),
-	mDeltaAverageIndex(0), mGateCheckDone(true)
+	mFlashingGates(0), mHeartbeatGates(0),
+	mHeartbeatCheckPeriod(DCConfig::kHeartbeatCheckPeriod), mCalibratedGate(0),
+	mMotorSensePeriod(DCConfig::kMotorSensePeriod),
+	mCANRxRingHead(0), mCANRxRingTail(0), mCANRxRingOverflows(0),
+	mCANRxOverruns(0), mCANRxLostReported(0),
+	mCANRecorder(mCANRecorderBuffer, CAN_RECORDER_SIZE), mSaveCANLog(false)
 {
 }
 
@@ -62,7 +102,7 @@ void DustCollector::begin(void)
 	*	MCP2515 setup
 	*/
 	{
-		MCP2515::begin(kTimingConfig);
+		MCP2515::begin(kTimingConfig.cnf);
 		/*
 		*	mGateBaseID is the base value of every valid gate ID.  Any gate ID that
 		*	doesn't have this ID as the most significant 13 bits is considered
@@ -83,10 +123,13 @@ void DustCollector::begin(void)
 		Serial.print(F("Gate base ID = 0x"));
 		Serial.println(mGateBaseID, HEX);
 		
+		sDustCollector = this;
 		attachInterrupt(digitalPinToInterrupt(DCConfig::kCANIntPin), ExtIntReq2, FALLING);
 		// The above does the following, in addition to saving the function address.
 		// EICRA = (EICRA & ~(_BV(ISC20))) | _BV(ISC21);	// Bits 5:4, ISC2n 0b10 = FALLING
 		// EIMSK |= _BV(INT2); // Enable INT2
+		// ExtIntReq2 reads the MCP2515.  Mask INT2 during all SPI transactions.
+		SPI.usingInterrupt(digitalPinToInterrupt(DCConfig::kCANIntPin));
 	}
 
 	//mGates.RemoveAllGates();
@@ -122,6 +165,7 @@ void DustCollector::begin(void)
 		Serial.println(status);
 		mPressureUpdatePeriod.Start();	
 	}
+	mHeartbeatCheckPeriod.Start();
 	
 	StopFlasher();
 	mFaultAcknowledged = true;
@@ -147,13 +191,15 @@ void DustCollector::begin(void)
 	}
 	mStatus = eNotRunning;
 
-#ifdef DEBUG_FRAMES
-	mFrameIndex = 0;
-#endif
 	mCANMessageQueueHead = 0;
 	mCANMessageQueueTail = 0;
+	memset(&mCANQueueStats, 0, sizeof(mCANQueueStats));
 	RequestAllGateStates();
-	mCANBusyPeriod.Start();
+	mCANQuietPeriod.Start();
+	// Wait mCANSettlePeriod before the first request, the sensors may still be
+	// starting up.
+	mCANSettlePeriod.Start();
+	mCANTxSettling = true;
 }
 
 /********************************** DoConfig **********************************/
@@ -170,6 +216,10 @@ void DustCollector::DoConfig(void)
 	*	allow any command through. The extended ID of the mask and filters are
 	*	setup to allow only commands targeting this sensor through.
 	*	
+	*	Protocol v2 sensor frames carry the sensor ID rather than the
+	*	controller ID.  They're accepted by RXB1's mask and filters on the v2
+	*	command range, any extended ID.
+	*	
 	*	Either receive buffer can be targeted by any command.
 	*	The interrupt pin is configured to trigger for errors and commands
 	*	received.
@@ -179,9 +229,12 @@ void DustCollector::DoConfig(void)
 		// Set the filter to match just the controller ID
 		const uint8_t*	filterRawFrame = filter.GetRawFrame();
 		WriteReg(eRXF0Reg, 4, filterRawFrame);
-		// Set the rest of the filters to do nothing
-		filter.SetStandardID(0x7FF);
+		// RXF1 also uses RXM0 so it matches the same frames as RXF0.
 		WriteReg(eRXF1Reg, 4, filterRawFrame);
+		// Set the v2 filters to match the v2 sensor commands.  RXF3 to RXF5
+		// also use RXM1 so they're set the same as RXF2, otherwise they would
+		// accept other standard IDs from any extended ID.
+		filter.SetStandardID(DCSensor::eGateIsOpenV2 & DCSensor::eV2CommandMask);
 		WriteReg(eRXF2Reg, 4, filterRawFrame);
 		WriteReg(eRXF3Reg, 4, filterRawFrame);
 		WriteReg(eRXF4Reg, 4, filterRawFrame);
@@ -193,13 +246,15 @@ void DustCollector::DoConfig(void)
 		CANFrame	mask(0, (uint32_t)0x3FFFF);
 		const uint8_t*	maskRawFrame = mask.GetRawFrame();
 		WriteReg(eRXM0Reg, 4, maskRawFrame);
-		// Set the other mask to do nothing
-		mask.SetStandardID(0x7FF);
+		// Set the other mask to match the v2 command range, any sensor ID.
+		mask.SetStandardID(DCSensor::eV2CommandMask);
+		mask.SetExtendedID(0);
 		WriteReg(eRXM1Reg, 4, maskRawFrame);
 	}
-	// Generate an interrupt when the receive buffer is full and if an
-	// error occurs.
-	WriteReg(eCANINTEReg, _BV(eRX0IE) | _BV(eRX1IE) | _BV(eERRIE));
+	// Generate an interrupt when the receive buffer is full, when a Tx buffer
+	// has been sent, and if an error occurs.
+	WriteReg(eCANINTEReg, _BV(eRX0IE) | _BV(eRX1IE) | _BV(eTX0IE) |
+							_BV(eTX1IE) | _BV(eTX2IE) | _BV(eERRIE));
 	// Allow receive buffer 1 to be used if buffer 0 is full
 	ModifyReg(eRXB0CTRLReg, _BV(eBUKT), _BV(eBUKT));
 }
@@ -224,6 +279,8 @@ void DustCollector::RemoveAllGates(void)
 	
 	mGates.RemoveAllGates();
 	mGateSets.RemoveAllGateSets();
+	mHeartbeatGates = 0;
+	PurgeCANMessageQueue();
 	ResetAllGatesToFactoryID();
 	RequestAllGateStates();
 }
@@ -270,6 +327,7 @@ void DustCollector::RemoveGate(
 	{
 		uint32_t	gateMask = ((uint32_t)1 << (inRecIndex -1));
 		mOpenGates &= ~gateMask;	// Should already be cleared.
+		mHeartbeatGates &= ~gateMask;
 		mGateSets.RemoveGateSetsContainingGate(gateMask);
 		mGates.GoToGate(inRecIndex);
 		mGates.RemoveCurrent();
@@ -365,22 +423,59 @@ void DustCollector::SendAudioAlertMessage(
 */
 bool DustCollector::Update(void)
 {
-	bool notBusy = CheckGates();
-	// Any activity on the CAN bus takes precidence over checking the filter
-	// and dust bin motor.
-	if (notBusy)
 	{
-		CheckFilter();
-		CheckDustBinMotor();
+		uint32_t	now = millis();
+		if (mLastUpdate)
+		{
+			DeadlineMonitor::Ran(eLoopTask, now - mLastUpdate, false);
+		}
+		mLastUpdate = now;
 	}
+	PROFILE_BEGIN(eCheckGatesSection);
+	bool notBusy = CheckGates();
+	PROFILE_END(eCheckGatesSection);
+	/*
+	*	The filter and dust bin motor checks are short (the BMP280 reads don't
+	*	use the MCP2515) so they aren't held off by CAN activity.  Only the UI
+	*	update waits, see CANOverflowRisk.
+	*/
+	PROFILE_BEGIN(eCheckFilterSection);
+	CheckFilter();
+	PROFILE_END(eCheckFilterSection);
+	PROFILE_BEGIN(eCheckDustBinMotorSection);
+	CheckDustBinMotor();
+	PROFILE_END(eCheckDustBinMotorSection);
 	return(notBusy);
 }
 
+#ifdef PROFILE_LOOP
+/****************************** DumpLoopProfile *******************************/
+void DustCollector::DumpLoopProfile(void)
+{
+	LoopProfiler::Dump(eLoopSection, F("loop"));
+	LoopProfiler::Dump(eCheckGatesSection, F("CheckGates"));
+	LoopProfiler::Dump(eCheckFilterSection, F("CheckFilter"));
+	LoopProfiler::Dump(eCheckDustBinMotorSection, F("CheckDustBinMotor"));
+	LoopProfiler::Dump(eUpdateDisplaySection, F("UpdateDisplay"));
+}
+#endif
+
+/******************************* DumpDeadlines ********************************/
+void DustCollector::DumpDeadlines(void)
+{
+	DeadlineMonitor::Dump(eLoopTask, F("loop gap"));
+	DeadlineMonitor::Dump(eCANReceiveTask, F("CAN receive"));
+	DeadlineMonitor::Dump(eCANSendTask, F("CAN send"));
+	DeadlineMonitor::Dump(ePressureTask, F("Pressure"));
+	DeadlineMonitor::Dump(eMotorSenseTask, F("Motor sense"));
+}
+
 /******************************** CheckFilter *********************************/
 void DustCollector::CheckFilter(void)
 {
 	if (mPressureUpdatePeriod.Passed())
 	{
+		DeadlineMonitor::RanPeriodic(ePressureTask, mPressureUpdatePeriod);
 		int32_t	temp;
 		mBMP280Ambient.DoForcedRead(temp, mAmbientPressure);
 		mBMP280Duct.DoForcedRead(temp, mDuctPressure);
@@ -536,6 +631,7 @@ void DustCollector::CheckDustBinMotor(void)
 {
 	if (mMotorSensePeriod.Passed())
 	{
+		DeadlineMonitor::RanPeriodic(eMotorSenseTask, mMotorSensePeriod);
 		uint16_t	reading = analogRead(DCConfig::kMotorSensePin);
 		mSampleAccumulator += reading;				// Add the newest reading
 		uint16_t	oldestReading = mRingBuf[mRingBufIndex];
@@ -592,11 +688,18 @@ void DustCollector::CheckDustBinMotor(void)
 }
 
 /******************************** SetGateState ********************************/
+/*
+*	mOpenGates is updated right away.  The gate set lookup is done by
+*	CheckGates kGateSetLookupDelay after the first change since the last
+*	lookup, so that the responses to RequestAllGateStates, or gates opened
+*	together, cost one GateSets lookup rather than one per gate.  The delay
+*	isn't restarted by later changes, so a chattering gate can't postpone the
+*	lookup that CheckFilter and the gate set saves depend on.
+*/
 void DustCollector::SetGateState(
 	uint16_t	inRecIndex,
 	bool		inGateIsOpen)
 {
-	bool stateChanged = false;
 	if (inRecIndex)
 	{
 		uint32_t	gateMask = ((uint32_t)1 << (inRecIndex -1));
@@ -609,10 +712,15 @@ void DustCollector::SetGateState(
 			openGates &= ~gateMask;
 		}
 		mUnresponsiveGates &= ~gateMask;
+		mGateLastSeen[inRecIndex -1] = millis();
 		if (openGates != mOpenGates)
 		{
 			mOpenGates = openGates;
-			mGateSets.GateStateChanged(openGates);
+			if (mGateSetLookupDelay.Get() == 0)
+			{
+				mGateSetLookupDelay.Set(DCConfig::kGateSetLookupDelay);
+				mGateSetLookupDelay.Start();
+			}
 		}
 	}
 }
@@ -640,40 +748,44 @@ uint8_t DustCollector::GetGateState(
 bool DustCollector::CheckGates(void)
 {
 	/*
-	*	If the INT pin on the MCP2515 is low THEN
-	*	see why.
+	*	ExtIntReq2 moves received frames to mCANRxRing.  If the INT pin on the
+	*	MCP2515 is still low THEN
+	*	an error occurred, or a frame was received while INT was already low
+	*	(no falling edge so the ISR wasn't called.)  See why.
 	*/
-	if (sMCP2515IntTriggered)
+	if (digitalRead(DCConfig::kCANIntPin) == LOW)
 	{
+		mCANQuietPeriod.Start();
 		uint8_t	canICODStat = ReadReg(eCANSTATReg) & eICODMask;
 		uint32_t	timeout = millis() + 200;
-		CANFrame	canFrame;
 		while (canICODStat && timeout > millis())
 		{
 			switch (canICODStat)
 			{
 				case eRxB0Interrupt:
 				case eRxB1Interrupt:
+				case eTXB0Interrupt:
+				case eTXB1Interrupt:
+				case eTxB2Interrupt:
 				{
-					if (ReceiveFrame(canFrame))
-					{
-					#ifdef DEBUG_FRAMES
-						AppendFrame(canFrame);
-					#endif
-						HandleReceivedFrame(canFrame);
-					}
+					EIMSK &= ~_BV(INT2);	// ServiceCANInterrupt isn't reentrant
+					ServiceCANInterrupt();
+					EIMSK |= _BV(INT2);
 					break;
 				}
 				case eErrorInterrupt:
 				{
-				#ifdef DEBUG_FRAMES
-				    canFrame.SetStandardID(0x200);	// Fake error frame
-				    canFrame.SetExtendedID(0);
-				    canFrame.GetRawFrame()[5] = ReadReg(eEFLGReg);
-				    canFrame.GetRawFrame()[6] = ReadReg(eCANINTEReg);
-				    canFrame.GetRawFrame()[7] = ReadReg(eCANINTFReg);
-				    AppendFrame(canFrame);
-				#endif
+					// Counts the error and clears RXnOVR, see MCP2515.h
+					uint8_t	eflg = UpdateErrorCounters();
+					mCANRecorder.RecordError(eflg, ReadReg(eCANINTEReg), ReadReg(eCANINTFReg));
+					// TEC or REC at 96 or more, back off.  See SendQueuedMessages.
+					mCANErrorWarning = (eflg & _BV(eEWARN)) != 0;
+					// If bus off THEN save the recorder.
+					if (eflg & _BV(eTXBO))
+					{
+						mSaveCANLog = true;
+					}
+					CountRxOverruns(eflg);
 				    ModifyReg(eCANINTFReg, _BV(eERRIF), 0);	// punt
 					break;
 				}
@@ -687,22 +799,276 @@ bool DustCollector::CheckGates(void)
 		{
 			Serial.print(F("Timeout reading frame, canICODStat = 0x"));
 			Serial.println(canICODStat, HEX);
+			mSaveCANLog = true;
 		}
-		mCANBusyPeriod.Start();
-		sMCP2515IntTriggered = false;
-	} else if (mCANBusyPeriod.Passed())
+	}
+	if (mCANRxRingHead != mCANRxRingTail)
 	{
-#ifdef DEBUG_FRAMES
-		DumpFrames();
-#endif
-		if (mCANMessageQueueHead != mCANMessageQueueTail)
+		mCANQuietPeriod.Start();
+		/*
+		*	sCANRxTime isn't changed by the ISR while the ring isn't empty.
+		*/
+		uint32_t	rxTime = sCANRxTime;
+		do
+		{
+			CANFrame&	canFrame = mCANRxRing[mCANRxRingHead];
+			mCANRecorder.Record(canFrame);
+			HandleReceivedFrame(canFrame);
+			mCANRxRingHead = (mCANRxRingHead + 1) % DCConfig::kCANRxRingSize;
+		} while (mCANRxRingHead != mCANRxRingTail);
+		/*
+		*	The receive deadline is missed when a frame was lost because the
+		*	ring or both MCP2515 receive buffers were full.
+		*/
+		uint16_t	lost = mCANRxRingOverflows + mCANRxOverruns;
+		DeadlineMonitor::Ran(eCANReceiveTask, millis() - rxTime, lost != mCANRxLostReported);
+		/*
+		*	A lost frame may have been a gate state change, so the gates are
+		*	polled for their current states.  The poll's responses are slotted
+		*	so they don't fill the ring.
+		*/
+		if (lost != mCANRxLostReported)
+		{
+			mCANRxLostReported = lost;
+			RequestAllGateStates();
+		}
+	}
+	/*
+	*	If kGateSetLookupDelay passed since the first gate state change THEN
+	*	find the gate set for the open gates.
+	*/
+	if (mGateSetLookupDelay.Passed())
+	{
+		mGateSetLookupDelay.Set(0);
+		mGateSets.GateStateChanged(mOpenGates);
+	}
+	if (mHeartbeatCheckPeriod.Passed())
+	{
+		mHeartbeatCheckPeriod.Start();
+		CheckHeartbeats();
+	}
+	CountRxOverruns(CheckErrorCounters());
+	SendQueuedMessages();
+	bool	overflowRisk = CANOverflowRisk();
+	if (!overflowRisk &&
+		mCANMessageQueueHead == mCANMessageQueueTail)
+	{
+		DrainCANRecorder();
+	}
+
+	return(!overflowRisk);
+}
+
+/****************************** CheckHeartbeats *******************************/
+/*
+*	A gate that has sent a protocol v2 frame is marked unresponsive
+*	(eErrorState) when nothing is received from it for kGateHeartbeatTimeout,
+*	about 3 heartbeats.  Gates with v1 sensors never send a heartbeat so
+*	they're only checked by RequestAllGateStates, a v1 gate state frame
+*	clears the gate's mHeartbeatGates bit.  Any frame from the gate clears its
+*	unresponsive bit again, see SetGateState.
+*/
+void DustCollector::CheckHeartbeats(void)
+{
+	uint32_t	now = millis();
+	uint32_t	gatesMask = mHeartbeatGates & ~mUnresponsiveGates;
+	uint32_t	gateMask = 1;
+	for (uint8_t i = 0; gatesMask; i++, gatesMask >>= 1, gateMask <<= 1)
+	{
+		if ((gatesMask & 1) &&
+			(now - mGateLastSeen[i]) > DCConfig::kGateHeartbeatTimeout)
 		{
-			SendNextQueuedMessage();
-			mCANBusyPeriod.Start();
+			mUnresponsiveGates |= gateMask;
+			mSaveCANLog = true;
 		}
 	}
+}
+
+/****************************** CountRxOverruns *******************************/
+/*
+*	Every path that reads EFLG also clears RX0OVR and RX1OVR (see
+*	MCP2515::UpdateErrorCounters), so each passes the value read here.  If a
+*	received frame was lost THEN it's counted and the recorder is saved.
+*/
+void DustCollector::CountRxOverruns(
+	uint8_t	inEFLG)
+{
+	uint8_t	overruns = ((inEFLG >> eRX0OVR) & 1) + ((inEFLG >> eRX1OVR) & 1);
+	if (overruns)
+	{
+		mCANRxOverruns += overruns;
+		mSaveCANLog = true;
+	}
+}
 
-	return(mCANBusyPeriod.Passed());
+/****************************** CANOverflowRisk *******************************/
+/*
+*	Returns true when frames are likely to arrive soon: a frame was received
+*	within kCANQuietPeriod, or gate state responses are due.  The sketch
+*	doesn't update the display while this is true, or while requests are
+*	waiting for a reply.  A display update takes up to 115 ms.  ExtIntReq2
+*	still runs between its SPI transactions, but CheckGates doesn't, so
+*	mCANRxRing can fill.  Any SPI transaction that isn't bounded masks INT2,
+*	leaving only the 2 MCP2515 receive buffers to hold the arriving frames.
+*/
+bool DustCollector::CANOverflowRisk(void) const
+{
+	return(mCANRxRingHead != mCANRxRingTail ||
+			!mCANQuietPeriod.Passed() ||
+			mCANResponsesDue != 0 ||
+			mCANRequestCount != 0);
+}
+
+/***************************** SendQueuedMessages *****************************/
+/*
+*	Sends queued messages as long as a Tx buffer is free and the bus can take
+*	them:
+*	- eCheckGateStateResponses waits till no poll responses are due and no
+*	  requests are waiting for a reply.  The poll responses due are dropped
+*	  when mCANResponseWindow passes, the window includes the response slots.
+*	- the requests (eRequestGateState, eSetID, eReplaceID) wait for a free
+*	  mCANRequest entry.  eRequestGateState also waits while the replies due
+*	  plus the frames in mCANRxRing are half of the ring, so that the
+*	  replies always fit.
+*	Sending waits till mCANSettlePeriod has passed since the last frame was
+*	loaded when:
+*	- mCANTxSettling is set by begin.  The sensors may still be starting up.
+*	- the error counters are at the warning level.  One message is sent per
+*	  period till EWARN clears.
+*	- all 3 Tx buffers are waiting to be sent.  After the period the message
+*	  is sent anyway, and SendAndRecordFrame fails if no buffer is free.
+*/
+void DustCollector::SendQueuedMessages(void)
+{
+	/*
+	*	If the response window passed THEN
+	*	the responses still due aren't coming.
+	*/
+	if (mCANResponsesDue &&
+		mCANResponseWindow.Passed())
+	{
+		mCANResponsesDue = 0;
+	}
+	/*
+	*	Nothing is sent till the bus off backoff has passed, see
+	*	MCP2515::CheckErrorCounters.
+	*/
+	if (BusOffHold())
+	{
+		return;
+	}
+	CheckCANRequests();
+	while (mCANMessageQueueHead != mCANMessageQueueTail)
+	{
+		uint16_t	command = mCANMessageQueue[mCANMessageQueueHead].command;
+		if (command == DCController::eCheckGateStateResponses)
+		{
+			if (mCANResponsesDue ||
+				mCANRequestCount)
+			{
+				break;
+			}
+			SendNextQueuedMessage();	// Not sent on the bus
+			continue;
+		}
+		if ((command == DCController::eRequestGateState ||
+			 command == DCController::eSetID ||
+			 command == DCController::eReplaceID) &&
+			mCANRequestCount == DCConfig::kCANMaxRequests)
+		{
+			break;
+		}
+		if (command == DCController::eRequestGateState &&
+			(mCANResponsesDue + mCANRequestCount + CANRxRingCount()) >= DCConfig::kCANRxRingSize/2)
+		{
+			break;
+		}
+		if (mCANTxSettling ||
+			mCANErrorWarning ||
+			mCANTxBusy == 7)
+		{
+			if (!mCANSettlePeriod.Passed())
+			{
+				mCANQueueWaiting = true;
+				break;
+			}
+			/*
+			*	Only messages that waited for the period are tracked.
+			*/
+			if (mCANQueueWaiting)
+			{
+				DeadlineMonitor::RanPeriodic(eCANSendTask, mCANSettlePeriod);
+				mCANQueueWaiting = false;
+			}
+			mCANTxSettling = false;
+			/*
+			*	The error interrupt only occurs when an EFLG bit is set, so
+			*	see if the warning cleared.
+			*/
+			if (mCANErrorWarning)
+			{
+				mCANErrorWarning = (ReadReg(eEFLGReg) & _BV(eEWARN)) != 0;
+			}
+		}
+		SendNextQueuedMessage();
+		if (mCANTxSettling ||
+			mCANErrorWarning)
+		{
+			break;
+		}
+	}
+}
+
+/**************************** ServiceCANInterrupt *****************************/
+/*
+*	Called by ExtIntReq2, or by CheckGates with INT2 masked.  READ STATUS
+*	returns the RXnIF, TXnIF and TXREQ flags in one byte.  Received frames are
+*	moved to mCANRxRing.  When the ring is full the frame is read and dropped
+*	so that the receive buffer is freed.  mCANTxBusy is updated from TXREQ and
+*	the TXnIF flags are cleared.  Loops till no flags are left so that INT
+*	goes high and the next falling edge isn't missed.
+*/
+void DustCollector::ServiceCANInterrupt(void)
+{
+	for (;;)
+	{
+		uint8_t	status = GetStatus();
+		mCANTxBusy = TxRequestFlags(status);
+		// READ STATUS bits 3, 5 and 7 are CANINTF TX0IF, TX1IF and TX2IF
+		uint8_t	txDone = ((status >> (eTX0IF_CANINTF - eTX0IF)) & _BV(eTX0IF)) |
+						((status >> (eTX1IF_CANINTF - eTX1IF)) & _BV(eTX1IF)) |
+						((status >> (eTX2IF_CANINTF - eTX2IF)) & _BV(eTX2IF));
+		if (txDone)
+		{
+			ModifyReg(eCANINTFReg, txDone, 0);
+		}
+		if (status & (_BV(eRX0IF_CANINTF) | _BV(eRX1IF_CANINTF)))
+		{
+			uint8_t	rxBuffer = (status & _BV(eRX0IF_CANINTF)) ? 0 : 1;
+			uint8_t	tail = mCANRxRingTail;
+			uint8_t	nextTail = (tail + 1) % DCConfig::kCANRxRingSize;
+			if (nextTail != mCANRxRingHead)
+			{
+				ReadRxBuffer(rxBuffer, mCANRxRing[tail]);
+				if (tail == mCANRxRingHead)
+				{
+					sCANRxTime = millis();
+				}
+				mCANRxRingTail = nextTail;
+			} else
+			{
+				CANFrame	canFrame;
+				ReadRxBuffer(rxBuffer, canFrame);
+				if (mCANRxRingOverflows != 0xFFFF)
+				{
+					mCANRxRingOverflows++;
+				}
+			}
+		} else if (!txDone)
+		{
+			break;
+		}
+	}
 }
 
 /*************************** SendNextQueuedMessage ****************************/
@@ -717,24 +1083,22 @@ void DustCollector::SendNextQueuedMessage(void)
 			if (gateIndex)
 			{
 				uint32_t	newID = mGateBaseID + gateIndex - 1;
-				CANFrame	canFrame((uint16_t)DCController::eSetID, (uint32_t)queueElement.targetID, newID);
-				if (SendFrame(canFrame))
+				CANFrame	canFrame((uint16_t)DCController::eSetID, (uint32_t)queueElement.targetID);
+				SetIDData(canFrame, newID);
+				if (SendAndRecordFrame(canFrame))
 				{
-				#ifdef DEBUG_FRAMES
-					AppendFrame(canFrame);
-				#endif
-					// Reuse this element to verify the registered gate sensor.
-					queueElement.command = DCController::eRequestGateState;
-					queueElement.targetID = newID;
+					// The new ID is verified by CheckCANRequests.
+					TrackCANRequest(newID, DCController::eSetID, queueElement.targetID);
 				} else
 				{
-				#ifdef DEBUG_FRAMES
-					canFrame.SetStandardID(0x201);	// Send set ID frame failed
-					AppendFrame(canFrame);
-				#endif
 					mGates.RemoveCurrent();
-					mCANMessageQueueHead = (mCANMessageQueueHead + 1) % DCConfig::kCANQueueSize;
 				}
+				mCANMessageQueueHead = (mCANMessageQueueHead + 1) % DCConfig::kCANQueueSize;
+			// Else there's no room for another gate.  Drop the request rather
+			// than retrying it forever and blocking the queue.
+			} else
+			{
+				mCANMessageQueueHead = (mCANMessageQueueHead + 1) % DCConfig::kCANQueueSize;
 			}
 			break;
 		}
@@ -743,24 +1107,16 @@ void DustCollector::SendNextQueuedMessage(void)
 		// sensor to replace the unresponsive gate.
 		case DCController::eReplaceID:
 		{
-			CANFrame	canFrame((uint16_t)DCController::eSetID, mUnregisteredGateID, (uint32_t)queueElement.targetID);
-			if (SendFrame(canFrame))
+			CANFrame	canFrame((uint16_t)DCController::eSetID, mUnregisteredGateID);
+			SetIDData(canFrame, queueElement.targetID);
+			if (SendAndRecordFrame(canFrame))
 			{
+				// The replaced gate sensor is verified by CheckCANRequests.
+				TrackCANRequest(queueElement.targetID, DCController::eReplaceID,
+								mUnregisteredGateID);
 				mUnregisteredGateID = 0;
-			#ifdef DEBUG_FRAMES
-				AppendFrame(canFrame);
-			#endif
-				// Reuse this element to verify the replaced gate sensor.
-				queueElement.command = DCController::eRequestGateState;
-				// queueElement.targetID is already setup
-			} else
-			{
-			#ifdef DEBUG_FRAMES
-				canFrame.SetStandardID(0x201);	// Send set ID frame failed
-				AppendFrame(canFrame);
-			#endif
-				mCANMessageQueueHead = (mCANMessageQueueHead + 1) % DCConfig::kCANQueueSize;
 			}
+			mCANMessageQueueHead = (mCANMessageQueueHead + 1) % DCConfig::kCANQueueSize;
 			break;
 		}
 		/*
@@ -770,21 +1126,446 @@ void DustCollector::SendNextQueuedMessage(void)
 		*/
 		case DCController::eCheckGateStateResponses:
 			mCANMessageQueueHead = (mCANMessageQueueHead + 1) % DCConfig::kCANQueueSize;
+			/*
+			*	If this follows the poll AND some gates didn't respond THEN
+			*	request their states individually before checking again.
+			*/
+			if (queueElement.targetID == DCConfig::kBroadcastID &&
+				mUnresponsiveGates)
+			{
+				/*
+				*	The requests and the check are queued at the head, in
+				*	reverse, so that they're sent before anything queued since
+				*	the poll.  queueElement is reused by the first of these.
+				*/
+				QueueCANMessage(0, DCController::eCheckGateStateResponses, true);
+				uint32_t	gatesMask = mUnresponsiveGates;
+				for (uint8_t gateIndex = DCConfig::kMaxGates; gateIndex; gateIndex--)
+				{
+					if (gatesMask & ((uint32_t)1 << (gateIndex -1)))
+					{
+						QueueCANMessage(mGateBaseID + gateIndex - 1,
+										DCController::eRequestGateState, true);
+					}
+				}
+				break;
+			}
 			mGateCheckDone = true;
+			// If any gates didn't respond THEN save the recorder.
+			if (mUnresponsiveGates)
+			{
+				mSaveCANLog = true;
+			}
+			break;
+		case DCController::eGateSnapshot:
+		{
+			uint32_t	bitmaps[] = {mOpenGates, mUnresponsiveGates};
+			CANFrame	canFrame((uint16_t)DCController::eGateSnapshot,
+								(uint32_t)queueElement.targetID, sizeof(bitmaps),
+								(const uint8_t*)bitmaps);
+			SendAndRecordFrame(canFrame);
+			mCANMessageQueueHead = (mCANMessageQueueHead + 1) % DCConfig::kCANQueueSize;
+			break;
+		}
+		case DCSensor::eErrorCountersV2:
+		{
+			CountRxOverruns(UpdateErrorCounters());	// For the current TEC and REC
+			CANFrame	canFrame((uint16_t)DCSensor::eErrorCountersV2,
+								(uint32_t)queueElement.targetID, sizeof(SErrorCounters),
+								(const uint8_t*)&GetErrorCounters());
+			SendAndRecordFrame(canFrame);
+			mCANMessageQueueHead = (mCANMessageQueueHead + 1) % DCConfig::kCANQueueSize;
 			break;
+		}
+		/*
+		*	A request for a gate that is already waiting for a reply isn't
+		*	sent again, the reply answers both.
+		*/
+		case DCController::eRequestGateState:
+			if (FindCANRequest(queueElement.targetID) == mCANRequestCount)
+			{
+				CANFrame	canFrame((uint16_t)DCController::eRequestGateState,
+									(uint32_t)queueElement.targetID);
+				if (SendAndRecordFrame(canFrame))
+				{
+					TrackCANRequest(queueElement.targetID, DCController::eRequestGateState);
+				}
+			}
+			mCANMessageQueueHead = (mCANMessageQueueHead + 1) % DCConfig::kCANQueueSize;
+			break;
+		case DCController::ePollGateStates:
+		{
+			uint8_t	data[6];
+			memcpy(data, &mGateBaseID, 4);
+			data[4] = DCConfig::kCANPollSlot;
+			data[5] = DCProtocol::eCurrent;
+			CANFrame	canFrame((uint16_t)DCController::ePollGateStates,
+								(uint32_t)queueElement.targetID, sizeof(data), data);
+			SendAndRecordFrame(canFrame);
+			mCANMessageQueueHead = (mCANMessageQueueHead + 1) % DCConfig::kCANQueueSize;
+			break;
+		}
 		default:
 		{
 			CANFrame	canFrame((uint16_t)queueElement.command, (uint32_t)queueElement.targetID);
-		#ifdef DEBUG_FRAMES
-			AppendFrame(canFrame);
-		#endif
-			SendFrame(canFrame);
+			SendAndRecordFrame(canFrame);
 			mCANMessageQueueHead = (mCANMessageQueueHead + 1) % DCConfig::kCANQueueSize;
 			break;
 		}
 	}
 }
 
+/********************************* SetIDData **********************************/
+/*
+*	The eSetID data, the new sensor ID followed by the protocol version.
+*/
+void DustCollector::SetIDData(
+	CANFrame&	inCANFrame,
+	uint32_t	inNewID)
+{
+	uint8_t	data[5];
+	memcpy(data, &inNewID, 4);
+	data[4] = DCProtocol::eCurrent;
+	inCANFrame.SetData(sizeof(data), data);
+}
+
+/***************************** SendAndRecordFrame *****************************/
+/*
+*	Loads the first Tx buffer that isn't waiting to be sent.  mCANTxBusy is
+*	kept by ServiceCANInterrupt.  When it shows all 3 buffers waiting, TXREQ is
+*	read again in case a TXnIF interrupt hasn't been serviced yet.
+*/
+bool DustCollector::SendAndRecordFrame(
+	CANFrame&	inCANFrame)
+{
+	EIMSK &= ~_BV(INT2);	// mCANTxBusy is also changed by ExtIntReq2
+	uint8_t	txBusy = mCANTxBusy;
+	if (txBusy == 7)
+	{
+		txBusy = TxRequestFlags(GetStatus());
+	}
+	uint8_t	txBuffer = 0;
+	for (; txBuffer < 3 && (txBusy & _BV(txBuffer)); txBuffer++){}
+	bool	success = txBuffer < 3;
+	if (success)
+	{
+		LoadAndSend(txBuffer, inCANFrame, TxPriority(inCANFrame.GetStandardID()));
+		txBusy |= _BV(txBuffer);
+	}
+	mCANTxBusy = txBusy;
+	EIMSK |= _BV(INT2);
+	mCANSettlePeriod.Start();
+	/*
+	*	The ePollGateStates response window also covers the slots up to the
+	*	highest registered gate index.  The other requests are tracked by
+	*	CheckCANRequests.
+	*/
+	if (success &&
+		inCANFrame.GetStandardID() == DCController::ePollGateStates)
+	{
+		uint32_t	gatesMask = mGates.GatesMask();
+		uint8_t		slots = 0;
+		uint8_t		responses = 0;
+		for (; gatesMask; gatesMask >>= 1, slots++)
+		{
+			responses += (gatesMask & 1);
+		}
+		ExtendResponseWindow(CANResponseWindow() + (uint32_t)slots * DCConfig::kCANPollSlot);
+		mCANResponsesDue += responses;
+	}
+	mCANRecorder.Record(inCANFrame, success ? CANRecorder::eSentFlag :
+											CANRecorder::eSendFailedFlag);
+	return(success);
+}
+
+/***************************** CANResponseWindow ******************************/
+/*
+*	Twice the average latency plus a margin, no more than
+*	kCANMaxResponseWindow.
+*/
+uint32_t DustCollector::CANResponseWindow(void) const
+{
+	uint32_t	window = mCANResponseLatency * 2 + DCConfig::kCANMinResponseWindow;
+	return(window < DCConfig::kCANMaxResponseWindow ? window : DCConfig::kCANMaxResponseWindow);
+}
+
+/******************************* TrackCANRequest ******************************/
+/*
+*	Adds a request that was just sent to mCANRequest.  Returns false if
+*	mCANRequest is full (SendQueuedMessages waits for a free entry, so this
+*	only happens if a request is sent from elsewhere.)
+*/
+bool DustCollector::TrackCANRequest(
+	uint32_t	inTargetID,
+	uint16_t	inCommand,
+	uint32_t	inSensorID)
+{
+	bool	success = mCANRequestCount < DCConfig::kCANMaxRequests;
+	if (success)
+	{
+		SCANRequest&	request = mCANRequest[mCANRequestCount];
+		request.targetID = inTargetID;
+		request.sensorID = inSensorID;
+		request.sentTime = millis();
+		request.command = inCommand;
+		request.retries = 0;
+		request.awaitingReply = inCommand == DCController::eRequestGateState;
+		mCANRequestCount++;
+	}
+	return(success);
+}
+
+/******************************* FindCANRequest *******************************/
+/*
+*	Returns the mCANRequest index of the request for inID, or mCANRequestCount
+*	if there isn't one.  When inSensorID, inID is matched to the ID of a sensor
+*	being given a new ID by eSetID or eReplaceID.
+*/
+uint8_t DustCollector::FindCANRequest(
+	uint32_t	inID,
+	bool		inSensorID) const
+{
+	uint8_t	i = 0;
+	for (; i < mCANRequestCount; i++)
+	{
+		const SCANRequest&	request = mCANRequest[i];
+		if (inSensorID ? (request.command != DCController::eRequestGateState &&
+							request.sensorID == inID) :
+						request.targetID == inID)
+		{
+			break;
+		}
+	}
+	return(i);
+}
+
+/***************************** CANRequestAnswered *****************************/
+/*
+*	Called for each gate state frame.  Returns true if the frame is the reply
+*	to a request, and removes the request.  The time from a request that
+*	wasn't resent till its reply updates the average latency.
+*/
+bool DustCollector::CANRequestAnswered(
+	uint32_t	inID)
+{
+	uint8_t	i = FindCANRequest(inID);
+	bool	answered = i < mCANRequestCount;
+	if (answered)
+	{
+		const SCANRequest&	request = mCANRequest[i];
+		if (request.command == DCController::eRequestGateState &&
+			request.retries == 0)
+		{
+			uint32_t	latency = millis() - request.sentTime;
+			if (latency > DCConfig::kCANMaxResponseWindow)
+			{
+				latency = DCConfig::kCANMaxResponseWindow;
+			}
+			mCANResponseLatency = (mCANResponseLatency * 3 + latency) / 4;
+		}
+		mCANRequestCount--;
+		mCANRequest[i] = mCANRequest[mCANRequestCount];
+	}
+	return(answered);
+}
+
+/****************************** CheckCANRequests ******************************/
+/*
+*	Resends the requests that weren't answered in time.  The first reply to
+*	an eRequestGateState is expected within the response window, which
+*	follows the average latency.  The retries back off from
+*	kCANMaxResponseWindow, doubled with each retry, so that a sensor that is
+*	briefly busy (or a noisy bus) is given time to recover.
+*
+*	eSetID and eReplaceID first wait kCANSettlePeriod for the sensor to save
+*	its new ID and reconfigure its MCP2515.  An eRequestGateState to the new
+*	ID then verifies it.  If the verification isn't answered within
+*	kCANSettlePeriod (doubled with each retry) the eSetID is resent to the
+*	sensor's old ID (if the sensor already took the new ID it doesn't receive
+*	it) followed by another verification.
+*
+*	After kCANMaxRetries the request fails, see CANRequestFailed.
+*/
+void DustCollector::CheckCANRequests(void)
+{
+	uint32_t	now = millis();
+	for (uint8_t i = 0; i < mCANRequestCount;)
+	{
+		SCANRequest&	request = mCANRequest[i];
+		uint32_t	timeout = DCConfig::kCANSettlePeriod;
+		if (request.awaitingReply)
+		{
+			if (request.command != DCController::eRequestGateState)
+			{
+				timeout = DCConfig::kCANSettlePeriod << request.retries;
+			} else if (request.retries)
+			{
+				timeout = DCConfig::kCANMaxResponseWindow << request.retries;
+			} else
+			{
+				timeout = CANResponseWindow();
+			}
+		}
+		if ((now - request.sentTime) < timeout)
+		{
+			i++;
+			continue;
+		}
+		if (!request.awaitingReply)
+		{
+			CANFrame	canFrame((uint16_t)DCController::eRequestGateState, request.targetID);
+			if (SendAndRecordFrame(canFrame))
+			{
+				request.awaitingReply = true;
+				request.sentTime = now;
+			}
+		} else if (request.retries < DCConfig::kCANMaxRetries)
+		{
+			bool	sent;
+			if (request.command == DCController::eRequestGateState)
+			{
+				CANFrame	canFrame((uint16_t)DCController::eRequestGateState, request.targetID);
+				sent = SendAndRecordFrame(canFrame);
+			} else
+			{
+				CANFrame	canFrame((uint16_t)DCController::eSetID, request.sensorID);
+				SetIDData(canFrame, request.targetID);
+				sent = SendAndRecordFrame(canFrame);
+				request.awaitingReply = !sent;
+			}
+			if (sent)
+			{
+				request.retries++;
+				request.sentTime = now;
+				if (mCANQueueStats.retries != 0xFFFF)
+				{
+					mCANQueueStats.retries++;
+				}
+			}
+		} else
+		{
+			CANRequestFailed(request);
+			mCANRequestCount--;
+			mCANRequest[i] = mCANRequest[mCANRequestCount];
+			continue;
+		}
+		i++;
+	}
+}
+
+/****************************** CANRequestFailed ******************************/
+/*
+*	A gate that never answered is marked unresponsive, and a new gate whose
+*	sensor never answered to its new ID is removed so that the sensor is
+*	registered again the next time it reports its state.  Either way the CAN
+*	recorder is saved.
+*/
+void DustCollector::CANRequestFailed(
+	const SCANRequest&	inRequest)
+{
+	uint16_t	gateIndex = (inRequest.targetID & DCConfig::kGateIndexMask) + 1;
+	if ((inRequest.targetID & DCConfig::kBaseIDMask) == mGateBaseID &&
+		mGates.IsValidIndex(gateIndex))
+	{
+		uint32_t	gateMask = ((uint32_t)1 << (gateIndex -1));
+		mUnresponsiveGates |= gateMask;
+		if (inRequest.command == DCController::eSetID)
+		{
+			RemoveGate(gateIndex);
+			mUnresponsiveGates &= ~gateMask;
+		}
+	}
+	if (mCANQueueStats.timeouts != 0xFFFF)
+	{
+		mCANQueueStats.timeouts++;
+	}
+	mSaveCANLog = true;
+}
+
+/**************************** ExtendResponseWindow ****************************/
+/*
+*	Restarts mCANResponseWindow as inWindow unless the responses already due
+*	are expected to take longer.
+*/
+void DustCollector::ExtendResponseWindow(
+	uint32_t	inWindow)
+{
+	if (!mCANResponsesDue ||
+		mCANResponseWindow.Passed() ||
+		(mCANResponseWindow.Get() - mCANResponseWindow.ElapsedTime()) < inWindow)
+	{
+		mCANResponseWindow.Set(inWindow);
+		mCANResponseWindow.Start();
+	}
+}
+
+/********************************* TxPriority *********************************/
+/*
+*	The MCP2515 TXP, 3 is the highest.  When more than one Tx buffer is waiting
+*	the highest priority is sent first.  Flashing a gate's LED is what the user
+*	is watching for, state requests come next, then registration.
+*/
+uint8_t DustCollector::TxPriority(
+	uint16_t	inCommand)
+{
+	uint8_t	priority = 0;
+	switch (inCommand)
+	{
+		case DCController::eFlash:
+		case DCController::eStopFlash:
+			priority = 3;
+			break;
+		case DCController::eRequestGateState:
+		case DCController::ePollGateStates:
+			priority = 2;
+			break;
+		case DCController::eSetID:
+		case DCController::eSetFactoryID:
+			priority = 1;
+			break;
+	}
+	return(priority);
+}
+
+/****************************** DrainCANRecorder ******************************/
+/*
+*	Called when the bus is idle and there are no queued messages.
+*
+*	When draining to Serial, only what fits in the serial transmit buffer is
+*	written so that the loop never waits on the UART.
+*
+*	When saving to SD, the recorder is only saved after a gate sensor failed
+*	to respond or a frame was lost.  If there's no SD card the records are
+*	kept and will be saved with the next event.
+*/
+const char kCANLogFilename[] = "CANLog.bin";
+void DustCollector::DrainCANRecorder(void)
+{
+#ifdef CAN_RECORDER_SERIAL
+	while (!mCANRecorder.IsEmpty() &&
+		Serial.availableForWrite() >= CANRecorder::eDrainRecordSize)
+	{
+		mCANRecorder.Drain(Serial, 1);
+	}
+#else
+	if (mSaveCANLog)
+	{
+		mSaveCANLog = false;
+		SdFat sd;
+		if (sd.begin(DCConfig::kSDSelectPin))
+		{
+			SdFile::dateTimeCallback(UnixTime::SDFatDateTimeCB);
+			SdFile file;
+			if (file.open(kCANLogFilename, O_WRONLY | O_APPEND | O_CREAT))
+			{
+				mCANRecorder.Drain(file);
+				file.close();
+			}
+		}
+	}
+#endif
+}
+
 
 /************************** RegisterUnregisteredGate **************************/
 /*
@@ -852,8 +1633,6 @@ void DustCollector::ToggleGateFlasher(
 		uint32_t	gateMask = ((uint32_t)1 << (inGateIndex -1));
 		bool	flashing = mFlashingGates & gateMask;
 		uint32_t	gateID = mGateBaseID + inGateIndex - 1;
-		CANFrame	canFrame(flashing ? DCController::eStopFlash :
-										DCController::eFlash, gateID);
 		if (flashing)
 		{
 			mFlashingGates &= ~gateMask;
@@ -861,10 +1640,9 @@ void DustCollector::ToggleGateFlasher(
 		{
 			mFlashingGates |= gateMask;
 		}
-	#ifdef DEBUG_FRAMES
-		AppendFrame(canFrame);
-	#endif
-		SendFrame(canFrame);
+		// Queued ahead of the other messages, see QueueCANMessage
+		QueueCANMessage(gateID, flashing ? DCController::eStopFlash :
+											DCController::eFlash);
 	}
 }
 
@@ -876,41 +1654,45 @@ void DustCollector::StopAllFlashingGateLEDs(void)
 {
 	return;
 	CANFrame	canFrame(DCController::eStopFlash, DCConfig::kBroadcastID);
-#ifdef DEBUG_FRAMES
-	AppendFrame(canFrame);
-#endif
-	SendFrame(canFrame);
+	SendAndRecordFrame(canFrame);
 	mFlashingGates = 0;
 }
 
 /**************************** RequestAllGateStates ****************************/
 /*
-*	Requests all registered gate states.
+*	Requests all registered gate states with one ePollGateStates broadcast.
+*	The sensors respond in the slots of their gate indexes.  Gates that don't
+*	respond to the poll (e.g. a sensor with older firmware) are requested
+*	individually when the eCheckGateStateResponses after the poll is reached.
 *	Open and close a gate to register a new gate (or replace an existing gate
 *	sensor that isn't responding.)
+*
+*	A check already in progress covers the request.  Starting over would mark
+*	the gates that already responded as unresponsive again, so repeated
+*	requests (e.g. Check Gates pressed again) are counted as coalesced.
 */
 void DustCollector::RequestAllGateStates(void)
 {
-	if (mGates.GetCount())
+	if (CANMessageIsQueued(DCConfig::kBroadcastID, DCController::eCheckGateStateResponses) ||
+		CANMessageIsQueued(0, DCController::eCheckGateStateResponses))
+	{
+		if (mCANQueueStats.coalesced != 0xFFFF)
+		{
+			mCANQueueStats.coalesced++;
+		}
+	} else if (mGates.GetCount())
 	{
 		uint32_t	gatesMask = mGates.GatesMask();
 		mUnresponsiveGates = gatesMask;
 		mUnregisteredGateID = 0;
 		mGateCheckDone = false;
-		uint16_t	savedCurrent = mGates.GetCurrentIndex();
 		if (gatesMask)
 		{
-			uint8_t	gateIndex = 1;
-			for (; gatesMask; gatesMask >>= 1, gateIndex++)
-			{
-				if (gatesMask & 1)
-				{
-					RequestGateState(gateIndex);
-				}
-			}
+			QueueCANMessage(DCConfig::kBroadcastID, DCController::ePollGateStates);
 			// Add an internal command to flag when to check to see if all of the
 			// gates have responded.  eCheckGateStateResponses is never sent on the bus.
-			QueueCANMessage(0, DCController::eCheckGateStateResponses);
+			// The broadcast ID marks it as the check following the poll.
+			QueueCANMessage(DCConfig::kBroadcastID, DCController::eCheckGateStateResponses);
 		}
 	}
 }
@@ -919,10 +1701,7 @@ void DustCollector::RequestAllGateStates(void)
 void DustCollector::ResetAllGatesToFactoryID(void)
 {
 	CANFrame	canFrame(DCController::eSetFactoryID, DCConfig::kBroadcastID);
-#ifdef DEBUG_FRAMES
-	AppendFrame(canFrame);
-#endif
-	SendFrame(canFrame);
+	SendAndRecordFrame(canFrame);
 }
 
 /****************************** RequestGateState ******************************/
@@ -936,6 +1715,18 @@ void DustCollector::RequestGateState(
 	}
 }
 
+/******************************* CalibrateGate ********************************/
+void DustCollector::CalibrateGate(
+	uint16_t	inGateIndex)
+{
+	if (inGateIndex)
+	{
+		uint32_t	gateID = mGateBaseID + inGateIndex - 1;
+		mCalibratedGate = 0;
+		QueueCANMessage(gateID, DCController::eCalibrate);
+	}
+}
+
 /**************************** HandleReceivedFrame *****************************/
 void DustCollector::HandleReceivedFrame(
 	CANFrame&	inCANFrame)
@@ -943,10 +1734,71 @@ void DustCollector::HandleReceivedFrame(
 	uint16_t	command = inCANFrame.GetStandardID();
 	switch (command)
 	{
+		/*
+		*	A diagnostic tool wants the gate bitmaps.  The snapshot is taken
+		*	when the reply is sent.
+		*/
+		case DCSensor::eRequestSnapshot:
+			QueueCANMessage(inCANFrame.GetDataLen() >= 4 ?
+								*(const uint32_t*)inCANFrame.GetData() :
+								DCConfig::kBroadcastID, DCController::eGateSnapshot);
+			break;
+		/*
+		*	The reply's extended ID is the controller ID, the ID of the replier.
+		*/
+		case DCController::eRequestErrorCounters:
+			QueueCANMessage(DCConfig::kControllerID, DCSensor::eErrorCountersV2);
+			break;
+		/*
+		*	The reply to CalibrateGate, kept for the UI.
+		*/
+		case DCSensor::eCalibrationV2:
+		{
+			uint32_t	gateID = inCANFrame.GetExtendedID();
+			uint16_t	gateIndex = (gateID & DCConfig::kGateIndexMask) + 1;
+			if ((gateID & DCConfig::kBaseIDMask) == mGateBaseID &&
+				mGates.IsValidIndex(gateIndex) &&
+				inCANFrame.GetDataLen() >= sizeof(DCSensor::SHallCalibration))
+			{
+				memcpy(&mGateCalibration, inCANFrame.GetData(), sizeof(DCSensor::SHallCalibration));
+				mCalibratedGate = gateIndex;
+			}
+			break;
+		}
+		/*
+		*	Only registered gates are tracked.  The heartbeat also corrects
+		*	the gate state if a state change frame was lost.
+		*/
+		case DCSensor::eHeartbeatV2:
+		{
+			uint32_t	gateID = inCANFrame.GetExtendedID();
+			uint16_t	gateIndex = (gateID & DCConfig::kGateIndexMask) + 1;
+			if ((gateID & DCConfig::kBaseIDMask) == mGateBaseID &&
+				mGates.IsValidIndex(gateIndex))
+			{
+				mHeartbeatGates |= ((uint32_t)1 << (gateIndex -1));
+				SetGateState(gateIndex, inCANFrame.GetDataLen() && inCANFrame.GetData()[0]);
+			}
+			break;
+		}
 		case DCSensor::eGateIsOpen:
 		case DCSensor::eGateIsClosed:
-			uint32_t	gateID = *(const uint32_t*)inCANFrame.GetData();
+		case DCSensor::eGateIsOpenV2:
+		case DCSensor::eGateIsClosedV2:
+			// v1 sends the sensor ID as data, v2 as the extended ID.
+			uint32_t	gateID = command < DCSensor::eGateIsOpenV2 ?
+										*(const uint32_t*)inCANFrame.GetData() :
+										inCANFrame.GetExtendedID();
 			uint16_t	gateIndex = (gateID & DCConfig::kGateIndexMask) + 1;
+			/*
+			*	If this isn't the reply to a request THEN
+			*	it's a poll response or a gate state change.
+			*/
+			if (!CANRequestAnswered(gateID) &&
+				mCANResponsesDue)
+			{
+				mCANResponsesDue--;
+			}
 			
 			/*
 			*	If gateID is invalid OR unregistered...
@@ -955,11 +1807,17 @@ void DustCollector::HandleReceivedFrame(
 				 !mGates.IsValidIndex(gateIndex))
 			{
 				/*
-				*	If there are missing gates THEN
+				*	If the sensor is being given a new ID THEN
+				*	it sent this before it received eSetID.
+				*/
+				if (FindCANRequest(gateID, true) < mCANRequestCount)
+				{
+				/*
+				*	Else if there are missing gates THEN
 				*	A gate sensor may have been replaced.  See if the
 				*	unregistered gate should replace one of the missing gates.  
 				*/
-				if (mUnresponsiveGates)
+				} else if (mUnresponsiveGates)
 				{
 					// Setting mUnregisteredGateID will cause the UI to change
 					// modes to determine how to handle the unregistered gate.
@@ -974,7 +1832,22 @@ void DustCollector::HandleReceivedFrame(
 				}
 			} else
 			{
-				SetGateState(gateIndex, command == DCSensor::eGateIsOpen);
+				SetGateState(gateIndex, command == DCSensor::eGateIsOpen ||
+										command == DCSensor::eGateIsOpenV2);
+				/*
+				*	v2 sensors send heartbeats, see CheckHeartbeats.  A v1
+				*	frame is from a sensor that doesn't, e.g. a v1 sensor
+				*	that replaced a v2 sensor.  The next poll sets its
+				*	protocol again.
+				*/
+				uint32_t	gateMask = (uint32_t)1 << (gateIndex -1);
+				if (command >= DCSensor::eGateIsOpenV2)
+				{
+					mHeartbeatGates |= gateMask;
+				} else
+				{
+					mHeartbeatGates &= ~gateMask;
+				}
 				mGates.GoToGate(gateIndex);
 			}
 			break;
@@ -982,35 +1855,143 @@ void DustCollector::HandleReceivedFrame(
 }
 
 /****************************** QueueCANMessage *******************************/
+/*
+*	When the tail == head, the queue is empty.
+*	When the ((tail+1) % kCANQueueSize) == head, the queue is full.
+*
+*	A message already queued isn't queued again.  The queue is searched from
+*	the tail back to the most recent message for inID, skipping the
+*	eCheckGateStateResponses markers.  If that message is inCommand the new
+*	message is coalesced, otherwise it's added so that the order of e.g.
+*	eFlash and eStopFlash is kept.  A marker is only coalesced with the same
+*	marker at the tail, a marker anywhere else belongs to an earlier request.
+*
+*	Urgent messages (TxPriority 3, the flasher the user is watching) are
+*	queued ahead of all but the other urgent messages.
+*
+*	inAtHead queues the message at the head without coalescing.  Used for
+*	the messages that take the place of the marker being handled.
+*/
 void DustCollector::QueueCANMessage(
 	uint32_t	inID,
-	uint16_t	inCommand)
+	uint16_t	inCommand,
+	bool		inAtHead)
 {
+	uint8_t	index = mCANMessageQueueTail;
+	bool	isMarker = inCommand == DCController::eCheckGateStateResponses;
+	while (!inAtHead &&
+		index != mCANMessageQueueHead)
+	{
+		index = (index + DCConfig::kCANQueueSize - 1) % DCConfig::kCANQueueSize;
+		const SCANMessageQueueElement&	queueElement = mCANMessageQueue[index];
+		bool	elementIsMarker = queueElement.command == DCController::eCheckGateStateResponses;
+		if (isMarker ||
+			(!elementIsMarker && queueElement.targetID == inID))
+		{
+			if (queueElement.targetID == inID &&
+				queueElement.command == inCommand)
+			{
+				if (mCANQueueStats.coalesced != 0xFFFF)
+				{
+					mCANQueueStats.coalesced++;
+				}
+				return;
+			}
+			break;
+		}
+	}
 	uint8_t	nextTail = (mCANMessageQueueTail + 1) % DCConfig::kCANQueueSize;
-	if (nextTail != mCANMessageQueueHead)
+	if (nextTail == mCANMessageQueueHead)
+	{
+		// Message not queued/sent
+		if (mCANQueueStats.overflows != 0xFFFF)
+		{
+			mCANQueueStats.overflows++;
+		}
+		Serial.print(F("CAN queue overflow"));
+		return;
+	}
+	if (inAtHead ||
+		TxPriority(inCommand) == 3)
 	{
 		/*
-		*	When the tail == head, the queue is empty.
-		*	When the ((tail+1) % kCANQueueSize) == head, the queue is full.
+		*	Open a slot before the head, then move the slot past the urgent
+		*	messages already queued.
 		*/
-		mCANMessageQueue[mCANMessageQueueTail].targetID = inID;
-		mCANMessageQueue[mCANMessageQueueTail].command = inCommand;
-		mCANMessageQueueTail = nextTail;
+		index = (mCANMessageQueueHead + DCConfig::kCANQueueSize - 1) % DCConfig::kCANQueueSize;
+		mCANMessageQueueHead = index;
+		uint8_t	next = (index + 1) % DCConfig::kCANQueueSize;
+		for (; !inAtHead && next != mCANMessageQueueTail &&
+			TxPriority(mCANMessageQueue[next].command) == 3;
+				next = (next + 1) % DCConfig::kCANQueueSize)
+		{
+			mCANMessageQueue[index] = mCANMessageQueue[next];
+			index = next;
+		}
 	} else
 	{
-		// Message not queued/sent
-		Serial.print(F("CAN queue overflow"));
+		index = mCANMessageQueueTail;
+		mCANMessageQueueTail = nextTail;
+	}
+	mCANMessageQueue[index].targetID = inID;
+	mCANMessageQueue[index].command = inCommand;
+	uint8_t	count = CANQueueCount();
+	if (count > mCANQueueStats.highWater)
+	{
+		mCANQueueStats.highWater = count;
 	}
 }
 
+/***************************** CANMessageIsQueued *****************************/
+bool DustCollector::CANMessageIsQueued(
+	uint32_t	inID,
+	uint16_t	inCommand) const
+{
+	uint8_t	index = mCANMessageQueueHead;
+	for (; index != mCANMessageQueueTail; index = (index + 1) % DCConfig::kCANQueueSize)
+	{
+		if (mCANMessageQueue[index].targetID == inID &&
+			mCANMessageQueue[index].command == inCommand)
+		{
+			break;
+		}
+	}
+	return(index != mCANMessageQueueTail);
+}
+
+/**************************** PurgeCANMessageQueue ****************************/
+/*
+*	Called when the gate IDs change.  Removes every queued message other than
+*	the replies to bus tools (targeted to kControllerID), including a gate
+*	check in progress, and the requests waiting for a reply.
+*/
+void DustCollector::PurgeCANMessageQueue(void)
+{
+	uint8_t	tail = mCANMessageQueueHead;
+	for (uint8_t index = mCANMessageQueueHead; index != mCANMessageQueueTail;
+			index = (index + 1) % DCConfig::kCANQueueSize)
+	{
+		if (mCANMessageQueue[index].targetID == DCConfig::kControllerID)
+		{
+			mCANMessageQueue[tail] = mCANMessageQueue[index];
+			tail = (tail + 1) % DCConfig::kCANQueueSize;
+		}
+	}
+	mCANMessageQueueTail = tail;
+	mCANRequestCount = 0;
+	mGateCheckDone = true;
+}
+
 /************************ External Interrupt Request 2 ************************/
 /*
 *
-*	Sets a flag to show that the CAN interrupt line is active (low true.)
+*	The CAN interrupt line went active (low true.)  Reads the received frames
+*	into mCANRxRing and frees the sent Tx buffers.  Any other interrupt
+*	(errors) is left for CheckGates.
 */
 void DustCollector::ExtIntReq2(void)
 {
-	sMCP2515IntTriggered = true;
+	sDustCollector->ServiceCANInterrupt();
 }
 
 
@@ -1094,124 +2075,3 @@ void DustCollector::DoSerial(void)
 	}
 }
 #endif
-
-#ifdef DEBUG_FRAMES
-/******************************** AppendFrame *********************************/
-void DustCollector::AppendFrame(
-	CANFrame&	inCANFrame)
-{
-	if (mFrameIndex == (DEBUG_FRAMES*sizeof(CANFrame)))
-	{
-		Serial.println('F');
-		DumpFrames();
-	}
-	inCANFrame.CopyFromRaw(&mFrameBuffer[mFrameIndex]);
-	mFrameIndex += sizeof(CANFrame);
-}
-
-const char kEWARNStr[] PROGMEM = "EWARN";
-const char kRXWARStr[] PROGMEM = "RXWAR";
-const char kTXWARStr[] PROGMEM = "TXWAR";
-const char kRXEPStr[] PROGMEM = "RXEP";
-const char kTXEPStr[] PROGMEM = "TXEP";
-const char kTXBOStr[] PROGMEM = "TXBO";
-const char kRX0OVRStr[] PROGMEM = "RX0OVR";
-const char kRX1OVRStr[] PROGMEM = "RX1OVR";
-typedef  const char* ConstCharPtr;
-const ConstCharPtr kErrorStrs[] PROGMEM = {
-	kEWARNStr, kRXWARStr, kTXWARStr, kRXEPStr,
-	kTXEPStr, kTXBOStr, kRX0OVRStr, kRX1OVRStr};
-
-/********************************* DumpFrames *********************************/
-void DustCollector::DumpFrames(void)
-{
-	uint32_t	fromID;
-	CANFrame	canFrame;
-	for (uint8_t frameIndex = 0; frameIndex < mFrameIndex; frameIndex += sizeof(CANFrame))
-	{
-		canFrame.CopyToRaw(&mFrameBuffer[frameIndex]);
-		fromID = 0;
-		Serial.print(F("To: 0x"));
-		Serial.print(canFrame.GetExtendedID(), HEX);
-		switch (canFrame.GetStandardID())
-		{
-			case DCController::eRequestGateState:
-				Serial.print(F(", eRequestGateState"));
-				break;
-			case DCController::eRequestTimestamp:
-				Serial.print(F(", eRequestTimestamp"));
-				break;
-			case DCController::eFlash:
-				Serial.print(F(", eFlash"));
-				break;
-			case DCController::eStopFlash:
-				Serial.print(F(", eStopFlash"));
-				break;
-			case DCController::eSetFactoryID:
-				Serial.print(F(", eSetFactoryID"));
-				break;
-			case 0x201:
-			case DCController::eSetID:
-				Serial.print(F(", eSetID to 0x"));
-				Serial.print(*((const uint32_t*)canFrame.GetData()), HEX);
-				if (canFrame.GetStandardID() == 0x201)
-				{
-					Serial.print(F(" (Failed)"));
-				}
-				break;
-			case DCSensor::eGateIsOpen:
-				fromID = *(const uint32_t*)canFrame.GetData();
-				Serial.print(F(", eGateIsOpen"));
-				break;
-			case DCSensor::eGateIsClosed:
-				fromID = *(const uint32_t*)canFrame.GetData();
-				Serial.print(F(", eGateIsClosed"));
-				break;
-			case DCSensor::eTimestamp:
-			{
-				fromID = *(const uint32_t*)canFrame.GetData();
-				Serial.print(F(", eTimestamp = "));
-				Serial.print(((const uint32_t*)canFrame.GetData())[1], HEX);
-				break;
-			}
-			case 0x200:
-			{
-				Serial.print(F(", Error 0x"));
-				uint8_t	error = canFrame.GetRawFrame()[5];
-				Serial.print(error, HEX);
-				for (uint8_t errIdx = 0; error; error >>= 1)
-				{
-					if (error & 1)
-					{
-						char errorStr[10];
-						char*	errorPtr;
-						memcpy_P(&errorPtr, &kErrorStrs[errIdx], sizeof(char*));
-						strcpy_P(errorStr, errorPtr);
-						Serial.print(F(", "));
-						Serial.print(errorStr);
-					}
-					errIdx++;
-				}
-				Serial.print(F(", CANINTE "));
-				Serial.print(canFrame.GetRawFrame()[6], HEX);
-				Serial.print(F(", CANINTF "));
-				Serial.print(canFrame.GetRawFrame()[7], HEX);
-				break;
-			}
-			default:
-				Serial.print(F(", Unknown command 0x"));
-				Serial.print(canFrame.GetStandardID(), HEX);
-				break;
-		}
-		if (fromID)
-		{
-			Serial.print(F(", GateID: 0x"));
-			Serial.println(fromID, HEX);
-		} else
-		{
-			Serial.println();
-		}
-	}
-	mFrameIndex = 0;
-}
-#endif
\ No newline at end of file
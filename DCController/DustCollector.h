@@ -36,12 +36,27 @@
 #include "BMP280SPI.h"
 #include "RFM69.h"    // https://github.com/LowPowerLab/RFM69
 #include "MCP2515.h"
+#include "CANRecorder.h"
+#include "DCMessages.h"
 #include "DCConfig.h"
 
+//#define PROFILE_LOOP	1	// Also defined by the host build (DCHost/Makefile)
+#include "LoopProfiler.h"
+//#define REPORT_DEADLINES	1	// Also defined by the host build (DCHost/Makefile)
+#include "DeadlineMonitor.h"
+
 //#define DEBUG_MOTOR	1
 //#define DEBUG_DELTAS	1
 
-//#define DEBUG_FRAMES		50
+/*
+*	The CAN recorder keeps the most recent frames and MCP2515 errors.  After a
+*	gate sensor fails to respond or a received frame is lost, the recorder is
+*	appended to CANLog.bin on the SD card once the bus is idle.  When
+*	CAN_RECORDER_SERIAL is defined it's instead drained to Serial whenever the
+*	bus is idle.  See CANRecorder.h for the format.
+*/
+#define CAN_RECORDER_SIZE	320
+//#define CAN_RECORDER_SERIAL	1
 #define CAN_QUEUE_SIZE		64
 
 class DustCollector : public MCP2515
@@ -61,6 +76,24 @@ public:
 		eOpenState,
 		eErrorState	// Gate sensor is not responding
 	};
+	
+	enum ELoopSection	// LoopProfiler sections
+	{
+		eLoopSection,
+		eCheckGatesSection,
+		eCheckFilterSection,
+		eCheckDustBinMotorSection,
+		eUpdateDisplaySection
+	};
+	
+	enum EDeadlineTask	// DeadlineMonitor tasks
+	{
+		eLoopTask,			// Time between Update calls, no deadline
+		eCANReceiveTask,	// From a frame entering mCANRxRing till it's handled
+		eCANSendTask,		// A queued message waiting for mCANSettlePeriod
+		ePressureTask,		// Pressure reads (mPressureUpdatePeriod)
+		eMotorSenseTask		// Bin motor sense (mMotorSensePeriod)
+	};
 							DustCollector(void);
 		
 	void					begin(void);
@@ -134,8 +167,29 @@ public:
 							*/
 	void					RequestGateState(
 								uint16_t				inGateIndex);
+							/*
+							*	Sends eCalibrate to the gate sensor.  The gate
+							*	should then be opened and closed within the
+							*	sensor's calibration period.  The sensor's
+							*	reply is kept, see GateCalibration.
+							*	CalibratedGate is 0 till it's received.
+							*/
+	void					CalibrateGate(
+								uint16_t				inGateIndex);
+	void					CalibrateCurrentGate(void)
+								{CalibrateGate(mGates.GetCurrentIndex());}
+							/*
+							*	The last eCalibrationV2 reply and the gate it's
+							*	from, 0 when none was received.
+							*/
+	const DCSensor::SHallCalibration&	GateCalibration(void) const
+								{return(mGateCalibration);}
+	uint8_t					CalibratedGate(void) const
+								{return(mCalibratedGate);}
 	uint32_t				UnresponsiveGates(void) const
 								{return(mUnresponsiveGates);}
+	uint32_t				HeartbeatGates(void) const
+								{return(mHeartbeatGates);}
 	uint8_t					NextUnresponsiveGate(
 								uint8_t					inGateIndex,
 								bool					inForward) const;
@@ -152,6 +206,38 @@ public:
 								uint16_t				inRecIndex) const;
 	uint32_t				OpenGates(void) const
 								{return(mOpenGates);}
+							/*
+							*	Received frames dropped because mCANRxRing was
+							*	full, and frames lost by the MCP2515 because
+							*	both of its receive buffers were full
+							*	(RX0OVR/RX1OVR.)
+							*/
+	uint16_t				CANRxRingOverflows(void) const
+								{return(mCANRxRingOverflows);}
+	uint16_t				CANRxOverruns(void) const
+								{return(mCANRxOverruns);}
+	/*
+	*	The average time from sending a gate state request till its response,
+	*	in ms.  Used to size the response window, see SendQueuedMessages.
+	*/
+	uint16_t				CANResponseLatency(void) const
+								{return(mCANResponseLatency);}
+	/*
+	*	The message queue and request statistics since begin, see
+	*	QueueCANMessage and CheckCANRequests.
+	*/
+	struct SCANQueueStats
+	{
+		uint8_t		highWater;	// Most messages queued at once
+		uint16_t	coalesced;	// Messages not queued because already queued
+		uint16_t	overflows;	// Messages dropped because the queue was full
+		uint16_t	retries;	// Requests resent, see CheckCANRequests
+		uint16_t	timeouts;	// Requests that were never answered
+	};
+	const SCANQueueStats&	CANQueueStats(void) const
+								{return(mCANQueueStats);}
+	CANRecorder&			GetCANRecorder(void)
+								{return(mCANRecorder);}
 	bool					GateCheckDone(void) const
 								{return(mGateCheckDone);}
 	uint8_t					GetTriggerThreshold(void) const
@@ -165,11 +251,37 @@ public:
 #if 0
 	void					DoSerial(void);
 #endif
+#ifdef PROFILE_LOOP
+	static void				DumpLoopProfile(void);
+#endif
+	static void				DumpDeadlines(void);
 protected:
 	Gates		mGates;
 	GateSets	mGateSets;
 	uint8_t		mStatus;
-	MSPeriod	mCANBusyPeriod;
+	MSPeriod	mCANQuietPeriod;	// Started when a frame is received
+	MSPeriod	mCANSettlePeriod;	// Started when a frame is loaded, see SendQueuedMessages
+	MSPeriod	mCANResponseWindow;	// Started when ePollGateStates is loaded
+	uint16_t	mCANResponseLatency;// Average ms from a gate state request till its response
+	uint8_t		mCANResponsesDue;	// Poll responses not received yet
+	bool		mCANErrorWarning;	// EWARN, TEC or REC is 96 or more
+	bool		mCANQueueWaiting;	// A queued message is waiting for mCANSettlePeriod
+	bool		mCANTxSettling;		// The next queued message waits for mCANSettlePeriod
+	/*
+	*	The requests waiting for a reply, see CheckCANRequests.
+	*/
+	struct SCANRequest
+	{
+		uint32_t	targetID;		// The ID the reply is expected from
+		uint32_t	sensorID;		// eSetID, eReplaceID: the sensor's ID before eSetID
+		uint32_t	sentTime;		// millis() when the last frame was sent
+		uint16_t	command;		// eRequestGateState, eSetID or eReplaceID
+		uint8_t		retries;
+		bool		awaitingReply;	// eRequestGateState was sent to targetID
+	} mCANRequest[DCConfig::kCANMaxRequests];
+	uint8_t		mCANRequestCount;
+	volatile uint8_t	mCANTxBusy;	// Tx buffers waiting to be sent (TXREQ), bits 0 to 2
+	uint32_t	mLastUpdate;		// millis() of the last Update call
 	MSPeriod	mPressureUpdatePeriod;
 	int32_t		mDeltaSum;
 	int32_t		mDelta[DCConfig::kNumDeltas];
@@ -188,11 +300,17 @@ protected:
 	uint32_t	mAmbientPressure;
 
 	uint32_t	mOpenGates;
+	MSPeriod	mGateSetLookupDelay;	// Started when a gate state changes
 	uint32_t	mFlashingGates;
 	uint32_t	mUnregisteredGateID; // Most recent unregistered gate
 	uint32_t	mUnresponsiveGates;	// Gates that didn't respond to gate status request
+	uint32_t	mHeartbeatGates;	// Gates that sent a v2 frame, see CheckHeartbeats
+	uint32_t	mGateLastSeen[DCConfig::kMaxGates];	// millis() of the last frame from each gate
+	MSPeriod	mHeartbeatCheckPeriod;
 	uint32_t	mGateBaseID;
-	static const uint8_t	kTimingConfig[];
+	DCSensor::SHallCalibration	mGateCalibration;	// See CalibrateGate
+	uint8_t		mCalibratedGate;
+	static const CANBitTiming::SConfig	kTimingConfig;
 
 	MSPeriod	mMotorSensePeriod;
 
@@ -211,12 +329,22 @@ protected:
 	} mCANMessageQueue[DCConfig::kCANQueueSize];
 	uint8_t		mCANMessageQueueHead;
 	uint8_t		mCANMessageQueueTail;
+	SCANQueueStats	mCANQueueStats;
+	/*
+	*	Received frames, filled by ExtIntReq2 and emptied by CheckGates.  When
+	*	head == tail the ring is empty.
+	*/
+	CANFrame	mCANRxRing[DCConfig::kCANRxRingSize];
+	volatile uint8_t	mCANRxRingHead;	// Only changed by CheckGates
+	volatile uint8_t	mCANRxRingTail;	// Only changed by ServiceCANInterrupt
+	volatile uint16_t	mCANRxRingOverflows;
+	uint16_t	mCANRxOverruns;
+	uint16_t	mCANRxLostReported;	// Overflows + overruns already reported to DeadlineMonitor
 	uint8_t	mNotUsed[32];
 
-#ifdef DEBUG_FRAMES
-	uint8_t				mFrameBuffer[DEBUG_FRAMES*sizeof(CANFrame)];
-	uint8_t				mFrameIndex;
-#endif
+	uint8_t		mCANRecorderBuffer[CAN_RECORDER_SIZE];
+	CANRecorder	mCANRecorder;
+	bool		mSaveCANLog;	// Drain mCANRecorder to SD when the bus is idle
 #ifdef DEBUG_DELTAS
 	uint16_t	mDebugAverageIndex;
 	int16_t		mDeltaAverageDebug[512];
@@ -233,14 +361,53 @@ protected:
 	void					StopDustBinMotor(void);
 	void					QueueCANMessage(
 								uint32_t				inID,
-								uint16_t				inCommand);
+								uint16_t				inCommand,
+								bool					inAtHead = false);
+	bool					CANMessageIsQueued(
+								uint32_t				inID,
+								uint16_t				inCommand) const;
+	void					PurgeCANMessageQueue(void);
+	void					CheckCANRequests(void);
+	bool					TrackCANRequest(
+								uint32_t				inTargetID,
+								uint16_t				inCommand,
+								uint32_t				inSensorID = 0);
+	uint8_t					FindCANRequest(
+								uint32_t				inID,
+								bool					inSensorID = false) const;
+	bool					CANRequestAnswered(
+								uint32_t				inID);
+	void					CANRequestFailed(
+								const SCANRequest&		inRequest);
+	uint32_t				CANResponseWindow(void) const;
+	inline uint8_t			CANQueueCount(void) const
+								{return((mCANMessageQueueTail - mCANMessageQueueHead +
+									DCConfig::kCANQueueSize) % DCConfig::kCANQueueSize);}
+	void					SendQueuedMessages(void);
+	void					CheckHeartbeats(void);
+	void					CountRxOverruns(
+								uint8_t					inEFLG);
+	bool					CANOverflowRisk(void) const;
+	inline uint8_t			CANRxRingCount(void) const
+								{return((mCANRxRingTail - mCANRxRingHead +
+									DCConfig::kCANRxRingSize) % DCConfig::kCANRxRingSize);}
 	void					SendNextQueuedMessage(void);
-
-#ifdef DEBUG_FRAMES
-	void					AppendFrame(
+	void					ServiceCANInterrupt(void);
+	static uint8_t			TxPriority(
+								uint16_t				inCommand);
+	static inline uint8_t	TxRequestFlags(
+								uint8_t					inStatus)	// GetStatus
+								{return(((inStatus >> eTXREQ_TXB0CTRL) & 1) |
+										((inStatus >> (eTXREQ_TXB1CTRL-1)) & 2) |
+										((inStatus >> (eTXREQ_TXB2CTRL-2)) & 4));}
+	static void				SetIDData(
+								CANFrame&				inCANFrame,
+								uint32_t				inNewID);
+	bool					SendAndRecordFrame(
 								CANFrame&				inCANFrame);
-	void					DumpFrames(void);
-#endif
+	void					ExtendResponseWindow(
+								uint32_t				inWindow);
+	void					DrainCANRecorder(void);
 };
 
 #endif // DustCollector_h
@@ -54,6 +54,8 @@ const char kSaveStr[] PROGMEM = "SAVE";
 const char kLoadStr[] PROGMEM = "LOAD";
 const char kResetStr[] PROGMEM = "RESET";
 const char kCheckGatesStr[] PROGMEM = "CHECK GATES";
+const char kCalibrateStr[] PROGMEM = "CALIBRATE";
+const char kPlusMinusStr[] PROGMEM = " +/- ";
 
 // Gate Sets menu items
 const char kSaveCStr[] PROGMEM = "SAVE:";
@@ -104,6 +106,14 @@ const char kOKStr[] PROGMEM = "OK";
 const char kDustBinFullStr[] PROGMEM = "DUST BIN FULL";
 const char kFilterLoadedStr[] PROGMEM = "FILTER LOADED";
 
+// Gate sensor calibration
+const char kCalibratingStr[] PROGMEM = "CALIBRATING";
+const char kOpenAndStr[] PROGMEM = "OPEN AND";
+const char kCloseGateStr[] PROGMEM = "CLOSE GATE";
+const char kCalibratedStr[] PROGMEM = "CALIBRATED";
+const char kCalibrateFailedStr[] PROGMEM = "CALIB FAILED";
+const char kNoReplyStr[] PROGMEM = "NO REPLY";
+
 
 struct SStringDesc
 {
@@ -128,6 +138,12 @@ const SStringDesc kTextDesc[] PROGMEM =
 	{kNotRunningStr, XFont::eYellow},
 	{kDustBinFullStr, XFont::eRed},
 	{kFilterLoadedStr, XFont::eRed},
+	{kCalibratingStr, XFont::eMagenta},
+	{kOpenAndStr, XFont::eWhite},
+	{kCloseGateStr, XFont::eWhite},
+	{kCalibratedStr, XFont::eGreen},
+	{kCalibrateFailedStr, XFont::eRed},
+	{kNoReplyStr, XFont::eYellow},
 	{kOKStr, XFont::eWhite},
 	// Gate States
 	{kClosedStr, XFont::eYellow},
@@ -163,6 +179,7 @@ const SStringDesc kTextDesc[] PROGMEM =
 /****************************** DustCollectorUI *******************************/
 DustCollectorUI::DustCollectorUI(void)
 : mSDCardPresent(false), mDebouncePeriod(DEBOUNCE_DELAY),
+	mCalibrateTimeout(DCConfig::kCalibrateTimeout),
 	mPrevDCIsRunning(false), mIgnoreButtonPress(false), mSleepEnabled(true)
 {
 }
@@ -385,8 +402,21 @@ void DustCollectorUI::EnterPressed(void)
 						mCurrentFieldOrItem = eVerifyNoItem;
 						break;
 					case eCheckGatesItem:
-						mDustCollector->RequestAllGateStates();
-						mMode = eWaitingForGateCheckMode;
+						if (mGateAction == eCheckGatesAction)
+						{
+							mDustCollector->RequestAllGateStates();
+							mMode = eWaitingForGateCheckMode;
+						/*
+						*	Else the sensor of the current gate is calibrated.
+						*	The user opens and closes the gate while waiting
+						*	for the result, see Update.
+						*/
+						} else
+						{
+							mDustCollector->CalibrateCurrentGate();
+							mCalibrateTimeout.Start();
+							mMode = eWaitingForCalibrationMode;
+						}
 						break;
 					case eSensorNamesSDActionItem:
 							if (mSDCardPresent)
@@ -550,6 +580,10 @@ void DustCollectorUI::EnterPressed(void)
 			mDustCollector->RegisterUnregisteredGate(mCurrentUnresponsiveGateIndex);
 			GoToInfoMode();
 			break;
+		case eCalibrationResultMode:
+			mMode = eGateSensorsMode;
+			mCurrentFieldOrItem = eCheckGatesItem;
+			break;
 	}
 	UnixTime::ResetSleepTime();
 }
@@ -606,6 +640,9 @@ void DustCollectorUI::LeftRightButtonPressed(
 				case eSensorNamesSDActionItem:
 					mSetAction = mSetAction == eSaveToSD ? eLoadFromSD:eSaveToSD;
 					break;
+				case eCheckGatesItem:
+					mGateAction = mGateAction == eCheckGatesAction ? eCalibrateAction:eCheckGatesAction;
+					break;
 				case eGateNameItem:
 					inIncrement ? mDustCollector->GetGates().Next() :
 									mDustCollector->GetGates().Previous();
@@ -682,6 +719,21 @@ void DustCollectorUI::Update(void)
 		{
 			return;
 		}
+	/*
+	*	The display shows the calibration prompt while waiting, unlike the gate
+	*	check which takes less than a second.
+	*/
+	} else if (mMode == eWaitingForCalibrationMode)
+	{
+		if (mDustCollector->CalibratedGate())
+		{
+			mMode = eCalibrationResultMode;
+			mCurrentFieldOrItem = eCalibrationOKItem;
+		} else if (mCalibrateTimeout.Passed())
+		{
+			QueueMessage(eCalibrateFailedMessage, eNoReplyMessage,
+				eGateSensorsMode, eCheckGatesItem);
+		}
 	} else if (mDustCollector->UnregisteredGateID() &&
 		mMode != eResolveUnregisteredGateMode)
 	{
@@ -716,7 +768,9 @@ void DustCollectorUI::Update(void)
 		}
 	}
 
+	PROFILE_BEGIN(DustCollector::eUpdateDisplaySection);
 	UpdateDisplay();
+	PROFILE_END(DustCollector::eUpdateDisplaySection);
 	UpdateActions();
 }
 
@@ -1016,10 +1070,18 @@ void DustCollectorUI::UpdateDisplay(void)
 				}
 				if (updateAll)
 				{
-					DrawCenteredItemP(eCheckGatesItem, kCheckGatesStr, eYellow);
 					DrawItemP(eSensorNamesSDActionItem, kNamesStr, eWhite);
 					DrawCenteredItemP(eResetItem, kResetStr, eRed);
 				}
+				if (updateAll ||
+					mGateAction != mPrevGateAction)
+				{
+					mPrevGateAction = mGateAction;
+					ClearLines(eCheckGatesItem, 1);
+					DrawCenteredItemP(eCheckGatesItem,
+							mGateAction == eCheckGatesAction ? kCheckGatesStr:kCalibrateStr,
+								eYellow);
+				}
 				if (updateAll ||
 					mSetAction != mPrevSetAction)
 				{
@@ -1116,6 +1178,46 @@ void DustCollectorUI::UpdateDisplay(void)
 					mSelectionFieldOrItem = 0;	// Force the selection frame to update
 				}
 				break;
+			case eWaitingForCalibrationMode:
+				if (updateAll)
+				{
+					DrawCenteredList(0,
+						eCalibratingMessage,
+						eNoMessage,
+						eOpenAndMessage,
+						eCloseGateMessage,
+						eTextListEnd);
+					Gates&	gates = mDustCollector->GetGates();
+					if (gates.GetCurrentIndex())
+					{
+						DrawCenteredItem(1, gates.GetCurrent().name, eWhite);
+					}
+				}
+				break;
+			case eCalibrationResultMode:
+				if (updateAll)
+				{
+					const DCSensor::SHallCalibration&	calibration =
+						mDustCollector->GateCalibration();
+					char	valueStr[20];
+					DrawCenteredDescP(eCalibrationItem,
+						calibration.result == DCSensor::eCalibrationSaved ?
+							eCalibratedMessage : eCalibrateFailedMessage);
+					// The threshold and hysteresis in use
+					UnixTime::Uint16ToDecStr(calibration.threshold, valueStr);
+					strcpy_P(&valueStr[strlen(valueStr)], kPlusMinusStr);
+					UnixTime::Uint16ToDecStr(calibration.hysteresis, &valueStr[strlen(valueStr)]);
+					DrawCenteredItem(eThresholdItem, valueStr, eMagenta);
+					// The values sampled
+					DrawItemP(eClosedValueItem, kClosedStr, eYellow);
+					UnixTime::Uint16ToDecStr(calibration.closedValue, valueStr);
+					DrawItem(eClosedValueItem, valueStr, eWhite, 150);
+					DrawItemP(eOpenValueItem, kOpenStr, eGreen);
+					UnixTime::Uint16ToDecStr(calibration.openValue, valueStr);
+					DrawItem(eOpenValueItem, valueStr, eWhite, 150);
+					DrawCenteredDescP(eCalibrationOKItem, eOKItemDesc);
+				}
+				break;
 			case eResolveUnregisteredGateMode:
 				if (updateAll)
 				{
@@ -1146,9 +1248,11 @@ void DustCollectorUI::UpdateDisplay(void)
 		}
 		
 		/*
-		*	Set time mode has its own selection frame...
+		*	Set time mode has its own selection frame, the calibration prompt
+		*	has none...
 		*/
-		if (mMode != eSetTimeMode)
+		if (mMode != eSetTimeMode &&
+			mMode != eWaitingForCalibrationMode)
 		{
 			UpdateSelectionFrame();
 		}
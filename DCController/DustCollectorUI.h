@@ -72,6 +72,7 @@ protected:
 	AnimatedFontIcon		mMotorIcon;
 	MSPeriod				mDebouncePeriod;	// For buttons and SD card
 	MSPeriod				mSelectionPeriod;	// Selection frame flash rate
+	MSPeriod				mCalibrateTimeout;	// Waiting for the sensor's reply
 	uint8_t					mMode;
 	uint8_t					mCurrentFieldOrItem;
 	uint8_t					mStartPinState;
@@ -83,6 +84,8 @@ protected:
 	bool					mPrevBinMotorIsRunning;
 	uint8_t					mSetAction;	// Used by eGateSensorsMode and eGateSetsMode
 	uint8_t					mPrevSetAction;
+	uint8_t					mGateAction;	// Used by eGateSensorsMode eCheckGatesItem
+	uint8_t					mPrevGateAction;
 	uint8_t					mSelectionIndex;
 	uint8_t					mSavedMotorThreshold;
 	uint8_t					mPrevMotorThreshold;
@@ -188,7 +191,9 @@ protected:
 		eMessageMode,
 		eWaitingForGateCheckMode,
 		eResolveUnregisteredGateMode,
-		eVerifyGateRemovalMode
+		eVerifyGateRemovalMode,
+		eWaitingForCalibrationMode,
+		eCalibrationResultMode
 	};
 	
 	enum EMainMenuItem
@@ -220,6 +225,11 @@ protected:
 		eSaveToSD,
 		eLoadFromSD
 	};
+	enum EGateAction
+	{
+		eCheckGatesAction,
+		eCalibrateAction
+	};
 	enum EGateSetsMenuItem
 	{
 		eSaveSetItem,
@@ -259,6 +269,14 @@ protected:
 		eMessage1Item,
 		eOKItemItem,
 	};
+	enum ECalibrationResultItem
+	{
+		eCalibrationItem,
+		eThresholdItem,
+		eClosedValueItem,
+		eOpenValueItem,
+		eCalibrationOKItem
+	};
 	enum ETextDesc
 	{
 		eTextListEnd,
@@ -279,6 +297,12 @@ protected:
 		eNotRunningMessage,
 		eDustBinFullMessage,
 		eFilterLoadedMessage,
+		eCalibratingMessage,
+		eOpenAndMessage,
+		eCloseGateMessage,
+		eCalibratedMessage,
+		eCalibrateFailedMessage,
+		eNoReplyMessage,
 		eOKItemDesc,
 		// Gate States
 		eClosedStateDesc,
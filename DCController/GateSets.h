@@ -43,8 +43,11 @@ class DataStream;
 *	Any change in the size of SGateSetLink must be reflected in SGateSetRoot by
 *	adjusting the size of SGateSetRoot.unused[].
 *	The sizeof(SGateSetRoot) must equal the sizeof(SGateSetLink)
+*
+*	Packed so the EEPROM layout documented in DCConfig.h (14 bytes per link)
+*	also holds on hosts that align uint32_t to 4 bytes.  No effect on the AVR.
 */
-typedef struct
+typedef struct __attribute__((packed))
 {
 	uint8_t		prev;		// Index of the previous set.  0 if head.
 	uint8_t		next;		// Index of the next set.  0 if tail.
@@ -0,0 +1,1136 @@
+/*
+*	DCBusStress.cpp, Copyright Jonathan Mackey 2021
+*	Runs the DCController sketch and N DCGateSensor instances on a simulated
+*	CAN bus.  Each node has its own MCP2515 register model.  The scenarios
+*	create bursts of gate sensor responses and report how many frames the
+*	controller drained before its receive buffers overflowed (RX0OVR/RX1OVR),
+*	the bus errors, and whether the controller ends up with the correct gate
+*	states.  The burst scenario is repeated with the controller in a 250 ms
+*	display update, first in bounded TFT SPI transactions and then in one
+*	transaction that masks INT2 throughout (see DisplayStall.)  The sensors
+*	use protocol v1 until the poll scenario, after which the broadcast
+*	request is repeated with v2 and the heartbeats are checked.  The
+*	broadcast scenario also checks that the controller's filters reject
+*	standard IDs outside the v2 range from other extended IDs.
+*	The repeat scenario repeats the controller's requests during a gate check
+*	to see that the message queue coalesces them.  The retry scenario makes
+*	a sensor deaf to see that the controller's requests and the
+*	registration of a new sensor are retried.  The noise scenario holds a
+*	gate's Hall value at the threshold with noise to see that the sensor's
+*	hysteresis keeps it from chattering.  The calibrate scenario moves a
+*	gate's magnet away and calibrates its sensor with DCController::eCalibrate,
+*	then calibrates it again without moving the gate to see it rejected.
+*	The profiles scenario reconfigures every node with each CANBitTiming
+*	profile and repeats the burst and the poll at that bit rate.  A sensor
+*	that power-down sleeps (DCGateSensor::Sleep) isn't run till INT0 or its
+*	watchdog tick wakes it, and each report gives the sensors' time powered
+*	down.
+*
+*	usage: DCBusStress [sensors [bit rate [scenario [log]]]]
+*		sensors		1 to 32, default 32
+*		bit rate	the bus bit rate, default 40000.  The nodes are configured
+*					by the sketches (DCConfig::kCANProfile, 40 kbps.)
+*		scenario	toggle, broadcast, burst, poll, repeat, retry, noise,
+*					calibrate, profiles or all (default)
+*		log			every frame on the bus is written to this file in the
+*					candump -L format.  See DCCANReplay.
+*
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#include "DCController.ino"
+#include "DCGateSensor.h"
+#include "DCMessages.h"
+#include "DCSConfig.h"
+#include "HostBMP280.h"
+#include "HostNode.h"
+#include "HostMCP2515.h"
+#include "HostCANBus.h"
+#include <avr/sleep.h>
+
+// The sensor's compile time ID, used by sensors with an erased EEPROM.
+volatile uint32_t	kTimestamp = 0x61000000;
+
+extern "C" void EXT_INT0_vect(void);
+extern "C" void WDT_vect(void);
+
+const uint8_t	kMaxSensors = 32;
+const uint32_t	kSensorLoopNanos = 100000;	// ATtiny84 loop() period
+const uint32_t	kHallSampleNanos = 2048000;	// ATtiny84 Timer0 overflow period
+const uint32_t	kStepMicros = 100;			// Between controller loop() calls
+const uint32_t	kStallMillis = 250;			// Longest UpdateDisplay, see DCLoopBench
+/*
+*	The longest TFT SPI transaction of a display update, 2 bytes per pixel at
+*	8MHz (1us per byte.)
+*/
+const uint32_t	kDisplayHeldMicros = TFT_ST77XX::ePixelsPerTransaction * 2;
+/*
+*	The sensor's INT input is PB2, which is pin 2 in the host pin numbering.
+*/
+const uint8_t	kSensorIntPin = 2;
+
+HostNode		controllerNode(true);
+HostBMP280		bmp280Ambient(DCConfig::kBMP0CSPin);
+HostBMP280		bmp280Duct(DCConfig::kBMP1CSPin);
+HostMCP2515		controllerCAN(DCConfig::kCANCSPin);
+HostCANBus		canBus;
+
+struct SSensor
+{
+	HostNode*		node;
+	HostMCP2515*	can;
+	DCGateSensor*	gateSensor;
+	bool			stopped;	// Update isn't called, see Heartbeats
+	bool			poweredDown;// See DCGateSensor::Sleep and PowerDownWake
+	bool			intWoke;	// INT0 delivered while powered down
+	uint64_t		sleepNanos;	// When it powered down or the last WDT tick
+	uint64_t		stoppedNanos;// Total powered down, HostIO::sMillisStopped
+	uint64_t		asleepNanos;// Powered down since ClearAllStats
+	uint32_t		wakes;		// Since ClearAllStats
+	uint32_t		intWakes;
+};
+static SSensor	sSensors[kMaxSensors];
+static uint8_t	sNumSensors;
+static uint8_t	sRunningSensor;
+static uint32_t	sOpenGates;		// Hall sensor state of each gate
+static uint64_t	sNextSensorNanos;
+static uint64_t	sNextHallNanos;
+static uint8_t	sNoisyGate = 0xFF;	// Index of the gate read by ReadNoisyHall
+static uint16_t	sNoisyHall;		// Its Hall value before the noise is added
+static uint16_t	sRawCrossings;	// Of the threshold by single conversions
+static uint8_t	sRawIsOpen;
+static uint8_t	sWeakGate = 0xFF;	// Index of the gate whose magnet is far, see ReadHall
+static uint16_t	sRingOverflows;	// DustCollector counts at ClearAllStats
+static uint16_t	sOverruns;
+static DustCollector::SCANQueueStats	sQueueStats;
+static uint32_t	sSensorBusOffsCounted;	// By the sensors' MCP2515 error counters
+static FILE*	sLog;
+static uint64_t	sStatsNanos;	// When ClearAllStats was called
+
+/********************************** LogFrame **********************************/
+/*
+*	Bus monitor, writes inRawFrame in the candump -L format.
+*/
+static void LogFrame(
+	const uint8_t*	inRawFrame,
+	uint64_t		inNanos)
+{
+	CANFrame	canFrame(inRawFrame);
+	fprintf(sLog, "(%u.%06u) can0 ", (uint32_t)(inNanos / 1000000000),
+		(uint32_t)((inNanos / 1000) % 1000000));
+	if (canFrame.IsExtended())
+	{
+		fprintf(sLog, "%08X#", ((uint32_t)canFrame.GetStandardID() << 18) |
+			canFrame.GetExtendedID());
+	} else
+	{
+		fprintf(sLog, "%03X#", canFrame.GetStandardID());
+	}
+	if (canFrame.IsRemoteRequest())
+	{
+		fprintf(sLog, "R");
+	} else
+	{
+		for (uint8_t i = 0; i < canFrame.GetDataLen(); i++)
+		{
+			fprintf(sLog, "%02X", canFrame.GetData()[i]);
+		}
+	}
+	fprintf(sLog, "\n");
+}
+
+/*
+*	MCP2515::begin is protected and hidden by the sketches' begin.  It's
+*	reached through these subclasses to change the nodes' bit timing.  The
+*	sensor's protected ID is also read through its subclass.
+*/
+class ControllerTimingProbe : public DustCollector
+{
+public:
+	using MCP2515::begin;
+	static void				Begin(
+								const uint8_t*			inTimingConfig)
+							{
+								void (MCP2515::*beginMCP2515)(const uint8_t*) = &ControllerTimingProbe::begin;
+								(dustCollector.*beginMCP2515)(inTimingConfig);
+							}
+};
+
+class SensorTimingProbe : public DCGateSensor
+{
+public:
+	using MCP2515::begin;
+	static void				Begin(
+								DCGateSensor&			inGateSensor,
+								const uint8_t*			inTimingConfig)
+							{
+								void (MCP2515::*beginMCP2515)(const uint8_t*) = &SensorTimingProbe::begin;
+								(inGateSensor.*beginMCP2515)(inTimingConfig);
+							}
+	static uint32_t			ID(
+								const DCGateSensor&		inGateSensor)
+								{return(inGateSensor.*(&SensorTimingProbe::mID));}
+};
+
+/******************************** ControllerInt *******************************/
+static void ControllerInt(void)
+{
+	HostPins::RaiseInterrupt(digitalPinToInterrupt(DCConfig::kCANIntPin));
+}
+
+/********************************** SensorInt *********************************/
+static void SensorInt(void)
+{
+	if (GIMSK & _BV(INT0))
+	{
+		sSensors[sRunningSensor].intWoke = true;
+		EXT_INT0_vect();
+	}
+}
+
+/*********************************** ReadHall *********************************/
+/*
+*	Below DCSConfig::kHallThreshold is open.  The sWeakGate sensor's magnet is
+*	further away, it reads below the threshold whether open or not.
+*/
+static int ReadHall(
+	uint8_t	inPin)
+{
+	bool	isOpen = (sOpenGates >> sRunningSensor) & 1;
+	if (sRunningSensor == sWeakGate)
+	{
+		return(isOpen ? 300 : 600);
+	}
+	return(isOpen ? 100 : 1023);
+}
+
+/******************************** ReadNoisyHall *******************************/
+/*
+*	sNoisyHall plus up to +/-80 of noise.  Counts how often a single
+*	conversion crosses the threshold, which is how often the sensor used to
+*	see the gate state change.
+*/
+static int ReadNoisyHall(void)
+{
+	static uint32_t	random = 1;
+	random = random * 1103515245 + 12345;
+	int		value = sNoisyHall + (int)((random >> 16) % 161) - 80;
+	value = value < 0 ? 0 : (value > 1023 ? 1023 : value);
+	uint8_t	isOpen = value < DCSConfig::kHallThreshold;
+	if (isOpen != sRawIsOpen)
+	{
+		sRawIsOpen = isOpen;
+		sRawCrossings++;
+	}
+	return(value);
+}
+
+/********************************** SensorADC *********************************/
+/*
+*	A conversion of the running sensor's Hall input, when enabled: on Timer0
+*	overflow, or every sensor loop when free running (a conversion takes
+*	104us.)  HallSampled is called directly rather than through ADC_vect
+*	because the ISR's sensor pointer is the last sensor begun.
+*/
+static void SensorADC(
+	bool	inTimer0Overflow)
+{
+	const uint8_t	kEnabled = _BV(ADEN) | _BV(ADATE) | _BV(ADIE);
+	uint8_t	trigger = ADCSRB & 7;
+	if ((ADCSRA & kEnabled) == kEnabled &&
+		((trigger == _BV(ADTS2) && inTimer0Overflow) || trigger == 0))
+	{
+		ADC = sRunningSensor == sNoisyGate ? ReadNoisyHall() : ReadHall(ADMUX & 7);
+		sSensors[sRunningSensor].gateSensor->HallSampled(ADC);
+	}
+}
+
+/********************************* AsleepSince *********************************/
+/*
+*	The time the powered down sensor has slept since ClearAllStats.
+*/
+static uint64_t AsleepSince(
+	const SSensor&	inSensor,
+	uint64_t		inNow)
+{
+	uint64_t	from = inSensor.sleepNanos > sStatsNanos ? inSensor.sleepNanos : sStatsNanos;
+	return(inSensor.poweredDown && inNow > from ? inNow - from : 0);
+}
+
+/********************************* WakeSensor *********************************/
+/*
+*	Called with the powered down sensor entered.  The node's millis() falls
+*	behind by the time powered down, same as Timer0 stopping.
+*/
+static void WakeSensor(
+	SSensor&	inSensor,
+	uint64_t	inNow)
+{
+	inSensor.asleepNanos += AsleepSince(inSensor, inNow);
+	inSensor.stoppedNanos += inNow - inSensor.sleepNanos;
+	inSensor.wakes++;
+	inSensor.intWakes += inSensor.intWoke;
+	inSensor.poweredDown = false;
+	HostIO::sMillisStopped = (uint32_t)(inSensor.stoppedNanos / 1000000);
+	HostIO::sSleeping = 0;
+}
+
+/******************************** WakeForReset ********************************/
+/*
+*	Called with the sensor entered, before begin is called again.
+*/
+static void WakeForReset(
+	SSensor&	inSensor)
+{
+	if (inSensor.poweredDown)
+	{
+		WDTCSR = 0;	// As after the reset that begin follows
+		WakeSensor(inSensor, HostClock::Nanos());
+	}
+	inSensor.can->Reset();	// The RESET pin isn't modelled
+}
+
+/******************************* PowerDownWake ********************************/
+/*
+*	Called with the powered down sensor entered.  Returns true when INT0 or
+*	the watchdog wakes it.  The watchdog ticks every 16ms << WDP3:0 from the
+*	power-down.
+*/
+static bool PowerDownWake(
+	SSensor&	inSensor)
+{
+	uint64_t	now = HostClock::Nanos();
+	bool		woke = inSensor.intWoke;
+	if (!woke &&
+		(WDTCSR & _BV(WDIE)))
+	{
+		uint8_t		wdp = (WDTCSR & (_BV(WDP2) | _BV(WDP1) | _BV(WDP0))) |
+							((WDTCSR & _BV(WDP3)) ? 8 : 0);
+		uint64_t	tickNanos = (uint64_t)16000000 << wdp;
+		if (now - inSensor.sleepNanos >= tickNanos)
+		{
+			now = inSensor.sleepNanos + tickNanos;
+			WDT_vect();
+			woke = true;
+		}
+	}
+	if (woke)
+	{
+		WakeSensor(inSensor, now);
+	}
+	return(woke);
+}
+
+/********************************* RunSensors *********************************/
+/*
+*	Runs the sensors' loop, Update then Sleep.  A sensor that power-down
+*	sleeps isn't run till PowerDownWake.
+*/
+static void RunSensors(void)
+{
+	bool	sampleHall = HostClock::Nanos() >= sNextHallNanos;
+	if (sampleHall)
+	{
+		sNextHallNanos += kHallSampleNanos;
+	}
+	for (uint8_t i = 0; i < sNumSensors; i++)
+	{
+		if (sSensors[i].stopped)
+		{
+			continue;
+		}
+		SSensor&	sensor = sSensors[i];
+		sRunningSensor = i;
+		sensor.intWoke = false;
+		sensor.node->Enter();	// Delivers a latched INT0, see SensorInt
+		if (sensor.poweredDown &&
+			!PowerDownWake(sensor))
+		{
+			sensor.node->Leave();
+			continue;
+		}
+		SensorADC(sampleHall);
+		sensor.gateSensor->Update();
+		sensor.gateSensor->Sleep();
+		if (HostIO::sSleeping == SLEEP_MODE_PWR_DOWN + 1)
+		{
+			sensor.poweredDown = true;
+			sensor.sleepNanos = HostClock::Nanos();
+		} else
+		{
+			HostIO::sSleeping = 0;
+		}
+		sensor.node->Leave();
+	}
+}
+
+/********************************* ServiceBus *********************************/
+/*
+*	Called by HostClock every time the clock advances.  Services the bus and
+*	runs the sensors' loop at their loop period.
+*/
+static void ServiceBus(void)
+{
+	static bool	inHook;
+	if (!inHook)
+	{
+		inHook = true;
+		canBus.Service();
+		if (HostClock::Nanos() >= sNextSensorNanos)
+		{
+			sNextSensorNanos += kSensorLoopNanos;
+			RunSensors();
+		}
+		inHook = false;
+	}
+}
+
+/********************************* AddSensor **********************************/
+static void AddSensor(
+	uint32_t	inID)
+{
+	SSensor&	sensor = sSensors[sNumSensors];
+	sRunningSensor = sNumSensors;
+	sensor.node = new HostNode;
+	sensor.node->Enter();
+	if (inID)
+	{
+		EEPROM.put(DCSConfig::kCAN_ID_Addr, inID);
+	}
+	HostPins::SetAnalogReader(ReadHall);
+	sensor.can = new HostMCP2515(DCSConfig::kCSPin);
+	sensor.can->SetNode(sensor.node);
+	sensor.node->SetIntPin(kSensorIntPin, SensorInt);
+	canBus.Attach(sensor.can);
+	SPI.begin();
+	sensor.gateSensor = new DCGateSensor;
+	sensor.gateSensor->begin();
+	sensor.node->Leave();
+	sNumSensors++;
+}
+
+/************************************ Run *************************************/
+static void Run(
+	uint32_t	inMillis)
+{
+	uint32_t	start = millis();
+	while (millis() - start < inMillis)
+	{
+		loop();
+		HostClock::Advance(kStepMicros);
+	}
+}
+
+/***************************** SensorBusOffsCounted ****************************/
+static uint32_t SensorBusOffsCounted(void)
+{
+	uint32_t	busOffs = 0;
+	for (uint8_t i = 0; i < sNumSensors; i++)
+	{
+		busOffs += sSensors[i].gateSensor->GetErrorCounters().busOffs;
+	}
+	return(busOffs);
+}
+
+/******************************* ClearAllStats ********************************/
+static void ClearAllStats(void)
+{
+	canBus.ClearStats();
+	controllerCAN.ClearStats();
+	for (uint8_t i = 0; i < sNumSensors; i++)
+	{
+		sSensors[i].can->ClearStats();
+		sSensors[i].asleepNanos = 0;
+		sSensors[i].wakes = 0;
+		sSensors[i].intWakes = 0;
+	}
+	sStatsNanos = HostClock::Nanos();
+	SPITracer::Reset();
+	dustCollector.GetCANRecorder().Clear();
+	sRingOverflows = dustCollector.CANRxRingOverflows();
+	sOverruns = dustCollector.CANRxOverruns();
+	sSensorBusOffsCounted = SensorBusOffsCounted();
+	sQueueStats = dustCollector.CANQueueStats();
+	DeadlineMonitor::Reset();
+}
+
+/******************************** PrintReport *********************************/
+static void PrintReport(
+	const char*	inScenario,
+	uint32_t	inElapsed,
+	uint32_t	inExpectedOpenGates)
+{
+	const HostCANBus::SStats&	busStats = canBus.GetStats();
+	const HostMCP2515::SStats&	ctrlStats = controllerCAN.GetStats();
+	uint32_t	sensorTxErrors = 0;
+	uint32_t	sensorBusOffs = 0;
+	uint32_t	sensorPending = 0;
+	uint16_t	maxTEC = 0;
+	uint64_t	now = HostClock::Nanos();
+	uint64_t	asleepNanos = 0;
+	uint32_t	wakes = 0;
+	uint32_t	intWakes = 0;
+	for (uint8_t i = 0; i < sNumSensors; i++)
+	{
+		asleepNanos += sSensors[i].asleepNanos + AsleepSince(sSensors[i], now);
+		wakes += sSensors[i].wakes;
+		intWakes += sSensors[i].intWakes;
+		const HostMCP2515::SStats&	stats = sSensors[i].can->GetStats();
+		sensorTxErrors += stats.txErrors;
+		sensorBusOffs += stats.busOffs;
+		sensorPending += sSensors[i].can->GetPendingTxBuffer() >= 0;
+		if (sSensors[i].can->GetTEC() > maxTEC)
+		{
+			maxTEC = sSensors[i].can->GetTEC();
+		}
+	}
+	uint32_t	busyMS = (uint32_t)(busStats.busyNanos / 1000000);
+	printf("\n%s: %u ms\n", inScenario, inElapsed);
+	printf("  bus:        %u frames, %u error frames, %u ACK errors, %u collisions, %u arbitration losses, busy %u ms\n",
+		busStats.frames, busStats.errorFrames, busStats.ackErrors,
+		busStats.collisions, busStats.arbitrationLosses, busyMS);
+	printf("  controller: %u received, %u drained, %u rolled over, RX0OVR %u, RX1OVR %u, TEC %u, REC %u\n",
+		ctrlStats.framesReceived, ctrlStats.framesDrained, ctrlStats.rollovers,
+		ctrlStats.rx0Overflows, ctrlStats.rx1Overflows,
+		controllerCAN.GetTEC(), controllerCAN.GetREC());
+	if (ctrlStats.receivedAtFirstOverflow)
+	{
+		printf("              first overflow after %u received, %u drained\n",
+			ctrlStats.receivedAtFirstOverflow, ctrlStats.drainedAtFirstOverflow);
+	} else
+	{
+		printf("              no overflow\n");
+	}
+	if (ctrlStats.framesDrained)
+	{
+		printf("              %.1f SPI bytes, %.1f SPI transactions per drained frame\n",
+			(double)ctrlStats.spiBytes / ctrlStats.framesDrained,
+			(double)ctrlStats.spiTransactions / ctrlStats.framesDrained);
+		printf("              %.1f SPI bytes, %.1f SPI transactions of status and receive instructions per drained frame\n",
+			(double)ctrlStats.rxSpiBytes / ctrlStats.framesDrained,
+			(double)ctrlStats.rxSpiTransactions / ctrlStats.framesDrained);
+	}
+	{
+		const SPITracer::SDevice*	tft = SPITracer::Get(DCConfig::kDispCSPin);
+		const SPITracer::SDevice*	can = SPITracer::Get(DCConfig::kCANCSPin);
+		const SPITracer::SDevice*	bmpA = SPITracer::Get(DCConfig::kBMP1CSPin);
+		const SPITracer::SDevice*	bmpD = SPITracer::Get(DCConfig::kBMP0CSPin);
+		printf("              SPI held us (max): TFT %u (%u), MCP2515 %u (%u), BMP280 %u (%u)\n",
+			tft ? tft->held : 0, tft ? tft->maxHeld : 0,
+			can ? can->held : 0, can ? can->maxHeld : 0,
+			(bmpA ? bmpA->held : 0) + (bmpD ? bmpD->held : 0),
+			max(bmpA ? bmpA->maxHeld : 0, bmpD ? bmpD->maxHeld : 0));
+	}
+	printf("              receive ring: %u dropped (full), %u overruns reported by EFLG\n",
+		(uint16_t)(dustCollector.CANRxRingOverflows() - sRingOverflows),
+		(uint16_t)(dustCollector.CANRxOverruns() - sOverruns));
+	{
+		const DeadlineMonitor::STask&	pressure = DeadlineMonitor::Get(DustCollector::ePressureTask);
+		printf("              response latency %u ms, pressure reads: %u, max %u ms late, %u missed\n",
+			dustCollector.CANResponseLatency(), pressure.count, pressure.maxLate,
+			pressure.misses);
+	}
+	printf("              CAN recorder: %u recorded, %u overwritten\n",
+		dustCollector.GetCANRecorder().GetRecorded(),
+		dustCollector.GetCANRecorder().GetOverwritten());
+	{
+		const DustCollector::SCANQueueStats&	queueStats = dustCollector.CANQueueStats();
+		printf("              message queue: %u sent, %u coalesced, %u overflows, high water %u of %u since start\n",
+			ctrlStats.framesTransmitted,
+			(uint16_t)(queueStats.coalesced - sQueueStats.coalesced),
+			(uint16_t)(queueStats.overflows - sQueueStats.overflows),
+			queueStats.highWater, DCConfig::kCANQueueSize - 1);
+		printf("              requests: %u retries, %u timeouts\n",
+			(uint16_t)(queueStats.retries - sQueueStats.retries),
+			(uint16_t)(queueStats.timeouts - sQueueStats.timeouts));
+	}
+	printf("  sensors:    %u tx errors, %u bus off (%u counted), max TEC %u, %u still pending\n",
+		sensorTxErrors, sensorBusOffs, SensorBusOffsCounted() - sSensorBusOffsCounted,
+		maxTEC, sensorPending);
+	if (now > sStatsNanos)
+	{
+		printf("              powered down %.1f%% of the time, %u wake ups (%u by INT0)\n",
+			(double)asleepNanos * 100 / ((double)(now - sStatsNanos) * sNumSensors),
+			wakes, intWakes);
+	}
+	uint32_t	openGates = dustCollector.OpenGates();
+	printf("  open gates: 0x%08X, expected 0x%08X %s\n", openGates,
+		inExpectedOpenGates, openGates == inExpectedOpenGates ? "OK" : "MISMATCH");
+}
+
+/******************************** ToggleGates *********************************/
+/*
+*	All gates change state at the same time.
+*/
+static void ToggleGates(
+	uint32_t	inGatesMask)
+{
+	ClearAllStats();
+	sOpenGates = sOpenGates ? 0 : inGatesMask;
+	Run(2000);
+	PrintReport(sOpenGates ? "Toggle all gates open" : "Toggle all gates closed",
+				2000, sOpenGates);
+}
+
+/******************************* BroadcastRequest *****************************/
+/*
+*	A bus tool broadcasts eRequestGateState.  All sensors respond at once, in
+*	the protocol version they last received from the controller.
+*/
+static void BroadcastRequest(
+	const char*	inTitle)
+{
+	ClearAllStats();
+	CANFrame	request((uint16_t)DCController::eRequestGateState, DCConfig::kBroadcastID);
+	canBus.Inject(request.GetRawFrame());
+	Run(2000);
+	PrintReport(inTitle, 2000, sOpenGates);
+}
+
+/******************************* ForeignFrames ********************************/
+/*
+*	Frames outside the v2 command range from an extended ID that isn't the
+*	controller's shouldn't pass the controller's acceptance filters.
+*/
+static void ForeignFrames(void)
+{
+	ClearAllStats();
+	for (uint16_t command = 0x7F0; command <= 0x7FF; command++)
+	{
+		CANFrame	frame(command, (uint32_t)0x12345);
+		canBus.Inject(frame.GetRawFrame());
+		Run(10);
+	}
+	Run(100);
+	uint32_t	received = controllerCAN.GetStats().framesReceived;
+	printf("\nForeign standard IDs 0x7F0-0x7FF: controller received %u, expected 0 %s\n",
+		received, received == 0 ? "OK" : "MISMATCH");
+}
+
+/******************************** DisplayStall ********************************/
+/*
+*	The controller's loop() isn't called for inStallMillis, same as a long
+*	display update.  The update is a run of TFT SPI transactions of up to
+*	inHeldMicros.  As on the board, SPI.usingInterrupt masks INT2 during each
+*	transaction, so ExtIntReq2 only runs between them (endTransaction
+*	delivers a pending INT2.)
+*/
+static void DisplayStall(
+	uint32_t	inStallMillis,
+	uint32_t	inHeldMicros)
+{
+	SPISettings	tftSettings(15000000, MSBFIRST, SPI_MODE3);	// As TFT_ST77XX
+	uint64_t	end = HostClock::Nanos() + (uint64_t)inStallMillis * 1000000;
+	for (uint64_t now = HostClock::Nanos(); now < end; now = HostClock::Nanos())
+	{
+		uint32_t	remaining = (uint32_t)((end - now + 999) / 1000);
+		SPI.beginTransaction(tftSettings);
+		SPI_TRACE_BEGIN(DCConfig::kDispCSPin);
+		HostClock::Advance(remaining < inHeldMicros ? remaining : inHeldMicros);
+		SPI_TRACE_END();
+		SPI.endTransaction();
+	}
+}
+
+/********************************* InjectBurst ********************************/
+/*
+*	A bus tool sends two gate state frames per gate back to back, the second
+*	reporting the gate's actual state.  There are no collisions, the frames
+*	arrive as fast as the bus allows.  When inStallMillis is non-zero the
+*	controller is in a display update for that long after the burst starts,
+*	see DisplayStall.
+*/
+static void InjectBurst(
+	uint32_t	inGateBaseID,
+	uint32_t	inStallMillis,
+	uint32_t	inHeldMicros = kDisplayHeldMicros)
+{
+	ClearAllStats();
+	for (uint8_t pass = 0; pass < 2; pass++)
+	{
+		for (uint8_t i = 0; i < sNumSensors; i++)
+		{
+			bool	isOpen = ((sOpenGates >> i) & 1) == pass;
+			CANFrame	gateState(isOpen ? DCSensor::eGateIsOpen : DCSensor::eGateIsClosed,
+								DCConfig::kControllerID, inGateBaseID + i);
+			canBus.Inject(gateState.GetRawFrame());
+		}
+	}
+	DisplayStall(inStallMillis, inHeldMicros);
+	Run(2000);
+	char	title[96];
+	snprintf(title, sizeof(title), "Burst of gate state frames, controller stalled %u ms, SPI held %u us",
+		inStallMillis, inStallMillis ? inHeldMicros : 0);
+	PrintReport(title, inStallMillis + 2000, sOpenGates);
+}
+
+/*********************************** PollAll **********************************/
+/*
+*	The controller requests the state of every registered gate.
+*/
+static void PollAll(void)
+{
+	ClearAllStats();
+	uint32_t	start = millis();
+	dustCollector.RequestAllGateStates();
+	while (!dustCollector.GateCheckDone() && millis() - start < 30000)
+	{
+		loop();
+		HostClock::Advance(kStepMicros);
+	}
+	uint32_t	elapsed = millis() - start;
+	PrintReport("Controller RequestAllGateStates", elapsed, sOpenGates);
+	printf("  unresponsive gates: 0x%08X\n", dustCollector.UnresponsiveGates());
+}
+
+/******************************* RepeatedCheck ********************************/
+/*
+*	While the controller checks the gates, Check Gates is pressed again and
+*	every gate's state is requested again every 20 ms, and the first gate's
+*	flasher is toggled on and off.  The repeats should be coalesced, not
+*	queued, and the flasher frames sent ahead of the queued requests.
+*/
+static void RepeatedCheck(void)
+{
+	ClearAllStats();
+	uint32_t	start = millis();
+	uint8_t		presses = 0;
+	dustCollector.RequestAllGateStates();
+	while ((presses < 10 || !dustCollector.GateCheckDone()) &&
+		millis() - start < 30000)
+	{
+		if (presses < 10 &&
+			millis() - start >= presses * 20U)
+		{
+			presses++;
+			dustCollector.RequestAllGateStates();
+			for (uint8_t i = 1; i <= sNumSensors; i++)
+			{
+				dustCollector.RequestGateState(i);
+			}
+			if (presses == 3 || presses == 6)
+			{
+				dustCollector.ToggleGateFlasher(1);
+			}
+		}
+		loop();
+		HostClock::Advance(kStepMicros);
+	}
+	uint32_t	elapsed = millis() - start;
+	PrintReport("Check Gates repeated 10 times during the check", elapsed, sOpenGates);
+	printf("  unresponsive gates: 0x%08X\n", dustCollector.UnresponsiveGates());
+	Run(1000);	// The requests still queued
+}
+
+/******************************** DeafenSensor ********************************/
+/*
+*	Stops sensor inIndex and fills its MCP2515 receive buffers with broadcast
+*	eStopFlash frames, so that the frames sent to it are lost (RXnOVR) till
+*	it runs again, same as a sensor busy or reset while the bus is noisy.
+*/
+static void DeafenSensor(
+	uint8_t	inIndex)
+{
+	sSensors[inIndex].stopped = true;
+	for (uint8_t i = 0; i < 2; i++)
+	{
+		CANFrame	stopFlash((uint16_t)DCController::eStopFlash, DCConfig::kBroadcastID);
+		canBus.Inject(stopFlash.GetRawFrame());
+	}
+	Run(20);
+}
+
+/******************************* RequestRetries *******************************/
+/*
+*	The controller requests the first gate's state while its sensor is deaf
+*	for inDeafMillis.  The request is resent with backoff, and fails after
+*	kCANMaxRetries when the sensor stays deaf too long.
+*/
+static void RequestRetries(
+	uint32_t	inDeafMillis)
+{
+	DeafenSensor(0);
+	ClearAllStats();
+	dustCollector.RequestGateState(1);
+	Run(inDeafMillis);
+	sSensors[0].stopped = false;
+	Run(3000);
+	char	title[64];
+	snprintf(title, sizeof(title), "Gate state request, first sensor deaf %u ms", inDeafMillis);
+	PrintReport(title, inDeafMillis + 3000, sOpenGates);
+	printf("  unresponsive gates: 0x%08X\n", dustCollector.UnresponsiveGates());
+	/*
+	*	The answer to another request clears the unresponsive mark.
+	*/
+	dustCollector.RequestGateState(1);
+	Run(1000);
+}
+
+/****************************** RegisterRetries *******************************/
+/*
+*	A new sensor with an unregistered ID reports its gate open, and is deaf
+*	when the controller sends eSetID.  The controller should resend eSetID
+*	till the sensor answers to its new ID.
+*/
+static void RegisterRetries(
+	uint32_t	inGateBaseID)
+{
+	Gates&		gates = dustCollector.GetGates();
+	uint16_t	numGates = gates.GetCount();
+	uint8_t		index = sNumSensors;
+	uint32_t	sensorID = (inGateBaseID ^ 0x1000) | DCConfig::kGateIndexMask;
+	HostClock::SetAdvanceHook(nullptr);	// AddSensor's begin advances the clock
+	AddSensor(sensorID);
+	HostClock::SetAdvanceHook(ServiceBus);
+	DeafenSensor(index);
+	ClearAllStats();
+	CANFrame	gateState(DCSensor::eGateIsOpen, DCConfig::kControllerID, sensorID);
+	canBus.Inject(gateState.GetRawFrame());
+	Run(600);
+	sSensors[index].stopped = false;
+	Run(3000);
+	PrintReport("New sensor registration, sensor deaf 600 ms", 3600, sOpenGates);
+	uint32_t	newID = SensorTimingProbe::ID(*sSensors[index].gateSensor);
+	bool	registered = gates.GetCount() == numGates + 1 &&
+							(newID & DCConfig::kBaseIDMask) == inGateBaseID &&
+							newID != sensorID;
+	printf("  gates: %u registered, sensor ID 0x%05X %s\n", gates.GetCount(),
+		newID, registered ? "OK" : "NOT REGISTERED");
+}
+
+/********************************* ResetSensor ********************************/
+/*
+*	The sensor's sketch starts over, its EEPROM is kept.
+*/
+static void ResetSensor(
+	uint8_t	inIndex)
+{
+	HostClock::SetAdvanceHook(nullptr);	// See SetProfile
+	sRunningSensor = inIndex;
+	sSensors[inIndex].node->Enter();
+	WakeForReset(sSensors[inIndex]);
+	sSensors[inIndex].gateSensor->begin();
+	sSensors[inIndex].node->Leave();
+	HostClock::SetAdvanceHook(ServiceBus);
+}
+
+/********************************* Heartbeats *********************************/
+/*
+*	The first sensor stops running (its MCP2515 still acknowledges frames.)
+*	The controller should mark its gate unresponsive from the missing
+*	heartbeats alone, without a gate state request.  The sensor is then
+*	reset.  It keeps the protocol the poll set, so its heartbeats should
+*	clear the gate's unresponsive state and go on being tracked.
+*/
+static void Heartbeats(void)
+{
+	ClearAllStats();
+	sSensors[0].stopped = true;
+	uint32_t	elapsed = DCConfig::kGateHeartbeatTimeout + 2 * DCSConfig::kHeartbeatPeriod;
+	Run(elapsed);
+	sSensors[0].stopped = false;
+	PrintReport("Heartbeats, first sensor stopped", elapsed, sOpenGates);
+	printf("  unresponsive gates: 0x%08X, expected 0x00000001 %s\n",
+		dustCollector.UnresponsiveGates(),
+		dustCollector.UnresponsiveGates() == 1 ? "OK" : "MISMATCH");
+
+	ResetSensor(0);
+	ClearAllStats();
+	Run(elapsed);
+	PrintReport("Heartbeats, first sensor reset", elapsed, sOpenGates);
+	bool	tracked = (dustCollector.HeartbeatGates() & 1) != 0;
+	printf("  unresponsive gates: 0x%08X, expected 0x00000000, first gate %s %s\n",
+		dustCollector.UnresponsiveGates(), tracked ? "tracked" : "not tracked",
+		dustCollector.UnresponsiveGates() == 0 && tracked ? "OK" : "MISMATCH");
+}
+
+/********************************* NoisyHall **********************************/
+/*
+*	The first gate's Hall value sits at the threshold with +/-80 of noise for
+*	2 seconds, then moves slowly through it to the opposite state.  The
+*	controller should see the gate change state once.
+*/
+static void NoisyHall(void)
+{
+	ClearAllStats();
+	uint8_t		isOpen = sOpenGates & 1;
+	int			target = isOpen ? 1023 : 100;
+	uint32_t	changes = 0;
+	uint32_t	start = millis();
+	sNoisyHall = DCSConfig::kHallThreshold;
+	sRawIsOpen = isOpen;
+	sRawCrossings = 0;
+	sNoisyGate = 0;
+	while (millis() - start < 4000)
+	{
+		uint32_t	elapsed = millis() - start;
+		if (elapsed >= 2000 && elapsed < 3000)
+		{
+			sNoisyHall = DCSConfig::kHallThreshold +
+				(target - (int)DCSConfig::kHallThreshold) * (int)(elapsed - 2000) / 1000;
+		}
+		loop();
+		HostClock::Advance(kStepMicros);
+		if ((dustCollector.OpenGates() & 1) != isOpen)
+		{
+			isOpen = !isOpen;
+			changes++;
+		}
+	}
+	sNoisyGate = 0xFF;
+	sOpenGates ^= 1;
+	PrintReport("Noisy Hall sensor on the first gate", 4000, sOpenGates);
+	printf("  gate changes seen by the controller: %u, expected 1 %s (%u threshold crossings by single conversions)\n",
+		changes, changes == 1 ? "OK" : "MISMATCH", sRawCrossings);
+}
+
+/******************************** CalibrateHall *******************************/
+/*
+*	The first gate's magnet is moved away so that its sensor reads it open
+*	when it's closed.  The gate is calibrated while it's opened and closed
+*	twice, after which the controller should see its actual state.
+*/
+static void CalibrateHall(void)
+{
+	sWeakGate = 0;
+	sOpenGates &= ~1;
+	Run(1000);
+	bool	openBefore = dustCollector.OpenGates() & 1;
+	ClearAllStats();
+	dustCollector.CalibrateGate(1);
+	Run(1000);
+	for (uint8_t i = 0; i < 4; i++)
+	{
+		sOpenGates ^= 1;
+		Run(2000);
+	}
+	Run(DCSConfig::kCalibratePeriod - 8000);
+	PrintReport("Hall calibration of the first gate, magnet moved away",
+		DCSConfig::kCalibratePeriod + 1000, sOpenGates);
+	const DCSensor::SHallCalibration&	calibration = dustCollector.GateCalibration();
+	printf("  gate %u calibration: threshold %u, hysteresis %u, closed %u, open %u (closed gate read %s before)\n",
+		dustCollector.CalibratedGate(), calibration.threshold, calibration.hysteresis,
+		calibration.closedValue, calibration.openValue, openBefore ? "open" : "closed");
+	sOpenGates |= 1;
+	Run(1000);
+	bool	openAfter = dustCollector.OpenGates() & 1;
+	sOpenGates &= ~1;
+	Run(1000);
+	bool	calibrated = dustCollector.CalibratedGate() == 1 &&
+							calibration.result == DCSensor::eCalibrationSaved && openAfter &&
+							(dustCollector.OpenGates() & 1) == 0;
+	printf("  opened and closed after: %s\n", calibrated ? "OK" : "MISMATCH");
+	/*
+	*	Calibrating again without moving the gate is rejected and the
+	*	threshold just saved is kept.
+	*/
+	uint16_t	threshold = calibration.threshold;
+	dustCollector.CalibrateGate(1);
+	Run(DCSConfig::kCalibratePeriod + 1000);
+	bool	kept = dustCollector.CalibratedGate() == 1 &&
+							calibration.result == DCSensor::eCalibrationKept &&
+							calibration.threshold == threshold;
+	printf("  gate not moved, calibration kept: %s\n", kept ? "OK" : "MISMATCH");
+	sWeakGate = 0xFF;
+	Run(1000);
+}
+
+/********************************* SetProfile *********************************/
+/*
+*	Resets every node's MCP2515 with the CANBitTiming registers of inProfile
+*	and runs the bus at the profile's bit rate.
+*/
+static void SetProfile(
+	CANBitTiming::EProfile	inProfile)
+{
+	CANBitTiming::SConfig	config = CANBitTiming::Config(DCConfig::kCANOscFreq, inProfile);
+	canBus.SetBitRate(CANBitTiming::kProfile[inProfile].bitRate);
+	/*
+	*	begin's reset delays advance the clock, the sensors mustn't run
+	*	till all of the nodes are reset.
+	*/
+	HostClock::SetAdvanceHook(nullptr);
+	controllerCAN.Reset();	// The RESET pin isn't modelled
+	ControllerTimingProbe::Begin(config.cnf);
+	for (uint8_t i = 0; i < sNumSensors; i++)
+	{
+		sRunningSensor = i;
+		sSensors[i].node->Enter();
+		WakeForReset(sSensors[i]);
+		SensorTimingProbe::Begin(*sSensors[i].gateSensor, config.cnf);
+		sSensors[i].node->Leave();
+	}
+	HostClock::SetAdvanceHook(ServiceBus);
+}
+
+/********************************** Profiles **********************************/
+/*
+*	For each CANBitTiming profile the nodes are reconfigured, then the burst
+*	(no stall) checks the controller's receive path at that bit rate and the
+*	controller polls all gates.  The nodes are left at the sketches' profile.
+*/
+static void Profiles(
+	uint32_t	inGateBaseID,
+	uint32_t	inGatesMask)
+{
+	sOpenGates = inGatesMask & 0x55555555;
+	for (uint8_t profile = 0; profile < CANBitTiming::eNumProfiles; profile++)
+	{
+		SetProfile((CANBitTiming::EProfile)profile);
+		Run(1000);
+		uint8_t	matching = 0;
+		for (uint8_t i = 0; i < sNumSensors; i++)
+		{
+			matching += sSensors[i].can->BitRateMatches(canBus.GetBitRate());
+		}
+		printf("\nProfile %u bps: CNF1-3 0x%02X 0x%02X 0x%02X, controller %u bps (sample point %u.%u%%), %u of %u sensors match\n",
+			canBus.GetBitRate(), controllerCAN.Peek(HostMCP2515::eCNF1Reg),
+			controllerCAN.Peek(HostMCP2515::eCNF2Reg), controllerCAN.Peek(HostMCP2515::eCNF3Reg),
+			controllerCAN.GetBitRate(), controllerCAN.GetSamplePoint()/10,
+			controllerCAN.GetSamplePoint()%10, matching, sNumSensors);
+		InjectBurst(inGateBaseID, 0);
+		PollAll();
+	}
+	SetProfile(DCConfig::kCANProfile);
+	Run(1000);
+}
+
+/*********************************** main *************************************/
+int main(
+	int		argc,
+	char*	argv[])
+{
+	uint32_t	numSensors = argc > 1 ? strtoul(argv[1], nullptr, 0) : kMaxSensors;
+	uint32_t	bitRate = argc > 2 ? strtoul(argv[2], nullptr, 0) : 40000;
+	const char*	scenario = argc > 3 ? argv[3] : "all";
+	if (numSensors < 1 || numSensors > kMaxSensors || bitRate == 0)
+	{
+		fprintf(stderr, "usage: %s [sensors [bit rate [toggle|broadcast|burst|poll|repeat|retry|noise|calibrate|profiles|all [log]]]]\n", argv[0]);
+		return(1);
+	}
+	if (argc > 4)
+	{
+		sLog = fopen(argv[4], "w");
+		if (!sLog)
+		{
+			perror(argv[4]);
+			return(1);
+		}
+		canBus.SetMonitor(LogFrame);
+	}
+	bool	all = strcmp(scenario, "all") == 0;
+
+	controllerCAN.SetNode(&controllerNode);
+	controllerNode.SetIntPin(DCConfig::kCANIntPin, ControllerInt);
+	canBus.SetBitRate(bitRate);
+	canBus.Attach(&controllerCAN);
+
+	HardwareSerial::sEnabled = false;	// The reports are written to stdout
+	setup();
+	profileDumpPeriod.Set(0);
+	spiTraceDumpPeriod.Set(0);
+	eepromTraceDumpPeriod.Set(0);
+	deadlineDumpPeriod.Set(0);
+	/*
+	*	Register the gates with the controller and give each sensor the ID
+	*	the controller assigned.
+	*/
+	uint32_t	gateBaseID;
+	EEPROM.get(DCConfig::kGateBaseIDAddr, gateBaseID);
+	gateBaseID &= DCConfig::kBaseIDMask;
+	Gates&	gates = dustCollector.GetGates();
+	while (gates.GetCount() < numSensors &&
+		gates.AddNew()){}
+	for (uint8_t i = 0; i < numSensors; i++)
+	{
+		AddSensor(gateBaseID + i);
+	}
+	uint32_t	gatesMask = numSensors == 32 ? 0xFFFFFFFF : (((uint32_t)1 << numSensors) - 1);
+	sNextSensorNanos = HostClock::Nanos();
+	sNextHallNanos = sNextSensorNanos;
+	HostClock::SetAdvanceHook(ServiceBus);
+	Run(1000);
+
+	printf("%u sensors, bus %u bps, controller %u bps (sample point %u.%u%%)\n",
+		numSensors, bitRate, controllerCAN.GetBitRate(),
+		controllerCAN.GetSamplePoint()/10, controllerCAN.GetSamplePoint()%10);
+	if (all || strcmp(scenario, "toggle") == 0)
+	{
+		ToggleGates(gatesMask);
+		ToggleGates(gatesMask);
+	}
+	if (all || strcmp(scenario, "broadcast") == 0)
+	{
+		sOpenGates = gatesMask & 0x55555555;
+		Run(2000);
+		BroadcastRequest("Broadcast gate state request, protocol v1");
+		ForeignFrames();
+	}
+	if (all || strcmp(scenario, "burst") == 0)
+	{
+		InjectBurst(gateBaseID, 0);
+		InjectBurst(gateBaseID, kStallMillis);
+		/*
+		*	A display update in one SPI transaction masks INT2 throughout.
+		*/
+		InjectBurst(gateBaseID, kStallMillis, kStallMillis * 1000);
+	}
+	if (all || strcmp(scenario, "poll") == 0)
+	{
+		PollAll();
+		/*
+		*	The poll switched the sensors to protocol v2.
+		*/
+		if (all)
+		{
+			BroadcastRequest("Broadcast gate state request, protocol v2");
+			Heartbeats();
+		}
+	}
+	if (all || strcmp(scenario, "repeat") == 0)
+	{
+		RepeatedCheck();
+	}
+	if (all || strcmp(scenario, "retry") == 0)
+	{
+		RequestRetries(300);
+		RequestRetries(3000);
+		if (numSensors < kMaxSensors)
+		{
+			RegisterRetries(gateBaseID);
+		}
+	}
+	if (all || strcmp(scenario, "noise") == 0)
+	{
+		NoisyHall();
+	}
+	if (all || strcmp(scenario, "calibrate") == 0)
+	{
+		CalibrateHall();
+	}
+	if (all || strcmp(scenario, "profiles") == 0)
+	{
+		Profiles(gateBaseID, gatesMask);
+	}
+	if (sLog)
+	{
+		fclose(sLog);
+	}
+	return(0);
+}
@@ -0,0 +1,733 @@
+/*
+*	DCCANReplay.cpp, Copyright Jonathan Mackey 2021
+*	Replays a captured CAN log through the controller's
+*	DustCollector::HandleReceivedFrame and SendQueuedMessages with the
+*	original frame timing, and reports the open gates, unresponsive gates,
+*	gate set and CAN message queue depth over time.
+*
+*	usage: DCCANReplay log [gates|EEPROM image [poll|nopoll]]
+*		log			a candump log (text) or a CANRecorder drain file (.bin,
+*					e.g. CANLog.bin from the controller's SD card.)
+*		gates		the number of registered gates.  The default is the
+*					highest gate index seen in the log.  The gate base ID is
+*					taken from the gate state frames in the log.
+*		EEPROM image
+*					a file containing the controller's EEPROM.  The gates,
+*					gate sets and gate base ID are taken from the image.
+*		poll		the controller calls RequestAllGateStates when the
+*					replay starts, as DustCollector::begin does (default.)
+*					nopoll replays the log's frames only.
+*
+*	Text logs: both the candump -L format, "(1.000000) can0 0000A001#0100",
+*	and the candump default format, "can0  0000A001   [2]  01 00", optionally
+*	with a timestamp and TX/RX columns, are accepted.  Lines without a
+*	timestamp are 1 ms apart.  Extended IDs are 8 hex digits.
+*
+*	Only the frames the controller's receive filter accepts (extended frames
+*	sent to kControllerID) are passed to HandleReceivedFrame.  Frames sent by
+*	the controller in the log (flagged as sent in a .bin log) are skipped
+*	because the replayed controller sends its own.  The frames the replayed
+*	controller sends are ACKed by a simulated bus tool and listed.
+*
+*	As in CheckGates, SendQueuedMessages sends the queued messages while one
+*	of the 3 Tx buffers is free, waiting kCANSettlePeriod after eSetID and
+*	before eCheckGateStateResponses.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#include <stdio.h>
+#include <ctype.h>
+#include <vector>	// Before Arduino.h, which defines min and max
+#include "DCController.ino"
+#include "DCMessages.h"
+#include "HostBMP280.h"
+#include "HostNode.h"
+#include "HostMCP2515.h"
+#include "HostCANBus.h"
+
+const uint32_t	kStepMicros = 1000;		// While messages are queued
+const uint32_t	kTailMillis = 2000;		// Run after the last frame
+const uint32_t	kCAN_EFF_FLAG = 0x80000000;
+const uint32_t	kCAN_RTR_FLAG = 0x40000000;
+const uint32_t	kCAN_ERR_FLAG = 0x20000000;
+
+HostNode		controllerNode(true);
+HostBMP280		bmp280Ambient(DCConfig::kBMP1CSPin);
+HostBMP280		bmp280Duct(DCConfig::kBMP0CSPin);
+HostMCP2515		controllerCAN(DCConfig::kCANCSPin);
+HostCANBus		canBus;
+
+struct SLogFrame
+{
+	uint64_t	micros;		// Log time
+	uint32_t	canID;		// SocketCAN can_id including the flags
+	uint8_t		len;
+	uint8_t		flags;		// 1 = sent by the controller
+	uint8_t		data[8];
+};
+
+struct SSnapshot
+{
+	uint32_t	openGates;
+	uint32_t	unresponsiveGates;
+	uint32_t	unregisteredGateID;
+	uint8_t		gateSet;
+	uint8_t		gates;
+};
+
+class ReplayProbe : public DustCollector
+{
+public:
+	static void				Receive(
+								CANFrame&				inCANFrame)
+								{(dustCollector.*(&ReplayProbe::HandleReceivedFrame))(inCANFrame);}
+	static void				SendQueued(void)
+								{(dustCollector.*(&ReplayProbe::SendQueuedMessages))();}
+	static uint8_t			QueueDepth(void)
+								{return((dustCollector.*(&ReplayProbe::mCANMessageQueueTail) -
+									dustCollector.*(&ReplayProbe::mCANMessageQueueHead) +
+									DCConfig::kCANQueueSize) % DCConfig::kCANQueueSize);}
+};
+
+static uint64_t	sStartNanos;	// Host time of log time 0
+static uint32_t	sFramesSent;
+
+/******************************** ReplayMillis ********************************/
+static double ReplayMillis(void)
+{
+	return((double)(HostClock::Nanos() - sStartNanos) / 1000000);
+}
+
+/******************************** CommandName *********************************/
+static const char* CommandName(
+	uint16_t	inCommand)
+{
+	switch (inCommand)
+	{
+		case DCSensor::eGateIsOpen:					return("eGateIsOpen");
+		case DCSensor::eGateIsClosed:				return("eGateIsClosed");
+		case DCSensor::eTimestamp:					return("eTimestamp");
+		case DCSensor::eGateIsOpenV2:				return("eGateIsOpenV2");
+		case DCSensor::eGateIsClosedV2:				return("eGateIsClosedV2");
+		case DCSensor::eRequestSnapshot:			return("eRequestSnapshot");
+		case DCSensor::eHeartbeatV2:				return("eHeartbeatV2");
+		case DCSensor::eErrorCountersV2:			return("eErrorCountersV2");
+		case DCSensor::eCalibrationV2:				return("eCalibrationV2");
+		case DCController::eRequestGateState:		return("eRequestGateState");
+		case DCController::eFlash:					return("eFlash");
+		case DCController::eStopFlash:				return("eStopFlash");
+		case DCController::eSetID:					return("eSetID");
+		case DCController::eSetFactoryID:			return("eSetFactoryID");
+		case DCController::eRequestTimestamp:		return("eRequestTimestamp");
+		case DCController::ePollGateStates:			return("ePollGateStates");
+		case DCController::eGateSnapshot:			return("eGateSnapshot");
+		case DCController::eRequestErrorCounters:	return("eRequestErrorCounters");
+		case DCController::eCalibrate:				return("eCalibrate");
+	}
+	return("?");
+}
+
+/******************************** ControllerInt *******************************/
+/*
+*	HandleReceivedFrame is called directly, the controller's interrupt only
+*	frees the sent Tx buffers.
+*/
+static void ControllerInt(void)
+{
+	HostPins::RaiseInterrupt(digitalPinToInterrupt(DCConfig::kCANIntPin));
+}
+
+/********************************* ServiceBus *********************************/
+static void ServiceBus(void)
+{
+	static bool	inHook;
+	if (!inHook)
+	{
+		inHook = true;
+		canBus.Service();
+		inHook = false;
+	}
+}
+
+/******************************** MonitorFrame ********************************/
+/*
+*	Bus monitor, lists the frames sent by the replayed controller.
+*/
+static void MonitorFrame(
+	const uint8_t*	inRawFrame,
+	uint64_t		inNanos)
+{
+	CANFrame	canFrame(inRawFrame);
+	sFramesSent++;
+	printf("  %10.3f  sent %s to 0x%05X", ReplayMillis() / 1000,
+		CommandName(canFrame.GetStandardID()), canFrame.GetExtendedID());
+	if (canFrame.GetDataLen() >= 4)
+	{
+		printf(", 0x%05X", *(const uint32_t*)canFrame.GetData());
+	}
+	if (canFrame.GetDataLen() == 8)
+	{
+		printf(", 0x%05X", ((const uint32_t*)canFrame.GetData())[1]);
+	}
+	printf("\n");
+}
+
+/********************************** HexValue **********************************/
+static int HexValue(
+	char	inChar)
+{
+	return(isdigit(inChar) ? inChar - '0' :
+		(isxdigit(inChar) ? (toupper(inChar) - 'A' + 10) : -1));
+}
+
+/********************************** ParseID ***********************************/
+/*
+*	Returns the SocketCAN can_id of an ID column.  As in candump, 8 hex digits
+*	is an extended ID.
+*/
+static bool ParseID(
+	const char*	inToken,
+	size_t		inLen,
+	uint32_t&	outCANID)
+{
+	bool	success = (inLen == 3 || inLen == 8);
+	outCANID = 0;
+	for (size_t i = 0; success && i < inLen; i++)
+	{
+		int	value = HexValue(inToken[i]);
+		success = value >= 0;
+		outCANID = (outCANID << 4) + value;
+	}
+	if (inLen == 8 && !(outCANID & kCAN_ERR_FLAG))
+	{
+		outCANID |= kCAN_EFF_FLAG;
+	}
+	return(success);
+}
+
+/******************************* ParseCandumpLine *****************************/
+static bool ParseCandumpLine(
+	char*		inLine,
+	SLogFrame&	outFrame,
+	bool&		outHasTime)
+{
+	memset(&outFrame, 0, sizeof(SLogFrame));
+	std::vector<char*>	tokens;
+	for (char* token = strtok(inLine, " \t\r\n"); token; token = strtok(nullptr, " \t\r\n"))
+	{
+		tokens.push_back(token);
+	}
+	size_t	ti = 0;
+	outHasTime = false;
+	if (ti < tokens.size() && tokens[ti][0] == '(')
+	{
+		unsigned long long	seconds;
+		unsigned long		usec;
+		if (sscanf(tokens[ti], "(%llu.%lu)", &seconds, &usec) != 2)
+		{
+			return(false);
+		}
+		outFrame.micros = seconds * 1000000 + usec;
+		outHasTime = true;
+		ti++;
+	}
+	ti++;	// Interface
+	for (; ti < tokens.size() && (strcmp(tokens[ti], "TX") == 0 ||
+			strcmp(tokens[ti], "RX") == 0 || strcmp(tokens[ti], "-") == 0); ti++)
+	{
+		if (strcmp(tokens[ti], "TX") == 0)
+		{
+			outFrame.flags = 1;
+		}
+	}
+	if (ti >= tokens.size())
+	{
+		return(false);
+	}
+	char*	id = tokens[ti++];
+	char*	hash = strchr(id, '#');
+	if (hash)
+	{
+		// candump -L, ID#DATA or ID#R
+		if (!ParseID(id, hash - id, outFrame.canID))
+		{
+			return(false);
+		}
+		const char*	data = hash + 1;
+		if (*data == 'R')
+		{
+			outFrame.canID |= kCAN_RTR_FLAG;
+			if (isdigit(data[1]))
+			{
+				outFrame.len = data[1] - '0';
+			}
+		} else
+		{
+			while (outFrame.len < 8 && *data)
+			{
+				if (*data == '.')
+				{
+					data++;
+					continue;
+				}
+				int	hi = HexValue(data[0]);
+				int	lo = HexValue(data[1]);
+				if (hi < 0 || lo < 0)
+				{
+					return(false);
+				}
+				outFrame.data[outFrame.len++] = (hi << 4) + lo;
+				data += 2;
+			}
+		}
+	} else
+	{
+		// candump, ID [len] XX XX ...
+		if (!ParseID(id, strlen(id), outFrame.canID) ||
+			ti >= tokens.size() ||
+			sscanf(tokens[ti++], "[%hhu]", &outFrame.len) != 1 ||
+			outFrame.len > 8)
+		{
+			return(false);
+		}
+		if (ti < tokens.size() && strcmp(tokens[ti], "remote") == 0)
+		{
+			outFrame.canID |= kCAN_RTR_FLAG;
+		} else
+		{
+			for (uint8_t i = 0; i < outFrame.len; i++, ti++)
+			{
+				if (ti >= tokens.size() ||
+					HexValue(tokens[ti][0]) < 0 || HexValue(tokens[ti][1]) < 0)
+				{
+					return(false);
+				}
+				outFrame.data[i] = (HexValue(tokens[ti][0]) << 4) + HexValue(tokens[ti][1]);
+			}
+		}
+	}
+	return(true);
+}
+
+/******************************** ReadCandumpLog ******************************/
+static bool ReadCandumpLog(
+	FILE*					inFile,
+	const char*				inName,
+	std::vector<SLogFrame>&	outFrames)
+{
+	char		line[256];
+	uint32_t	lineNum = 0;
+	uint64_t	lastMicros = 0;
+	while (fgets(line, sizeof(line), inFile))
+	{
+		lineNum++;
+		const char*	start = line;
+		while (isspace(*start))
+		{
+			start++;
+		}
+		if (*start == 0 ||
+			*start == '#')
+		{
+			continue;
+		}
+		SLogFrame	frame;
+		bool		hasTime;
+		if (!ParseCandumpLine(line, frame, hasTime))
+		{
+			fprintf(stderr, "%s:%u: not a candump line\n", inName, lineNum);
+			return(false);
+		}
+		if (!hasTime)
+		{
+			frame.micros = outFrames.empty() ? 0 : lastMicros + 1000;
+		}
+		lastMicros = frame.micros;
+		outFrames.push_back(frame);
+	}
+	return(true);
+}
+
+/********************************* ReadBinaryLog ******************************/
+/*
+*	The CANRecorder drain format, 24 byte little endian records.
+*/
+static bool ReadBinaryLog(
+	FILE*					inFile,
+	const char*				inName,
+	std::vector<SLogFrame>&	outFrames)
+{
+	uint8_t	record[CANRecorder::eDrainRecordSize];
+	size_t	bytesRead;
+	while ((bytesRead = fread(record, 1, sizeof(record), inFile)) == sizeof(record))
+	{
+		SLogFrame	frame;
+		uint32_t	seconds = record[0] | (record[1] << 8) | (record[2] << 16) | ((uint32_t)record[3] << 24);
+		uint32_t	usec = record[4] | (record[5] << 8) | (record[6] << 16) | ((uint32_t)record[7] << 24);
+		frame.micros = (uint64_t)seconds * 1000000 + usec;
+		frame.canID = record[8] | (record[9] << 8) | (record[10] << 16) | ((uint32_t)record[11] << 24);
+		frame.len = record[12] > 8 ? 8 : record[12];
+		frame.flags = record[13];
+		memcpy(frame.data, &record[16], 8);
+		outFrames.push_back(frame);
+	}
+	if (bytesRead)
+	{
+		fprintf(stderr, "%s: partial record at the end ignored\n", inName);
+	}
+	return(true);
+}
+
+/********************************* ToCANFrame ********************************/
+static CANFrame ToCANFrame(
+	const SLogFrame&	inFrame)
+{
+	CANFrame	canFrame;
+	if (inFrame.canID & kCAN_EFF_FLAG)
+	{
+		canFrame = CANFrame((uint16_t)((inFrame.canID >> 18) & 0x7FF),
+			inFrame.canID & 0x3FFFF, inFrame.len, inFrame.data);
+	} else
+	{
+		canFrame = CANFrame((uint16_t)(inFrame.canID & 0x7FF), inFrame.len, inFrame.data);
+	}
+	return(canFrame);
+}
+
+/******************************* IsForController ******************************/
+/*
+*	Same as the controller's receive filters: the controller ID, or a protocol
+*	v2 sensor command from any sensor ID.
+*/
+static inline bool IsForController(
+	const SLogFrame&	inFrame)
+{
+	return((inFrame.canID & (kCAN_EFF_FLAG | kCAN_ERR_FLAG)) == kCAN_EFF_FLAG &&
+		((inFrame.canID & 0x3FFFF) == DCConfig::kControllerID ||
+		(((inFrame.canID >> 18) & DCSensor::eV2CommandMask) ==
+			(DCSensor::eGateIsOpenV2 & DCSensor::eV2CommandMask))));
+}
+
+/******************************* GateStateSensorID ****************************/
+/*
+*	Returns true if inFrame is a gate state frame for the controller, v1 or
+*	v2 (including eHeartbeatV2), and the sensor ID it's from.
+*/
+static bool GateStateSensorID(
+	const SLogFrame&	inFrame,
+	uint32_t&			outSensorID)
+{
+	uint16_t	command = (inFrame.canID >> 18) & 0x7FF;
+	bool	isGateState = false;
+	if (inFrame.flags == 0 && IsForController(inFrame))
+	{
+		if (command == DCSensor::eGateIsOpenV2 || command == DCSensor::eGateIsClosedV2 ||
+			command == DCSensor::eHeartbeatV2)
+		{
+			outSensorID = inFrame.canID & 0x3FFFF;
+			isGateState = true;
+		} else if (inFrame.len >= 4 &&
+			(command == DCSensor::eGateIsOpen || command == DCSensor::eGateIsClosed))
+		{
+			outSensorID = *(const uint32_t*)inFrame.data;
+			isGateState = true;
+		}
+	}
+	return(isGateState);
+}
+
+/******************************** InferGates **********************************/
+/*
+*	Returns the most common base ID in the gate state frames and the number of
+*	gates needed to register the highest gate index seen with this base ID.
+*/
+static uint32_t InferGates(
+	const std::vector<SLogFrame>&	inFrames,
+	uint8_t&						outNumGates)
+{
+	std::vector<std::pair<uint32_t, uint32_t>>	counts;	// base ID, count
+	uint32_t	sensorID;
+	for (const SLogFrame& frame : inFrames)
+	{
+		if (GateStateSensorID(frame, sensorID))
+		{
+			uint32_t	baseID = sensorID & DCConfig::kBaseIDMask;
+			size_t	i = 0;
+			for (; i < counts.size() && counts[i].first != baseID; i++){}
+			if (i == counts.size())
+			{
+				counts.push_back(std::make_pair(baseID, 0));
+			}
+			counts[i].second++;
+		}
+	}
+	uint32_t	baseID = 0;
+	uint32_t	maxCount = 0;
+	for (auto& count : counts)
+	{
+		if (count.second > maxCount)
+		{
+			baseID = count.first;
+			maxCount = count.second;
+		}
+	}
+	outNumGates = 0;
+	for (const SLogFrame& frame : inFrames)
+	{
+		if (GateStateSensorID(frame, sensorID) &&
+			(sensorID & DCConfig::kBaseIDMask) == baseID)
+		{
+			uint8_t	gates = (sensorID & DCConfig::kGateIndexMask) + 1;
+			if (gates > outNumGates)
+			{
+				outNumGates = gates;
+			}
+		}
+	}
+	return(baseID);
+}
+
+/****************************** TakeSnapshot **********************************/
+static void TakeSnapshot(
+	SSnapshot&	outSnapshot)
+{
+	outSnapshot.openGates = dustCollector.OpenGates();
+	outSnapshot.unresponsiveGates = dustCollector.UnresponsiveGates();
+	outSnapshot.unregisteredGateID = dustCollector.UnregisteredGateID();
+	outSnapshot.gateSet = dustCollector.GetGateSets().GetCount() ?
+							dustCollector.GetGateSets().GetCurrentIndex() : 0;
+	outSnapshot.gates = dustCollector.GetGates().GetCount();
+}
+
+/******************************* PrintSnapshot ********************************/
+static void PrintSnapshot(
+	const SSnapshot&	inSnapshot)
+{
+	printf("  %10.3f  open 0x%08X  unresponsive 0x%08X  set %u  gates %u  queue %u",
+		ReplayMillis() / 1000, inSnapshot.openGates, inSnapshot.unresponsiveGates,
+		inSnapshot.gateSet, inSnapshot.gates, ReplayProbe::QueueDepth());
+	if (inSnapshot.unregisteredGateID)
+	{
+		printf("  unregistered 0x%05X", inSnapshot.unregisteredGateID);
+	}
+	printf("\n");
+}
+
+/*********************************** main *************************************/
+int main(
+	int		argc,
+	char*	argv[])
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s log [gates|EEPROM image [poll|nopoll]]\n", argv[0]);
+		return(1);
+	}
+	const char*	logName = argv[1];
+	std::vector<SLogFrame>	frames;
+	{
+		FILE*	file = fopen(logName, "rb");
+		if (!file)
+		{
+			perror(logName);
+			return(1);
+		}
+		size_t	nameLen = strlen(logName);
+		bool	success = nameLen > 4 && strcmp(&logName[nameLen - 4], ".bin") == 0 ?
+					ReadBinaryLog(file, logName, frames) :
+					ReadCandumpLog(file, logName, frames);
+		fclose(file);
+		if (!success)
+		{
+			return(1);
+		}
+	}
+	if (frames.empty())
+	{
+		fprintf(stderr, "%s: no frames\n", logName);
+		return(1);
+	}
+
+	/*
+	*	The gate configuration, from an EEPROM image or inferred from the log.
+	*/
+	uint8_t		numGates = 0;
+	bool		eepromImage = false;
+	uint32_t	gateBaseID = InferGates(frames, numGates);
+	if (argc > 2)
+	{
+		char*	end;
+		uint32_t	gates = strtoul(argv[2], &end, 0);
+		if (*end == 0 &&
+			gates <= 32)
+		{
+			numGates = gates;
+		} else
+		{
+			FILE*	file = fopen(argv[2], "rb");
+			if (!file)
+			{
+				perror(argv[2]);
+				return(1);
+			}
+			fread(HostEEPROM::sBytes, 1, E2END + 1, file);
+			fclose(file);
+			eepromImage = true;
+		}
+	}
+	if (!eepromImage)
+	{
+		EEPROM.put(DCConfig::kGateBaseIDAddr, gateBaseID);
+	}
+	bool	poll = argc <= 3 || strcmp(argv[3], "nopoll") != 0;
+
+	controllerCAN.SetNode(&controllerNode);
+	controllerNode.SetIntPin(DCConfig::kCANIntPin, ControllerInt);
+	canBus.Attach(&controllerCAN);
+	canBus.AttachTool();
+
+	HardwareSerial::sEnabled = false;	// The report is written to stdout
+	setup();
+	profileDumpPeriod.Set(0);
+	spiTraceDumpPeriod.Set(0);
+	eepromTraceDumpPeriod.Set(0);
+	deadlineDumpPeriod.Set(0);
+	if (!eepromImage)
+	{
+		Gates&	gates = dustCollector.GetGates();
+		while (gates.GetCount() < numGates &&
+			gates.AddNew()){}
+	}
+	EEPROM.get(DCConfig::kGateBaseIDAddr, gateBaseID);
+	HostClock::SetAdvanceHook(ServiceBus);
+	canBus.SetMonitor(MonitorFrame);
+
+	printf("%s: %u frames, %.3f s, gate base ID 0x%05X, %u gates%s\n", logName,
+		(uint32_t)frames.size(),
+		(double)(frames.back().micros - frames.front().micros) / 1000000,
+		gateBaseID & DCConfig::kBaseIDMask, dustCollector.GetGates().GetCount(),
+		eepromImage ? " (EEPROM image)" : "");
+
+	/*
+	*	Replay.  Time only advances in kStepMicros steps while messages are
+	*	queued, otherwise it jumps to the next frame.
+	*/
+	uint64_t	logStart = frames.front().micros;
+	uint64_t	logEnd = frames.back().micros - logStart + kTailMillis * 1000;
+	uint64_t	drainEnd = logEnd + (uint64_t)DCConfig::kCANQueueSize *
+							DCConfig::kCANSettlePeriod * 2000;
+	uint32_t	delivered = 0;
+	uint32_t	skippedSent = 0;
+	uint32_t	notForController = 0;
+	uint32_t	errorFrames = 0;
+	uint8_t		maxQueueDepth = 0;
+	uint64_t	queuedMicros = 0;
+	uint64_t	depthMicros = 0;	// Queue depth * time
+	size_t		next = 0;
+	SSnapshot	last;
+	sStartNanos = HostClock::Nanos();
+	if (poll)
+	{
+		dustCollector.RequestAllGateStates();
+	}
+	TakeSnapshot(last);
+	PrintSnapshot(last);
+	for (;;)
+	{
+		uint64_t	now = (HostClock::Nanos() - sStartNanos) / 1000;
+		for (; next < frames.size() && frames[next].micros - logStart <= now; next++)
+		{
+			const SLogFrame&	frame = frames[next];
+			if (frame.canID & kCAN_ERR_FLAG)
+			{
+				errorFrames++;
+				printf("  %10.3f  error frame 0x%08X", ReplayMillis() / 1000, frame.canID);
+				for (uint8_t i = 0; i < frame.len; i++)
+				{
+					printf(" %02X", frame.data[i]);
+				}
+				printf("\n");
+			} else if (frame.flags)
+			{
+				skippedSent++;
+			} else if (!IsForController(frame))
+			{
+				notForController++;
+			} else
+			{
+				CANFrame	canFrame = ToCANFrame(frame);
+				ReplayProbe::Receive(canFrame);
+				delivered++;
+			}
+		}
+		ReplayProbe::SendQueued();
+		SSnapshot	snapshot;
+		TakeSnapshot(snapshot);
+		if (memcmp(&snapshot, &last, sizeof(SSnapshot)))
+		{
+			PrintSnapshot(snapshot);
+			last = snapshot;
+		}
+		uint8_t	depth = ReplayProbe::QueueDepth();
+		if (depth > maxQueueDepth)
+		{
+			maxQueueDepth = depth;
+		}
+		now = (HostClock::Nanos() - sStartNanos) / 1000;
+		if (next >= frames.size() &&
+			now >= logEnd)
+		{
+			if (depth == 0)
+			{
+				break;
+			}
+			/*
+			*	All 3 Tx buffers stay full when nothing ACKs the frames.
+			*/
+			if (now >= drainEnd)
+			{
+				printf("  %10.3f  queue stalled, %u messages not sent\n",
+					ReplayMillis() / 1000, depth);
+				break;
+			}
+		}
+		uint64_t	step = kStepMicros;
+		if (depth == 0)
+		{
+			uint64_t	nextMicros = next < frames.size() ?
+							frames[next].micros - logStart : logEnd;
+			step = nextMicros > now ? nextMicros - now : kStepMicros;
+		} else
+		{
+			queuedMicros += step;
+			depthMicros += step * depth;
+		}
+		HostClock::AdvanceNanos(step * 1000);
+	}
+	printf("  frames: %u delivered, %u sent by the controller (skipped), %u not for the controller, %u error frames\n",
+		delivered, skippedSent, notForController, errorFrames);
+	printf("  replayed controller: %u frames sent\n", sFramesSent);
+	printf("  queue: max depth %u, not empty for %.3f s, mean depth %.1f while not empty\n",
+		maxQueueDepth, (double)queuedMicros / 1000000,
+		queuedMicros ? (double)depthMicros / queuedMicros : 0.0);
+	printf("  final: open gates 0x%08X, unresponsive 0x%08X, %u gates\n",
+		dustCollector.OpenGates(), dustCollector.UnresponsiveGates(),
+		dustCollector.GetGates().GetCount());
+	return(0);
+}
@@ -0,0 +1,438 @@
+/*
+*	DCDisplayBench.cpp, Copyright Jonathan Mackey 2021
+*	Measures the SPI traffic of the DCController display code and saves a
+*	screenshot of each UI mode.
+*
+*	The sketch is run with the DustCollectorUI drawing into a HostFrameBuffer
+*	rather than the TFT_ST7789.  For each DustCollectorUI mode the bytes sent
+*	by the full redraw and by the following (incremental) redraw are reported
+*	along with the bytes the TFT_ST7789 actually sent for the same redraw, then
+*	the FilterStatusMeter and each kind of DCInfoField are measured on their
+*	own, then the info screen is run for a minute of simulated time.  The SPI
+*	clock on an ATmega644PA at 16MHz is 8MHz, 1us per byte.
+*
+*	Usage: DCDisplayBench [output directory [reference directory]]
+*
+*	The screenshots are written to the output directory (default
+*	"build/screens", same as make screens) as <mode>.ppm.  When a reference
+*	directory is passed, each screenshot is compared with the file of the same
+*	name in the reference directory and the exit status is 1 if any differ.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#include "DCController.ino"
+#include "HostBMP280.h"
+#include "HostFrameBuffer.h"
+#include <stdio.h>
+#include <sys/stat.h>
+
+HostBMP280		bmp280Ambient(DCConfig::kBMP0CSPin);
+HostBMP280		bmp280Duct(DCConfig::kBMP1CSPin);
+HostFrameBuffer	frameBuffer(240, 240);
+
+extern "C" void TIMER2_OVF_vect(void);
+
+// 2021-06-01 10:09:08, so that the date and time fields are repeatable.
+const time32_t	kScreenshotTime = 1622542148;
+
+/*
+*	Counts what the TFT_ST7789 sends over SPI.
+*/
+class DisplaySPICounter : public HostSPIDevice
+{
+public:
+							DisplaySPICounter(
+								uint8_t					inCSPin)
+								: HostSPIDevice(inCSPin), mBytes(0), mTransactions(0)
+								{SPI.Attach(this);}
+	virtual void			Select(void)
+								{mTransactions++;}
+	virtual uint8_t			Transfer(
+								uint8_t					inByte)
+								{mBytes++; return(0);}
+	uint32_t	mBytes;
+	uint32_t	mTransactions;
+};
+DisplaySPICounter	displaySPI(DCConfig::kDispCSPin);
+
+/*
+*	Access to the DustCollectorUI internals.  The member pointers are taken
+*	via this subclass, which is allowed access to the protected members of
+*	its base.
+*/
+class UIProbe : public DustCollectorUI
+{
+public:
+	static const uint8_t	kModeCount = eCalibrationResultMode + 1;
+	static const uint8_t	kInfoMode = eInfoMode;
+	static const char*		ModeName(
+								uint8_t					inMode);
+	static void				ShowMode(
+								uint8_t					inMode);
+	static void				Redraw(void)
+								{(dustCollectorUI.*(&UIProbe::UpdateDisplay))();}
+	static FilterStatusMeter&	Meter(void)
+								{return(dustCollectorUI.*(&UIProbe::mFilterStatusMeter));}
+	static DCInfoField&		InfoField0(void)
+								{return(dustCollectorUI.*(&UIProbe::mDCInfoField0));}
+};
+
+class InfoFieldProbe : public DCInfoField
+{
+public:
+	static void				SetInfo(
+								DCInfoField&			inField,
+								uint8_t					inInfo)
+								{inField.*(&InfoFieldProbe::mDCInfo) = inInfo;}
+};
+
+/********************************** ModeName **********************************/
+const char* UIProbe::ModeName(
+	uint8_t	inMode)
+{
+	static const char* const	kModeName[] =
+	{
+		"MainMenu", "Info", "GateSensors", "GateSets", "SetTime", "BinMotor",
+		"VerifyResetGates", "VerifyResetGateSets", "Message",
+		"WaitingForGateCheck", "ResolveUnregisteredGate", "VerifyGateRemoval",
+		"WaitingForCalibration", "CalibrationResult"
+	};
+	return(inMode < kModeCount ? kModeName[inMode] : "?");
+}
+
+/********************************** ShowMode **********************************/
+/*
+*	Sets the mode the same way the button handlers do without the side effects
+*	(sending gate requests, removing gates, etc.)
+*/
+void UIProbe::ShowMode(
+	uint8_t	inMode)
+{
+	DustCollectorUI&	ui = dustCollectorUI;
+	uint8_t	item = 0;
+	switch (inMode)
+	{
+		case eMessageMode:
+			(ui.*(&UIProbe::mMessageLine0)) = eFilterLoadedMessage;
+			(ui.*(&UIProbe::mMessageLine1)) = eNoMessage;
+			(ui.*(&UIProbe::mMessageReturnMode)) = eInfoMode;
+			(ui.*(&UIProbe::mMessageReturnItem)) = eInfoField0;
+			break;
+		case eSetTimeMode:
+			(ui.*(&UIProbe::mUnixTimeEditor)).SetTime(UnixTime::Time());
+			break;
+		case eBinMotorMode:
+			item = eMotorSensitivityItem;
+			break;
+		case eVerifyResetGatesMode:
+		case eVerifyResetGateSetsMode:
+		case eVerifyGateRemovalMode:
+			item = eVerifyNoItem;
+			break;
+		case eResolveUnregisteredGateMode:
+			item = eDoResolutionItem;
+			(ui.*(&UIProbe::mUIGateIndex)) = 33;
+			break;
+		case eCalibrationResultMode:
+			item = eCalibrationOKItem;
+			break;
+	}
+	(ui.*(&UIProbe::mMode)) = inMode;
+	(ui.*(&UIProbe::mCurrentFieldOrItem)) = item;
+	(ui.*(&UIProbe::mSetAction)) = 0;
+}
+
+/********************************* ComparePPM *********************************/
+/*
+*	Returns the number of bytes that differ, or -1 if either file can't be
+*	read or the sizes differ.
+*/
+static int32_t ComparePPM(
+	const char*	inPath,
+	const char*	inRefPath)
+{
+	int32_t	differences = -1;
+	FILE*	file = fopen(inPath, "rb");
+	FILE*	refFile = fopen(inRefPath, "rb");
+	if (file && refFile)
+	{
+		int	ch, refCh;
+		differences = 0;
+		do
+		{
+			ch = fgetc(file);
+			refCh = fgetc(refFile);
+			if (ch != refCh)
+			{
+				if (ch == EOF || refCh == EOF)
+				{
+					differences = -1;
+					break;
+				}
+				differences++;
+			}
+		} while (ch != EOF);
+	}
+	if (file)
+	{
+		fclose(file);
+	}
+	if (refFile)
+	{
+		fclose(refFile);
+	}
+	return(differences);
+}
+
+/********************************** AttachUI **********************************/
+/*
+*	(Re)starts the UI on inDisplay so that both displays are drawn from the
+*	same UI state.
+*/
+static void AttachUI(
+	DisplayController*	inDisplay)
+{
+	dustCollectorUI.begin(&dustCollector, inDisplay,
+							&MyriadPro_Regular_36_1b::font,
+								&MyriadPro_Regular_18::font,
+									&DC_Icons::font);
+}
+
+/********************************* BenchModes *********************************/
+/*
+*	Redraws each mode on the TFT_ST7789 to get the bytes it sends, then
+*	switches the UI to the frame buffer, redraws each mode again and saves the
+*	screenshots.  The frame buffer redraw of each mode starts at the same
+*	simulated time as the TFT_ST7789 redraw did so that anything time dependent
+*	is drawn the same way.  Returns false if a screenshot doesn't match the
+*	reference.
+*/
+static bool BenchModes(
+	const char*	inOutDir,
+	const char*	inRefDir)
+{
+	bool		success = true;
+	char		path[256];
+	uint32_t	tftBytes[UIProbe::kModeCount];
+	uint64_t	startNanos[UIProbe::kModeCount];
+	
+	/*
+	*	The DCInfoField time is only drawn when the time changes, so the first
+	*	time through the info screen draws more than later full redraws.  Go
+	*	through the modes once before measuring.
+	*/
+	AttachUI(&frameBuffer);
+	UnixTime::SetTime(kScreenshotTime);
+	for (uint8_t mode = 0; mode < UIProbe::kModeCount; mode++)
+	{
+		UIProbe::ShowMode(mode);
+		UIProbe::Redraw();
+	}
+
+	AttachUI(&display);
+	UnixTime::SetTime(kScreenshotTime);
+	for (uint8_t mode = 0; mode < UIProbe::kModeCount; mode++)
+	{
+		startNanos[mode] = HostClock::Nanos();
+		displaySPI.mBytes = 0;
+		UIProbe::ShowMode(mode);
+		UIProbe::Redraw();
+		tftBytes[mode] = displaySPI.mBytes;
+	}
+	uint64_t	endNanos = HostClock::Nanos();
+
+	AttachUI(&frameBuffer);
+	UnixTime::SetTime(kScreenshotTime);
+	printf("UpdateDisplay bytes per redraw:\n");
+	printf("  %-24s %8s %8s %6s %6s %6s\n", "mode", "full", "TFT", "trans", "cmds", "next");
+	for (uint8_t mode = 0; mode < UIProbe::kModeCount; mode++)
+	{
+		const char*	modeName = UIProbe::ModeName(mode);
+		HostClock::SetNanos(startNanos[mode]);
+		frameBuffer.ResetStats();
+		UIProbe::ShowMode(mode);
+		UIProbe::Redraw();
+		HostFrameBuffer::SStats	fullStats = frameBuffer.GetStats();
+		frameBuffer.ResetStats();
+		UIProbe::Redraw();
+		printf("  %-24s %8u %8u %6u %6u %6u%s\n", modeName,
+			fullStats.bytes, tftBytes[mode], fullStats.transactions,
+			fullStats.commands, frameBuffer.GetStats().bytes,
+			fullStats.bytes != tftBytes[mode] ? "  (TFT differs)" : "");
+		
+		snprintf(path, sizeof(path), "%s/%s.ppm", inOutDir, modeName);
+		if (!frameBuffer.WritePPM(path))
+		{
+			printf("  Unable to write %s\n", path);
+			success = false;
+		} else if (inRefDir)
+		{
+			char	refPath[256];
+			snprintf(refPath, sizeof(refPath), "%s/%s.ppm", inRefDir, modeName);
+			int32_t	differences = ComparePPM(path, refPath);
+			if (differences)
+			{
+				success = false;
+				if (differences < 0)
+				{
+					printf("  %s is missing or a different size\n", refPath);
+				} else
+				{
+					printf("  %d bytes differ from %s\n", differences, refPath);
+				}
+			}
+		}
+	}
+	HostClock::SetNanos(endNanos);
+	return(success);
+}
+
+/********************************* BenchMeter *********************************/
+/*
+*	The FilterStatusMeter full redraw, then the indicator moving from one end
+*	to the other, one pixel per animation period.
+*/
+static void BenchMeter(void)
+{
+	FilterStatusMeter&	meter = UIProbe::Meter();
+	meter.SetMinMax(0, FilterStatusMeter::eTransWidth);
+	meter.SetValue(0);
+	frameBuffer.ResetStats();
+	meter.Update(true);
+	uint32_t	fullBytes = frameBuffer.GetStats().bytes;
+	
+	meter.SetValue(FilterStatusMeter::eTransWidth);
+	frameBuffer.ResetStats();
+	uint32_t	steps = 0;
+	uint32_t	maxStepBytes = 0;
+	while (steps < FilterStatusMeter::eTransWidth * 2)
+	{
+		HostClock::Advance(30000);
+		uint32_t	startBytes = frameBuffer.GetStats().bytes;
+		meter.Update(false);
+		uint32_t	stepBytes = frameBuffer.GetStats().bytes - startBytes;
+		if (stepBytes == 0)
+		{
+			break;
+		}
+		if (stepBytes > maxStepBytes)
+		{
+			maxStepBytes = stepBytes;
+		}
+		steps++;
+	}
+	const HostFrameBuffer::SStats&	stats = frameBuffer.GetStats();
+	printf("FilterStatusMeter: full %u bytes, %u indicator steps, "
+		"%u bytes per step (max %u), %u invalid windows, %u pixels dropped\n",
+		fullBytes, steps, steps ? stats.bytes/steps : 0, maxStepBytes,
+		stats.invalidWindows, stats.droppedPixels);
+}
+
+/****************************** BenchInfoFields *******************************/
+/*
+*	Each kind of DCInfoField drawn in the first field, and the redraw that
+*	follows it.  The field is left as the last kind, eCANErrorsInfo.
+*/
+static void BenchInfoFields(void)
+{
+	static const char* const	kInfoName[] =
+	{
+		"Nothing", "DuctPa", "AmbientPa", "BaselinePa", "StaticPa",
+		"StaticInches", "Time", "Date", "GateSet", "Motor", "Software",
+		"Deadline", "CANErrors"
+	};
+	DCInfoField&	field = UIProbe::InfoField0();
+	printf("DCInfoField bytes per redraw:\n");
+	for (uint8_t info = 0; info < DCInfoField::eInfoCount; info++)
+	{
+		InfoFieldProbe::SetInfo(field, info);
+		frameBuffer.ResetStats();
+		field.Update(true);
+		uint32_t	fullBytes = frameBuffer.GetStats().bytes;
+		frameBuffer.ResetStats();
+		field.Update(false);
+		printf("  %-24s %8u %8u\n",
+			kInfoName[info],
+			fullBytes, frameBuffer.GetStats().bytes);
+	}
+}
+
+/****************************** BenchInfoScreen *******************************/
+/*
+*	The info screen running the sketch's loop() for a minute with the clock
+*	ticking.
+*/
+static void BenchInfoScreen(void)
+{
+	const uint32_t	kSeconds = 60;
+	const uint32_t	kStepMicros = 100;
+	UIProbe::ShowMode(UIProbe::kInfoMode);
+	UIProbe::Redraw();
+	frameBuffer.ResetStats();
+	uint32_t	frames = 0;
+	uint32_t	maxFrameBytes = 0;
+	MSPeriod	rtcTickPeriod(1000);
+	rtcTickPeriod.Start();
+	uint32_t	startMillis = millis();
+	while ((millis() - startMillis) < kSeconds * 1000)
+	{
+		uint32_t	startBytes = frameBuffer.GetStats().bytes;
+		loop();
+		uint32_t	frameBytes = frameBuffer.GetStats().bytes - startBytes;
+		if (frameBytes)
+		{
+			frames++;
+			if (frameBytes > maxFrameBytes)
+			{
+				maxFrameBytes = frameBytes;
+			}
+		}
+		HostClock::Advance(kStepMicros);
+		if (rtcTickPeriod.Passed())
+		{
+			rtcTickPeriod.Start();
+			TIMER2_OVF_vect();
+		}
+	}
+	const HostFrameBuffer::SStats&	stats = frameBuffer.GetStats();
+	printf("Info screen, %u s: %u bytes in %u frames that drew, "
+		"%u bytes per frame (max %u), %u bytes/s\n",
+		kSeconds, stats.bytes, frames, frames ? stats.bytes/frames : 0,
+		maxFrameBytes, stats.bytes/kSeconds);
+}
+
+/************************************ main ************************************/
+int main(
+	int		argc,
+	char*	argv[])
+{
+	const char*	outDir = argc > 1 ? argv[1] : "build/screens";
+	const char*	refDir = argc > 2 ? argv[2] : nullptr;
+	
+	HardwareSerial::sEnabled = false;
+	mkdir(outDir, 0755);
+	setup();
+	profileDumpPeriod.Set(0);	// Disable the sketch's periodic dump/reset
+	
+	bool	success = BenchModes(outDir, refDir);
+	BenchMeter();
+	BenchInfoFields();
+	BenchInfoScreen();
+	return(success ? 0 : 1);
+}
@@ -0,0 +1,282 @@
+/*
+*	DCEEPROMWear.cpp, Copyright Jonathan Mackey 2021
+*	Measures the EEPROM traffic of the controller's Gates and GateSets
+*	operations.  Each operation is run on the gate and gate set lists stored
+*	in the simulated EEPROM and the DataStream_E reads, changed bytes and
+*	estimated write blocking time per call are reported (see EEPROMTracer.h.)
+*	At exit the EEPROMTracer read and write heat maps of the whole run are
+*	printed, one character per EEPROM address.
+*
+*	usage: DCEEPROMWear [gates]
+*		gates		the number of gates and gate sets, 2 to 32, default 32
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#include <stdio.h>
+#include "DCController.ino"
+#include "HostBMP280.h"
+
+HostBMP280	bmp280Ambient(DCConfig::kBMP1CSPin);
+HostBMP280	bmp280Duct(DCConfig::kBMP0CSPin);
+
+static EEPROMTracer::SState	sTotal;	// Of all operations
+
+/*
+*	CheckGates is protected.  A pointer to it can be taken through this
+*	subclass, which is allowed access to the protected members of its base.
+*/
+class WearProbe : public DustCollector
+{
+public:
+	static void				Check(void)
+								{(dustCollector.*(&WearProbe::CheckGates))();}
+};
+
+/****************************** SettleGateStates ******************************/
+/*
+*	Lets kGateSetLookupDelay pass so that CheckGates does the gate set lookup
+*	of the gate state changes so far.
+*/
+static void SettleGateStates(void)
+{
+	HostClock::Advance(DCConfig::kGateSetLookupDelay * 1000);
+	WearProbe::Check();
+}
+
+/********************************* BeginOp ************************************/
+static void BeginOp(void)
+{
+	EEPROMTracer::Reset();
+}
+
+/********************************** EndOp *************************************/
+/*
+*	Prints the per call traffic of the operation since BeginOp and adds the
+*	counts to sTotal.
+*/
+static void EndOp(
+	const char*	inName,
+	uint32_t	inCalls)
+{
+	const EEPROMTracer::SState&	state = EEPROMTracer::State();
+	printf("  %-36s %5u %9.1f %9.1f %9.1f %9.1f %7u\n", inName, inCalls,
+		(double)state.readCalls / inCalls, (double)state.readBytes / inCalls,
+		(double)state.changedBytes / inCalls, (double)state.blocking / inCalls,
+		state.maxBlocking);
+	for (uint16_t i = 0; i < EEPROMTracer::eNumBlocks; i++)
+	{
+		sTotal.block[i].reads += state.block[i].reads;
+		sTotal.block[i].writes += state.block[i].writes;
+	}
+	sTotal.readCalls += state.readCalls;
+	sTotal.readBytes += state.readBytes;
+	sTotal.writeCalls += state.writeCalls;
+	sTotal.writeBytes += state.writeBytes;
+	sTotal.changedBytes += state.changedBytes;
+	sTotal.blocking += state.blocking;
+	if (state.maxBlocking > sTotal.maxBlocking)
+	{
+		sTotal.maxBlocking = state.maxBlocking;
+	}
+}
+
+/********************************* GateMask ***********************************/
+/*
+*	The gate set mask used for set inIndex, 1 to 4 of the registered gates.
+*/
+static uint32_t GateMask(
+	uint8_t	inIndex,
+	uint8_t	inNumGates)
+{
+	uint32_t	mask = 0;
+	for (uint8_t j = 0; j <= (inIndex % 4); j++)
+	{
+		mask |= (uint32_t)1 << ((inIndex * 7 + j * 5) % inNumGates);
+	}
+	return(mask);
+}
+
+/*********************************** main *************************************/
+int main(
+	int		argc,
+	char*	argv[])
+{
+	uint32_t	numGates = argc > 1 ? strtoul(argv[1], nullptr, 0) : 32;
+	if (numGates < 2 || numGates > DCConfig::kMaxGates)
+	{
+		fprintf(stderr, "usage: %s [gates (2 to 32)]\n", argv[0]);
+		return(1);
+	}
+
+	HardwareSerial::sEnabled = false;
+	setup();
+	profileDumpPeriod.Set(0);
+	spiTraceDumpPeriod.Set(0);
+	eepromTraceDumpPeriod.Set(0);
+	deadlineDumpPeriod.Set(0);
+	Gates&		gates = dustCollector.GetGates();
+	GateSets&	gateSets = dustCollector.GetGateSets();
+	gates.RemoveAllGates();
+	gateSets.RemoveAllGateSets();
+	memset(&sTotal, 0, sizeof(sTotal));
+
+	printf("%u gates and gate sets.  Per call: DataStream_E reads, bytes read, bytes changed,\n"
+		"estimated ms blocked by writes, and the longest single write in ms.\n", numGates);
+	printf("  %-36s %5s %9s %9s %9s %9s %7s\n", "operation", "calls", "reads",
+		"bytes", "changed", "block ms", "max ms");
+
+	BeginOp();
+	for (uint8_t i = 0; i < numGates; i++)
+	{
+		gates.AddNew();
+	}
+	EndOp("Gates::AddNew", numGates);
+
+	BeginOp();
+	gates.GoToNthGate(0);
+	for (uint8_t i = 0; i < numGates; i++)
+	{
+		gates.Next();
+	}
+	EndOp("Gates::Next", numGates);
+
+	BeginOp();
+	for (uint8_t i = 0; i < numGates; i++)
+	{
+		gates.Previous();
+	}
+	EndOp("Gates::Previous", numGates);
+
+	BeginOp();
+	for (uint8_t i = 0; i < numGates; i++)
+	{
+		gates.GoToNthGate(numGates - 1 - i);
+	}
+	EndOp("Gates::GoToNthGate", numGates);
+
+	BeginOp();
+	for (uint8_t i = 0; i < numGates; i++)
+	{
+		gates.GetLogicalIndex();
+	}
+	EndOp("Gates::GetLogicalIndex", numGates);
+
+	BeginOp();
+	for (uint8_t i = 0; i < numGates; i++)
+	{
+		gateSets.SaveCleanSet(GateMask(i, numGates), 100 + i);
+	}
+	EndOp("GateSets::SaveCleanSet (new set)", numGates);
+
+	BeginOp();
+	for (uint8_t i = 0; i < numGates; i++)
+	{
+		gateSets.SaveDirtySet(GateMask(i, numGates), 400 + i);
+	}
+	EndOp("GateSets::SaveDirtySet (existing)", numGates);
+
+	BeginOp();
+	gateSets.GoToNthGateSet(0);
+	for (uint8_t i = 0; i < numGates; i++)
+	{
+		gateSets.Next();
+	}
+	EndOp("GateSets::Next", numGates);
+
+	BeginOp();
+	for (uint8_t i = 0; i < numGates; i++)
+	{
+		gateSets.GoToGateSetWithMask(GateMask(i, numGates));
+	}
+	EndOp("GateSets::GoToGateSetWithMask", numGates);
+
+	/*
+	*	Each gate opened then closed, as the sensors report, the changes more
+	*	than kGateSetLookupDelay apart.
+	*/
+	BeginOp();
+	for (uint8_t i = 1; i <= numGates; i++)
+	{
+		dustCollector.SetGateState(i, true);
+		SettleGateStates();
+		dustCollector.SetGateState(i, false);
+		SettleGateStates();
+	}
+	EndOp("DustCollector::SetGateState", numGates * 2);
+
+	/*
+	*	Three gates opened together then closed together, one gate set lookup
+	*	per batch.
+	*/
+	BeginOp();
+	uint8_t	batches = 0;
+	for (uint8_t i = 1; i + 2U <= numGates; i += 3, batches++)
+	{
+		for (uint8_t j = 0; j < 3; j++)
+		{
+			dustCollector.SetGateState(i + j, true);
+		}
+		SettleGateStates();
+		for (uint8_t j = 0; j < 3; j++)
+		{
+			dustCollector.SetGateState(i + j, false);
+		}
+		SettleGateStates();
+	}
+	EndOp("SetGateState x3 (per batch)", batches * 2);
+
+	BeginOp();
+	uint8_t	removed = 0;
+	for (; removed < numGates / 4; removed++)
+	{
+		gateSets.GoToNthGateSet((removed * 3) % gateSets.GetCount());
+		gateSets.RemoveCurrent();
+	}
+	EndOp("GateSets::RemoveCurrent", removed);
+
+	BeginOp();
+	for (removed = 0; removed < numGates / 4; removed++)
+	{
+		gates.GoToNthGate((removed * 3) % gates.GetCount());
+		gates.RemoveCurrent();
+	}
+	EndOp("Gates::RemoveCurrent", removed);
+
+	BeginOp();
+	for (removed = 0; removed < numGates / 4; removed++)
+	{
+		gates.AddNew();
+	}
+	EndOp("Gates::AddNew (reusing free records)", removed);
+
+	uint16_t	gateSetsAddr = DCConfig::kGatesDataAddr + sizeof(SGateLink) * (DCConfig::kMaxGates + 1);
+	printf("\nAll operations.  Gates records 0x%03X-0x%03X (%u bytes each), gate set records\n"
+		"0x%03X-0x%03X (%u bytes each)\n",
+		DCConfig::kGatesDataAddr, gateSetsAddr - 1, (uint32_t)sizeof(SGateLink),
+		gateSetsAddr, gateSetsAddr + (uint32_t)sizeof(SGateSetLink) * (DCConfig::kMaxGateSets + 1) - 1,
+		(uint32_t)sizeof(SGateSetLink));
+	/*
+	*	Load the totals so that Dump prints the heat maps of all operations.
+	*/
+	sTotal.windowStart = EEPROMTracer::State().windowStart;
+	EEPROMTracer::State() = sTotal;
+	HardwareSerial::sEnabled = true;
+	EEPROMTracer::Dump();
+	return(0);
+}
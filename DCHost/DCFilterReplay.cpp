@@ -0,0 +1,527 @@
+/*
+*	DCFilterReplay.cpp, Copyright Jonathan Mackey 2021
+*	Replays ambient and duct pressure traces through the controller's
+*	DustCollector::CheckFilter and reports how long it takes to detect that
+*	the dust collector started, stopped and that the filter is full, and how
+*	many times it got it wrong.
+*
+*	The pressures are returned by simulated BMP280s so the sketch's own
+*	BMP280SPI compensation, CheckFilter, DeltaAverage and Baseline code is
+*	used unchanged.  CheckFilter is called every step (default 100 ms) of
+*	simulated time.
+*
+*	usage: DCFilterReplay [trace [dirty delta [step]]]
+*		trace		a CSV or binary (.bin) trace file, or synthetic (default)
+*		dirty delta	the filter full delta in Pa, default is the controller's
+*					current dirty pressure.
+*		step		ms between CheckFilter calls, default 100
+*
+*	CSV trace: one sample per line, time (ms from the start of the trace),
+*	ambient pressure (Pa), duct pressure (Pa) and, optionally, the actual
+*	state: 0 = off, 1 = running, 2 = running with the filter full.  Lines not
+*	starting with a digit are ignored.
+*
+*	Binary trace: 16 byte little endian records, uint32 time, ambient, duct
+*	and state.  A state of 0xFFFFFFFF means the state isn't known.
+*
+*	The latencies and false trigger counts are only reported for samples that
+*	have a state.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#include <stdio.h>
+#include <vector>	// Before Arduino.h, which defines min and max
+#include "DCController.ino"
+#include "HostBMP280.h"
+
+HostBMP280	bmp280Ambient(DCConfig::kBMP1CSPin);
+HostBMP280	bmp280Duct(DCConfig::kBMP0CSPin);
+
+enum EState
+{
+	eUnknown = -1,
+	eOff,
+	eOn,
+	eFull
+};
+
+struct SSample
+{
+	uint32_t	time;		// ms from the start of the trace
+	uint32_t	ambient;	// Pa
+	uint32_t	duct;		// Pa
+	int8_t		state;		// EState
+};
+
+/*
+*	A change of the actual state (from the trace) or of the controller's
+*	status.
+*/
+struct SChange
+{
+	uint32_t	time;
+	int8_t		from;
+	int8_t		to;
+};
+
+/*
+*	Access to DustCollector::CheckFilter.  The member pointer is taken via
+*	this subclass, which is allowed access to the protected members of its
+*	base.
+*/
+class FilterProbe : public DustCollector
+{
+public:
+	static void				Check(void)
+								{(dustCollector.*(&FilterProbe::CheckFilter))();}
+};
+
+/*
+*	The synthetic trace is built from these segments.  Delta is the actual
+*	duct pressure above ambient (the pressure on the blower side of the
+*	filter) while the collector is running, it changes linearly from
+*	startDelta to endDelta over the segment.
+*	A delta of 0 means the collector is off.  Gusts are short ambient pressure
+*	steps (doors, HVAC) that the duct sensor doesn't see.
+*/
+struct SSegment
+{
+	uint16_t	duration;	// seconds
+	uint16_t	startDelta;	// Pa
+	uint16_t	endDelta;	// Pa
+	uint16_t	gust;		// Pa
+};
+
+static const SSegment	kSegments[] =
+{
+	{60,	0,		0,		0},		// Power up, off
+	{120,	650,	650,	0},		// Run
+	{45,	0,		0,		0},		// Off
+	{300,	0,		0,		20},	// Off, gusts below the start threshold
+	{300,	0,		0,		40},	// Off, gusts above the start threshold
+	{20,	700,	700,	0},		// Short runs
+	{15,	0,		0,		0},
+	{20,	700,	700,	0},
+	{15,	0,		0,		0},
+	{60,	700,	700,	0},
+	{1200,	700,	1400,	0},		// Filter loading
+	{60,	0,		0,		0},		// Off
+	{180,	1350,	1350,	0},		// Start with the filter already full
+	{60,	0,		0,		0}		// Off
+};
+const uint32_t	kSamplePeriod = 250;		// ms between synthetic samples
+const uint32_t	kAmbient = 101325;			// Pa
+const int32_t	kDuctSensorOffset = 9;		// Pa, duct sensor reads high
+const int32_t	kDriftPerHour = 60;			// Pa, weather
+const uint32_t	kSpinUpTau = 1000;			// ms
+const uint32_t	kSpinDownTau = 3000;		// ms
+const uint32_t	kGustPeriod = 20000;		// ms
+const uint32_t	kGustLength = 2000;			// ms
+
+/*********************************** Noise ************************************/
+/*
+*	Deterministic noise in the range +/- inAmplitude, roughly normal.
+*/
+static int32_t Noise(
+	int32_t	inAmplitude)
+{
+	static uint32_t	sSeed = 0x2F6E2B1;
+	int32_t	sum = 0;
+	for (uint8_t i = 0; i < 4; i++)
+	{
+		sSeed = sSeed * 1664525 + 1013904223;
+		sum += (int32_t)((sSeed >> 16) % (2 * inAmplitude + 1)) - inAmplitude;
+	}
+	return(sum / 4);
+}
+
+/***************************** MakeSyntheticTrace *****************************/
+static void MakeSyntheticTrace(
+	uint32_t				inDirtyDelta,
+	std::vector<SSample>&	outTrace)
+{
+	uint32_t	time = 0;
+	double		delta = 0;	// Actual, follows the segment's delta
+	for (uint8_t i = 0; i < sizeof(kSegments)/sizeof(SSegment); i++)
+	{
+		const SSegment&	segment = kSegments[i];
+		uint32_t	segmentEnd = time + (uint32_t)segment.duration * 1000;
+		uint32_t	segmentStart = time;
+		for (; time < segmentEnd; time += kSamplePeriod)
+		{
+			double	target = segment.startDelta + ((double)segment.endDelta - segment.startDelta) *
+								(time - segmentStart) / (segmentEnd - segmentStart);
+			uint32_t	tau = target > delta ? kSpinUpTau : kSpinDownTau;
+			delta += (target - delta) * kSamplePeriod / (tau + kSamplePeriod);
+			int32_t	ambient = kAmbient + (int32_t)((int64_t)time * kDriftPerHour / 3600000);
+			if (segment.gust &&
+				(time % kGustPeriod) < kGustLength)
+			{
+				ambient += ((time / kGustPeriod) & 1) ? segment.gust : -(int32_t)segment.gust;
+			}
+			int32_t	duct = ambient + (int32_t)delta + kDuctSensorOffset;
+			SSample	sample;
+			sample.time = time;
+			sample.ambient = ambient + Noise(3);
+			sample.duct = duct + Noise(3);
+			sample.state = segment.startDelta == 0 ? eOff :
+				(abs(duct - ambient) >= (int32_t)inDirtyDelta ? eFull : eOn);
+			outTrace.push_back(sample);
+		}
+	}
+}
+
+/******************************** ReadCSVTrace ********************************/
+static bool ReadCSVTrace(
+	FILE*					inFile,
+	std::vector<SSample>&	outTrace)
+{
+	char	line[256];
+	uint32_t	lineNum = 0;
+	while (fgets(line, sizeof(line), inFile))
+	{
+		lineNum++;
+		if (line[0] < '0' || line[0] > '9')
+		{
+			continue;
+		}
+		SSample	sample;
+		int		state = eUnknown;
+		if (sscanf(line, "%u , %u , %u , %d", &sample.time, &sample.ambient,
+				&sample.duct, &state) < 3 ||
+			state < eUnknown || state > eFull ||
+			(outTrace.size() && sample.time < outTrace.back().time))
+		{
+			fprintf(stderr, "Invalid sample, line %u: %s", lineNum, line);
+			return(false);
+		}
+		sample.state = state;
+		outTrace.push_back(sample);
+	}
+	return(true);
+}
+
+/****************************** ReadBinaryTrace *******************************/
+static bool ReadBinaryTrace(
+	FILE*					inFile,
+	std::vector<SSample>&	outTrace)
+{
+	uint8_t	record[16];
+	while (fread(record, 1, sizeof(record), inFile) == sizeof(record))
+	{
+		uint32_t	field[4];
+		for (uint8_t i = 0; i < 4; i++)
+		{
+			field[i] = record[i*4] | ((uint32_t)record[i*4+1] << 8) |
+				((uint32_t)record[i*4+2] << 16) | ((uint32_t)record[i*4+3] << 24);
+		}
+		SSample	sample;
+		sample.time = field[0];
+		sample.ambient = field[1];
+		sample.duct = field[2];
+		sample.state = field[3] <= eFull ? (int8_t)field[3] : eUnknown;
+		if (outTrace.size() && sample.time < outTrace.back().time)
+		{
+			fprintf(stderr, "Invalid sample, record %u\n", (uint32_t)outTrace.size());
+			return(false);
+		}
+		outTrace.push_back(sample);
+	}
+	return(true);
+}
+
+/********************************* StateName **********************************/
+static const char* StateName(
+	int8_t	inState)
+{
+	static const char*	kName[] = {"unknown", "off", "running", "filter full"};
+	return(kName[inState + 1]);
+}
+
+/********************************* StatusName *********************************/
+static const char* StatusName(
+	int8_t	inStatus)
+{
+	static const char*	kName[] = {"not running", "running", "bin full", "filter full"};
+	return(kName[inStatus]);
+}
+
+/*********************************** Replay ***********************************/
+/*
+*	Each sample's pressures are returned by the BMP280s until the time of the
+*	next sample.  The last sample is held for kNumDeltas + kNumDeltaAvgs
+*	pressure updates so the controller can respond to it.
+*/
+static void Replay(
+	const std::vector<SSample>&	inTrace,
+	uint32_t					inStep,
+	std::vector<SChange>&		outActual,
+	std::vector<SChange>&		outDetected)
+{
+	uint32_t	start = millis();
+	uint32_t	elapsed = 0;
+	int8_t		state = eUnknown;
+	int8_t		status = dustCollector.Status();
+	for (size_t i = 0; i < inTrace.size(); i++)
+	{
+		const SSample&	sample = inTrace[i];
+		uint32_t	until = i + 1 < inTrace.size() ? inTrace[i+1].time :
+			sample.time + (DCConfig::kNumDeltas + DCConfig::kNumDeltaAvgs) *
+				DCConfig::kPressureUpdatePeriod;
+		bmp280Ambient.SetPressure(sample.ambient);
+		bmp280Duct.SetPressure(sample.duct);
+		if (sample.state != state)
+		{
+			SChange	change = {sample.time, state, sample.state};
+			outActual.push_back(change);
+			state = sample.state;
+		}
+		while (elapsed < until)
+		{
+			FilterProbe::Check();
+			if (dustCollector.Status() != status)
+			{
+				SChange	change = {elapsed, status, (int8_t)dustCollector.Status()};
+				outDetected.push_back(change);
+				status = dustCollector.Status();
+			}
+			HostClock::Advance(inStep * 1000);
+			elapsed = millis() - start;
+		}
+	}
+}
+
+/******************************** PrintLatency ********************************/
+static void PrintLatency(
+	const char*	inLabel,
+	uint32_t	inCount,
+	uint32_t	inDetected,
+	uint32_t	inTotal,
+	uint32_t	inMax)
+{
+	printf("  %-13s %u of %u detected", inLabel, inDetected, inCount);
+	if (inDetected)
+	{
+		printf(", latency mean %.1f s, max %.1f s", (double)inTotal / inDetected / 1000,
+			(double)inMax / 1000);
+	}
+	printf("\n");
+}
+
+/*********************************** Score ************************************/
+/*
+*	A change of the actual state is detected by the first change of the
+*	controller's status to the corresponding status before the next change of
+*	the actual state.  Starting with the filter already full is detected as a
+*	start followed by filter full.
+*
+*	A change of the controller's status that doesn't agree with the actual
+*	state at the time of the change is a false trigger.
+*/
+static void Score(
+	const std::vector<SChange>&	inActual,
+	const std::vector<SChange>&	inDetected,
+	uint32_t					inTraceEnd)
+{
+	enum
+	{
+		eStartEvent,
+		eFullEvent,
+		eStopEvent,
+		eNumEvents
+	};
+	static const char*	kEventName[] = {"start", "filter full", "stop"};
+	static const int8_t	kEventStatus[] = {DustCollector::eRunning,
+							DustCollector::eFilterFull, DustCollector::eNotRunning};
+	uint32_t	count[eNumEvents] = {0};
+	uint32_t	detected[eNumEvents] = {0};
+	uint32_t	total[eNumEvents] = {0};
+	uint32_t	maxLatency[eNumEvents] = {0};
+
+	printf("  actual state changes:\n");
+	for (size_t i = 0; i < inActual.size(); i++)
+	{
+		const SChange&	actual = inActual[i];
+		if (actual.to == eUnknown ||
+			actual.from == eUnknown)
+		{
+			continue;
+		}
+		uint32_t	until = i + 1 < inActual.size() ? inActual[i+1].time : inTraceEnd;
+		bool		event[eNumEvents] = {false};
+		event[eStartEvent] = actual.from == eOff;
+		event[eFullEvent] = actual.to == eFull;
+		event[eStopEvent] = actual.to == eOff;
+		printf("    %7.1f s  %s -> %s", (double)actual.time / 1000,
+			StateName(actual.from), StateName(actual.to));
+		for (uint8_t e = 0; e < eNumEvents; e++)
+		{
+			if (!event[e])
+			{
+				continue;
+			}
+			count[e]++;
+			size_t	d = 0;
+			for (; d < inDetected.size(); d++)
+			{
+				if (inDetected[d].time >= actual.time &&
+					inDetected[d].time < until &&
+					inDetected[d].to == kEventStatus[e])
+				{
+					break;
+				}
+			}
+			if (d < inDetected.size())
+			{
+				uint32_t	latency = inDetected[d].time - actual.time;
+				detected[e]++;
+				total[e] += latency;
+				if (latency > maxLatency[e])
+				{
+					maxLatency[e] = latency;
+				}
+				printf(", %s detected in %.1f s", kEventName[e], (double)latency / 1000);
+			} else
+			{
+				printf(", %s MISSED", kEventName[e]);
+			}
+		}
+		printf("\n");
+	}
+	uint32_t	falseStarts = 0;
+	uint32_t	falseFull = 0;
+	uint32_t	falseStops = 0;
+	size_t		a = 0;
+	int8_t		state = eUnknown;
+	for (size_t d = 0; d < inDetected.size(); d++)
+	{
+		const SChange&	change = inDetected[d];
+		while (a < inActual.size() &&
+			inActual[a].time <= change.time)
+		{
+			state = inActual[a].to;
+			a++;
+		}
+		const char*	falseTrigger = nullptr;
+		if (state != eUnknown)
+		{
+			if (change.to == DustCollector::eRunning &&
+				change.from == DustCollector::eNotRunning &&
+				state == eOff)
+			{
+				falseTrigger = "false start";
+				falseStarts++;
+			} else if (change.to == DustCollector::eFilterFull &&
+				state != eFull)
+			{
+				falseTrigger = "false filter full";
+				falseFull++;
+			} else if (change.to == DustCollector::eNotRunning &&
+				state != eOff)
+			{
+				falseTrigger = "false stop";
+				falseStops++;
+			}
+		}
+		if (falseTrigger)
+		{
+			printf("    %7.1f s  %s, actual state %s\n", (double)change.time / 1000,
+				falseTrigger, StateName(state));
+		}
+	}
+	for (uint8_t e = 0; e < eNumEvents; e++)
+	{
+		PrintLatency(kEventName[e], count[e], detected[e], total[e], maxLatency[e]);
+	}
+	printf("  false triggers: %u starts, %u filter full, %u stops\n",
+		falseStarts, falseFull, falseStops);
+}
+
+/************************************ main ************************************/
+int main(
+	int		argc,
+	char*	argv[])
+{
+	const char*	traceName = argc > 1 ? argv[1] : "synthetic";
+	uint32_t	dirtyDelta = argc > 2 ? strtoul(argv[2], nullptr, 0) : 0;
+	uint32_t	step = argc > 3 ? strtoul(argv[3], nullptr, 0) : 100;
+	if (step == 0 ||
+		step > DCConfig::kPressureUpdatePeriod)
+	{
+		fprintf(stderr, "usage: %s [trace file|synthetic [dirty delta [step ms]]]\n", argv[0]);
+		return(1);
+	}
+
+	HardwareSerial::sEnabled = false;	// The report is written to stdout
+	setup();
+	profileDumpPeriod.Set(0);
+	spiTraceDumpPeriod.Set(0);
+	eepromTraceDumpPeriod.Set(0);
+	deadlineDumpPeriod.Set(0);
+	if (dirtyDelta)
+	{
+		dustCollector.GetGateSets().SaveDirtySet(0, dirtyDelta);
+	}
+	dirtyDelta = dustCollector.GetGateSets().CurrentDirtyPressure();
+
+	std::vector<SSample>	trace;
+	if (strcmp(traceName, "synthetic") == 0)
+	{
+		MakeSyntheticTrace(dirtyDelta, trace);
+	} else
+	{
+		FILE*	file = fopen(traceName, "rb");
+		if (!file)
+		{
+			perror(traceName);
+			return(1);
+		}
+		size_t	nameLen = strlen(traceName);
+		bool	success = nameLen > 4 && strcmp(&traceName[nameLen - 4], ".bin") == 0 ?
+					ReadBinaryTrace(file, trace) : ReadCSVTrace(file, trace);
+		fclose(file);
+		if (!success)
+		{
+			return(1);
+		}
+	}
+	if (trace.empty())
+	{
+		fprintf(stderr, "%s: no samples\n", traceName);
+		return(1);
+	}
+
+	std::vector<SChange>	actual;
+	std::vector<SChange>	detected;
+	Replay(trace, step, actual, detected);
+
+	uint32_t	traceEnd = trace.back().time + (DCConfig::kNumDeltas +
+					DCConfig::kNumDeltaAvgs) * DCConfig::kPressureUpdatePeriod;
+	printf("%s: %u samples, %.1f minutes, dirty delta %u Pa, CheckFilter every %u ms\n",
+		traceName, (uint32_t)trace.size(), (double)trace.back().time / 60000,
+		dirtyDelta, step);
+	printf("  controller status changes:\n");
+	for (size_t i = 0; i < detected.size(); i++)
+	{
+		printf("    %7.1f s  %s -> %s\n", (double)detected[i].time / 1000,
+			StatusName(detected[i].from), StatusName(detected[i].to));
+	}
+	Score(actual, detected, traceEnd);
+	return(0);
+}
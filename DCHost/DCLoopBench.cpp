@@ -0,0 +1,120 @@
+/*
+*	DCLoopBench.cpp, Copyright Jonathan Mackey 2021
+*	Host benchmark of the DCController main loop.
+*
+*	Builds the unmodified DCController sketch against the host stand-ins in
+*	Stubs/ and calls setup() then loop() repeatedly.  Simulated time advances
+*	by a fixed step each iteration plus whatever the code under test spends in
+*	delay() and on the SPI bus.  The UI is exercised by periodic simulated
+*	button presses.
+*
+*	Usage: DCLoopBench [iterations [step us]]
+*
+*	At exit the LoopProfiler statistics are printed for loop, CheckGates,
+*	CheckFilter, CheckDustBinMotor and UpdateDisplay, followed by the
+*	SPITracer statistics for each device on the SPI bus, the EEPROMTracer
+*	statistics and the DeadlineMonitor lateness of each periodic task.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#include "DCController.ino"
+#include "HostBMP280.h"
+
+HostBMP280	bmp280Ambient(DCConfig::kBMP0CSPin);
+HostBMP280	bmp280Duct(DCConfig::kBMP1CSPin);
+
+extern "C" void PCINT0_vect(void);
+extern "C" void TIMER2_OVF_vect(void);
+
+/*
+*	Button presses used to cycle through the UI modes.  Each entry is a PINA
+*	bit number.
+*/
+static const uint8_t	kButtonScript[] =
+{
+	PINA7, PINA7, PINA6, PINA6, PINA5, PINA4, PINA3, PINA7, PINA5, PINA4,
+	PINA6, PINA6, PINA6, PINA5, PINA3, PINA3, PINA5, PINA4
+};
+const uint32_t	kButtonPeriod = 1500;	// ms between button presses
+const uint32_t	kButtonDownTime = 100;	// ms
+
+/*********************************** main *************************************/
+int main(
+	int		argc,
+	char*	argv[])
+{
+	uint32_t	iterations = argc > 1 ? strtoul(argv[1], nullptr, 0) : 200000;
+	uint32_t	stepUS = argc > 2 ? strtoul(argv[2], nullptr, 0) : 100;
+	
+	setup();
+	profileDumpPeriod.Set(0);	// Disable the sketch's periodic dumps/resets
+	spiTraceDumpPeriod.Set(0);
+	eepromTraceDumpPeriod.Set(0);
+	deadlineDumpPeriod.Set(0);
+	LoopProfiler::Reset();
+	SPITracer::Reset();
+	EEPROMTracer::Reset();
+	DeadlineMonitor::Reset();
+	
+	MSPeriod	rtcTickPeriod(1000);
+	MSPeriod	buttonPeriod(kButtonPeriod);
+	MSPeriod	buttonDownPeriod;
+	uint8_t		buttonIndex = 0;
+	rtcTickPeriod.Start();
+	buttonPeriod.Start();
+	
+	HardwareSerial::sEnabled = false;
+	for (uint32_t i = 0; i < iterations; i++)
+	{
+		loop();
+		HostClock::Advance(stepUS);
+		if (rtcTickPeriod.Passed())
+		{
+			rtcTickPeriod.Start();
+			TIMER2_OVF_vect();
+		}
+		if (buttonPeriod.Passed())
+		{
+			buttonPeriod.Start();
+			PINA &= ~_BV(kButtonScript[buttonIndex]);
+			PCINT0_vect();
+			buttonIndex = (buttonIndex + 1) % sizeof(kButtonScript);
+			buttonDownPeriod.Set(kButtonDownTime);
+			buttonDownPeriod.Start();
+		} else if (buttonDownPeriod.Passed())
+		{
+			buttonDownPeriod.Set(0);
+			PINA |= DCConfig::kPINABtnMask;
+			PCINT0_vect();
+		}
+	}
+	HardwareSerial::sEnabled = true;
+
+	Serial.print(F("Iterations: "));
+	Serial.print(iterations);
+	Serial.print(F(", simulated time: "));
+	Serial.print(millis());
+	Serial.print(F(" ms, pressure reads: "));
+	Serial.println(bmp280Ambient.GetForcedReadCount());
+	DustCollector::DumpLoopProfile();
+	SPITracer::Dump();
+	EEPROMTracer::Dump();
+	DustCollector::DumpDeadlines();
+	return(0);
+}
@@ -0,0 +1,452 @@
+/*
+*	DCMicroBench.cpp, Copyright Jonathan Mackey 2021
+*	Times the small functions the controller calls on every gate, pressure,
+*	display and CAN event, and compares the results to a stored baseline so
+*	that a change that slows down one of them shows up.
+*
+*	usage: DCMicroBench [baseline [update]]
+*		baseline	the baseline file, see MicroBenchBaseline.txt.  When
+*					given, each result is compared to its baseline value and
+*					the exit status is 1 if any is more than kTolerance
+*					percent slower.
+*		update		write the results to the baseline file instead.
+*
+*	The results are host CPU cycles per call (the time stamp counter on x86,
+*	otherwise nanoseconds.)  Each benchmark is run kRuns times and the fastest
+*	run is used, which is the least affected by other activity on the host.  The baseline is only meaningful on the machine it was made on;
+*	run with update before making a change to get a baseline for comparison.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#include <stdio.h>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC	1
+#endif
+#include "DCController.ino"
+#include "DCMessages.h"
+#include "HostBMP280.h"
+
+HostBMP280	bmp280Ambient(DCConfig::kBMP1CSPin);
+HostBMP280	bmp280Duct(DCConfig::kBMP0CSPin);
+
+const uint8_t	kRuns = 31;
+const uint32_t	kTolerance = 25;	// percent
+const uint8_t	kNumGateSets = 24;
+#ifdef HAVE_RDTSC
+static const char	kUnit[] = "cycles";
+#else
+static const char	kUnit[] = "ns";
+#endif
+
+static volatile uint32_t	sSink;	// Keeps the results from being optimized away
+
+class GateSetsProbe : public GateSets
+{
+public:
+	static uint8_t			Count(
+								uint32_t				inValue)
+								{return(CountBits(inValue));}
+};
+
+class BMP280Probe : public BMP280SPI
+{
+public:
+							BMP280Probe(
+								uint8_t					inCSPin)
+								: BMP280SPI(inCSPin){}
+	void					SetTemp(
+								int32_t					inUncompTemp)
+								{UncompToCompTemp32(inUncompTemp);}	// Sets t_fine
+	uint32_t				Pressure(
+								int32_t					inUncompPres)
+								{return(UncompToCompPres32(inUncompPres));}
+};
+
+static BMP280Probe	sBMP280(DCConfig::kBMP1CSPin);
+
+/********************************** Now ***************************************/
+static inline uint64_t Now(void)
+{
+#ifdef HAVE_RDTSC
+	return(__rdtsc());
+#else
+	return(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+/******************************* BenchCountBits *******************************/
+static void BenchCountBits(
+	uint32_t	inCalls)
+{
+	uint32_t	sum = 0;
+	uint32_t	value = 0x9E3779B9;
+	for (uint32_t i = 0; i < inCalls; i++)
+	{
+		sum += GateSetsProbe::Count(value);
+		value = value * 1664525 + 1013904223;
+	}
+	sSink = sum;
+}
+
+/************************** BenchGoToNearestGateSet ***************************/
+/*
+*	Mostly masks without a set, which walks all of the sets.
+*/
+static void BenchGoToNearestGateSet(
+	uint32_t	inCalls)
+{
+	GateSets&	gateSets = dustCollector.GetGateSets();
+	uint32_t	sum = 0;
+	uint32_t	mask = 0x1234567;
+	for (uint32_t i = 0; i < inCalls; i++)
+	{
+		sum += gateSets.GoToNearestGateSet(mask & 0xFFFF);
+		mask = mask * 1664525 + 1013904223;
+	}
+	sSink = sum;
+}
+
+/******************************* BenchFindGlyph *******************************/
+static void BenchFindGlyph(
+	uint32_t	inCalls)
+{
+	uint32_t	sum = 0;
+	for (uint32_t i = 0; i < inCalls; i++)
+	{
+		sum += dustCollectorUI.FindGlyph(' ' + (i % 95));
+	}
+	sSink = sum;
+}
+
+/******************************** BenchNextChar *******************************/
+/*
+*	Per character, the string has one 2 byte UTF-8 character.
+*/
+static void BenchNextChar(
+	uint32_t	inCalls)
+{
+	static const char	kStr[] = "Filter loaded, 21.5\xC2\xB0";
+	const uint32_t	kChars = 20;
+	uint32_t	sum = 0;
+	for (uint32_t i = 0; i < inCalls; i += kChars)
+	{
+		const char*	str = kStr;
+		for (uint32_t j = 0; j < kChars; j++)
+		{
+			sum += XFont::NextChar(str);
+		}
+	}
+	sSink = sum;
+}
+
+/****************************** BenchMeasureStr *******************************/
+static void BenchMeasureStr(
+	uint32_t	inCalls)
+{
+	static const char* const	kStrs[] =
+	{
+		"Gate Sensors", "Filter loaded", "All gates OK", "Dust bin full"
+	};
+	uint32_t	sum = 0;
+	for (uint32_t i = 0; i < inCalls; i++)
+	{
+		uint16_t	height, width;
+		dustCollectorUI.MeasureStr(kStrs[i & 3], height, width);
+		sum += width;
+	}
+	sSink = sum;
+}
+
+/*************************** BenchUncompToCompPres32 **************************/
+static void BenchUncompToCompPres32(
+	uint32_t	inCalls)
+{
+	uint32_t	sum = 0;
+	for (uint32_t i = 0; i < inCalls; i++)
+	{
+		sum += sBMP280.Pressure(415148 + (i & 0x3FF));
+	}
+	sSink = sum;
+}
+
+/***************************** BenchDateComponents ****************************/
+static void BenchDateComponents(
+	uint32_t	inCalls)
+{
+	uint32_t	sum = 0;
+	for (uint32_t i = 0; i < inCalls; i++)
+	{
+		uint16_t	year;
+		uint8_t		month, day;
+		sum += UnixTime::DateComponents(0x61000000 + i * 86413, year, month, day);
+		sum += day;
+	}
+	sSink = sum;
+}
+
+/***************************** BenchCreateTimeStr *****************************/
+static void BenchCreateTimeStr(
+	uint32_t	inCalls)
+{
+	char	timeStr[16];
+	uint32_t	sum = 0;
+	for (uint32_t i = 0; i < inCalls; i++)
+	{
+		sum += UnixTime::CreateTimeStr(0x61000000 + i * 61, timeStr);
+		sum += timeStr[4];
+	}
+	sSink = sum;
+}
+
+/******************************* BenchCANFramePack ****************************/
+/*
+*	A gate state frame as sent by a sensor, packing the standard and
+*	extended IDs into the MCP2515 register layout.
+*/
+static void BenchCANFramePack(
+	uint32_t	inCalls)
+{
+	uint32_t	sum = 0;
+	for (uint32_t i = 0; i < inCalls; i++)
+	{
+		CANFrame	canFrame(DCSensor::eGateIsOpen, DCConfig::kControllerID,
+						(uint32_t)(0x3FFE0 + (i & 0x1F)));
+		sum += canFrame.GetRawFrame()[1];
+	}
+	sSink = sum;
+}
+
+/****************************** BenchCANFrameUnpack ***************************/
+static void BenchCANFrameUnpack(
+	uint32_t	inCalls)
+{
+	CANFrame	canFrames[32];
+	for (uint8_t i = 0; i < 32; i++)
+	{
+		canFrames[i] = CANFrame((uint16_t)(DCController::eRequestGateState + (i & 7)),
+							(uint32_t)(0x3FFE0 + i));
+	}
+	uint32_t	sum = 0;
+	for (uint32_t i = 0; i < inCalls; i++)
+	{
+		const CANFrame&	canFrame = canFrames[i & 0x1F];
+		sum += canFrame.GetStandardID() + canFrame.GetExtendedID();
+	}
+	sSink = sum;
+}
+
+/**************************** BenchXFont16BitRead *****************************/
+/*
+*	Per glyph, LoadGlyph then Read of the glyph's pixels in 16 pixel blocks,
+*	as when drawing a glyph.
+*/
+static void BenchXFont16BitRead(
+	uint32_t	inCalls)
+{
+	static const char	kGlyphs[] = "WgF8%";
+	uint16_t	pixels[16];
+	uint32_t	sum = 0;
+	for (uint32_t i = 0; i < inCalls; i++)
+	{
+		dustCollectorUI.LoadGlyph(kGlyphs[i % 5]);
+		const GlyphHeader&	glyph = dustCollectorUI.Glyph();
+		uint32_t	pixelsLeft = (uint32_t)glyph.rows * glyph.columns;
+		while (pixelsLeft)
+		{
+			uint32_t	pixelsToRead = pixelsLeft > 16 ? 16 : pixelsLeft;
+			MyriadPro_Regular_18::xFontDataStream.Read(pixelsToRead, pixels);
+			pixelsLeft -= pixelsToRead;
+			sum += pixels[0];
+		}
+	}
+	sSink = sum;
+}
+
+struct SBench
+{
+	const char*	name;
+	void		(*func)(uint32_t);
+	uint32_t	calls;
+	double		result;
+};
+
+static SBench	sBenches[] =
+{
+	{"GateSets::CountBits",				BenchCountBits,				10000},
+	{"GateSets::GoToNearestGateSet",	BenchGoToNearestGateSet,	200},
+	{"XFont::FindGlyph",				BenchFindGlyph,				20000},
+	{"XFont::NextChar",					BenchNextChar,				40000},
+	{"XFont::MeasureStr",				BenchMeasureStr,			4000},
+	{"XFont16BitDataStream::Read",		BenchXFont16BitRead,		200},
+	{"BMP280SPI::UncompToCompPres32",	BenchUncompToCompPres32,	20000},
+	{"UnixTime::DateComponents",		BenchDateComponents,		20000},
+	{"UnixTime::CreateTimeStr",			BenchCreateTimeStr,			20000},
+	{"CANFrame pack",					BenchCANFramePack,			40000},
+	{"CANFrame unpack",					BenchCANFrameUnpack,		40000}
+};
+const uint8_t	kNumBenches = sizeof(sBenches)/sizeof(SBench);
+
+/*********************************** Measure **********************************/
+/*
+*	Returns the time per call of the fastest of kRuns runs.
+*/
+static double Measure(
+	const SBench&	inBench)
+{
+	uint64_t	fastest = ~(uint64_t)0;
+	for (uint8_t i = 0; i < kRuns; i++)
+	{
+		uint64_t	start = Now();
+		inBench.func(inBench.calls);
+		uint64_t	elapsed = Now() - start;
+		if (elapsed < fastest)
+		{
+			fastest = elapsed;
+		}
+	}
+	return((double)fastest / inBench.calls);
+}
+
+/******************************** ReadBaseline ********************************/
+/*
+*	Returns the baseline value for inName or 0 if there isn't one.
+*/
+static double ReadBaseline(
+	FILE*		inFile,
+	const char*	inName)
+{
+	char	line[128];
+	double	baseline = 0;
+	rewind(inFile);
+	while (fgets(line, sizeof(line), inFile))
+	{
+		char*	tab = strchr(line, '\t');
+		if (line[0] != '#' &&
+			tab)
+		{
+			*tab = 0;
+			if (strcmp(line, inName) == 0)
+			{
+				baseline = strtod(tab + 1, nullptr);
+				break;
+			}
+		}
+	}
+	return(baseline);
+}
+
+/*********************************** main *************************************/
+int main(
+	int		argc,
+	char*	argv[])
+{
+	const char*	baselineName = argc > 1 ? argv[1] : nullptr;
+	bool		update = argc > 2 && strcmp(argv[2], "update") == 0;
+
+	HardwareSerial::sEnabled = false;
+	setup();
+	profileDumpPeriod.Set(0);
+	spiTraceDumpPeriod.Set(0);
+	eepromTraceDumpPeriod.Set(0);
+	deadlineDumpPeriod.Set(0);
+	sBMP280.begin();
+	sBMP280.SetTemp(519888);
+	{
+		/*
+		*	Gate sets with 1 to 5 of the first 16 gates open.
+		*/
+		GateSets&	gateSets = dustCollector.GetGateSets();
+		for (uint8_t i = 0; i < kNumGateSets; i++)
+		{
+			uint32_t	mask = 0;
+			for (uint8_t j = 0; j <= (i % 5); j++)
+			{
+				mask |= (uint32_t)1 << ((i * 7 + j * 3) & 0xF);
+			}
+			gateSets.SaveCleanSet(mask, 100 + i);
+		}
+	}
+	/*
+	*	Run everything once first so the host CPU is at full speed before
+	*	anything is timed.
+	*/
+	for (uint8_t i = 0; i < kNumBenches; i++)
+	{
+		sBenches[i].func(sBenches[i].calls);
+	}
+	for (uint8_t i = 0; i < kNumBenches; i++)
+	{
+		sBenches[i].result = Measure(sBenches[i]);
+	}
+
+	if (update)
+	{
+		FILE*	file = fopen(baselineName, "w");
+		if (!file)
+		{
+			perror(baselineName);
+			return(1);
+		}
+		fprintf(file, "# DCMicroBench baseline, %s per call.  Regenerate with:\n", kUnit);
+		fprintf(file, "# DCMicroBench %s update\n", baselineName);
+		for (uint8_t i = 0; i < kNumBenches; i++)
+		{
+			fprintf(file, "%s\t%.1f\n", sBenches[i].name, sBenches[i].result);
+		}
+		fclose(file);
+		printf("%s updated\n", baselineName);
+	}
+	FILE*	baselineFile = baselineName && !update ? fopen(baselineName, "r") : nullptr;
+	if (baselineName && !update && !baselineFile)
+	{
+		perror(baselineName);
+	}
+	uint8_t	slower = 0;
+	printf("%-32s %10s %10s %8s\n", "", kUnit, "baseline", "change");
+	for (uint8_t i = 0; i < kNumBenches; i++)
+	{
+		const SBench&	bench = sBenches[i];
+		printf("%-32s %10.1f", bench.name, bench.result);
+		double	baseline = baselineFile ? ReadBaseline(baselineFile, bench.name) : 0;
+		if (baseline > 0)
+		{
+			double	change = (bench.result - baseline) * 100 / baseline;
+			printf(" %10.1f %+7.0f%%", baseline, change);
+			if (change > kTolerance)
+			{
+				printf("  SLOWER");
+				slower++;
+			}
+		}
+		printf("\n");
+	}
+	if (baselineFile)
+	{
+		fclose(baselineFile);
+		if (slower)
+		{
+			printf("%u of %u more than %u%% slower than the baseline\n",
+				slower, kNumBenches, kTolerance);
+		}
+	}
+	return(slower ? 1 : 0);
+}
@@ -0,0 +1,147 @@
+/*
+*	HostBMP280.cpp, Copyright Jonathan Mackey 2021
+*	Register level model of a BMP280 on the SPI bus.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#include "HostBMP280.h"
+#include "bmp280_defs.h"
+#include "BMP280SPI.h"
+
+/*
+*	A BMP280SPI whose compensation parameters are copied from the model's
+*	calibration registers rather than read over SPI.  Used to find the
+*	uncompensated value for a given pressure using the driver's own
+*	compensation code.
+*/
+class BMP280Compensator : public BMP280SPI
+{
+public:
+							BMP280Compensator(
+								uint8_t					inCSPin,
+								const uint8_t*			inCalib,
+								int32_t					inUncompTemp)
+								: BMP280SPI(inCSPin)
+							{
+								memcpy(&mCParams, inCalib, BMP280_CALIB_DATA_SIZE);
+								UncompToCompTemp32(inUncompTemp);	// Sets t_fine
+							}
+	uint32_t				Pressure(
+								int32_t					inUncompPres)
+								{return(UncompToCompPres32(inUncompPres));}
+};
+
+/********************************* HostBMP280 *********************************/
+HostBMP280::HostBMP280(
+	uint8_t	inCSPin)
+	: HostSPIDevice(inCSPin), mAddr(0), mHaveAddr(false), mRead(false),
+	  mForcedReadCount(0)
+{
+	static const uint16_t	kCalib[] =
+	{
+		27504, 26435, (uint16_t)-1000,		// dig_T1..3
+		36477, (uint16_t)-10685, 3024, 2855,	// dig_P1..4
+		140, (uint16_t)-7, 15500, (uint16_t)-14600, 6000	// dig_P5..9
+	};
+	memset(mReg, 0, sizeof(mReg));
+	mReg[BMP280_CHIP_ID_ADDR] = BMP280_CHIP_ID3;
+	for (uint8_t i = 0; i < sizeof(kCalib)/sizeof(kCalib[0]); i++)
+	{
+		mReg[BMP280_DIG_T1_LSB_ADDR + i*2] = kCalib[i] & 0xFF;
+		mReg[BMP280_DIG_T1_LSB_ADDR + i*2 + 1] = kCalib[i] >> 8;
+	}
+	SetUncompData(415148, 519888);
+	SPI.Attach(this);
+}
+
+/******************************* SetUncompData ********************************/
+void HostBMP280::SetUncompData(
+	int32_t	inUncompPres,
+	int32_t	inUncompTemp)
+{
+	mReg[BMP280_PRES_MSB_ADDR] = (uint8_t)(inUncompPres >> 12);
+	mReg[BMP280_PRES_MSB_ADDR+1] = (uint8_t)(inUncompPres >> 4);
+	mReg[BMP280_PRES_MSB_ADDR+2] = (uint8_t)(inUncompPres << 4);
+	mReg[BMP280_PRES_MSB_ADDR+3] = (uint8_t)(inUncompTemp >> 12);
+	mReg[BMP280_PRES_MSB_ADDR+4] = (uint8_t)(inUncompTemp >> 4);
+	mReg[BMP280_PRES_MSB_ADDR+5] = (uint8_t)(inUncompTemp << 4);
+	mUncompTemp = inUncompTemp;
+}
+
+/******************************** SetPressure *********************************/
+/*
+*	The compensated pressure decreases as the uncompensated (20 bit) value
+*	increases.  This does a binary search for the smallest uncompensated value
+*	that compensates to a pressure less than or equal to inPressure.
+*/
+void HostBMP280::SetPressure(
+	uint32_t	inPressure)
+{
+	BMP280Compensator	compensator(mCSPin, &mReg[BMP280_DIG_T1_LSB_ADDR], mUncompTemp);
+	int32_t	low = 0;
+	int32_t	high = 0xFFFFF;
+	while (low < high)
+	{
+		int32_t	mid = (low + high) / 2;
+		if (compensator.Pressure(mid) > inPressure)
+		{
+			low = mid + 1;
+		} else
+		{
+			high = mid;
+		}
+	}
+	SetUncompData(low, mUncompTemp);
+}
+
+/*********************************** Select ***********************************/
+void HostBMP280::Select(void)
+{
+	mHaveAddr = false;
+}
+
+/********************************** Transfer **********************************/
+/*
+*	The first byte of a transaction is the register address with bit 7 set for
+*	a read.  Reads auto-increment, writes are address/data pairs.
+*/
+uint8_t HostBMP280::Transfer(
+	uint8_t	inByte)
+{
+	uint8_t	result = 0xFF;
+	if (!mHaveAddr)
+	{
+		mHaveAddr = true;
+		mRead = (inByte & 0x80) != 0;
+		mAddr = inByte | 0x80;
+	} else if (mRead)
+	{
+		result = mReg[mAddr++];
+	} else
+	{
+		mReg[mAddr] = inByte;
+		if (mAddr == BMP280_CTRL_MEAS_ADDR &&
+			(inByte & BMP280_FORCED_MODE))
+		{
+			mForcedReadCount++;
+		}
+		mHaveAddr = false;
+	}
+	return(result);
+}
@@ -0,0 +1,59 @@
+/*
+*	HostBMP280.h, Copyright Jonathan Mackey 2021
+*	Register level model of a BMP280 on the SPI bus.  The calibration data and
+*	the default raw readings are the example values from the Bosch datasheet
+*	(section 8.2), which compensate to 25.08C and 100653 Pa.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef HostBMP280_h
+#define HostBMP280_h
+
+#include <SPI.h>
+
+class HostBMP280 : public HostSPIDevice
+{
+public:
+							HostBMP280(
+								uint8_t					inCSPin);
+	virtual void			Select(void);
+	virtual uint8_t			Transfer(
+								uint8_t					inByte);
+	void					SetUncompData(
+								int32_t					inUncompPres,
+								int32_t					inUncompTemp);
+							/*
+							*	Sets the uncompensated pressure that
+							*	BMP280SPI::DoForcedRead will compensate to
+							*	inPressure (Pa) at the current temperature.
+							*/
+	void					SetPressure(
+								uint32_t				inPressure);
+	uint32_t				GetForcedReadCount(void) const
+								{return(mForcedReadCount);}
+protected:
+	uint8_t		mReg[256];
+	uint8_t		mAddr;
+	bool		mHaveAddr;
+	bool		mRead;
+	uint32_t	mForcedReadCount;
+	int32_t		mUncompTemp;
+};
+
+#endif // HostBMP280_h
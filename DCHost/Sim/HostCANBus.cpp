@@ -0,0 +1,473 @@
+/*
+*	HostCANBus.cpp, Copyright Jonathan Mackey 2021
+*	A CAN bus connecting HostMCP2515 models.
+*
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#include "HostCANBus.h"
+
+/*
+*	Bits after the CRC sequence: CRC delimiter, ACK slot, ACK delimiter, EOF
+*	and the interframe space.
+*/
+const uint8_t	kFrameTrailerBits = 1 + 2 + 7 + 3;
+/*
+*	Error flag, worst case superposition of the other nodes' error flags,
+*	error delimiter and the interframe space.
+*/
+const uint8_t	kErrorFrameBits = 6 + 6 + 8 + 3;
+/*
+*	A node configured for a different bit rate detects a stuff or form error
+*	within the arbitration field.
+*/
+const uint8_t	kBitRateErrorPos = 16;
+/*
+*	Recovery from bus off requires 128 occurrences of 11 recessive bits.
+*/
+const uint16_t	kBusOffRecoveryBits = 128 * 11;
+const uint8_t	kSuspendTransmissionBits = 8;
+
+/********************************* HostCANBus *********************************/
+HostCANBus::HostCANBus(
+	uint32_t	inBitRate)
+	: mNumNodes(0), mInjectedHead(0), mInjectedCount(0), mToolPresent(false),
+	  mMonitor(nullptr), mBitRate(inBitRate), mBusy(false),
+	  mErrorFrame(false), mAckError(false), mIdleNanos(0), mEndNanos(0),
+	  mNumTransmitters(0)
+{
+	ClearStats();
+}
+
+/*********************************** Attach ***********************************/
+void HostCANBus::Attach(
+	HostMCP2515*	inController)
+{
+	if (mNumNodes < kMaxNodes)
+	{
+		mNodes[mNumNodes] = inController;
+		mNumNodes++;
+	}
+}
+
+/*********************************** Inject ***********************************/
+bool HostCANBus::Inject(
+	const uint8_t*	inRawFrame)
+{
+	bool	success = mInjectedCount < kMaxInjected;
+	if (success)
+	{
+		uint8_t	index = (mInjectedHead + mInjectedCount) % kMaxInjected;
+		memcpy(mInjected[index], inRawFrame, HostMCP2515::kRawFrameSize);
+		mInjectedNanos[index] = HostClock::Nanos();
+		mInjectedCount++;
+		mToolPresent = true;
+	}
+	return(success);
+}
+
+/********************************** Service ***********************************/
+/*
+*	Completes the frame in progress and starts the following frames until the
+*	current time is reached.
+*/
+void HostCANBus::Service(void)
+{
+	uint64_t	now = HostClock::Nanos();
+	while (true)
+	{
+		if (mBusy)
+		{
+			if (mEndNanos > now)
+			{
+				break;
+			}
+			EndFrame();
+		}
+		uint64_t	startNanos = UINT64_MAX;
+		for (uint8_t i = 0; i < mNumNodes; i++)
+		{
+			HostMCP2515*	node = mNodes[i];
+			if (node->IsBusOff() &&
+				node->GetHoldOffNanos() <= now)
+			{
+				node->RecoverFromBusOff();
+			}
+			int8_t	buffer = node->GetPendingTxBuffer();
+			if (buffer >= 0)
+			{
+				uint64_t	readyNanos = max(node->GetTxRequestNanos(buffer), node->GetHoldOffNanos());
+				if (readyNanos < startNanos)
+				{
+					startNanos = readyNanos;
+				}
+			}
+		}
+		if (mInjectedCount &&
+			mInjectedNanos[mInjectedHead] < startNanos)
+		{
+			startNanos = mInjectedNanos[mInjectedHead];
+		}
+		if (startNanos == UINT64_MAX)
+		{
+			break;
+		}
+		if (startNanos < mIdleNanos)
+		{
+			startNanos = mIdleNanos;
+		}
+		if (startNanos > now)
+		{
+			break;
+		}
+		StartFrame(startNanos);
+	}
+}
+
+/********************************* StartFrame *********************************/
+/*
+*	All nodes ready to transmit at inStartNanos start a frame.  Arbitration is
+*	resolved by comparing the unstuffed bit sequences of the frames.  The
+*	lowest sequence wins.  A node whose sequence differs from the winner after
+*	the arbitration field is sending a different frame with the same ID.  It
+*	detects a bit error.  If the node is error active its error flag destroys
+*	the frame, otherwise only the node's own transmission fails.
+*/
+void HostCANBus::StartFrame(
+	uint64_t	inStartNanos)
+{
+	STransmitter	candidates[kMaxNodes+1];
+	uint8_t			bits[kMaxNodes+1][kMaxFrameBits];
+	uint8_t			numCandidates = 0;
+	for (uint8_t i = 0; i < mNumNodes; i++)
+	{
+		HostMCP2515*	node = mNodes[i];
+		mWoke[i] = node->GetMode() == HostMCP2515::eSleepMode;
+		node->BusActivity();
+		int8_t	buffer = node->GetPendingTxBuffer();
+		if (buffer >= 0 &&
+			node->GetTxRequestNanos(buffer) <= inStartNanos &&
+			node->GetHoldOffNanos() <= inStartNanos)
+		{
+			candidates[numCandidates].node = i;
+			candidates[numCandidates].buffer = buffer;
+			candidates[numCandidates].failed = false;
+			numCandidates++;
+		}
+	}
+	if (mInjectedCount &&
+		mInjectedNanos[mInjectedHead] <= inStartNanos)
+	{
+		candidates[numCandidates].node = kTool;
+		candidates[numCandidates].buffer = 0;
+		candidates[numCandidates].failed = false;
+		numCandidates++;
+	}
+	uint8_t	winner = 0;
+	uint8_t	numBits = 0;
+	for (uint8_t i = 0; i < numCandidates; i++)
+	{
+		numBits = FrameToBits(TxFrame(candidates[i].node, candidates[i].buffer), bits[i]);
+		if (i && memcmp(bits[i], bits[winner], min(numBits, kMaxFrameBits)) < 0)
+		{
+			winner = i;
+		}
+	}
+	const uint8_t*	winnerBits = bits[winner];
+	numBits = FrameToBits(TxFrame(candidates[winner].node, candidates[winner].buffer), bits[winner]);
+	memcpy(mFrame, TxFrame(candidates[winner].node, candidates[winner].buffer), HostMCP2515::kRawFrameSize);
+	bool	extended = (mFrame[1] & 0x08) != 0;
+	uint8_t	errorPos = kMaxFrameBits;
+	mNumTransmitters = 0;
+	for (uint8_t i = 0; i < numCandidates; i++)
+	{
+		uint8_t	diffPos = 0;
+		while (diffPos < numBits && bits[i][diffPos] == winnerBits[diffPos])
+		{
+			diffPos++;
+		}
+		int8_t	nodeIndex = candidates[i].node;
+		if (diffPos < numBits)
+		{
+			/*
+			*	The IDE bit (13) is part of arbitration between standard and
+			*	extended frames.
+			*/
+			if (diffPos <= 13 || (extended && diffPos <= 32))
+			{
+				mStats.arbitrationLosses++;
+				if (nodeIndex != kTool)
+				{
+					mNodes[nodeIndex]->TxLostArbitration(candidates[i].buffer);
+				}
+				continue;
+			}
+			mStats.collisions++;
+			candidates[i].failed = true;
+			if ((nodeIndex == kTool || !mNodes[nodeIndex]->IsErrorPassive()) &&
+				diffPos < errorPos)
+			{
+				errorPos = diffPos;
+			}
+		}
+		mTransmitters[mNumTransmitters] = candidates[i];
+		mNumTransmitters++;
+	}
+	/*
+	*	A transmitter or an error active receiver with a mismatched bit rate
+	*	destroys the frame.
+	*/
+	for (uint8_t i = 0; i < mNumNodes; i++)
+	{
+		HostMCP2515*	node = mNodes[i];
+		if (node->GetMode() == HostMCP2515::eNormalMode &&
+			!node->IsBusOff() &&
+			!node->BitRateMatches(mBitRate) &&
+			(IsTransmitter(i) || !node->IsErrorPassive()) &&
+			kBitRateErrorPos < errorPos)
+		{
+			errorPos = kBitRateErrorPos;
+		}
+	}
+	mErrorFrame = errorPos < numBits;
+	mAckError = false;
+	uint32_t	frameBits;
+	if (mErrorFrame)
+	{
+		frameBits = StuffedLength(winnerBits, errorPos + 1) + kErrorFrameBits;
+	} else
+	{
+		bool	acked = mToolPresent && candidates[winner].node != kTool;
+		for (uint8_t i = 0; i < mNumNodes && !acked; i++)
+		{
+			HostMCP2515*	node = mNodes[i];
+			acked = node->GetMode() == HostMCP2515::eNormalMode &&
+				!node->IsBusOff() &&
+				node->BitRateMatches(mBitRate) &&
+				!IsTransmitter(i);
+		}
+		mAckError = !acked;
+		frameBits = StuffedLength(winnerBits, numBits) +
+			(mAckError ? 2 + kErrorFrameBits : kFrameTrailerBits);
+	}
+	mEndNanos = inStartNanos + BitsToNanos(frameBits);
+	mStats.busyNanos += mEndNanos - inStartNanos;
+	mBusy = true;
+}
+
+/********************************** EndFrame **********************************/
+void HostCANBus::EndFrame(void)
+{
+	mBusy = false;
+	mIdleNanos = mEndNanos;
+	if (mErrorFrame)
+	{
+		mStats.errorFrames++;
+	} else if (mAckError)
+	{
+		mStats.ackErrors++;
+	} else
+	{
+		mStats.frames++;
+	}
+	for (uint8_t i = 0; i < mNumTransmitters; i++)
+	{
+		STransmitter&	transmitter = mTransmitters[i];
+		if (transmitter.node == kTool)
+		{
+			if (!mErrorFrame && !mAckError && !transmitter.failed)
+			{
+				mInjectedHead = (mInjectedHead + 1) % kMaxInjected;
+				mInjectedCount--;
+			}
+			continue;
+		}
+		HostMCP2515*	node = mNodes[transmitter.node];
+		if (mErrorFrame || transmitter.failed)
+		{
+			node->TxFailed(transmitter.buffer, false);
+		} else if (mAckError)
+		{
+			node->TxFailed(transmitter.buffer, true);
+		} else
+		{
+			node->TxSucceeded(transmitter.buffer);
+		}
+		if (node->IsBusOff())
+		{
+			node->SetHoldOffNanos(mEndNanos + BitsToNanos(kBusOffRecoveryBits));
+		} else if (node->IsErrorPassive())
+		{
+			node->SetHoldOffNanos(mEndNanos + BitsToNanos(kSuspendTransmissionBits));
+		}
+	}
+	if (mAckError)
+	{
+		return;
+	}
+	for (uint8_t i = 0; i < mNumNodes; i++)
+	{
+		HostMCP2515*	node = mNodes[i];
+		uint8_t	mode = node->GetMode();
+		if ((mode == HostMCP2515::eNormalMode || mode == HostMCP2515::eListenOnlyMode) &&
+			!node->IsBusOff() &&
+			!mWoke[i] &&
+			!IsTransmitter(i))
+		{
+			if (mErrorFrame || !node->BitRateMatches(mBitRate))
+			{
+				if (mode == HostMCP2515::eNormalMode)
+				{
+					node->RxFailed(1);
+				}
+			} else
+			{
+				node->Receive(mFrame);
+			}
+		}
+	}
+	if (!mErrorFrame && mMonitor)
+	{
+		mMonitor(mFrame, mEndNanos);
+	}
+}
+
+/******************************** IsTransmitter *******************************/
+bool HostCANBus::IsTransmitter(
+	int8_t	inNode) const
+{
+	for (uint8_t i = 0; i < mNumTransmitters; i++)
+	{
+		if (mTransmitters[i].node == inNode)
+		{
+			return(true);
+		}
+	}
+	return(false);
+}
+
+/********************************** TxFrame ***********************************/
+const uint8_t* HostCANBus::TxFrame(
+	int8_t	inNode,
+	uint8_t	inBuffer) const
+{
+	return(inNode == kTool ? mInjected[mInjectedHead] : mNodes[inNode]->GetTxFrame(inBuffer));
+}
+
+/********************************** PutBits ***********************************/
+static void PutBits(
+	uint32_t	inValue,
+	uint8_t		inCount,
+	uint8_t*	outBits,
+	uint8_t&	ioLength)
+{
+	while (inCount)
+	{
+		inCount--;
+		outBits[ioLength] = (inValue >> inCount) & 1;
+		ioLength++;
+	}
+}
+
+/******************************** FrameToBits *********************************/
+/*
+*	Returns the unstuffed bits from SOF through the CRC sequence.
+*/
+uint8_t HostCANBus::FrameToBits(
+	const uint8_t*	inRawFrame,
+	uint8_t*		outBits)
+{
+	uint8_t		length = 0;
+	uint16_t	sid = ((uint16_t)inRawFrame[0] << 3) | (inRawFrame[1] >> 5);
+	uint8_t		remote = (inRawFrame[4] & 0x40) ? 1 : 0;
+	uint8_t		dlc = inRawFrame[4] & 0x0F;
+	uint8_t		dataLen = remote ? 0 : min(dlc, (uint8_t)8);
+	PutBits(0, 1, outBits, length);		// SOF
+	PutBits(sid, 11, outBits, length);
+	if (inRawFrame[1] & 0x08)
+	{
+		uint32_t	eid = ((uint32_t)(inRawFrame[1] & 3) << 16) |
+							((uint32_t)inRawFrame[2] << 8) | inRawFrame[3];
+		PutBits(3, 2, outBits, length);	// SRR, IDE
+		PutBits(eid, 18, outBits, length);
+		PutBits(remote, 1, outBits, length);
+		PutBits(0, 2, outBits, length);	// r1, r0
+	} else
+	{
+		PutBits(remote, 1, outBits, length);
+		PutBits(0, 2, outBits, length);	// IDE, r0
+	}
+	PutBits(dlc, 4, outBits, length);
+	for (uint8_t i = 0; i < dataLen; i++)
+	{
+		PutBits(inRawFrame[5+i], 8, outBits, length);
+	}
+	uint16_t	crc = 0;
+	for (uint8_t i = 0; i < length; i++)
+	{
+		bool	crcNext = outBits[i] ^ ((crc >> 14) & 1);
+		crc = (crc << 1) & 0x7FFF;
+		if (crcNext)
+		{
+			crc ^= 0x4599;
+		}
+	}
+	PutBits(crc, 15, outBits, length);
+	return(length);
+}
+
+/******************************* StuffedLength ********************************/
+/*
+*	A complementary bit is inserted after 5 consecutive bits of the same
+*	value.  The stuff bit starts the next run.
+*/
+uint16_t HostCANBus::StuffedLength(
+	const uint8_t*	inBits,
+	uint8_t			inLength)
+{
+	uint16_t	length = inLength;
+	uint8_t		prevBit = inBits[0];
+	uint8_t		run = 1;
+	for (uint8_t i = 1; i < inLength; i++)
+	{
+		if (inBits[i] == prevBit)
+		{
+			run++;
+			if (run == 5)
+			{
+				length++;
+				prevBit = !prevBit;
+				run = 1;
+			}
+		} else
+		{
+			prevBit = inBits[i];
+			run = 1;
+		}
+	}
+	return(length);
+}
+
+/********************************* FrameBits **********************************/
+uint16_t HostCANBus::FrameBits(
+	const uint8_t*	inRawFrame)
+{
+	uint8_t	bits[kMaxFrameBits];
+	return(StuffedLength(bits, FrameToBits(inRawFrame, bits)) + kFrameTrailerBits);
+}
@@ -0,0 +1,148 @@
+/*
+*	HostCANBus.h, Copyright Jonathan Mackey 2021
+*	A CAN bus connecting HostMCP2515 models.  The bus models bitwise
+*	arbitration, exact frame lengths (stuffing, CRC, EOF and IFS), the ACK
+*	slot, collisions between frames with the same arbitration field but
+*	different data, error frames, error passive suspend, bus off and nodes
+*	configured for a different bit rate.
+*
+*	The bus is serviced lazily.  Service() completes and starts frames up to
+*	the current HostClock time, so it needs to be called at least every few
+*	bit times, typically from a HostClock advance hook.
+*
+*	Frames can also be injected by a virtual bus tool (e.g. a USB CAN adapter)
+*	that ACKs every frame.
+*
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef HostCANBus_h
+#define HostCANBus_h
+
+#include "HostMCP2515.h"
+
+class HostCANBus
+{
+public:
+	typedef void			(*MonitorFunc)(
+								const uint8_t*			inRawFrame,
+								uint64_t				inNanos);
+	struct SStats
+	{
+		uint32_t	frames;
+		uint32_t	errorFrames;
+		uint32_t	ackErrors;
+		uint32_t	arbitrationLosses;
+		uint32_t	collisions;			// Same arbitration field, different data
+		uint64_t	busyNanos;
+	};
+							HostCANBus(
+								uint32_t				inBitRate = 40000);
+	void					Attach(
+								HostMCP2515*			inController);
+	inline void				SetBitRate(
+								uint32_t				inBitRate)
+								{mBitRate = inBitRate;}
+	inline uint32_t			GetBitRate(void) const
+								{return(mBitRate);}
+	void					Service(void);
+	/*
+	*	Queue a frame, in the MCP2515 transmit buffer layout, to be sent by
+	*	the bus tool.
+	*/
+	bool					Inject(
+								const uint8_t*			inRawFrame);
+	inline uint8_t			GetInjectedCount(void) const
+								{return(mInjectedCount);}
+	/*
+	*	A bus tool that acknowledges frames without sending any.  Inject
+	*	also makes the tool present.
+	*/
+	inline void				AttachTool(void)
+								{mToolPresent = true;}
+	/*
+	*	The monitor is called for every frame transmitted without error.
+	*/
+	inline void				SetMonitor(
+								MonitorFunc				inMonitor)
+								{mMonitor = inMonitor;}
+	inline bool				IsIdle(void) const
+								{return(!mBusy);}
+	inline const SStats&	GetStats(void) const
+								{return(mStats);}
+	inline void				ClearStats(void)
+								{memset(&mStats, 0, sizeof(mStats));}
+	inline uint64_t			BitsToNanos(
+								uint32_t				inBits) const
+								{return((uint64_t)inBits * 1000000000 / mBitRate);}
+	/*
+	*	The length of a frame on the wire in bits including stuff bits, the
+	*	ACK slot, EOF and the interframe space.
+	*/
+	static uint16_t			FrameBits(
+								const uint8_t*			inRawFrame);
+protected:
+	static const uint8_t	kMaxNodes = 64;
+	static const uint8_t	kMaxInjected = 64;
+	static const uint8_t	kMaxFrameBits = 128;	// SOF through CRC, unstuffed
+	static const int8_t		kTool = -1;
+	struct STransmitter
+	{
+		int8_t	node;		// Index in mNodes or kTool
+		uint8_t	buffer;
+		bool	failed;		// Detected a bit error while error passive
+	};
+	HostMCP2515*	mNodes[kMaxNodes];
+	uint8_t			mNumNodes;
+	uint8_t			mInjected[kMaxInjected][HostMCP2515::kRawFrameSize];
+	uint64_t		mInjectedNanos[kMaxInjected];
+	uint8_t			mInjectedHead;
+	uint8_t			mInjectedCount;
+	bool			mToolPresent;
+	MonitorFunc		mMonitor;
+	uint32_t		mBitRate;
+	SStats			mStats;
+	// The frame in progress
+	bool			mBusy;
+	bool			mErrorFrame;
+	bool			mAckError;
+	uint64_t		mIdleNanos;
+	uint64_t		mEndNanos;
+	uint8_t			mFrame[HostMCP2515::kRawFrameSize];
+	bool			mWoke[kMaxNodes];	// Woken by this frame, frame is lost
+	STransmitter	mTransmitters[kMaxNodes+1];
+	uint8_t			mNumTransmitters;
+
+	void					StartFrame(
+								uint64_t				inStartNanos);
+	void					EndFrame(void);
+	bool					IsTransmitter(
+								int8_t					inNode) const;
+	const uint8_t*			TxFrame(
+								int8_t					inNode,
+								uint8_t					inBuffer) const;
+	static uint8_t			FrameToBits(
+								const uint8_t*			inRawFrame,
+								uint8_t*				outBits);
+	static uint16_t			StuffedLength(
+								const uint8_t*			inBits,
+								uint8_t					inLength);
+};
+
+#endif // HostCANBus_h
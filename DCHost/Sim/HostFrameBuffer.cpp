@@ -0,0 +1,283 @@
+/*
+*	HostFrameBuffer.cpp, Copyright Jonathan Mackey 2021
+*	RGB565 frame buffer DisplayController.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#include "HostFrameBuffer.h"
+#include "TFT_ST77XX.h"
+#include <DataStream.h>
+#include <stdio.h>
+
+/****************************** HostFrameBuffer *******************************/
+HostFrameBuffer::HostFrameBuffer(
+	uint16_t	inRows,
+	uint16_t	inColumns,
+	bool		inIsBGR)
+	: DisplayController(inRows, inColumns),
+	  mStartColumn(0), mEndColumn(inColumns-1), mStartRow(0), mEndRow(inRows-1),
+	  mPtrColumn(0), mPtrRow(0), mWriting(false), mSleeping(false),
+	  mIsBGR(inIsBGR)
+{
+	mPixels = new uint16_t[(uint32_t)inRows * inColumns];
+	memset(mPixels, 0, (uint32_t)inRows * inColumns * sizeof(uint16_t));
+	ResetStats();
+}
+
+/****************************** ~HostFrameBuffer ******************************/
+HostFrameBuffer::~HostFrameBuffer(void)
+{
+	delete [] mPixels;
+}
+
+/********************************* ResetStats *********************************/
+void HostFrameBuffer::ResetStats(void)
+{
+	memset(&mStats, 0, sizeof(mStats));
+}
+
+/********************************** Command ***********************************/
+/*
+*	Any command other than RAMWR ends a memory write.  Pixel data sent after
+*	the command's parameters is ignored by the controller.
+*/
+void HostFrameBuffer::Command(
+	uint8_t	inDataBytes)
+{
+	mStats.commands++;
+	mStats.bytes += 1 + inDataBytes;
+	mWriting = false;
+}
+
+/********************************* WritePixel *********************************/
+/*
+*	The RAM write pointer moves left to right within the column window, then
+*	to the start column of the next row.  After the last row of the window it
+*	wraps to the first row.
+*/
+void HostFrameBuffer::WritePixel(
+	uint16_t	inPixel)
+{
+	mStats.bytes += 2;
+	mStats.pixels++;
+	if (mWriting &&
+		mStartColumn <= mEndColumn &&
+		mStartRow <= mEndRow)
+	{
+		if (mPtrRow < mRows &&
+			mPtrColumn < mColumns)
+		{
+			mPixels[(uint32_t)mPtrRow * mColumns + mPtrColumn] = inPixel;
+		} else
+		{
+			mStats.droppedPixels++;
+		}
+		if (mPtrColumn < mEndColumn)
+		{
+			mPtrColumn++;
+		} else
+		{
+			mPtrColumn = mStartColumn;
+			mPtrRow = mPtrRow < mEndRow ? (mPtrRow + 1) : mStartRow;
+		}
+	} else
+	{
+		mStats.droppedPixels++;
+	}
+}
+
+/*********************************** MoveTo ***********************************/
+void HostFrameBuffer::MoveTo(
+	uint16_t	inRow,
+	uint16_t	inColumn)
+{
+	MoveToRow(inRow);
+	mColumn = inColumn;
+}
+
+/********************************* MoveToRow **********************************/
+/*
+*	Same as TFT_ST77XX, the row range is set from inRow to the last row.
+*/
+void HostFrameBuffer::MoveToRow(
+	uint16_t inRow)
+{
+	SetRowRange(inRow, mRows - 1);
+	mRow = inRow;
+}
+
+/******************************** MoveToColumn ********************************/
+// Doesn't make any changes to the controller, same as TFT_ST77XX.
+void HostFrameBuffer::MoveToColumn(
+	uint16_t inColumn)
+{
+	mColumn = inColumn;
+}
+
+/******************************* SetColumnRange *******************************/
+/*
+*	CASET followed by RAMWR.  RAMWR resets the write pointer to the start
+*	column and the start row of the current row range.
+*/
+void HostFrameBuffer::SetColumnRange(
+	uint16_t	inStartColumn,
+	uint16_t	inEndColumn)
+{
+	mStats.transactions++;
+	Command(4);	// CASET
+	mStartColumn = inStartColumn;
+	mEndColumn = inEndColumn;
+	if (inStartColumn > inEndColumn)
+	{
+		mStats.invalidWindows++;
+	}
+	Command(0);	// RAMWR
+	mPtrColumn = mStartColumn;
+	mPtrRow = mStartRow;
+	mWriting = true;
+}
+
+/******************************** SetRowRange *********************************/
+/*
+*	RASET only.  As with TFT_ST77XX, SetRowRange should be called before
+*	SetColumnRange.
+*/
+void HostFrameBuffer::SetRowRange(
+	uint16_t	inStartRow,
+	uint16_t	inEndRow)
+{
+	mStats.transactions++;
+	Command(4);	// RASET
+	mStartRow = inStartRow;
+	mEndRow = inEndRow;
+	if (inStartRow > inEndRow)
+	{
+		mStats.invalidWindows++;
+	}
+}
+
+/*********************************** Sleep ************************************/
+void HostFrameBuffer::Sleep(void)
+{
+	mStats.transactions++;
+	Command(0);	// SLPIN
+	mSleeping = true;
+}
+
+/*********************************** WakeUp ***********************************/
+void HostFrameBuffer::WakeUp(void)
+{
+	mStats.transactions++;
+	Command(0);	// SLPOUT
+	mSleeping = false;
+}
+
+/********************************* FillPixels *********************************/
+void HostFrameBuffer::FillPixels(
+	uint16_t	inPixelsToFill,
+	uint16_t	inFillColor)
+{
+	mStats.transactions += (inPixelsToFill + TFT_ST77XX::ePixelsPerTransaction - 1) /
+								TFT_ST77XX::ePixelsPerTransaction;
+	for (; inPixelsToFill; inPixelsToFill--)
+	{
+		WritePixel(inFillColor);
+	}
+}
+
+/********************************* StreamCopy *********************************/
+/*
+*	Read from the stream 32 pixels at a time, same as TFT_ST77XX.  As with
+*	FillPixels, a transaction is counted per ePixelsPerTransaction pixels.
+*/
+void HostFrameBuffer::StreamCopy(
+	DataStream*	inDataStream,	// A 16 bit data stream
+	uint16_t	inPixelsToCopy)
+{
+	mStats.transactions += inPixelsToCopy ? (inPixelsToCopy + TFT_ST77XX::ePixelsPerTransaction - 1) /
+								TFT_ST77XX::ePixelsPerTransaction : 1;
+	uint16_t	buffer[32];
+	while (inPixelsToCopy)
+	{
+		uint16_t pixelsToWrite = inPixelsToCopy > 32 ? 32 : inPixelsToCopy;
+		inPixelsToCopy -= pixelsToWrite;
+		inDataStream->Read(pixelsToWrite, buffer);
+		for (uint16_t i = 0; i < pixelsToWrite; i++)
+		{
+			WritePixel(buffer[i]);
+		}
+	}
+}
+
+/********************************* CopyPixels *********************************/
+void HostFrameBuffer::CopyPixels(
+	const void*		inPixels,
+	uint16_t		inPixelsToCopy)
+{
+	mStats.transactions++;
+	const uint16_t*	pixels = (const uint16_t*)inPixels;
+	for (; inPixelsToCopy; inPixelsToCopy--)
+	{
+		WritePixel(*(pixels++));
+	}
+}
+
+/********************************** GetPixel **********************************/
+uint16_t HostFrameBuffer::GetPixel(
+	uint16_t	inRow,
+	uint16_t	inColumn) const
+{
+	return(inRow < mRows && inColumn < mColumns ?
+				mPixels[(uint32_t)inRow * mColumns + inColumn] : 0);
+}
+
+/********************************** WritePPM **********************************/
+/*
+*	Each 5 or 6 bit component is scaled to 8 bits by replicating its high bits.
+*/
+bool HostFrameBuffer::WritePPM(
+	const char*	inPath) const
+{
+	FILE*	file = fopen(inPath, "wb");
+	if (file)
+	{
+		fprintf(file, "P6\n%u %u\n255\n", mColumns, mRows);
+		const uint16_t*	pixelPtr = mPixels;
+		const uint16_t*	endPtr = mPixels + ((uint32_t)mRows * mColumns);
+		for (; pixelPtr < endPtr; pixelPtr++)
+		{
+			uint16_t	pixel = *pixelPtr;
+			uint8_t		red = pixel >> 11;
+			uint8_t		green = (pixel >> 5) & 0x3F;
+			uint8_t		blue = pixel & 0x1F;
+			if (mIsBGR)
+			{
+				uint8_t	temp = red;
+				red = blue;
+				blue = temp;
+			}
+			uint8_t	rgb[] = {(uint8_t)((red << 3) | (red >> 2)),
+								(uint8_t)((green << 2) | (green >> 4)),
+								(uint8_t)((blue << 3) | (blue >> 2))};
+			fwrite(rgb, 1, 3, file);
+		}
+		fclose(file);
+	}
+	return(file != nullptr);
+}
@@ -0,0 +1,120 @@
+/*
+*	HostFrameBuffer.h, Copyright Jonathan Mackey 2021
+*	RGB565 frame buffer DisplayController.  Behaves like TFT_ST77XX on an
+*	ST7789 with respect to the row/column window (RASET/CASET) and the RAM
+*	write pointer (RAMWR), but the pixels are written to memory rather than
+*	sent over SPI.  The bytes TFT_ST77XX would have sent are counted so that
+*	the cost of a redraw can be measured without a display.
+*
+*	TFT_ST77XX sets the MADCTL BGR bit, so by default pixels are treated as
+*	BGR565, which is how the XFont color constants are defined.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef HostFrameBuffer_h
+#define HostFrameBuffer_h
+
+#include "DisplayController.h"
+
+class HostFrameBuffer : public DisplayController
+{
+public:
+							HostFrameBuffer(
+								uint16_t				inRows,
+								uint16_t				inColumns,
+								bool					inIsBGR = true);
+	virtual					~HostFrameBuffer(void);
+	virtual void			MoveTo(
+								uint16_t				inRow,
+								uint16_t				inColumn);
+	virtual void			MoveToRow(
+								uint16_t				inRow);
+	virtual void			MoveToColumn(
+								uint16_t				inColumn);
+	virtual void			Sleep(void);
+	virtual void			WakeUp(void);
+	virtual void			FillPixels(
+								uint16_t				inPixelsToFill,
+								uint16_t				inFillColor);
+	virtual void			SetColumnRange(
+								uint16_t				inStartColumn,
+								uint16_t				inEndColumn);
+	virtual void			SetRowRange(
+								uint16_t				inStartRow,
+								uint16_t				inEndRow);
+	virtual void			StreamCopy(
+								DataStream*				inDataStream,
+								uint16_t				inPixelsToCopy);
+	virtual void			CopyPixels(
+								const void*				inPixels,
+								uint16_t				inPixelsToCopy);
+	virtual void			SetAddressingMode(
+								EAddressingMode			inAddressingMode){}
+
+	uint16_t				GetPixel(
+								uint16_t				inRow,
+								uint16_t				inColumn) const;
+	/*
+	*	WritePPM: Writes the frame buffer as a binary (P6) PPM file.  Returns
+	*	false if the file can't be created.
+	*/
+	bool					WritePPM(
+								const char*				inPath) const;
+	bool					IsSleeping(void) const
+								{return(mSleeping);}
+
+	/*
+	*	What TFT_ST77XX would have sent.  A transaction is one
+	*	BeginTransaction/EndTransaction pair.  invalidWindows is the number of
+	*	CASET/RASET windows where the start is past the end.  The ST7789 doc
+	*	doesn't define what happens, pixels written to such a window are
+	*	discarded and counted as droppedPixels.
+	*/
+	struct SStats
+	{
+		uint32_t	bytes;
+		uint32_t	transactions;
+		uint32_t	commands;
+		uint32_t	pixels;
+		uint32_t	droppedPixels;
+		uint32_t	invalidWindows;
+	};
+	const SStats&			GetStats(void) const
+								{return(mStats);}
+	void					ResetStats(void);
+protected:
+	uint16_t*	mPixels;
+	uint16_t	mStartColumn;	// CASET
+	uint16_t	mEndColumn;
+	uint16_t	mStartRow;		// RASET
+	uint16_t	mEndRow;
+	uint16_t	mPtrColumn;		// RAM write pointer
+	uint16_t	mPtrRow;
+	bool		mWriting;		// RAMWR was the last command
+	bool		mSleeping;
+	bool		mIsBGR;			// Blue is in the high bits of a pixel
+	SStats		mStats;
+
+	void					Command(
+								uint8_t					inDataBytes);
+	void					WritePixel(
+								uint16_t				inPixel);
+};
+
+#endif // HostFrameBuffer_h
@@ -0,0 +1,862 @@
+/*
+*	HostMCP2515.cpp, Copyright Jonathan Mackey 2021
+*	Register level model of an MCP2515 CAN controller on the SPI bus.
+*
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#include "HostMCP2515.h"
+#include "HostNode.h"
+
+enum EInstruction
+{
+	eResetInst			= 0xC0,
+	eReadInst			= 0x03,
+	eReadRxBufferInst	= 0x90,	// 0b10010nm0
+	eWriteInst			= 0x02,
+	eLoadTxBufferInst	= 0x40,	// 0b01000abc
+	eReqToSendInst		= 0x80,	// 0b10000nnn
+	eReadStatusInst		= 0xA0,
+	eRxStatusInst		= 0xB0,
+	eBitModifyInst		= 0x05
+};
+
+/******************************** HostMCP2515 *********************************/
+HostMCP2515::HostMCP2515(
+	uint8_t		inCSPin,
+	uint32_t	inOscFreq)
+	: HostSPIDevice(inCSPin), mNode(nullptr), mOscFreq(inOscFreq),
+	  mIntLow(false)
+{
+	ClearStats();
+	Reset();
+	SPI.Attach(this);
+}
+
+/*********************************** Reset ************************************/
+/*
+*	Same as asserting the RESET pin or the SPI RESET instruction: all registers
+*	are cleared, the device is in configuration mode.
+*/
+void HostMCP2515::Reset(void)
+{
+	memset(mReg, 0, sizeof(mReg));
+	mReg[eCANCTRLReg] = 0x87;
+	mMode = eConfigMode;
+	mTEC = 0;
+	mREC = 0;
+	mHoldOffNanos = 0;
+	memset(mTxRequestNanos, 0, sizeof(mTxRequestNanos));
+	mRxBufferRead = 0;
+	UpdateInt();
+}
+
+/********************************* ClearStats *********************************/
+void HostMCP2515::ClearStats(void)
+{
+	memset(&mStats, 0, sizeof(mStats));
+}
+
+/*********************************** Select ***********************************/
+void HostMCP2515::Select(void)
+{
+	mByteIndex = 0;
+	mRxBufferRead = 0;
+	mStats.spiTransactions++;
+}
+
+/********************************** Deselect **********************************/
+/*
+*	Per the datasheet, the RXnIF flag of the buffer read by READ RX BUFFER is
+*	cleared when CS is raised.
+*/
+void HostMCP2515::Deselect(void)
+{
+	if (mByteIndex &&
+		(mInst == eRxStatusInst || mInst == eReadStatusInst ||
+		(mInst & 0xF9) == eReadRxBufferInst ||
+		(mInst == eBitModifyInst && mByteIndex >= 4 &&
+			mAddr == eCANINTFReg && (mMask & ~(eRX0IF | eRX1IF)) == 0)))
+	{
+		mStats.rxSpiBytes += mByteIndex;
+		mStats.rxSpiTransactions++;
+	}
+	if (mRxBufferRead)
+	{
+		ClearIntFlags(mRxBufferRead);
+		mRxBufferRead = 0;
+	}
+}
+
+/********************************** Transfer **********************************/
+uint8_t HostMCP2515::Transfer(
+	uint8_t	inByte)
+{
+	uint8_t	result = 0;
+	mStats.spiBytes++;
+	if (mByteIndex == 0)
+	{
+		mInst = inByte;
+		if (inByte == eResetInst)
+		{
+			Reset();
+		} else if ((inByte & 0xF8) == eReqToSendInst)
+		{
+			RequestToSend(inByte & 7);
+		} else if ((inByte & 0xF9) == eReadRxBufferInst)
+		{
+			uint8_t	buffer = (inByte >> 2) & 1;
+			mAddr = eRXB0CTRLReg + 1 + buffer*0x10 + ((inByte & 2) ? 5 : 0);
+			mRxBufferRead = buffer ? eRX1IF : eRX0IF;
+		} else if ((inByte & 0xF8) == eLoadTxBufferInst && (inByte & 7) <= 5)
+		{
+			mAddr = eTXB0CTRLReg + 1 + ((inByte >> 1) & 3)*0x10 + ((inByte & 1) ? 5 : 0);
+		}
+	} else
+	{
+		switch (mInst)
+		{
+			case eReadInst:
+				if (mByteIndex == 1)
+				{
+					mAddr = inByte & 0x7F;
+				} else
+				{
+					result = Read(mAddr);
+					mAddr = (mAddr + 1) & 0x7F;
+				}
+				break;
+			case eWriteInst:
+				if (mByteIndex == 1)
+				{
+					mAddr = inByte & 0x7F;
+				} else
+				{
+					Write(mAddr, inByte);
+					mAddr = (mAddr + 1) & 0x7F;
+				}
+				break;
+			case eBitModifyInst:
+				if (mByteIndex == 1)
+				{
+					mAddr = inByte & 0x7F;
+				} else if (mByteIndex == 2)
+				{
+					mMask = inByte;
+				} else if (mByteIndex == 3)
+				{
+					/*
+					*	Only the control, interrupt, error flag and CNF registers
+					*	support bit modify.  Any other register is written as a
+					*	whole byte.
+					*/
+					uint8_t	lowNibble = mAddr & 0x0F;
+					bool	modifiable = lowNibble == 0x0F ||
+						mAddr == eBFPCTRLReg || mAddr == eTXRTSCTRLReg ||
+						(mAddr >= eCNF3Reg && mAddr <= eEFLGReg) ||
+						(lowNibble == 0 && mAddr >= eTXB0CTRLReg);
+					Write(mAddr, inByte, modifiable ? mMask : 0xFF);
+				}
+				break;
+			case eReadStatusInst:
+				result = ReadStatus();
+				break;
+			case eRxStatusInst:
+				result = RxStatus();
+				break;
+			default:
+				if ((mInst & 0xF9) == eReadRxBufferInst)
+				{
+					result = mReg[mAddr];
+					mAddr = (mAddr + 1) & 0x7F;
+				} else if ((mInst & 0xF8) == eLoadTxBufferInst)
+				{
+					if (!(mReg[mAddr & 0xF0] & eTXREQ))
+					{
+						mReg[mAddr] = inByte;
+					}
+					mAddr = (mAddr + 1) & 0x7F;
+				}
+				break;
+		}
+	}
+	mByteIndex++;
+	return(result);
+}
+
+/************************************ Peek ************************************/
+uint8_t HostMCP2515::Peek(
+	uint8_t	inAddr) const
+{
+	return(Read(inAddr & 0x7F));
+}
+
+/************************************ Read ************************************/
+uint8_t HostMCP2515::Read(
+	uint8_t	inAddr) const
+{
+	uint8_t	value;
+	switch (inAddr & 0x0F)
+	{
+		case eCANSTATReg:
+		{
+			/*
+			*	ICOD is the highest priority enabled interrupt.
+			*/
+			uint8_t	flags = mReg[eCANINTFReg] & mReg[eCANINTEReg] & 0x7F;
+			uint8_t	icod = 0;
+			if (flags & eERRIF)
+			{
+				icod = 1;
+			} else if (flags & eWAKIF)
+			{
+				icod = 2;
+			} else if (flags & 0x1C)	// TXnIF
+			{
+				icod = flags & eTX0IF ? 3 : (flags & (eTX0IF << 1) ? 4 : 5);
+			} else if (flags)
+			{
+				icod = flags & eRX0IF ? 6 : 7;
+			}
+			value = mMode | (icod << 1);
+			break;
+		}
+		case eCANCTRLReg:
+			value = mReg[eCANCTRLReg];
+			break;
+		default:
+			if (inAddr == eTECReg)
+			{
+				value = mTEC > 255 ? 255 : mTEC;
+			} else if (inAddr == eRECReg)
+			{
+				value = mREC;
+			} else
+			{
+				value = mReg[inAddr];
+			}
+			break;
+	}
+	return(value);
+}
+
+/*********************************** Write ************************************/
+void HostMCP2515::Write(
+	uint8_t	inAddr,
+	uint8_t	inValue,
+	uint8_t	inMask)
+{
+	uint8_t	lowNibble = inAddr & 0x0F;
+	uint8_t	value = (mReg[inAddr] & ~inMask) | (inValue & inMask);
+	if (lowNibble == eCANSTATReg ||
+		inAddr == eTECReg ||
+		inAddr == eRECReg)
+	{
+		return;	// Read only
+	}
+	if (lowNibble == eCANCTRLReg)
+	{
+		WriteCANCTRL((mReg[eCANCTRLReg] & ~inMask) | (inValue & inMask));
+		return;
+	}
+	if (inAddr < eTXB0CTRLReg &&
+		inAddr != eBFPCTRLReg &&
+		inAddr != eTXRTSCTRLReg &&
+		inAddr < eCANINTEReg)
+	{
+		/*
+		*	The filters, masks and CNF1-3 can only be modified in
+		*	configuration mode.
+		*/
+		if (mMode == eConfigMode)
+		{
+			mReg[inAddr] = value;
+		}
+		return;
+	}
+	switch (inAddr)
+	{
+		case eCANINTFReg:
+			ClearIntFlags(mReg[eCANINTFReg] & ~value);
+			SetIntFlags(value);
+			break;
+		case eEFLGReg:
+			// Only RX0OVR and RX1OVR are writable
+			mReg[eEFLGReg] = (mReg[eEFLGReg] & 0x3F) | (value & (eRX0OVR | eRX1OVR));
+			break;
+		case eTXB0CTRLReg:
+		case eTXB0CTRLReg + 0x10:
+		case eTXB0CTRLReg + 0x20:
+			WriteTXBnCTRL(inAddr, value);
+			break;
+		case eRXB0CTRLReg:
+			mReg[inAddr] = (value & (eRXM | eBUKT)) |
+				(mReg[inAddr] & (eRXRTR | 1)) | ((value & eBUKT) ? eBUKT1 : 0);
+			break;
+		case eRXB1CTRLReg:
+			mReg[inAddr] = (value & eRXM) | (mReg[inAddr] & 0x0F);
+			break;
+		default:
+			if (inAddr < eRXB0CTRLReg)
+			{
+				/*
+				*	A transmit buffer can't be modified while a transmission is
+				*	pending.
+				*/
+				if (inAddr < eTXB0CTRLReg ||
+					!(mReg[inAddr & 0xF0] & eTXREQ))
+				{
+					mReg[inAddr] = value;
+				}
+			}	// else the receive buffers are read only
+			break;
+	}
+	UpdateInt();
+}
+
+/******************************** WriteCANCTRL ********************************/
+void HostMCP2515::WriteCANCTRL(
+	uint8_t	inValue)
+{
+	mReg[eCANCTRLReg] = inValue;
+	if (inValue & eABAT)
+	{
+		for (uint8_t ctrlAddr = eTXB0CTRLReg; ctrlAddr <= eTXB0CTRLReg + 0x20; ctrlAddr += 0x10)
+		{
+			if (mReg[ctrlAddr] & eTXREQ)
+			{
+				mReg[ctrlAddr] = (mReg[ctrlAddr] & ~eTXREQ) | eABTF;
+			}
+		}
+	}
+	uint8_t	reqMode = inValue & 0xE0;
+	if (reqMode > eConfigMode)
+	{
+		reqMode = eConfigMode;	// Invalid REQOP values
+	}
+	mMode = reqMode;
+}
+
+/******************************* WriteTXBnCTRL ********************************/
+void HostMCP2515::WriteTXBnCTRL(
+	uint8_t	inAddr,
+	uint8_t	inValue)
+{
+	uint8_t	buffer = (inAddr >> 4) - 3;
+	uint8_t	ctrl = mReg[inAddr];
+	bool	wasRequested = (ctrl & eTXREQ) != 0;
+	bool	requested = (inValue & eTXREQ) != 0;
+	/*
+	*	While ABAT is set new requests are aborted as well.
+	*/
+	if (requested && !wasRequested &&
+		(mReg[eCANCTRLReg] & eABAT))
+	{
+		mReg[inAddr] = (ctrl & ~eTXP) | (inValue & eTXP) | eABTF;
+		return;
+	}
+	ctrl = (ctrl & ~(eTXREQ | eTXP)) | (inValue & (eTXREQ | eTXP));
+	if (requested && !wasRequested)
+	{
+		ctrl &= ~(eABTF | eMLOA | eTXERR);
+		mTxRequestNanos[buffer] = HostClock::Nanos();
+	} else if (!requested && wasRequested)
+	{
+		ctrl |= eABTF;
+	}
+	mReg[inAddr] = ctrl;
+	/*
+	*	In loopback mode the frame is received by this device immediately.
+	*/
+	if (requested && !wasRequested && mMode == eLoopbackMode)
+	{
+		Receive(GetTxFrame(buffer));
+		TxSucceeded(buffer);
+	}
+}
+
+/******************************* RequestToSend ********************************/
+void HostMCP2515::RequestToSend(
+	uint8_t	inBuffers)
+{
+	for (uint8_t buffer = 0; buffer < 3; buffer++)
+	{
+		if (inBuffers & (1 << buffer))
+		{
+			uint8_t	ctrlAddr = eTXB0CTRLReg + buffer*0x10;
+			WriteTXBnCTRL(ctrlAddr, mReg[ctrlAddr] | eTXREQ);
+		}
+	}
+}
+
+/******************************* ClearIntFlags ********************************/
+void HostMCP2515::ClearIntFlags(
+	uint8_t	inFlags)
+{
+	uint8_t	cleared = mReg[eCANINTFReg] & inFlags;
+	if (cleared & eRX0IF)
+	{
+		mStats.framesDrained++;
+	}
+	if (cleared & eRX1IF)
+	{
+		mStats.framesDrained++;
+	}
+	mReg[eCANINTFReg] &= ~inFlags;
+	UpdateInt();
+}
+
+/******************************** SetIntFlags *********************************/
+void HostMCP2515::SetIntFlags(
+	uint8_t	inFlags)
+{
+	mReg[eCANINTFReg] |= inFlags;
+	UpdateInt();
+}
+
+/********************************* UpdateInt **********************************/
+/*
+*	INT is active low while any enabled interrupt flag is set.
+*/
+void HostMCP2515::UpdateInt(void)
+{
+	bool	intLow = (mReg[eCANINTFReg] & mReg[eCANINTEReg]) != 0;
+	if (intLow != mIntLow)
+	{
+		mIntLow = intLow;
+		if (mNode)
+		{
+			mNode->SetIntLine(intLow);
+		}
+	}
+}
+
+/********************************* ReadStatus *********************************/
+uint8_t HostMCP2515::ReadStatus(void) const
+{
+	uint8_t	flags = mReg[eCANINTFReg];
+	uint8_t	status = flags & (eRX0IF | eRX1IF);
+	for (uint8_t buffer = 0; buffer < 3; buffer++)
+	{
+		if (mReg[eTXB0CTRLReg + buffer*0x10] & eTXREQ)
+		{
+			status |= 4 << (buffer*2);
+		}
+		if (flags & (eTX0IF << buffer))
+		{
+			status |= 8 << (buffer*2);
+		}
+	}
+	return(status);
+}
+
+/********************************** RxStatus **********************************/
+/*
+*	Bits 7:6 buffers with a message, 4:3 the message type, 2:0 the filter
+*	match of the message in RXB0, else RXB1 (6 and 7 are RXF0 and RXF1
+*	rolled over to RXB1.)
+*/
+uint8_t HostMCP2515::RxStatus(void) const
+{
+	uint8_t	flags = mReg[eCANINTFReg];
+	uint8_t	status = ((flags & eRX0IF) ? 0x40 : 0) | ((flags & eRX1IF) ? 0x80 : 0);
+	if (status)
+	{
+		uint8_t	ctrlAddr = (flags & eRX0IF) ? eRXB0CTRLReg : eRXB1CTRLReg;
+		bool	extended = (mReg[ctrlAddr + 2] & 0x08) != 0;
+		bool	remote = extended ? (mReg[ctrlAddr + 5] & 0x40) != 0 :
+									(mReg[ctrlAddr + 2] & 0x10) != 0;
+		uint8_t	filterHit = ctrlAddr == eRXB0CTRLReg ? (mReg[ctrlAddr] & 1) :
+									(mReg[ctrlAddr] & 7);
+		if (ctrlAddr == eRXB1CTRLReg && filterHit < 2)
+		{
+			filterHit += 6;
+		}
+		status |= (extended ? 0x10 : 0) | (remote ? 0x08 : 0) | filterHit;
+	}
+	return(status);
+}
+
+/********************************* GetBitRate *********************************/
+/*
+*	bit rate = Fosc / (2 * (BRP + 1) * (SyncSeg + PropSeg + PS1 + PS2))
+*/
+uint32_t HostMCP2515::GetBitRate(void) const
+{
+	uint8_t	cnf1 = mReg[eCNF1Reg];
+	uint8_t	cnf2 = mReg[eCNF2Reg];
+	uint8_t	cnf3 = mReg[eCNF3Reg];
+	uint32_t	brp = (cnf1 & 0x3F) + 1;
+	uint32_t	propSeg = (cnf2 & 7) + 1;
+	uint32_t	phSeg1 = ((cnf2 >> 3) & 7) + 1;
+	uint32_t	phSeg2 = (cnf2 & 0x80) ? (cnf3 & 7) + 1 : max(phSeg1, 2UL);
+	return(mOscFreq / (2 * brp * (1 + propSeg + phSeg1 + phSeg2)));
+}
+
+/******************************* GetSamplePoint *******************************/
+uint16_t HostMCP2515::GetSamplePoint(void) const
+{
+	uint8_t	cnf2 = mReg[eCNF2Reg];
+	uint8_t	cnf3 = mReg[eCNF3Reg];
+	uint16_t	propSeg = (cnf2 & 7) + 1;
+	uint16_t	phSeg1 = ((cnf2 >> 3) & 7) + 1;
+	uint16_t	phSeg2 = (cnf2 & 0x80) ? (cnf3 & 7) + 1 : max(phSeg1, (uint16_t)2);
+	return((1 + propSeg + phSeg1) * 1000 / (1 + propSeg + phSeg1 + phSeg2));
+}
+
+/******************************* BitRateMatches *******************************/
+/*
+*	Nodes more than 1% apart can't resynchronize over a frame.
+*/
+bool HostMCP2515::BitRateMatches(
+	uint32_t	inBusBitRate) const
+{
+	uint32_t	bitRate = GetBitRate();
+	uint32_t	delta = bitRate > inBusBitRate ? bitRate - inBusBitRate : inBusBitRate - bitRate;
+	return(delta * 100 <= inBusBitRate);
+}
+
+/***************************** GetPendingTxBuffer *****************************/
+/*
+*	Returns the buffer to transmit next, the highest TXP, then the highest
+*	buffer number.  -1 if none.
+*/
+int8_t HostMCP2515::GetPendingTxBuffer(void) const
+{
+	int8_t	pending = -1;
+	if (mMode == eNormalMode &&
+		!IsBusOff())
+	{
+		uint8_t	pendingPriority = 0;
+		for (uint8_t buffer = 0; buffer < 3; buffer++)
+		{
+			uint8_t	ctrl = mReg[eTXB0CTRLReg + buffer*0x10];
+			if ((ctrl & eTXREQ) &&
+				(pending < 0 || (ctrl & eTXP) >= pendingPriority))
+			{
+				pending = buffer;
+				pendingPriority = ctrl & eTXP;
+			}
+		}
+	}
+	return(pending);
+}
+
+/***************************** TxLostArbitration ******************************/
+void HostMCP2515::TxLostArbitration(
+	uint8_t	inBuffer)
+{
+	uint8_t&	ctrl = mReg[eTXB0CTRLReg + inBuffer*0x10];
+	mStats.arbitrationLosses++;
+	ctrl |= eMLOA;
+	if (mReg[eCANCTRLReg] & eOSM)
+	{
+		ctrl = (ctrl & ~eTXREQ) | eABTF;
+	}
+}
+
+/******************************** TxSucceeded *********************************/
+void HostMCP2515::TxSucceeded(
+	uint8_t	inBuffer)
+{
+	mReg[eTXB0CTRLReg + inBuffer*0x10] &= ~(eTXREQ | eTXERR | eMLOA);
+	mStats.framesTransmitted++;
+	if (mTEC)
+	{
+		mTEC--;
+	}
+	UpdateErrorFlags();
+	SetIntFlags(eTX0IF << inBuffer);
+}
+
+/********************************** TxFailed **********************************/
+/*
+*	As per ISO 11898-1, an error passive transmitter that detects an ACK error
+*	doesn't increment TEC.  This keeps a lone node from going bus off.
+*/
+void HostMCP2515::TxFailed(
+	uint8_t	inBuffer,
+	bool	inAckError)
+{
+	uint8_t&	ctrl = mReg[eTXB0CTRLReg + inBuffer*0x10];
+	mStats.txErrors++;
+	ctrl |= eTXERR;
+	if (mReg[eCANCTRLReg] & eOSM)
+	{
+		ctrl = (ctrl & ~eTXREQ) | eABTF;
+	}
+	if (!inAckError || !IsErrorPassive())
+	{
+		mTEC += 8;
+		if (IsBusOff())
+		{
+			mStats.busOffs++;
+		}
+	}
+	UpdateErrorFlags();
+	SetIntFlags(eMERRF);
+}
+
+/********************************** RxFailed **********************************/
+void HostMCP2515::RxFailed(
+	uint8_t	inIncrement)
+{
+	mStats.rxErrors++;
+	mREC = mREC + inIncrement > 255 ? 255 : mREC + inIncrement;
+	UpdateErrorFlags();
+	SetIntFlags(eMERRF);
+}
+
+/***************************** RecoverFromBusOff ******************************/
+void HostMCP2515::RecoverFromBusOff(void)
+{
+	mTEC = 0;
+	mREC = 0;
+	UpdateErrorFlags();
+}
+
+/******************************** BusActivity *********************************/
+/*
+*	Bus activity wakes a sleeping device into listen only mode.  The frame
+*	that caused the wake up is lost.
+*/
+void HostMCP2515::BusActivity(void)
+{
+	if (mMode == eSleepMode)
+	{
+		mMode = eListenOnlyMode;
+		SetIntFlags(eWAKIF);
+	}
+}
+
+/****************************** UpdateErrorFlags ******************************/
+/*
+*	ERRIF is set when any of the EFLG error state bits is newly set.
+*/
+void HostMCP2515::UpdateErrorFlags(void)
+{
+	uint8_t	flags = 0;
+	if (mTEC >= 96)
+	{
+		flags |= eTXWAR | eEWARN;
+	}
+	if (mREC >= 96)
+	{
+		flags |= eRXWAR | eEWARN;
+	}
+	if (mTEC >= 128)
+	{
+		flags |= eTXEP;
+	}
+	if (mREC >= 128)
+	{
+		flags |= eRXEP;
+	}
+	if (mTEC > 255)
+	{
+		flags |= eTXBO;
+	}
+	uint8_t	prevFlags = mReg[eEFLGReg] & 0x3F;
+	mReg[eEFLGReg] = (mReg[eEFLGReg] & (eRX0OVR | eRX1OVR)) | flags;
+	if (flags & ~prevFlags)
+	{
+		SetIntFlags(eERRIF);
+	}
+}
+
+/*********************************** Accept ***********************************/
+/*
+*	For standard frames the EID15:0 bits of the mask and filter are applied to
+*	the first two data bytes.
+*/
+bool HostMCP2515::Accept(
+	const uint8_t*	inRawFrame,
+	uint8_t			inMaskAddr,
+	uint8_t			inFilterAddr) const
+{
+	const uint8_t*	mask = &mReg[inMaskAddr];
+	const uint8_t*	filter = &mReg[inFilterAddr];
+	bool	extended = (inRawFrame[1] & 0x08) != 0;
+	if (((filter[1] & 0x08) != 0) != extended)
+	{
+		return(false);	// EXIDE doesn't match
+	}
+	uint16_t	sid = ((uint16_t)inRawFrame[0] << 3) | (inRawFrame[1] >> 5);
+	uint16_t	maskSID = ((uint16_t)mask[0] << 3) | (mask[1] >> 5);
+	uint16_t	filterSID = ((uint16_t)filter[0] << 3) | (filter[1] >> 5);
+	if ((sid ^ filterSID) & maskSID)
+	{
+		return(false);
+	}
+	if (extended)
+	{
+		for (uint8_t i = 1; i < 4; i++)
+		{
+			uint8_t	eidMask = i == 1 ? 0x03 : 0xFF;
+			if ((inRawFrame[i] ^ filter[i]) & mask[i] & eidMask)
+			{
+				return(false);
+			}
+		}
+	} else
+	{
+		uint8_t	dataLen = (inRawFrame[1] & 0x10) ? 0 : min(inRawFrame[4] & 0x0F, 8);
+		for (uint8_t i = 0; i < 2 && i < dataLen; i++)
+		{
+			if ((inRawFrame[5+i] ^ filter[2+i]) & mask[2+i])
+			{
+				return(false);
+			}
+		}
+	}
+	return(true);
+}
+
+/******************************** LoadRxBuffer ********************************/
+void HostMCP2515::LoadRxBuffer(
+	uint8_t			inCtrlAddr,
+	const uint8_t*	inRawFrame)
+{
+	memcpy(&mReg[inCtrlAddr + 1], inRawFrame, kRawFrameSize);
+	mStats.framesReceived++;
+}
+
+/********************************** Receive ***********************************/
+/*
+*	Called by the bus for every frame received without error.  Frames are
+*	received in normal, listen only and loopback modes.
+*/
+void HostMCP2515::Receive(
+	const uint8_t*	inRawFrame)
+{
+	if (mMode == eConfigMode ||
+		mMode == eSleepMode)
+	{
+		return;
+	}
+	if (mREC > 127)
+	{
+		mREC = 127;
+	} else if (mREC)
+	{
+		mREC--;
+	}
+	UpdateErrorFlags();
+	/*
+	*	Convert the transmit layout (RTR in DLC) to the receive layout (SRR in
+	*	SIDL for standard frames.)
+	*/
+	uint8_t	frame[kRawFrameSize];
+	memcpy(frame, inRawFrame, kRawFrameSize);
+	bool	remote = (inRawFrame[4] & 0x40) != 0;
+	if (inRawFrame[1] & 0x08)
+	{
+		frame[4] &= 0x4F;
+	} else
+	{
+		frame[1] = (frame[1] & 0xE0) | (remote ? 0x10 : 0);
+		frame[2] = 0;
+		frame[3] = 0;
+		frame[4] &= 0x0F;
+	}
+	uint8_t	rtrBit = remote ? eRXRTR : 0;
+	int8_t	filterHit = -1;
+	if ((mReg[eRXB0CTRLReg] & eRXM) == eRXM)
+	{
+		filterHit = 0;	// Filters off, receive any
+	} else if (Accept(frame, eRXM0Reg, eRXF0Reg))
+	{
+		filterHit = 0;
+	} else if (Accept(frame, eRXM0Reg, eRXF1Reg))
+	{
+		filterHit = 1;
+	}
+	if (filterHit >= 0)
+	{
+		if (!(mReg[eCANINTFReg] & eRX0IF))
+		{
+			LoadRxBuffer(eRXB0CTRLReg, frame);
+			mReg[eRXB0CTRLReg] = (mReg[eRXB0CTRLReg] & ~(eRXRTR | 1)) | rtrBit | filterHit;
+			SetIntFlags(eRX0IF);
+		} else if (mReg[eRXB0CTRLReg] & eBUKT)
+		{
+			if (!(mReg[eCANINTFReg] & eRX1IF))
+			{
+				LoadRxBuffer(eRXB1CTRLReg, frame);
+				mReg[eRXB1CTRLReg] = (mReg[eRXB1CTRLReg] & eRXM) | rtrBit | filterHit;
+				mStats.rollovers++;
+				SetIntFlags(eRX1IF);
+			} else
+			{
+				Overflow(eRX1OVR);
+			}
+		} else
+		{
+			Overflow(eRX0OVR);
+		}
+		return;
+	}
+	if ((mReg[eRXB1CTRLReg] & eRXM) == eRXM)
+	{
+		filterHit = 2;
+	} else
+	{
+		static const uint8_t	kRXB1Filters[] = {eRXF2Reg, eRXF3Reg, eRXF4Reg, eRXF5Reg};
+		for (uint8_t i = 0; i < sizeof(kRXB1Filters); i++)
+		{
+			if (Accept(frame, eRXM1Reg, kRXB1Filters[i]))
+			{
+				filterHit = i + 2;
+				break;
+			}
+		}
+	}
+	if (filterHit >= 2)
+	{
+		if (!(mReg[eCANINTFReg] & eRX1IF))
+		{
+			LoadRxBuffer(eRXB1CTRLReg, frame);
+			mReg[eRXB1CTRLReg] = (mReg[eRXB1CTRLReg] & eRXM) | rtrBit | filterHit;
+			SetIntFlags(eRX1IF);
+		} else
+		{
+			Overflow(eRX1OVR);
+		}
+	}
+}
+
+/********************************** Overflow **********************************/
+void HostMCP2515::Overflow(
+	uint8_t	inOverflowFlag)
+{
+	if (inOverflowFlag == eRX0OVR)
+	{
+		mStats.rx0Overflows++;
+	} else
+	{
+		mStats.rx1Overflows++;
+	}
+	if (mStats.receivedAtFirstOverflow == 0)
+	{
+		mStats.receivedAtFirstOverflow = mStats.framesReceived;
+		mStats.drainedAtFirstOverflow = mStats.framesDrained;
+	}
+	mReg[eEFLGReg] |= inOverflowFlag;
+	SetIntFlags(eERRIF);
+}
@@ -0,0 +1,251 @@
+/*
+*	HostMCP2515.h, Copyright Jonathan Mackey 2021
+*	Register level model of an MCP2515 CAN controller on the SPI bus.  The
+*	model implements the SPI instruction set, the operating modes, the
+*	acceptance masks and filters, RXB0 to RXB1 rollover (BUKT), overflow,
+*	CANSTAT ICOD, CANINTF/EFLG and the TEC/REC error state transitions.  The
+*	bit rate is derived from CNF1-3 and the oscillator frequency.
+*
+*	Frames are exchanged with other nodes by a HostCANBus.  The model doesn't
+*	observe the RESET pin, the harness calls Reset() at power up.
+*
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef HostMCP2515_h
+#define HostMCP2515_h
+
+#include <SPI.h>
+
+class HostNode;
+
+class HostMCP2515 : public HostSPIDevice
+{
+public:
+	enum ERegs
+	{
+		eRXF0Reg				= 0x00,
+		eRXF1Reg				= 0x04,
+		eRXF2Reg				= 0x08,
+		eBFPCTRLReg				= 0x0C,
+		eTXRTSCTRLReg			= 0x0D,
+		eCANSTATReg				= 0x0E,
+		eCANCTRLReg				= 0x0F,
+			eABAT				= 0x10,
+			eOSM				= 0x08,
+		eRXF3Reg				= 0x10,
+		eRXF4Reg				= 0x14,
+		eRXF5Reg				= 0x18,
+		eTECReg					= 0x1C,
+		eRECReg					= 0x1D,
+		eRXM0Reg				= 0x20,
+		eRXM1Reg				= 0x24,
+		eCNF3Reg				= 0x28,
+		eCNF2Reg				= 0x29,
+		eCNF1Reg				= 0x2A,
+		eCANINTEReg				= 0x2B,
+		eCANINTFReg				= 0x2C,
+			eRX0IF				= 0x01,
+			eRX1IF				= 0x02,
+			eTX0IF				= 0x04,
+			eERRIF				= 0x20,
+			eWAKIF				= 0x40,
+			eMERRF				= 0x80,
+		eEFLGReg				= 0x2D,
+			eEWARN				= 0x01,
+			eRXWAR				= 0x02,
+			eTXWAR				= 0x04,
+			eRXEP				= 0x08,
+			eTXEP				= 0x10,
+			eTXBO				= 0x20,
+			eRX0OVR				= 0x40,
+			eRX1OVR				= 0x80,
+		eTXB0CTRLReg			= 0x30,
+			eTXREQ				= 0x08,
+			eTXERR				= 0x10,
+			eMLOA				= 0x20,
+			eABTF				= 0x40,
+			eTXP				= 0x03,
+		eRXB0CTRLReg			= 0x60,
+			eBUKT				= 0x04,
+			eBUKT1				= 0x02,
+			eRXRTR				= 0x08,
+			eRXM				= 0x60,
+		eRXB1CTRLReg			= 0x70
+	};
+	enum EMode
+	{
+		eNormalMode				= 0x00,
+		eSleepMode				= 0x20,
+		eLoopbackMode			= 0x40,
+		eListenOnlyMode			= 0x60,
+		eConfigMode				= 0x80
+	};
+	static const uint8_t	kRawFrameSize = 13;	// SIDH, SIDL, EID8, EID0, DLC, D0-D7
+
+	struct SStats
+	{
+		uint32_t	spiBytes;
+		uint32_t	spiTransactions;
+		uint32_t	framesReceived;		// Loaded into RXB0 or RXB1
+		uint32_t	framesDrained;		// RXnIF cleared by the MCU
+		uint32_t	rollovers;			// RXB0 frames rolled over to RXB1
+		uint32_t	rx0Overflows;
+		uint32_t	rx1Overflows;
+		uint32_t	framesTransmitted;
+		uint32_t	arbitrationLosses;
+		uint32_t	txErrors;
+		uint32_t	rxErrors;
+		uint32_t	busOffs;
+		/*
+		*	The number of frames received and drained when the first overflow
+		*	occurred.  Zero if no overflow has occurred.
+		*/
+		uint32_t	receivedAtFirstOverflow;
+		uint32_t	drainedAtFirstOverflow;
+		/*
+		*	The part of spiBytes and spiTransactions used by the status and
+		*	receive instructions: READ STATUS, RX STATUS, READ RX BUFFER and
+		*	the bit modifies that only clear RXnIF.
+		*/
+		uint32_t	rxSpiBytes;
+		uint32_t	rxSpiTransactions;
+	};
+
+							HostMCP2515(
+								uint8_t					inCSPin,
+								uint32_t				inOscFreq = 8000000);
+	void					Reset(void);
+	virtual void			Select(void);
+	virtual uint8_t			Transfer(
+								uint8_t					inByte);
+	virtual void			Deselect(void);
+	/*
+	*	The node whose interrupt input is driven by the INT output.
+	*/
+	inline void				SetNode(
+								HostNode*				inNode)
+								{mNode = inNode;}
+	inline HostNode*		GetNode(void) const
+								{return(mNode);}
+	/*
+	*	Peek returns a register value without side effects.
+	*/
+	uint8_t					Peek(
+								uint8_t					inAddr) const;
+	inline uint8_t			GetMode(void) const
+								{return(mMode);}
+	uint32_t				GetBitRate(void) const;
+	uint16_t				GetSamplePoint(void) const;	// tenths of a percent
+	bool					BitRateMatches(
+								uint32_t				inBusBitRate) const;
+	inline uint16_t			GetTEC(void) const
+								{return(mTEC);}
+	inline uint8_t			GetREC(void) const
+								{return(mREC);}
+	inline bool				IsErrorPassive(void) const
+								{return(mTEC >= 128 || mREC >= 128);}
+	inline bool				IsBusOff(void) const
+								{return(mTEC > 255);}
+	inline const SStats&	GetStats(void) const
+								{return(mStats);}
+	void					ClearStats(void);
+
+	/*
+	*	HostCANBus interface
+	*/
+	int8_t					GetPendingTxBuffer(void) const;
+	inline const uint8_t*	GetTxFrame(
+								uint8_t					inBuffer) const
+								{return(&mReg[eTXB0CTRLReg + 1 + inBuffer*0x10]);}
+	inline uint64_t			GetTxRequestNanos(
+								uint8_t					inBuffer) const
+								{return(mTxRequestNanos[inBuffer]);}
+	void					TxLostArbitration(
+								uint8_t					inBuffer);
+	void					TxSucceeded(
+								uint8_t					inBuffer);
+	void					TxFailed(
+								uint8_t					inBuffer,
+								bool					inAckError);
+	void					Receive(
+								const uint8_t*			inRawFrame);
+	void					RxFailed(
+								uint8_t					inIncrement);
+	void					BusActivity(void);
+	void					RecoverFromBusOff(void);
+	/*
+	*	The hold off time is when the node may next start a transmission after
+	*	going bus off or after an error passive transmission.
+	*/
+	inline uint64_t			GetHoldOffNanos(void) const
+								{return(mHoldOffNanos);}
+	inline void				SetHoldOffNanos(
+								uint64_t				inNanos)
+								{mHoldOffNanos = inNanos;}
+protected:
+	uint8_t		mReg[128];
+	uint64_t	mTxRequestNanos[3];
+	uint64_t	mHoldOffNanos;
+	HostNode*	mNode;
+	uint32_t	mOscFreq;
+	uint16_t	mTEC;
+	uint8_t		mREC;
+	uint8_t		mMode;
+	uint8_t		mInst;
+	uint8_t		mAddr;
+	uint8_t		mMask;
+	uint8_t		mByteIndex;
+	uint8_t		mRxBufferRead;	// RXnIF to clear when CS rises
+	bool		mIntLow;
+	SStats		mStats;
+
+	uint8_t					Read(
+								uint8_t					inAddr) const;
+	void					Write(
+								uint8_t					inAddr,
+								uint8_t					inValue,
+								uint8_t					inMask = 0xFF);
+	void					WriteCANCTRL(
+								uint8_t					inValue);
+	void					WriteTXBnCTRL(
+								uint8_t					inAddr,
+								uint8_t					inValue);
+	void					RequestToSend(
+								uint8_t					inBuffers);
+	void					ClearIntFlags(
+								uint8_t					inFlags);
+	void					SetIntFlags(
+								uint8_t					inFlags);
+	uint8_t					ReadStatus(void) const;
+	uint8_t					RxStatus(void) const;
+	bool					Accept(
+								const uint8_t*			inRawFrame,
+								uint8_t					inMaskAddr,
+								uint8_t					inFilterAddr) const;
+	void					LoadRxBuffer(
+								uint8_t					inCtrlAddr,
+								const uint8_t*			inRawFrame);
+	void					Overflow(
+								uint8_t					inOverflowFlag);
+	void					UpdateErrorFlags(void);
+	void					UpdateInt(void);
+};
+
+#endif // HostMCP2515_h
@@ -0,0 +1,197 @@
+/*
+*	HostNode.cpp, Copyright Jonathan Mackey 2021
+*	The execution context of one simulated MCU.
+*
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#include "HostNode.h"
+
+HostNode*			HostNode::sActive;
+HostNode::SState	HostNode::sRootState;	// Used when there's no primary node
+
+/********************************** HostNode **********************************/
+/*
+*	A secondary node starts in the power-up state: pins pulled high, EEPROM
+*	erased, no SPI devices.  Devices constructed while the node is entered are
+*	attached to the node.  The primary node (inOwnsClock) takes over the
+*	current live state and must be constructed before any node is entered.
+*/
+HostNode::HostNode(
+	bool	inOwnsClock)
+	: mPrev(nullptr), mEnterNanos(0), mIntVector(nullptr), mIntPort(0),
+	  mIntBitMask(0), mOwnsClock(inOwnsClock), mIntLatched(false)
+{
+	memset(&mState, 0, sizeof(mState));
+	memset(mState.pin, 0xFF, sizeof(mState.pin));
+	HostEEPROM::Erase(mEEPROM);
+	mState.eeprom = mEEPROM;
+	mState.spiByteNanos = 1000;
+#ifdef TRACE_SPI
+	mState.spiTrace.device[0].csPin = SPITracer::eUntraced;
+	mState.spiTrace.numDevices = 1;
+#endif
+	if (inOwnsClock)
+	{
+		sActive = this;
+	}
+}
+
+/*********************************** Enter ************************************/
+void HostNode::Enter(void)
+{
+	mPrev = sActive;
+	Save(StateOf(mPrev));
+	Load(mState);
+	sActive = this;
+	mEnterNanos = HostClock::Nanos();
+	DeliverLatchedInt();
+}
+
+/*********************************** Leave ************************************/
+void HostNode::Leave(void)
+{
+	Save(mState);
+	Load(StateOf(mPrev));
+	sActive = mPrev;
+	mPrev = nullptr;
+	if (!mOwnsClock)
+	{
+		HostClock::SetNanos(mEnterNanos);
+	}
+	if (sActive)
+	{
+		sActive->DeliverLatchedInt();
+	}
+}
+
+/***************************** DeliverLatchedInt ******************************/
+void HostNode::DeliverLatchedInt(void)
+{
+	if (mIntLatched)
+	{
+		mIntLatched = false;
+		if (mIntVector)
+		{
+			mIntVector();
+		}
+	}
+}
+
+/********************************* SetIntPin **********************************/
+void HostNode::SetIntPin(
+	uint8_t	inPin,
+	ISRFunc	inVector)
+{
+	mIntPort = digitalPinToPort(inPin);
+	mIntBitMask = digitalPinToBitMask(inPin);
+	mIntVector = inVector;
+}
+
+/********************************* SetIntLine *********************************/
+void HostNode::SetIntLine(
+	bool	inLow)
+{
+	if (mIntBitMask)
+	{
+		uint8_t*	pin = IsActive() ? (uint8_t*)&HostIO::sPIN[mIntPort] : &mState.pin[mIntPort];
+		bool	wasLow = (*pin & mIntBitMask) == 0;
+		if (inLow)
+		{
+			*pin &= ~mIntBitMask;
+			if (!wasLow)
+			{
+				if (!IsActive())
+				{
+					mIntLatched = true;
+				} else if (mIntVector)
+				{
+					mIntVector();
+				}
+			}
+		} else
+		{
+			*pin |= mIntBitMask;
+		}
+	}
+}
+
+/************************************ Save ************************************/
+void HostNode::Save(
+	SState&	outState)
+{
+	for (uint8_t i = 0; i < HostIO::eNumPorts; i++)
+	{
+		outState.port[i] = HostIO::sPORT[i];
+		outState.pin[i] = HostIO::sPIN[i];
+		outState.ddr[i] = HostIO::sDDR[i];
+	}
+	for (uint8_t i = 0; i < sizeof(outState.reg); i++)
+	{
+		outState.reg[i] = HostIO::sReg[i];
+	}
+	outState.adc = HostIO::sADC;
+	outState.sleepMode = HostIO::sSleepMode;
+	outState.sleepEnabled = HostIO::sSleepEnabled;
+	outState.sleeping = HostIO::sSleeping;
+	outState.millisStopped = HostIO::sMillisStopped;
+	outState.eeprom = HostEEPROM::sBytes;
+	outState.spiDevices = SPIClass::sDevices;
+	outState.spiSelected = SPIClass::sSelected;
+	outState.spiByteNanos = SPIClass::sByteNanos;
+	outState.spiInterruptMask = SPIClass::sInterruptMask;
+	outState.spiInterruptSave = SPIClass::sInterruptSave;
+	outState.analogReader = HostPins::sAnalogReader;
+	memcpy(outState.isr, HostPins::sISR, sizeof(outState.isr));
+#ifdef TRACE_SPI
+	outState.spiTrace = SPITracer::State();
+#endif
+}
+
+/************************************ Load ************************************/
+void HostNode::Load(
+	const SState&	inState)
+{
+	for (uint8_t i = 0; i < HostIO::eNumPorts; i++)
+	{
+		HostIO::sPORT[i] = inState.port[i];
+		HostIO::sPIN[i] = inState.pin[i];
+		HostIO::sDDR[i] = inState.ddr[i];
+	}
+	for (uint8_t i = 0; i < sizeof(inState.reg); i++)
+	{
+		HostIO::sReg[i] = inState.reg[i];
+	}
+	HostIO::sADC = inState.adc;
+	HostIO::sSleepMode = inState.sleepMode;
+	HostIO::sSleepEnabled = inState.sleepEnabled;
+	HostIO::sSleeping = inState.sleeping;
+	HostIO::sMillisStopped = inState.millisStopped;
+	HostEEPROM::sBytes = inState.eeprom;
+	SPIClass::sDevices = inState.spiDevices;
+	SPIClass::sSelected = inState.spiSelected;
+	SPIClass::sByteNanos = inState.spiByteNanos;
+	SPIClass::sInterruptMask = inState.spiInterruptMask;
+	SPIClass::sInterruptSave = inState.spiInterruptSave;
+	HostPins::sAnalogReader = inState.analogReader;
+	memcpy(HostPins::sISR, inState.isr, sizeof(inState.isr));
+#ifdef TRACE_SPI
+	SPITracer::State() = inState.spiTrace;
+#endif
+}
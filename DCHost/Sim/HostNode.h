@@ -0,0 +1,114 @@
+/*
+*	HostNode.h, Copyright Jonathan Mackey 2021
+*	The execution context of one simulated MCU.  The host stand-ins keep the
+*	I/O registers, EEPROM, SPI device list and interrupt hooks in statics.  A
+*	HostNode holds a private copy of that state so that several sketches, for
+*	example a controller and a number of gate sensors, can share one process.
+*	Enter() swaps the node's state in, Leave() swaps it back out.
+*
+*	The node that owns the clock is the primary node.  Its state is the live
+*	state whenever no other node is entered, so globals constructed before
+*	main() belong to it.  Time spent by the other nodes is rolled back when
+*	they leave, i.e. they appear to run instantly between steps of the primary
+*	node.
+*
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef HostNode_h
+#define HostNode_h
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <EEPROM.h>
+#include "SPITracer.h"
+
+class HostNode
+{
+public:
+	typedef void			(*ISRFunc)(void);
+							HostNode(
+								bool					inOwnsClock = false);
+	void					Enter(void);
+	void					Leave(void);
+	static HostNode*		Active(void)
+								{return(sActive);}
+	inline bool				IsActive(void) const
+								{return(sActive == this);}
+	/*
+	*	SetIntPin identifies the input pin driven by a device's active low
+	*	interrupt output and the vector to call on a falling edge.  When the
+	*	node isn't active the falling edge is latched and the vector is called
+	*	when the node is next entered (same as an AVR INTFn flag.)
+	*/
+	void					SetIntPin(
+								uint8_t					inPin,
+								ISRFunc					inVector);
+	void					SetIntLine(
+								bool					inLow);
+	inline uint8_t*			GetEEPROM(void)
+								{return(IsActive() ? HostEEPROM::sBytes : mState.eeprom);}
+protected:
+	struct SState
+	{
+		uint8_t						port[HostIO::eNumPorts];
+		uint8_t						pin[HostIO::eNumPorts];
+		uint8_t						ddr[HostIO::eNumPorts];
+		uint8_t						reg[32];
+		uint16_t					adc;
+		uint8_t						sleepMode;
+		bool						sleepEnabled;
+		uint8_t						sleeping;
+		uint32_t					millisStopped;
+		uint8_t*					eeprom;
+		HostSPIDevice*				spiDevices;
+		HostSPIDevice*				spiSelected;
+		uint32_t					spiByteNanos;
+		uint8_t						spiInterruptMask;
+		uint8_t						spiInterruptSave;
+		HostPins::AnalogReadFunc	analogReader;
+		void						(*isr[3])(void);
+	#ifdef TRACE_SPI
+		SPITracer::SState			spiTrace;
+	#endif
+	};
+	SState		mState;
+	uint8_t		mEEPROM[E2END+1];
+	HostNode*	mPrev;
+	uint64_t	mEnterNanos;
+	ISRFunc		mIntVector;
+	uint8_t		mIntPort;
+	uint8_t		mIntBitMask;
+	bool		mOwnsClock;
+	bool		mIntLatched;
+
+	static HostNode*	sActive;
+	static SState		sRootState;
+
+	void					DeliverLatchedInt(void);
+	static SState&			StateOf(
+								HostNode*				inNode)
+								{return(inNode ? inNode->mState : sRootState);}
+	static void				Save(
+								SState&					outState);
+	static void				Load(
+								const SState&			inState);
+};
+
+#endif // HostNode_h
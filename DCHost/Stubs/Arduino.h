@@ -0,0 +1,165 @@
+/*
+*	Arduino.h, Copyright Jonathan Mackey 2021
+*	Host (Linux/macOS) stand-in for the Arduino core used by the DCController
+*	and DCSensor sketches.  Only what the sketches and libraries in this
+*	repository reference is implemented.
+*
+*	Time is simulated.  millis() and micros() return HostClock time, which only
+*	advances when the harness calls HostClock::Advance() or the code under test
+*	calls delay()/delayMicroseconds().
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <avr/pgmspace.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "HardwareSerial.h"
+
+#define F_CPU			16000000UL
+
+#define HIGH			1
+#define LOW				0
+#define INPUT			0
+#define OUTPUT			1
+#define INPUT_PULLUP	2
+
+#define CHANGE			1
+#define FALLING			2
+#define RISING			3
+
+typedef bool	boolean;
+typedef uint8_t	byte;
+
+#define clockCyclesPerMicrosecond()	(F_CPU / 1000000L)
+
+#ifndef min
+#define min(a,b) ((a)<(b)?(a):(b))
+#define max(a,b) ((a)>(b)?(a):(b))
+#endif
+/*
+*	Same as the AVR core.  Note that, as on the target, abs() of an unsigned
+*	expression returns the expression unchanged.
+*/
+#undef abs
+#define abs(x) ((x)>0?(x):-(x))
+
+uint32_t	millis(void);
+uint32_t	micros(void);
+void		delay(
+				uint32_t	inMS);
+void		delayMicroseconds(
+				uint32_t	inUS);
+
+void		pinMode(
+				uint8_t		inPin,
+				uint8_t		inMode);
+void		digitalWrite(
+				uint8_t		inPin,
+				uint8_t		inValue);
+int			digitalRead(
+				uint8_t		inPin);
+int			analogRead(
+				uint8_t		inPin);
+
+/*
+*	Pin numbering follows the ATmega644PA "standard" pinout used by DCConfig:
+*	0-7 PB, 8-15 PD, 16-23 PC, 24-31 PA.  The port index returned by
+*	digitalPinToPort() is an index into HostIO::sPORT.
+*/
+#define digitalPinToPort(p)			((uint8_t)((p) >> 3))
+#define digitalPinToBitMask(p)		((uint8_t)(1 << ((p) & 7)))
+#define portOutputRegister(port)	(&HostIO::sPORT[(port)])
+#define portInputRegister(port)		(&HostIO::sPIN[(port)])
+#define digitalPinToInterrupt(p)	((p) == 10 ? 0 : ((p) == 11 ? 1 : ((p) == 2 ? 2 : -1)))
+
+void		attachInterrupt(
+				int8_t		inInterruptNum,
+				void		(*inISR)(void),
+				int			inMode);
+void		detachInterrupt(
+				int8_t		inInterruptNum);
+
+/*
+*	Simulated time is kept in nanoseconds so that sub-microsecond costs, such
+*	as the SPI bus time per byte, accumulate correctly.
+*
+*	When an advance hook is set, time advances in steps of at most
+*	kHookStepNanos and the hook is called after each step.  The simulators use
+*	this to run other nodes and the CAN bus while the code under test spins in
+*	a delay or a polling loop.
+*/
+class HostClock
+{
+public:
+	typedef void			(*AdvanceHook)(void);
+	static const uint32_t	kHookStepNanos = 20000;
+
+	static inline uint32_t	Micros(void)
+								{return((uint32_t)(sNanos/1000));}
+	static inline uint64_t	Nanos(void)
+								{return(sNanos);}
+	static inline void		Advance(
+								uint32_t				inMicros)
+								{AdvanceNanos((uint64_t)inMicros * 1000);}
+	static void				AdvanceNanos(
+								uint64_t				inNanos);
+	static inline void		Set(
+								uint64_t				inMicros)
+								{sNanos = inMicros * 1000;}
+	static inline void		SetNanos(
+								uint64_t				inNanos)
+								{sNanos = inNanos;}
+	static inline void		SetAdvanceHook(
+								AdvanceHook				inHook)
+								{sAdvanceHook = inHook;}
+protected:
+	static uint64_t		sNanos;
+	static AdvanceHook	sAdvanceHook;
+};
+
+/*
+*	Hooks the harness can use to supply analog values and to raise external
+*	interrupts attached via attachInterrupt().  An interrupt raised while it's
+*	masked (EIMSK) or while an ISR is running is latched in EIFR and delivered
+*	by DeliverPending, same as the AVR.
+*/
+class HostPins
+{
+public:
+	typedef int				(*AnalogReadFunc)(
+								uint8_t					inPin);
+	static void				SetAnalogReader(
+								AnalogReadFunc			inReader)
+								{sAnalogReader = inReader;}
+	static void				RaiseInterrupt(
+								int8_t					inInterruptNum);
+	static void				DeliverPending(void);
+	static AnalogReadFunc	sAnalogReader;
+	static void				(*sISR[3])(void);
+	static bool				sInISR;
+};
+
+#endif // Arduino_h
@@ -0,0 +1,116 @@
+/*
+*	EEPROM.h, Copyright Jonathan Mackey 2021
+*	Host stand-in for the Arduino EEPROM library.  Same interface as the AVR
+*	version (EERef, EEPtr, EEPROMClass) backed by a RAM array that starts out
+*	erased (0xFF).
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef EEPROM_h
+#define EEPROM_h
+
+#include <inttypes.h>
+#include <string.h>
+
+#ifndef E2END
+#define E2END	0x7FF	// ATmega644PA, 2KB
+#endif
+
+class HostEEPROM
+{
+public:
+	static uint8_t			Read(
+								int						inIndex)
+								{return(sBytes[inIndex & E2END]);}
+	static void				Write(
+								int						inIndex,
+								uint8_t					inValue)
+								{sBytes[inIndex & E2END] = inValue;}
+	static void				Erase(
+								uint8_t*				outBytes)
+								{memset(outBytes, 0xFF, E2END+1);}
+	/*
+	*	sBytes points to the EEPROM of the node being run.  See HostNode.
+	*/
+	static uint8_t*	sBytes;
+};
+
+struct EERef
+{
+	EERef(const int inIndex)
+		: index(inIndex){}
+	uint8_t operator*() const				{return(HostEEPROM::Read(index));}
+	operator uint8_t() const				{return(**this);}
+	EERef& operator=(const EERef& inRef)	{return(*this = *inRef);}
+	EERef& operator=(uint8_t inValue)		{HostEEPROM::Write(index, inValue); return(*this);}
+	EERef& operator+=(uint8_t inValue)		{return(*this = **this + inValue);}
+	EERef& operator-=(uint8_t inValue)		{return(*this = **this - inValue);}
+	EERef& operator|=(uint8_t inValue)		{return(*this = **this | inValue);}
+	EERef& operator&=(uint8_t inValue)		{return(*this = **this & inValue);}
+	EERef& operator++()						{return(*this += 1);}
+	EERef& operator--()						{return(*this -= 1);}
+	EERef& update(uint8_t inValue)			{return(inValue != **this ? *this = inValue : *this);}
+	int index;
+};
+
+struct EEPtr
+{
+	EEPtr(const int inIndex)
+		: index(inIndex){}
+	operator int() const					{return(index);}
+	EEPtr& operator=(int inIndex)			{index = inIndex; return(*this);}
+	bool operator!=(const EEPtr& inPtr)		{return(index != inPtr.index);}
+	EERef operator*()						{return(index);}
+	EEPtr& operator++()						{++index; return(*this);}
+	EEPtr& operator--()						{--index; return(*this);}
+	EEPtr operator++(int)					{return(index++);}
+	EEPtr operator--(int)					{return(index--);}
+	int index;
+};
+
+struct EEPROMClass
+{
+	EERef operator[](const int inIndex)		{return(inIndex);}
+	uint8_t read(int inIndex)				{return(EERef(inIndex));}
+	void write(int inIndex, uint8_t inValue){(EERef(inIndex)) = inValue;}
+	void update(int inIndex, uint8_t inValue){EERef(inIndex).update(inValue);}
+	EEPtr begin()							{return(0x00);}
+	EEPtr end()								{return(length());}
+	uint16_t length()						{return(E2END + 1);}
+
+	template<typename T> T& get(int inIndex, T& outValue)
+	{
+		EEPtr e = inIndex;
+		uint8_t* ptr = (uint8_t*)&outValue;
+		for (int count = sizeof(T); count; --count, ++e) *ptr++ = *e;
+		return(outValue);
+	}
+
+	template<typename T> const T& put(int inIndex, const T& inValue)
+	{
+		EEPtr e = inIndex;
+		const uint8_t* ptr = (const uint8_t*)&inValue;
+		for (int count = sizeof(T); count; --count, ++e) (*e).update(*ptr++);
+		return(inValue);
+	}
+};
+
+extern EEPROMClass EEPROM;
+
+#endif // EEPROM_h
@@ -0,0 +1,125 @@
+/*
+*	HardwareSerial.h, Copyright Jonathan Mackey 2021
+*	Host stand-in for the Arduino Print and HardwareSerial classes.  Serial
+*	writes to stdout and reads from stdin (non-blocking).
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef HardwareSerial_h
+#define HardwareSerial_h
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+#define DEC	10
+#define HEX	16
+#define OCT	8
+#define BIN	2
+
+class __FlashStringHelper;
+#define F(string_literal)	(reinterpret_cast<const __FlashStringHelper*>(string_literal))
+
+class Print
+{
+public:
+	virtual					~Print(void){}
+	virtual size_t			write(
+								uint8_t					inByte) = 0;
+	virtual size_t			write(
+								const uint8_t*			inBuffer,
+								size_t					inSize);
+	size_t					write(
+								const char*				inStr);
+	size_t					write(
+								char					inChar)
+								{return(write((uint8_t)inChar));}
+	size_t					write(
+								int						inByte)
+								{return(write((uint8_t)inByte));}
+
+	size_t					print(
+								const __FlashStringHelper*	inStr);
+	size_t					print(
+								const char*				inStr);
+	size_t					print(
+								char					inChar);
+	size_t					print(
+								unsigned char			inValue,
+								int						inBase = DEC);
+	size_t					print(
+								int						inValue,
+								int						inBase = DEC);
+	size_t					print(
+								unsigned int			inValue,
+								int						inBase = DEC);
+	size_t					print(
+								long					inValue,
+								int						inBase = DEC);
+	size_t					print(
+								unsigned long			inValue,
+								int						inBase = DEC);
+	size_t					print(
+								double					inValue,
+								int						inDigits = 2);
+
+	size_t					println(void);
+	template <class T>
+	size_t					println(
+								T						inValue)
+								{size_t n = print(inValue); return(n + println());}
+	template <class T>
+	size_t					println(
+								T						inValue,
+								int						inFormat)
+								{size_t n = print(inValue, inFormat); return(n + println());}
+protected:
+	size_t					PrintNumber(
+								unsigned long			inValue,
+								uint8_t					inBase);
+};
+
+class HardwareSerial : public Print
+{
+public:
+	void					begin(
+								unsigned long			inBaud){}
+	void					end(void){}
+	int						available(void);
+	int						read(void);
+	int						peek(void);
+	int						availableForWrite(void)
+								{return(63);}	// Never waits on the UART
+	void					flush(void);
+	virtual size_t			write(
+								uint8_t					inByte);
+	using Print::write;
+	operator				bool(void)
+								{return(true);}
+	/*
+	*	When false, output is discarded.  The benchmark harness turns Serial
+	*	off during timed runs so stdout doesn't distort the measurements.
+	*/
+	static bool	sEnabled;
+};
+
+extern HardwareSerial Serial;
+
+#endif // HardwareSerial_h
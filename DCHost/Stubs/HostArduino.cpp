@@ -0,0 +1,539 @@
+/*
+*	HostArduino.cpp, Copyright Jonathan Mackey 2021
+*	Implementation of the host stand-ins for the Arduino core, SPI, EEPROM and
+*	Wire.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#include <Arduino.h>
+#include <SPI.h>
+#include <EEPROM.h>
+#include <Wire.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+uint64_t				HostClock::sNanos;
+HostClock::AdvanceHook	HostClock::sAdvanceHook;
+
+volatile uint8_t	HostIO::sPORT[HostIO::eNumPorts];
+volatile uint8_t	HostIO::sPIN[HostIO::eNumPorts] = {0xFF, 0xFF, 0xFF, 0xFF};
+volatile uint8_t	HostIO::sDDR[HostIO::eNumPorts];
+volatile uint8_t	HostIO::sReg[32];
+volatile uint16_t	HostIO::sADC;
+volatile uint8_t	HostIO::sSleepMode;
+volatile bool		HostIO::sSleepEnabled;
+volatile uint8_t	HostIO::sSleeping;
+uint32_t			HostIO::sMillisStopped;
+
+HostPins::AnalogReadFunc	HostPins::sAnalogReader;
+void						(*HostPins::sISR[3])(void);
+bool						HostPins::sInISR;
+
+static uint8_t	sEEPROMBytes[E2END+1];
+uint8_t*		HostEEPROM::sBytes = sEEPROMBytes;
+/*
+*	The EEPROM starts out erased.
+*/
+static struct HostEEPROMEraser
+{
+	HostEEPROMEraser(void)
+		{HostEEPROM::Erase(sEEPROMBytes);}
+} sEEPROMEraser;
+
+HardwareSerial	Serial;
+bool			HardwareSerial::sEnabled = true;
+SPIClass		SPI;
+EEPROMClass		EEPROM;
+TwoWire			Wire;
+
+HostSPIDevice*	SPIClass::sDevices;
+HostSPIDevice*	SPIClass::sSelected;
+uint32_t		SPIClass::sByteNanos = 1000;
+uint8_t			SPIClass::sInterruptMask;
+uint8_t			SPIClass::sInterruptSave;
+
+/******************************** AdvanceNanos ********************************/
+void HostClock::AdvanceNanos(
+	uint64_t	inNanos)
+{
+	if (!sAdvanceHook)
+	{
+		sNanos += inNanos;
+	} else
+	{
+		while (inNanos)
+		{
+			uint64_t	step = inNanos < kHookStepNanos ? inNanos : kHookStepNanos;
+			sNanos += step;
+			inNanos -= step;
+			sAdvanceHook();
+		}
+	}
+}
+
+/*********************************** millis ***********************************/
+uint32_t millis(void)
+{
+	return((uint32_t)(HostClock::Nanos()/1000000) - HostIO::sMillisStopped);
+}
+
+/*********************************** micros ***********************************/
+uint32_t micros(void)
+{
+	return(HostClock::Micros());
+}
+
+/*********************************** delay ************************************/
+void delay(
+	uint32_t	inMS)
+{
+	HostClock::Advance(inMS * 1000);
+}
+
+/***************************** delayMicroseconds ******************************/
+void delayMicroseconds(
+	uint32_t	inUS)
+{
+	HostClock::Advance(inUS);
+}
+
+/********************************** pinMode ***********************************/
+void pinMode(
+	uint8_t	inPin,
+	uint8_t	inMode)
+{
+	uint8_t	port = digitalPinToPort(inPin);
+	uint8_t	bitMask = digitalPinToBitMask(inPin);
+	if (inMode == OUTPUT)
+	{
+		HostIO::sDDR[port] |= bitMask;
+	} else
+	{
+		HostIO::sDDR[port] &= ~bitMask;
+		if (inMode == INPUT_PULLUP)
+		{
+			HostIO::sPORT[port] |= bitMask;
+		}
+	}
+}
+
+/******************************** digitalWrite ********************************/
+void digitalWrite(
+	uint8_t	inPin,
+	uint8_t	inValue)
+{
+	uint8_t	port = digitalPinToPort(inPin);
+	uint8_t	bitMask = digitalPinToBitMask(inPin);
+	if (inValue)
+	{
+		HostIO::sPORT[port] |= bitMask;
+	} else
+	{
+		HostIO::sPORT[port] &= ~bitMask;
+	}
+}
+
+/******************************** digitalRead *********************************/
+int digitalRead(
+	uint8_t	inPin)
+{
+	return((HostIO::sPIN[digitalPinToPort(inPin)] & digitalPinToBitMask(inPin)) ? HIGH : LOW);
+}
+
+/********************************* analogRead *********************************/
+int analogRead(
+	uint8_t	inPin)
+{
+	return(HostPins::sAnalogReader ? HostPins::sAnalogReader(inPin) : 1023);
+}
+
+/****************************** attachInterrupt *******************************/
+void attachInterrupt(
+	int8_t	inInterruptNum,
+	void	(*inISR)(void),
+	int		inMode)
+{
+	if (inInterruptNum >= 0 && inInterruptNum < 3)
+	{
+		HostPins::sISR[inInterruptNum] = inISR;
+		EIFR &= ~_BV(inInterruptNum);
+		EIMSK |= _BV(inInterruptNum);
+	}
+}
+
+/****************************** detachInterrupt *******************************/
+void detachInterrupt(
+	int8_t	inInterruptNum)
+{
+	if (inInterruptNum >= 0 && inInterruptNum < 3)
+	{
+		EIMSK &= ~_BV(inInterruptNum);
+		HostPins::sISR[inInterruptNum] = nullptr;
+	}
+}
+
+/******************************* RaiseInterrupt *******************************/
+void HostPins::RaiseInterrupt(
+	int8_t	inInterruptNum)
+{
+	if (inInterruptNum >= 0 && inInterruptNum < 3 &&
+		sISR[inInterruptNum])
+	{
+		EIFR |= _BV(inInterruptNum);
+		DeliverPending();
+	}
+}
+
+/******************************* DeliverPending *******************************/
+void HostPins::DeliverPending(void)
+{
+	while (!sInISR)
+	{
+		uint8_t	pending = EIFR & EIMSK & 7;
+		if (!pending)
+		{
+			break;
+		}
+		int8_t	interruptNum = 0;
+		for (; (pending & 1) == 0; pending >>= 1)
+		{
+			interruptNum++;
+		}
+		EIFR &= ~_BV(interruptNum);
+		if (sISR[interruptNum])
+		{
+			sInISR = true;
+			sISR[interruptNum]();
+			sInISR = false;
+		}
+	}
+}
+
+/*********************************** write ************************************/
+size_t Print::write(
+	const uint8_t*	inBuffer,
+	size_t			inSize)
+{
+	size_t	n = 0;
+	while (inSize--)
+	{
+		n += write(*(inBuffer++));
+	}
+	return(n);
+}
+
+/*********************************** write ************************************/
+size_t Print::write(
+	const char*	inStr)
+{
+	return(inStr ? write((const uint8_t*)inStr, strlen(inStr)) : 0);
+}
+
+/*********************************** print ************************************/
+size_t Print::print(
+	const __FlashStringHelper*	inStr)
+{
+	return(write((const char*)inStr));
+}
+
+/*********************************** print ************************************/
+size_t Print::print(
+	const char*	inStr)
+{
+	return(write(inStr));
+}
+
+/*********************************** print ************************************/
+size_t Print::print(
+	char	inChar)
+{
+	return(write((uint8_t)inChar));
+}
+
+/*********************************** print ************************************/
+size_t Print::print(
+	unsigned char	inValue,
+	int				inBase)
+{
+	return(print((unsigned long)inValue, inBase));
+}
+
+/*********************************** print ************************************/
+size_t Print::print(
+	int	inValue,
+	int	inBase)
+{
+	return(print((long)inValue, inBase));
+}
+
+/*********************************** print ************************************/
+size_t Print::print(
+	unsigned int	inValue,
+	int				inBase)
+{
+	return(print((unsigned long)inValue, inBase));
+}
+
+/*********************************** print ************************************/
+size_t Print::print(
+	long	inValue,
+	int		inBase)
+{
+	if (inBase == DEC && inValue < 0)
+	{
+		return(write('-') + PrintNumber(-(unsigned long)inValue, DEC));
+	}
+	/*
+	*	As on the AVR, non-decimal negative values print as their 32 bit two's
+	*	complement.
+	*/
+	return(PrintNumber((uint32_t)inValue, inBase));
+}
+
+/*********************************** print ************************************/
+size_t Print::print(
+	unsigned long	inValue,
+	int				inBase)
+{
+	return(PrintNumber((uint32_t)inValue, inBase));
+}
+
+/*********************************** print ************************************/
+size_t Print::print(
+	double	inValue,
+	int		inDigits)
+{
+	char	buffer[32];
+	snprintf(buffer, sizeof(buffer), "%.*f", inDigits, inValue);
+	return(write(buffer));
+}
+
+/********************************** println ***********************************/
+size_t Print::println(void)
+{
+	return(write("\r\n"));
+}
+
+/******************************** PrintNumber *********************************/
+size_t Print::PrintNumber(
+	unsigned long	inValue,
+	uint8_t			inBase)
+{
+	char	buffer[8 * sizeof(long) + 1];
+	char*	str = &buffer[sizeof(buffer) - 1];
+	*str = 0;
+	if (inBase < 2)
+	{
+		inBase = 10;
+	}
+	do
+	{
+		uint8_t	digit = inValue % inBase;
+		inValue /= inBase;
+		*(--str) = digit < 10 ? digit + '0' : digit + 'A' - 10;
+	} while (inValue);
+	return(write(str));
+}
+
+/*********************************** write ************************************/
+size_t HardwareSerial::write(
+	uint8_t	inByte)
+{
+	if (sEnabled)
+	{
+		putchar(inByte);
+	}
+	return(1);
+}
+
+/********************************* available **********************************/
+int HardwareSerial::available(void)
+{
+	return(peek() >= 0 ? 1 : 0);
+}
+
+/************************************ peek ************************************/
+int HardwareSerial::peek(void)
+{
+	static bool	sNonBlocking;
+	if (!sNonBlocking)
+	{
+		sNonBlocking = true;
+		fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+	}
+	int	thisChar = getchar();
+	if (thisChar != EOF)
+	{
+		ungetc(thisChar, stdin);
+		return(thisChar);
+	}
+	clearerr(stdin);
+	return(-1);
+}
+
+/************************************ read ************************************/
+int HardwareSerial::read(void)
+{
+	return(peek() >= 0 ? getchar() : -1);
+}
+
+/*********************************** flush ************************************/
+void HardwareSerial::flush(void)
+{
+	fflush(stdout);
+}
+
+/******************************* HostSPIDevice ********************************/
+HostSPIDevice::HostSPIDevice(
+	uint8_t	inCSPin)
+	: mCSPin(inCSPin), mNext(nullptr)
+{
+}
+
+/******************************* ~HostSPIDevice *******************************/
+HostSPIDevice::~HostSPIDevice(void)
+{
+	SPIClass::Detach(this);
+}
+
+/********************************* IsSelected *********************************/
+bool HostSPIDevice::IsSelected(void) const
+{
+	return((HostIO::sPORT[digitalPinToPort(mCSPin)] & digitalPinToBitMask(mCSPin)) == 0);
+}
+
+/*********************************** Attach ***********************************/
+void SPIClass::Attach(
+	HostSPIDevice*	inDevice)
+{
+	inDevice->mNext = sDevices;
+	sDevices = inDevice;
+}
+
+/*********************************** Detach ***********************************/
+void SPIClass::Detach(
+	HostSPIDevice*	inDevice)
+{
+	HostSPIDevice**	link = &sDevices;
+	for (; *link; link = &(*link)->mNext)
+	{
+		if (*link == inDevice)
+		{
+			*link = inDevice->mNext;
+			break;
+		}
+	}
+	if (sSelected == inDevice)
+	{
+		sSelected = nullptr;
+	}
+}
+
+/****************************** beginTransaction ******************************/
+void SPIClass::beginTransaction(
+	const SPISettings&	inSettings)
+{
+	/*
+	*	The ATmega SPI clock is at most F_CPU/2.  Round up to the next
+	*	power of 2 divider as the AVR SPI library does.
+	*/
+	uint32_t	clock = F_CPU/2;
+	while (clock > inSettings.mClock && clock > F_CPU/128)
+	{
+		clock /= 2;
+	}
+	sByteNanos = (uint32_t)(8000000000ULL / clock);
+	if (sInterruptMask)
+	{
+		sInterruptSave = EIMSK;
+		EIMSK &= ~sInterruptMask;
+	}
+}
+
+/******************************* endTransaction *******************************/
+void SPIClass::endTransaction(void)
+{
+	if (sSelected)
+	{
+		HostSPIDevice*	device = sSelected;
+		sSelected = nullptr;
+		device->Deselect();
+	}
+	if (sInterruptMask)
+	{
+		EIMSK = sInterruptSave;
+		HostPins::DeliverPending();
+	}
+}
+
+/******************************* usingInterrupt *******************************/
+void SPIClass::usingInterrupt(
+	uint8_t	inInterruptNum)
+{
+	if (inInterruptNum < 3)
+	{
+		sInterruptMask |= _BV(inInterruptNum);
+	}
+}
+
+/********************************** transfer **********************************/
+uint8_t SPIClass::transfer(
+	uint8_t	inByte)
+{
+	HostClock::AdvanceNanos(sByteNanos);
+	if (!sSelected || !sSelected->IsSelected())
+	{
+		if (sSelected)
+		{
+			sSelected->Deselect();
+		}
+		sSelected = nullptr;
+		for (HostSPIDevice* device = sDevices; device; device = device->mNext)
+		{
+			if (device->IsSelected())
+			{
+				sSelected = device;
+				device->Select();
+				break;
+			}
+		}
+	}
+	return(sSelected ? sSelected->Transfer(inByte) : 0);
+}
+
+/********************************* transfer16 *********************************/
+uint16_t SPIClass::transfer16(
+	uint16_t	inData)
+{
+	uint16_t	msb = transfer(inData >> 8);
+	return((msb << 8) | transfer(inData & 0xFF));
+}
+
+/********************************** transfer **********************************/
+void SPIClass::transfer(
+	void*	ioBuffer,
+	size_t	inCount)
+{
+	uint8_t*	buffer = (uint8_t*)ioBuffer;
+	for (; inCount; inCount--, buffer++)
+	{
+		*buffer = transfer(*buffer);
+	}
+}
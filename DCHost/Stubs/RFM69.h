@@ -0,0 +1,61 @@
+/*
+*	RFM69.h, Copyright Jonathan Mackey 2021
+*	Host stand-in for the subset of Felix Rusu's RFM69 library used by the
+*	DCController.  Sends are counted and otherwise discarded.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef RFM69_h
+#define RFM69_h
+
+#include <inttypes.h>
+
+#define RF69_315MHZ	31
+#define RF69_433MHZ	43
+#define RF69_868MHZ	86
+#define RF69_915MHZ	91
+
+class RFM69
+{
+public:
+							RFM69(
+								uint8_t					inSlaveSelectPin,
+								uint8_t					inInterruptPin,
+								bool					inIsRFM69HW = false)
+								: mSendCount(0){}
+	bool					initialize(
+								uint8_t					inFreqBand,
+								uint16_t				inNodeID,
+								uint8_t					inNetworkID = 1)
+								{return(true);}
+	bool					sendWithRetry(
+								uint16_t				inToAddress,
+								const void*				inBuffer,
+								uint8_t					inBufferSize,
+								uint8_t					inRetries = 2,
+								uint8_t					inRetryWaitTime = 40)
+								{mSendCount++; return(true);}
+	void					sleep(void){}
+	uint32_t				GetSendCount(void) const
+								{return(mSendCount);}
+protected:
+	uint32_t	mSendCount;
+};
+
+#endif // RFM69_h
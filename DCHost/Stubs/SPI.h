@@ -0,0 +1,130 @@
+/*
+*	SPI.h, Copyright Jonathan Mackey 2021
+*	Host stand-in for the Arduino SPI library.
+*
+*	Simulated peripherals derive from HostSPIDevice and are attached by chip
+*	select pin.  Each transfer is routed to the attached device whose chip
+*	select is currently low.  Each byte advances HostClock by the time it
+*	would take on the bus at the transaction's clock rate (limited to F_CPU/2
+*	as on the ATmega.)
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef SPI_h
+#define SPI_h
+
+#include <Arduino.h>
+
+#define SPI_HAS_TRANSACTION 1
+
+#define SPI_MODE0	0x00
+#define SPI_MODE1	0x04
+#define SPI_MODE2	0x08
+#define SPI_MODE3	0x0C
+#define LSBFIRST	0
+#define MSBFIRST	1
+
+#define SS			4	// PB4
+#define MOSI		5
+#define MISO		6
+#define SCK			7
+
+class SPISettings
+{
+public:
+							SPISettings(void)
+								: mClock(4000000), mBitOrder(MSBFIRST), mDataMode(SPI_MODE0){}
+							SPISettings(
+								uint32_t				inClock,
+								uint8_t					inBitOrder,
+								uint8_t					inDataMode)
+								: mClock(inClock), mBitOrder(inBitOrder), mDataMode(inDataMode){}
+	uint32_t	mClock;
+	uint8_t		mBitOrder;
+	uint8_t		mDataMode;
+};
+
+class HostSPIDevice
+{
+public:
+							HostSPIDevice(
+								uint8_t					inCSPin);
+	virtual					~HostSPIDevice(void);
+	/*
+	*	Select is called before the first byte of a transaction is routed
+	*	to the device.  Deselect is called when the transaction ends.
+	*/
+	virtual void			Select(void){}
+	virtual uint8_t			Transfer(
+								uint8_t					inByte) = 0;
+	virtual void			Deselect(void){}
+	bool					IsSelected(void) const;
+	inline uint8_t			GetCSPin(void) const
+								{return(mCSPin);}
+protected:
+	uint8_t			mCSPin;
+	HostSPIDevice*	mNext;
+	friend class SPIClass;
+};
+
+class SPIClass
+{
+public:
+	static void				begin(void){}
+	static void				end(void){}
+	static void				beginTransaction(
+								const SPISettings&		inSettings);
+	static void				endTransaction(void);
+	static uint8_t			transfer(
+								uint8_t					inByte);
+	static uint16_t			transfer16(
+								uint16_t				inData);
+	static void				transfer(
+								void*					ioBuffer,
+								size_t					inCount);
+	static void				setDataMode(
+								uint8_t					inMode){}
+	static void				setBitOrder(
+								uint8_t					inBitOrder){}
+	static void				setClockDivider(
+								uint8_t					inDivider){}
+	/*
+	*	As on the AVR, the external interrupts passed to usingInterrupt are
+	*	masked (EIMSK) from beginTransaction till endTransaction.  An
+	*	interrupt raised while masked is delivered by endTransaction.
+	*/
+	static void				usingInterrupt(
+								uint8_t					inInterruptNum);
+
+	static void				Attach(
+								HostSPIDevice*			inDevice);
+	static void				Detach(
+								HostSPIDevice*			inDevice);
+protected:
+	friend class HostNode;
+	static HostSPIDevice*	sDevices;
+	static HostSPIDevice*	sSelected;
+	static uint32_t			sByteNanos;
+	static uint8_t			sInterruptMask;
+	static uint8_t			sInterruptSave;
+};
+
+extern SPIClass SPI;
+
+#endif // SPI_h
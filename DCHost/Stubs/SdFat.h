@@ -0,0 +1,72 @@
+/*
+*	SdFat.h, Copyright Jonathan Mackey 2021
+*	Host stand-in for the subset of Bill Greiman's SdFat library used by the
+*	DCController.  There is no card: begin() always fails, so the code under
+*	test takes its no-SD-card paths.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef SdFat_h
+#define SdFat_h
+
+#include <Arduino.h>
+
+#define O_RDONLY	0x00
+#define O_WRONLY	0x01
+#define O_RDWR		0x02
+#define O_APPEND	0x08
+#define O_CREAT		0x10
+#define O_TRUNC		0x20
+#define O_EXCL		0x40
+
+class SdFile : public Print
+{
+public:
+	typedef void			(*DateTimeCallback)(
+								uint16_t*				outDate,
+								uint16_t*				outTime);
+	static void				dateTimeCallback(
+								DateTimeCallback		inCallback){}
+	bool					open(
+								const char*				inPath,
+								uint8_t					inFlags = O_RDONLY)
+								{return(false);}
+	bool					close(void)
+								{return(true);}
+	int						read(
+								void*					outBuffer,
+								size_t					inCount)
+								{return(0);}
+	virtual size_t			write(
+								uint8_t					inByte)
+								{return(1);}
+	using Print::write;
+};
+
+class SdFat
+{
+public:
+	bool					begin(
+								uint8_t					inCSPin)
+								{return(false);}
+	void					initErrorHalt(void)
+								{Serial.println(F("SD begin failed"));}
+};
+
+#endif // SdFat_h
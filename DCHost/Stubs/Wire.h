@@ -0,0 +1,55 @@
+/*
+*	Wire.h, Copyright Jonathan Mackey 2021
+*	Host stand-in for the Arduino Wire (TWI) library.  There are no simulated
+*	I2C devices so every request returns no data.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef TwoWire_h
+#define TwoWire_h
+
+#include <inttypes.h>
+#include <stddef.h>
+
+class TwoWire
+{
+public:
+	void					begin(void){}
+	void					beginTransmission(
+								uint8_t					inAddress){}
+	uint8_t					endTransmission(
+								uint8_t					inSendStop = true)
+								{return(2);}	// NACK on address
+	uint8_t					requestFrom(
+								uint8_t					inAddress,
+								uint8_t					inQuantity,
+								uint8_t					inSendStop = true)
+								{return(0);}
+	size_t					write(
+								uint8_t					inByte)
+								{return(1);}
+	int						available(void)
+								{return(0);}
+	int						read(void)
+								{return(-1);}
+};
+
+extern TwoWire Wire;
+
+#endif // TwoWire_h
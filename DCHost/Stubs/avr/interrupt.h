@@ -0,0 +1,32 @@
+/*
+*	interrupt.h, Copyright Jonathan Mackey 2021
+*	Host stand-in for <avr/interrupt.h>.  ISR(vector) declares an ordinary
+*	function named after the vector so the host harness can call it directly
+*	to simulate the interrupt.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef HostAVRInterrupt_h
+#define HostAVRInterrupt_h
+
+#define ISR(vector, ...)	extern "C" void vector(void); extern "C" void vector(void)
+#define cli()
+#define sei()
+
+#endif // HostAVRInterrupt_h
@@ -0,0 +1,190 @@
+/*
+*	io.h, Copyright Jonathan Mackey 2021
+*	Host stand-in for <avr/io.h>.  The I/O registers referenced by the
+*	DCController and DCSensor code are plain memory so the code compiles and
+*	runs unchanged.  Port registers are indexed the same way as the ATmega644PA
+*	pinout in DCConfig (B, D, C, A).
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef HostAVRIO_h
+#define HostAVRIO_h
+
+#include <inttypes.h>
+
+#ifndef _BV
+#define _BV(bit)	(1 << (bit))
+#endif
+
+class HostIO
+{
+public:
+	enum EPort
+	{
+		ePortB,
+		ePortD,
+		ePortC,
+		ePortA,
+		eNumPorts
+	};
+	static volatile uint8_t	sPORT[eNumPorts];
+	static volatile uint8_t	sPIN[eNumPorts];
+	static volatile uint8_t	sDDR[eNumPorts];
+	static volatile uint8_t	sReg[32];	// Everything else, see below.
+	static volatile uint16_t	sADC;
+	/*
+	*	Host only.  The sleep mode + 1 of the last sleep_cpu, 0 when awake,
+	*	see avr/sleep.h.  sMillisStopped is subtracted from millis(), the
+	*	time Timer0 didn't run because the node was powered down.
+	*/
+	static volatile uint8_t		sSleepMode;
+	static volatile bool		sSleepEnabled;
+	static volatile uint8_t		sSleeping;
+	static uint32_t				sMillisStopped;
+};
+
+#define PORTA	HostIO::sPORT[HostIO::ePortA]
+#define PORTB	HostIO::sPORT[HostIO::ePortB]
+#define PORTC	HostIO::sPORT[HostIO::ePortC]
+#define PORTD	HostIO::sPORT[HostIO::ePortD]
+#define PINA	HostIO::sPIN[HostIO::ePortA]
+#define PINB	HostIO::sPIN[HostIO::ePortB]
+#define PINC	HostIO::sPIN[HostIO::ePortC]
+#define PIND	HostIO::sPIN[HostIO::ePortD]
+#define DDRA	HostIO::sDDR[HostIO::ePortA]
+#define DDRB	HostIO::sDDR[HostIO::ePortB]
+#define DDRC	HostIO::sDDR[HostIO::ePortC]
+#define DDRD	HostIO::sDDR[HostIO::ePortD]
+
+#define PCMSK0	HostIO::sReg[0]
+#define PCMSK1	HostIO::sReg[1]
+#define PCMSK2	HostIO::sReg[2]
+#define PCMSK3	HostIO::sReg[3]
+#define PCICR	HostIO::sReg[4]
+#define EIMSK	HostIO::sReg[5]
+#define EICRA	HostIO::sReg[6]
+#define MCUCR	HostIO::sReg[7]
+#define GIMSK	HostIO::sReg[8]
+#define TIMSK2	HostIO::sReg[9]
+#define ASSR	HostIO::sReg[10]
+#define TCNT2	HostIO::sReg[11]
+#define TCCR2A	HostIO::sReg[12]
+#define TCCR2B	HostIO::sReg[13]
+#define ADCSRA	HostIO::sReg[14]
+#define ADCSRB	HostIO::sReg[15]
+#define ADMUX	HostIO::sReg[16]
+#define DIDR0	HostIO::sReg[17]
+#define WDTCSR	HostIO::sReg[18]
+#define MCUSR	HostIO::sReg[19]
+#define GIFR	HostIO::sReg[20]
+#define PCMSK	HostIO::sReg[21]
+#define PRR		HostIO::sReg[22]
+#define EIFR	HostIO::sReg[23]
+#define ADC		HostIO::sADC
+
+// Port bits
+#define PINA0	0
+#define PINA1	1
+#define PINA2	2
+#define PINA3	3
+#define PINA4	4
+#define PINA5	5
+#define PINA6	6
+#define PINA7	7
+#define PINB0	0
+#define PINB1	1
+#define PINB2	2
+#define PINB3	3
+#define PIND2	2
+#define PIND5	5
+#define PORTA0	0
+#define PORTA1	1
+#define PORTA2	2
+#define PORTA3	3
+#define PORTA4	4
+#define PORTA5	5
+#define PORTA6	6
+#define PORTA7	7
+#define PORTB0	0
+#define PORTB1	1
+#define PORTB2	2
+
+// Pin change, external interrupt and timer 2 bits
+#define PCINT0	0
+#define PCINT3	3
+#define PCINT4	4
+#define PCINT5	5
+#define PCINT6	6
+#define PCINT7	7
+#define PCINT29	5
+#define PCIE0	0
+#define PCIE1	1
+#define PCIE3	3
+#define INT0	6
+#define INT2	2
+#define ISC00	0
+#define ISC01	1
+#define ISC20	4
+#define ISC21	5
+#define TOIE2	0
+#define OCIE2A	1
+#define OCIE2B	2
+#define EXCLK	6
+#define AS2		5
+#define TCN2UB	4
+#define OCR2AUB	3
+#define OCR2BUB	2
+#define TCR2AUB	1
+#define TCR2BUB	0
+#define WGM20	0
+#define WGM21	1
+#define WGM22	3
+#define CS20	0
+#define CS21	1
+#define CS22	2
+
+// ADC bits
+#define ADEN	7
+#define ADSC	6
+#define ADATE	5
+#define ADIF	4
+#define ADIE	3
+#define ADPS2	2
+#define ADPS1	1
+#define ADPS0	0
+#define ADTS0	0
+#define ADTS1	1
+#define ADTS2	2
+#define ADC0D	0
+
+// Watchdog and power bits
+#define WDIE	6
+#define WDCE	4
+#define WDE		3
+#define WDP0	0
+#define WDP1	1
+#define WDP2	2
+#define WDP3	5
+#define WDRF	3
+#define INTF0	6
+#define PCIF0	4
+#define PRADC	0
+#define PRUSI	1
+
+#endif // HostAVRIO_h
@@ -0,0 +1,44 @@
+/*
+*	sleep.h, Copyright Jonathan Mackey 2021
+*	Host stand-in for <avr/sleep.h>.  Sleeping returns immediately.
+*	sleep_cpu records the sleep mode in HostIO::sSleeping so that a harness
+*	can treat the node as sleeping till it delivers a wake up interrupt, see
+*	DCBusStress.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef HostAVRSleep_h
+#define HostAVRSleep_h
+
+#include <avr/io.h>
+
+#define SLEEP_MODE_IDLE			0
+#define SLEEP_MODE_ADC			1
+#define SLEEP_MODE_PWR_DOWN		2
+#define SLEEP_MODE_PWR_SAVE		3
+#define SLEEP_MODE_STANDBY		6
+
+#define set_sleep_mode(mode)	(HostIO::sSleepMode = (mode))
+#define sleep_enable()			(HostIO::sSleepEnabled = true)
+#define sleep_disable()			(HostIO::sSleepEnabled = false)
+#define sleep_cpu()				(HostIO::sSleeping = HostIO::sSleepEnabled ? HostIO::sSleepMode + 1 : 0)
+#define sleep_mode()			do {sleep_enable(); sleep_cpu(); sleep_disable();} while (0)
+#define sleep_bod_disable()
+
+#endif // HostAVRSleep_h
@@ -23,6 +23,7 @@
 #include "DCGateSensor.h"
 #include "Arduino.h"
 #include <EEPROM.h>
+#include <avr/sleep.h>
 #include "DCMessages.h"
 #include "DCSConfig.h"
 //#include "CompileTime.h"
@@ -30,13 +31,18 @@
 uint32_t	lastHallValue;
 #endif
 
-//					The timing config is written CNF3, CNF2, CNF1
-const uint8_t	DCGateSensor::kTimingConfig[] = {0x07, 0xAC, 0x04}; // 40kHz CAN baud rate
+static_assert(CANBitTiming::Valid(DCSConfig::kCANOscFreq, DCSConfig::kCANProfile),
+	"No CAN bit timing for the oscillator frequency and bit rate");
+const CANBitTiming::SConfig	DCGateSensor::kTimingConfig =
+	CANBitTiming::Config(DCSConfig::kCANOscFreq, DCSConfig::kCANProfile);
 
 const uint32_t	kControllerID = 0x20000;
 const uint32_t	kBroadcastID = 0x20001;
+const uint32_t	kGateIndexMask = 0x1F;
 
-volatile bool	sMCP2515IntTriggered;
+static volatile bool	sMCP2515IntTriggered;
+static DCGateSensor*	sGateSensor;	// For the ADC ISR
+static volatile uint8_t	sWDTTicks;		// Watchdog ticks while powered down
 
 /********************************* DCGateSensor *********************************/
 DCGateSensor::DCGateSensor(void)
@@ -55,14 +61,62 @@ void DCGateSensor::begin(void)
 	pinMode(DCSConfig::kBlueRGBPin, OUTPUT);
 	SetStatusRGB(DCGateSensor::eBlue);
 	
-	MCP2515::begin(kTimingConfig);
+	MCP2515::begin(kTimingConfig.cnf);
 	sMCP2515IntTriggered = false;
+	/*
+	*	The protocol negotiated before a reset is kept so that a v2 sensor
+	*	goes on sending heartbeats.  The controller only sets it again on the
+	*	next poll or eSetID.
+	*/
+	mProtocol = EEPROM.read(DCSConfig::kProtocolAddr);
+	if (mProtocol < DCProtocol::eV1 ||
+		mProtocol > DCProtocol::eCurrent)
+	{
+		mProtocol = DCProtocol::eV1;
+	}
+	/*
+	*	The heartbeat phase is random, seeded by the sensor ID, so that the
+	*	heartbeats of sensors powered on together don't collide.  The
+	*	multiply spreads the IDs of neighbouring gates across all 16 bits.
+	*/
+	mRandom = (uint16_t)(mID ^ (mID >> 16)) * 0x9E37;
+	if (mRandom == 0)
+	{
+		mRandom = 1;
+	}
+	mHeartbeatPeriod.Set(NextRandom() % DCSConfig::kHeartbeatPeriod + 1);
+	mHeartbeatPeriod.Start();
+	mCANIdlePeriod.Set(DCSConfig::kCANIdlePeriod);
+	mCANIdlePeriod.Start();
+	LoadCalibration();
 	mPrevGateIsOpen = GateIsOpen();
 	pinMode(DCSConfig::kGateOpenLEDPin, OUTPUT);
 	digitalWrite(DCSConfig::kGateOpenLEDPin, mPrevGateIsOpen);
 
 	cli();
 	/*
+	*	From here on the Hall sensor is read by the ADC ISR, see HallSampled.
+	*	As per 16.13 in the ATtiny84 doc, ADTS2:0 0b100 auto triggers a
+	*	conversion on Timer0 overflow.  Timer0 is the millis() timer, its
+	*	overflow ISR clears TOV0 so every overflow triggers.  The ADC clock is
+	*	8MHz/64 = 125KHz.  Vcc reference, ADC0 (kHallPin, PA0), its digital
+	*	input buffer disabled.
+	*/
+	sGateSensor = this;
+	mHallState = mPrevGateIsOpen;
+	mHallChanged = false;
+	mHallSum = 0;
+	mHallSamples = 0;
+	mHallConfirm = 0;
+	mCalibrating = false;
+	mHallAverages = 0;
+	mSleepState = eAwake;
+	mCANAsleep = false;
+	DIDR0 |= _BV(ADC0D);
+	ADMUX = 0;
+	ADCSRB = _BV(ADTS2);
+	ADCSRA = _BV(ADEN) | _BV(ADATE) | _BV(ADIF) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1);
+	/*
 	*	As per 9.3.1 in the ATtiny84 doc, clearing ISC00 and setting ISC01 sets
 	*	the mode to generate an interrupt when PB2/INT0 is falling.
 	*/
@@ -166,7 +220,8 @@ void DCGateSensor::DoConfig(void)
 	*	Generate an interrupt when the receive buffer is full and if an
 	*	error occurs.
 	*/
-	WriteReg(eCANINTEReg, _BV(eRX0IE) | _BV(eRX1IE) | _BV(eERRIE));
+	WriteReg(eCANINTEReg, _BV(eRX0IE) | _BV(eRX1IE) | _BV(eERRIE) |
+							(DCSConfig::kCANSleep ? _BV(eWAKIE) : 0));
 	/*
 	*	Allow receive buffer 1 to be used if buffer 0 is full
 	*/
@@ -188,6 +243,36 @@ void DCGateSensor::SetSensorID(
 	}
 }
 
+/******************************** SetProtocol *********************************/
+/*
+*	The controller's protocol version is the data byte at inOffset.  When the
+*	frame is from a v1 controller, without this byte, v1 is used.  The
+*	version is saved to EEPROM when it changes, see begin.
+*/
+void DCGateSensor::SetProtocol(
+	const CANFrame&	inCANFrame,
+	uint8_t			inOffset)
+{
+	uint8_t	protocol = DCProtocol::eV1;
+	if (inCANFrame.GetDataLen() > inOffset)
+	{
+		protocol = inCANFrame.GetData()[inOffset];
+		if (protocol > DCProtocol::eCurrent)
+		{
+			protocol = DCProtocol::eCurrent;
+		}
+	}
+	SaveProtocol(protocol);
+}
+
+/******************************** SaveProtocol ********************************/
+void DCGateSensor::SaveProtocol(
+	uint8_t	inProtocol)
+{
+	mProtocol = inProtocol;
+	EEPROM.update(DCSConfig::kProtocolAddr, inProtocol);
+}
+
 /*********************************** Update ***********************************/
 /*
 *	This is called every time the main sketch's loop is called.
@@ -210,25 +295,39 @@ void DCGateSensor::Update(void)
 				case eRxB0Interrupt:
 				case eRxB1Interrupt:
 				{
+					/*
+					*	Read both buffers before checking CANSTAT again.
+					*	Clearing the interrupt is done in ReceiveFrame.
+					*/
 					CANFrame	canFrame;
-					if (ReceiveFrame(canFrame))
+					while (ReceiveFrame(canFrame))
 					{
 						HandleReceivedFrame(canFrame);
-						// Clearing the interrupt is done in RecieveFrame
-						//ModifyReg(eCANINTFReg, canICODStat == eRxB0Interrupt ? _BV(eRX0IF) : _BV(eRX1IF), 0);
 					}
 					break;
 				}
+				/*
+				*	Bus activity woke the sleeping MCP2515 into listen only
+				*	mode, see DCSConfig::kCANSleep.
+				*/
+				case eWakupInterrupt:
+					SetMode(eNormalMode);
+					mCANAsleep = false;
+					mCANIdlePeriod.Start();
+					ModifyReg(eCANINTFReg, _BV(eWAKIF), 0);
+					break;
 				case eErrorInterrupt:
 				{
-					SetStatusRGB(eRed);
-					// Clear the error interrupt
-				    ModifyReg(eCANINTFReg, _BV(eERRIF), 0);
 					/*
-					*	See what triggered the error.
-					*	If it was a transmit error, then try to resend it.
+					*	Count what triggered the error.  Red when error passive
+					*	or bus off, yellow for warnings and receive overflows.
+					*	The MCP2515 resends after a transmit error by itself,
+					*	after bus off see CheckErrorCounters.
 					*/
-					ResendIfError();
+					uint8_t	eflg = UpdateErrorCounters();
+					SetStatusRGB((eflg & (_BV(eTXEP) | _BV(eTXBO))) ? eRed : eYellow);
+					// Clear the error interrupt
+				    ModifyReg(eCANINTFReg, _BV(eERRIF), 0);
 					break;
 				}
 			}
@@ -240,10 +339,20 @@ void DCGateSensor::Update(void)
 		}*/
 		sMCP2515IntTriggered = false;
 	}
-	if (!mSendDelay.Get() ||
-		mSendDelay.Passed())
+	/*
+	*	The ADC ISR only sets mHallChanged when a gate state change is
+	*	confirmed, see HallSampled.  mHallChanged is cleared before the state
+	*	is read so that a change made by the ISR in between isn't lost.
+	*/
+	if (mHallChanged &&
+		(!mSendDelay.Get() || mSendDelay.Passed()))
 	{
-		uint8_t	gateIsOpen = GateIsOpen();
+		mHallChanged = false;
+		uint8_t	gateIsOpen = mHallState;
+#ifdef HAS_SERIAL
+		swSerial.print(mHallValue);
+		swSerial.print(F(", "));
+#endif
 		if (mPrevGateIsOpen != gateIsOpen)
 		{
 			mPrevGateIsOpen = gateIsOpen;
@@ -257,6 +366,36 @@ void DCGateSensor::Update(void)
 			mSendDelay.Set(0);
 		}
 	}
+	/*
+	*	If the ePollGateStates slot of this gate has come THEN
+	*	respond.
+	*/
+	if (mPollSlotDelay.Passed())
+	{
+		mPollSlotDelay.Set(0);
+		SetStatusRGB(eGreen);
+		SendGateState();
+	}
+	/*
+	*	The heartbeat is only sent once the controller has shown that it knows
+	*	protocol v2.  The period is restarted either way to keep the phase.
+	*/
+	if (mHeartbeatPeriod.Passed())
+	{
+		if (mProtocol >= DCProtocol::eV2)
+		{
+			SendHeartbeat();
+		}
+		mHeartbeatPeriod.Set(DCSConfig::kHeartbeatPeriod - DCSConfig::kHeartbeatPeriod/16 +
+								NextRandom() % (DCSConfig::kHeartbeatPeriod/8));
+		mHeartbeatPeriod.Start();
+	}
+	if (mCalibratePeriod.Passed())
+	{
+		mCalibratePeriod.Set(0);
+		FinishCalibration();
+	}
+	CheckErrorCounters();
 	if (mFlashDelay.Passed())
 	{
 		IncRGB();
@@ -264,16 +403,177 @@ void DCGateSensor::Update(void)
 	}
 }
 
+/*********************************** Sleep ************************************/
+/*
+*	Called by the sketch's loop after Update.  The MCU idle sleeps till the
+*	next interrupt: Timer0 overflow (every 2.048ms), the ADC, or INT0.
+*
+*	When nothing is pending (CanPowerDown) it power-down sleeps instead, till
+*	the next watchdog tick or INT0.  Timer0 doesn't run in power-down, so
+*	after a tick the heartbeat and CAN idle periods are moved back by the
+*	time slept, and the ADC free runs for one Hall average (about 0.8ms)
+*	before the MCU power-down sleeps again.  A gate change is confirmed
+*	after kHallConfirm ticks.
+*
+*	The time slept before an INT0 wake up isn't known (the watchdog counter
+*	can't be read) and is lost, up to one kSleepTickMillis tick per frame
+*	received while powered down.  The CAN idle period only gets longer.  The
+*	heartbeat is late by the time lost: with a kHeartbeatPeriod of 30 s it
+*	would take over 1000 such frames (70 s / 64 ms) within one period to
+*	reach the controller's 100 s kGateHeartbeatTimeout.  Gate state requests
+*	and polls are also answered, and the controller counts any gate state
+*	frame as the gate being seen (DustCollector::SetGateState.)
+*/
+void DCGateSensor::Sleep(void)
+{
+	if (mSleepState == ePoweredDown)
+	{
+		/*
+		*	Woken up.  The watchdog is stopped till the next power-down and
+		*	INT0 goes back to the falling edge.
+		*/
+		cli();
+		uint8_t	ticks = sWDTTicks;
+		sWDTTicks = 0;
+		WDTCSR |= _BV(WDCE) | _BV(WDE);
+		WDTCSR = 0;
+		MCUCR = (MCUCR & ~_BV(ISC00)) | _BV(ISC01);
+		GIFR = _BV(INTF0);
+		sei();
+		if (ticks)
+		{
+			uint32_t	slept = (uint32_t)ticks * DCSConfig::kSleepTickMillis;
+			mHeartbeatPeriod.Start(0 - (mHeartbeatPeriod.ElapsedTime() + slept));
+			mCANIdlePeriod.Start(0 - (mCANIdlePeriod.ElapsedTime() + slept));
+			mSleepAverages = mHallAverages;
+			SetHallTrigger(true);
+			mSleepState = eSampling;
+		} else
+		{
+			SetHallTrigger(false);
+			mSleepState = eAwake;
+		}
+	} else if (mSleepState == eSampling &&
+		mHallAverages != mSleepAverages)
+	{
+		SetHallTrigger(false);
+		mSleepState = eAwake;
+	}
+	if (mSleepState == eAwake &&
+		CanPowerDown())
+	{
+		PowerDown();
+	} else
+	{
+		/*
+		*	The MCP2515 is only left asleep during the ADC burst.  A frame
+		*	loaded while it slept is sent once it's awake.
+		*/
+		if (mCANAsleep &&
+			mSleepState == eAwake)
+		{
+			SetMode(eNormalMode);
+			mCANAsleep = false;
+		}
+		set_sleep_mode(SLEEP_MODE_IDLE);
+		sleep_mode();
+	}
+}
+
+/******************************** CanPowerDown ********************************/
+/*
+*	True when nothing that needs millis() or the ADC running is pending, and
+*	the MCP2515 has nothing left to send.
+*/
+bool DCGateSensor::CanPowerDown(void)
+{
+	return(DCSConfig::kDeepSleep &&
+		!sMCP2515IntTriggered &&
+		!mHallChanged &&
+		!mCalibrating &&
+		!mFlashDelay.Get() &&
+		!mPollSlotDelay.Get() &&
+		(!mSendDelay.Get() || mSendDelay.Passed()) &&
+		!BusOffHold() &&
+		(GetStatus() & (_BV(eTXREQ_TXB0CTRL) | _BV(eTXREQ_TXB1CTRL) | _BV(eTXREQ_TXB2CTRL))) == 0);
+}
+
+/********************************* PowerDown **********************************/
+/*
+*	The ADC is turned off and the partial Hall average dropped.  INT0 is set
+*	to the low level because the edges are only detected with the I/O clock
+*	running (9.2 in the ATtiny84 doc.)  The EXT_INT0 ISR sets it back.  The
+*	flags are checked again with interrupts disabled, and sleep_cpu follows
+*	sei, so an interrupt after the check still wakes the MCU.
+*/
+void DCGateSensor::PowerDown(void)
+{
+	if (DCSConfig::kCANSleep &&
+		!mCANAsleep &&
+		mCANIdlePeriod.Passed())
+	{
+		SetMode(eSleepMode);
+		mCANAsleep = true;
+	}
+	cli();
+	if (!sMCP2515IntTriggered &&
+		!mHallChanged)
+	{
+		ADCSRA &= ~_BV(ADEN);
+		mHallSum = 0;
+		mHallSamples = 0;
+		MCUCR &= ~(_BV(ISC01) | _BV(ISC00));
+		MCUSR &= ~_BV(WDRF);
+		WDTCSR |= _BV(WDCE) | _BV(WDE);
+		WDTCSR = _BV(WDIE) | DCSConfig::kSleepTickWDP;
+		mSleepState = ePoweredDown;
+		set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		sleep_disable();
+	}
+	sei();
+}
+
+/******************************* SetHallTrigger *******************************/
+/*
+*	Timer0 overflow triggered, see begin, or free running: a conversion every
+*	13 ADC clocks (104us.)  Also turns the ADC back on after PowerDown.
+*/
+void DCGateSensor::SetHallTrigger(
+	bool	inFreeRunning)
+{
+	ADCSRB = inFreeRunning ? 0 : _BV(ADTS2);
+	ADCSRA |= inFreeRunning ? (_BV(ADEN) | _BV(ADSC)) : _BV(ADEN);
+}
+
 /**************************** HandleReceivedFrame *****************************/
 void DCGateSensor::HandleReceivedFrame(
 	CANFrame&	inCANFrame)
 {
+	mCANIdlePeriod.Start();
 	switch (inCANFrame.GetStandardID())
 	{
 		case DCController::eRequestGateState:
 			SetStatusRGB(eGreen);
 			SendGateState();
 			break;
+		/*
+		*	The data is the gate base ID and the slot in ms.  Only registered
+		*	sensors respond, each in the slot of its gate index, and only they
+		*	change protocol (unregistered sensors may share the same ID.)  The
+		*	delay is 1 ms longer so that it isn't 0 (disabled) for gate index 0.
+		*/
+		case DCController::ePollGateStates:
+			if (inCANFrame.GetDataLen() >= 5 &&
+				(mID & ~kGateIndexMask) == *(const uint32_t*)inCANFrame.GetData())
+			{
+				SetProtocol(inCANFrame, 5);
+				mPollSlotDelay.Set((mID & kGateIndexMask) * inCANFrame.GetData()[4] + 1);
+				mPollSlotDelay.Start();
+			}
+			break;
 		case DCController::eFlash:
 			mFlashDelay.Set(300);
 			mFlashDelay.Start();
@@ -283,44 +583,44 @@ void DCGateSensor::HandleReceivedFrame(
 			mFlashDelay.Set(0);
 			break;
 		case DCController::eSetID:
+			SetProtocol(inCANFrame, 4);
 			SetSensorID(*((const uint32_t*)inCANFrame.GetData()));
 			break;
 		case DCController::eSetFactoryID:
+			SaveProtocol(DCProtocol::eV1);
 			SetSensorID(0xFFFFFFFF);
 			break;
 		case DCController::eRequestTimestamp:
 			SendTimestamp();
 			break;
-	}
-}
-
-/******************************* ResendIfError ********************************/
-void DCGateSensor::ResendIfError(void)
-{
-	uint8_t	reqToSendBits = 1;
-	for (uint8_t txCtrlRegAddr = eTXB0CTRLReg;
-			txCtrlRegAddr <= eTXB2CTRLReg; txCtrlRegAddr += 0x10)
-	{
-		if (ReadReg(txCtrlRegAddr) & eTXERR)
-		{
-			SetStatusRGB(eYellow);
-			// Tell the controller the Tx buffer is ready to be resent.
-			BeginTransaction();
-			SPI.transfer(eReqToSendInst + reqToSendBits);
-			EndTransaction();
+		case DCController::eRequestErrorCounters:
+			SendErrorCounters();
+			break;
+		case DCController::eCalibrate:
+			StartCalibration();
 			break;
-		}
-		reqToSendBits <<= 1;
 	}
 }
 
 /******************************* SendGateState ********************************/
+/*
+*	v1 sends to the controller ID with the sensor ID as data.  v2 sends the
+*	sensor ID as the extended ID with no data.
+*/
 void DCGateSensor::SendGateState(void)
 {
-	CANFrame	gateStateFrame(mPrevGateIsOpen ? DCSensor::eGateIsOpen :
+	if (mProtocol >= DCProtocol::eV2)
+	{
+		CANFrame	gateStateFrame((uint16_t)(mPrevGateIsOpen ? DCSensor::eGateIsOpenV2 :
+												DCSensor::eGateIsClosedV2), mID);
+		SendFrame(gateStateFrame);
+	} else
+	{
+		CANFrame	gateStateFrame(mPrevGateIsOpen ? DCSensor::eGateIsOpen :
 												DCSensor::eGateIsClosed,
 													kControllerID, mID);
-	SendFrame(gateStateFrame);
+		SendFrame(gateStateFrame);
+	}
 }
 
 /******************************* SendTimestamp ********************************/
@@ -337,6 +637,113 @@ void DCGateSensor::SendTimestamp(void)
 	SendFrame(timestampFrame);
 }
 
+/******************************* SendHeartbeat ********************************/
+void DCGateSensor::SendHeartbeat(void)
+{
+	CANFrame	heartbeatFrame((uint16_t)DCSensor::eHeartbeatV2, mID, (uint8_t)mPrevGateIsOpen);
+	SendFrame(heartbeatFrame);
+}
+
+/***************************** SendErrorCounters ******************************/
+/*
+*	Sent with protocol v2 whatever the protocol in use, the extended ID
+*	identifies the sender.
+*/
+void DCGateSensor::SendErrorCounters(void)
+{
+	UpdateErrorCounters();	// For the current TEC and REC
+	CANFrame	countersFrame((uint16_t)DCSensor::eErrorCountersV2, mID,
+							sizeof(SErrorCounters), (const uint8_t*)&GetErrorCounters());
+	SendFrame(countersFrame);
+}
+
+/****************************** LoadCalibration *******************************/
+/*
+*	The threshold and hysteresis saved by FinishCalibration.  The defaults
+*	are used when the EEPROM is erased or the values don't fit the ADC range,
+*	or the hysteresis doesn't fit SHallCalibration (a calibration saves at
+*	most 1023/16.)
+*/
+void DCGateSensor::LoadCalibration(void)
+{
+	EEPROM.get(DCSConfig::kHallThresholdAddr, mHallThreshold);
+	EEPROM.get(DCSConfig::kHallHysteresisAddr, mHallHysteresis);
+	if (mHallThreshold > 1023 ||
+		mHallHysteresis >= mHallThreshold ||
+		mHallHysteresis > 0xFF ||
+		mHallThreshold + mHallHysteresis > 1023)
+	{
+		mHallThreshold = DCSConfig::kHallThreshold;
+		mHallHysteresis = DCSConfig::kHallHysteresis;
+	}
+}
+
+/****************************** StartCalibration ******************************/
+/*
+*	HallSampled keeps the lowest and highest averages till mCalibratePeriod
+*	passes.  A calibration in progress starts over.
+*/
+void DCGateSensor::StartCalibration(void)
+{
+	mCalibrating = false;
+	mHallMin = 0xFFFF;
+	mHallMax = 0;
+	mCalibrating = true;
+	mCalibratePeriod.Set(DCSConfig::kCalibratePeriod);
+	mCalibratePeriod.Start();
+	SetStatusRGB(eMagenta);
+}
+
+/***************************** FinishCalibration ******************************/
+/*
+*	The threshold is midway between the lowest (open) and highest (closed)
+*	averages, the hysteresis 1/16 of the difference.  When the gate wasn't
+*	opened and closed far enough the calibration in use is kept.  Either way
+*	the calibration in use and the values sampled are sent to the
+*	controller, as protocol v2 like the error counters.
+*/
+void DCGateSensor::FinishCalibration(void)
+{
+	mCalibrating = false;	// mHallMin and mHallMax are no longer changed
+	DCSensor::SHallCalibration	calibration;
+	calibration.closedValue = mHallMax;
+	calibration.openValue = mHallMin;
+	if (mHallMax > mHallMin &&
+		mHallMax - mHallMin >= DCSConfig::kHallMinSpan)
+	{
+		uint16_t	span = mHallMax - mHallMin;
+		cli();	// HallSampled uses them
+		mHallThreshold = mHallMin + span/2;
+		mHallHysteresis = span/16;
+		sei();
+		EEPROM.put(DCSConfig::kHallThresholdAddr, mHallThreshold);
+		EEPROM.put(DCSConfig::kHallHysteresisAddr, mHallHysteresis);
+		SetStatusRGB(eGreen);
+		calibration.result = DCSensor::eCalibrationSaved;
+	} else
+	{
+		SetStatusRGB(eRed);
+		calibration.result = DCSensor::eCalibrationKept;
+	}
+	calibration.threshold = mHallThreshold;
+	calibration.hysteresis = mHallHysteresis;
+	CANFrame	calibrationFrame((uint16_t)DCSensor::eCalibrationV2, mID,
+							sizeof(calibration), (const uint8_t*)&calibration);
+	SendFrame(calibrationFrame);
+}
+
+/********************************* NextRandom *********************************/
+/*
+*	16 bit xorshift, never 0 given a non-zero mRandom.
+*/
+uint16_t DCGateSensor::NextRandom(void)
+{
+	mRandom ^= mRandom << 7;
+	mRandom ^= mRandom >> 9;
+	mRandom ^= mRandom << 8;
+	return(mRandom);
+}
+
 /*********************************** SetStatusRGB ***********************************/
 void DCGateSensor::SetStatusRGB(
 	uint8_t	inState)
@@ -359,6 +766,10 @@ void DCGateSensor::IncRGB(void)
 }
 
 /********************************* GateIsOpen *********************************/
+/*
+*	Blocking read of the Hall sensor, only used by begin to get the initial
+*	gate state before the ADC ISR takes over.
+*/
 uint8_t DCGateSensor::GateIsOpen(void)
 {
 	uint32_t	hallValue = analogRead(DCSConfig::kHallPin);
@@ -370,7 +781,63 @@ uint8_t DCGateSensor::GateIsOpen(void)
 		swSerial.print(F(", "));
 	}
 #endif
-	return(hallValue < 700);
+	return(hallValue < mHallThreshold);
+}
+
+/******************************** HallSampled *********************************/
+/*
+*	Called from the ADC ISR.  kHallOversample conversions are averaged, which
+*	filters out the noise of a single conversion.  The gate state only
+*	changes when kHallConfirm averages in a row are on the other side of the
+*	hysteresis band, mHallThreshold +/- mHallHysteresis, so a magnet sitting
+*	near the threshold doesn't make the state chatter.  Only then is
+*	mHallChanged set for Update.  While calibrating the lowest and highest
+*	averages are kept.
+*/
+void DCGateSensor::HallSampled(
+	uint16_t	inValue)
+{
+	mHallSum += inValue;
+	mHallSamples++;
+	if (mHallSamples >= DCSConfig::kHallOversample)
+	{
+		mHallValue = mHallSum / DCSConfig::kHallOversample;
+		mHallSum = 0;
+		mHallSamples = 0;
+		mHallAverages++;
+		if (mCalibrating)
+		{
+			if (mHallValue < mHallMin)
+			{
+				mHallMin = mHallValue;
+			}
+			if (mHallValue > mHallMax)
+			{
+				mHallMax = mHallValue;
+			}
+		}
+		if (mHallState ?
+				mHallValue > mHallThreshold + mHallHysteresis :
+				mHallValue < mHallThreshold - mHallHysteresis)
+		{
+			mHallConfirm++;
+			if (mHallConfirm >= DCSConfig::kHallConfirm)
+			{
+				mHallConfirm = 0;
+				mHallState = !mHallState;
+				mHallChanged = true;
+			}
+		} else
+		{
+			mHallConfirm = 0;
+		}
+	}
+}
+
+/********************************** ADC ISR ***********************************/
+ISR(ADC_vect)
+{
+	sGateSensor->HallSampled(ADC);
 }
 
 /***************************** External INT0 ISR ******************************/
@@ -379,4 +846,16 @@ ISR(EXT_INT0_vect)
 	// sMCP2515IntTriggered is only set here.
 	// It's cleared when handled in Update().
 	sMCP2515IntTriggered = sMCP2515IntTriggered || (PINB & DCSConfig::kPINBMask) != DCSConfig::kPINBMask;
+	/*
+	*	Back to the falling edge when the low level woke the MCU from
+	*	power-down (see PowerDown), otherwise this repeats till the MCP2515
+	*	interrupt is handled.
+	*/
+	MCUCR |= _BV(ISC01);
+}
+
+/******************************** Watchdog ISR ********************************/
+ISR(WDT_vect)
+{
+	sWDTTicks++;
 }
\ No newline at end of file
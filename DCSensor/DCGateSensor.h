@@ -24,6 +24,7 @@
 #define DCGateSensor_h
 
 #include "MCP2515.h"
+#include "CANBitTiming.h"
 #include "MSPeriod.h"
 
 extern volatile uint32_t	kTimestamp;
@@ -36,6 +37,7 @@ public:
 	void					begin(void);
 
 	void					Update(void);
+	void					Sleep(void);
 	enum ERGBMask
 	{
 		eRGBOff,		
@@ -50,21 +52,67 @@ public:
 	void					SetStatusRGB(
 								uint8_t					inState);
 	void					IncRGB(void);
+	/*
+	*	HallSampled: Called by the ADC ISR with each Hall sensor conversion.
+	*/
+	void					HallSampled(
+								uint16_t				inValue);
 protected:
 	uint32_t	mID;
 	MSPeriod	mSendDelay;
 	MSPeriod	mFlashDelay;
+	MSPeriod	mPollSlotDelay;	// Of the ePollGateStates response
+	MSPeriod	mHeartbeatPeriod;
+	uint16_t	mRandom;		// Heartbeat phase, see NextRandom
 	uint8_t		mPrevGateIsOpen;
-	static const uint8_t	kTimingConfig[];
+	volatile uint8_t	mHallState;		// Confirmed by HallSampled, 1 = open
+	volatile bool		mHallChanged;	// Set by HallSampled, cleared by Update
+	uint16_t	mHallSum;		// Of the conversions being averaged
+	uint16_t	mHallValue;		// The last average
+	uint8_t		mHallSamples;	// In mHallSum
+	uint8_t		mHallConfirm;	// Averages in a row outside the band
+	uint16_t	mHallThreshold;	// See LoadCalibration
+	uint16_t	mHallHysteresis;
+	MSPeriod	mCalibratePeriod;	// See DCController::eCalibrate
+	volatile uint16_t	mHallMin;	// Averages while mCalibrating
+	volatile uint16_t	mHallMax;
+	volatile bool		mCalibrating;
+	volatile uint8_t	mHallAverages;	// Count, see Sleep
+	uint8_t		mSleepAverages;	// mHallAverages when the ADC burst started
+	uint8_t		mSleepState;
+	MSPeriod	mCANIdlePeriod;	// Since the last frame received, see PowerDown
+	bool		mCANAsleep;		// See DCSConfig::kCANSleep
+	uint8_t		mProtocol;		// DCProtocol version used to send
+	static const CANBitTiming::SConfig	kTimingConfig;
+	enum ESleepState
+	{
+		eAwake,
+		ePoweredDown,	// Till woken by the watchdog or INT0
+		eSampling		// The ADC burst after a watchdog tick
+	};
 
 	virtual void			DoConfig(void);
 	void					SetSensorID(
 								uint32_t				inSensorID);
+	void					SetProtocol(
+								const CANFrame&			inCANFrame,
+								uint8_t					inOffset);
+	void					SaveProtocol(
+								uint8_t					inProtocol);
 	void					SendGateState(void);
 	void					SendTimestamp(void);
+	void					SendHeartbeat(void);
+	void					SendErrorCounters(void);
+	void					LoadCalibration(void);
+	void					StartCalibration(void);
+	void					FinishCalibration(void);
+	bool					CanPowerDown(void);
+	void					PowerDown(void);
+	void					SetHallTrigger(
+								bool					inFreeRunning);
+	uint16_t				NextRandom(void);
 	void					HandleReceivedFrame(
 								CANFrame&				inCANFrame);
 	uint8_t					GateIsOpen(void);
-	void					ResendIfError(void);
 };
 #endif // DCGateSensor_h
@@ -23,6 +23,7 @@
 #define DCSConfig_h
 
 #include <inttypes.h>
+#include "CANBitTiming.h"
 
 //#define HAS_SERIAL
 #ifdef HAS_SERIAL
@@ -46,12 +47,63 @@ namespace DCSConfig
 	const int8_t kGateOpenLEDPin	= 10;	// PB0
 	const uint8_t	kPINBMask = _BV(PINB2);	// PB2 CAN_INT
 	
+	// CAN bit timing, see CANBitTiming.h
+	const uint32_t	kCANOscFreq = 8000000;	// MCP2515 crystal
+	const CANBitTiming::EProfile	kCANProfile = CANBitTiming::e40kbps;	// Same as the controller
+	
+	// eHeartbeatV2 period in milliseconds, randomized by +/- 1/16
+	const uint32_t	kHeartbeatPeriod = 30000;
+	
+	/*
+	*	Hall sensor, see DCGateSensor::HallSampled.  The ADC converts on every
+	*	Timer0 overflow (2.048ms at 8MHz.)  kHallOversample conversions are
+	*	averaged.  The gate is open when kHallConfirm averages in a row are
+	*	below kHallThreshold - kHallHysteresis, closed when they're above
+	*	kHallThreshold + kHallHysteresis.  These are the defaults, replaced
+	*	by the sensor's calibration (see DCController::eCalibrate.)
+	*/
+	const uint16_t	kHallThreshold = 700;
+	const uint16_t	kHallHysteresis = 50;
+	const uint8_t	kHallOversample = 8;	// Power of 2, at most 64
+	const uint8_t	kHallConfirm = 2;
+	/*
+	*	DCController::eCalibrate: the period the gate is opened and closed in,
+	*	and the least difference between the closed and open averages that's
+	*	accepted.  The calibrated hysteresis is 1/16 of the difference.
+	*/
+	const uint16_t	kCalibratePeriod = 10000;	// ms
+	const uint16_t	kHallMinSpan = 200;
+	
+	/*
+	*	Low power, see DCGateSensor::Sleep.  With kDeepSleep the MCU power-down
+	*	sleeps when nothing is pending, woken by INT0 or the watchdog every
+	*	kSleepTickMillis to sample the Hall sensor.  With kCANSleep the
+	*	MCP2515 also sleeps then, once no frame has been received for
+	*	kCANIdlePeriod, woken by bus activity.  The frame that wakes it is
+	*	lost and not acknowledged by it.  The sender's retransmission is
+	*	only received when another node acknowledges the lost frame, so
+	*	the controller's requests to a bus of sleeping sensors are missed.
+	*/
+	const bool		kDeepSleep = true;
+	const bool		kCANSleep = false;
+	const uint16_t	kCANIdlePeriod = 1000;	// ms
+	const uint8_t	kSleepTickMillis = 64;
+	const uint8_t	kSleepTickWDP = _BV(WDP1);	// WDT prescaler for 64ms
+	
 	/*
 	*	EEPROM usage, 512 bytes
 	*
 	*	[0]		uint32_t	CAN ID.  Initially this is set to the compile time
+	*	[4]		uint16_t	Calibrated Hall threshold, see DCController::eCalibrate.
+	*	[6]		uint16_t	Calibrated Hall hysteresis.  When erased (0xFFFF)
+	*						kHallThreshold and kHallHysteresis are used.
+	*	[8]		uint8_t		DCProtocol version last set by the controller, see
+	*						DCGateSensor::SetProtocol.  When erased v1 is used.
 	*/
 	const uint16_t	kCAN_ID_Addr	= 0;
+	const uint16_t	kHallThresholdAddr	= 4;
+	const uint16_t	kHallHysteresisAddr	= 6;
+	const uint16_t	kProtocolAddr	= 8;
 }
 
 #endif // DCSConfig_h
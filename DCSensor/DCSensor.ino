@@ -65,4 +65,5 @@ void setup(void)
 void loop(void)
 {
 	gateSensor.Update();
+	gateSensor.Sleep();
 }
@@ -32,6 +32,7 @@
 #else
 #include <SPI.h>
 #endif
+#include "SPITracer.h"
 
 class BMP280SPI
 {
@@ -91,12 +92,14 @@ protected:
 							#else
 								SPI.setDataMode(SPI_MODE0);
 							#endif
+								SPI_TRACE_BEGIN(mCSPin);
 								digitalWrite(mCSPin, LOW);
 							}
 
 	inline void				EndTransaction(void)
 							{
 								digitalWrite(mCSPin, HIGH);
+								SPI_TRACE_END();
 							#ifdef SPI_HAS_TRANSACTION
 								SPI.endTransaction();
 							#endif
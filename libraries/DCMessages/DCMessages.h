@@ -35,7 +35,67 @@ namespace DCSensor
 		// The eGate commands also serve as a login when sent to the controller.
 		eGateIsOpen			= 1,	// Extended frame, data is the sensor ID
 		eGateIsClosed,				// Extended frame, data is the sensor ID
-		eTimestamp					// Extended frame, data is the sensor ID + unix timestamp
+		eTimestamp,					// Extended frame, data is the sensor ID + unix timestamp
+		// Sent by a diagnostic tool to the controller ID, data is the ID to
+		// reply to (the broadcast ID when there's no data.)
+		eRequestSnapshot,			// Extended frame, see DCController::eGateSnapshot
+		// Protocol v2, the extended ID is the sensor ID.  See below.
+		eGateIsOpenV2		= 0x10,	// Extended frame, no data
+		eGateIsClosedV2,			// Extended frame, no data
+		eHeartbeatV2,				// Extended frame, data is 1 if the gate is open
+		eErrorCountersV2,			// Extended frame, see DCController::eRequestErrorCounters
+		eCalibrationV2				// Extended frame, see DCController::eCalibrate
+	};
+	
+	/*
+	*	The data of eCalibrationV2.  The Hall values are 10 bit ADC averages,
+	*	see DCGateSensor::HallSampled.  When the values sampled are too close
+	*	together the calibration in use is kept and sent with eCalibrationKept.
+	*/
+	enum ECalibrationResult
+	{
+		eCalibrationKept,
+		eCalibrationSaved
+	};
+	struct SHallCalibration
+	{
+		uint16_t	threshold;		// In use after the calibration
+		uint8_t		hysteresis;
+		uint8_t		result;			// ECalibrationResult
+		uint16_t	closedValue;	// Highest average sampled
+		uint16_t	openValue;		// Lowest average sampled
+	};
+	
+	/*
+	*	In protocol v1 a sensor sends its frames to the controller ID and
+	*	repeats its 4 byte sensor ID in the data.  In v2 the extended ID is the
+	*	sender's sensor ID (the gate base ID plus the gate index) and a gate
+	*	state frame has no data, about 35% fewer bits at 40 kbps.  It also
+	*	keeps two sensors from ever sending the same identifier.  A v2 sensor
+	*	also sends eHeartbeatV2 about every 30 s so that the controller notices
+	*	when it stops responding.  The v2
+	*	commands are kept within eV2CommandMask so that the controller can
+	*	accept all of them with one filter.
+	*/
+	enum
+	{
+		eV2CommandMask		= 0x7F0
+	};
+}
+
+/*
+*	A sensor starts in protocol v1 and switches to the version the controller
+*	sends with ePollGateStates and eSetID.  Sensors that don't know v2 ignore
+*	the extra data byte and continue using v1, and the controller accepts both
+*	so that v1 and v2 sensors can be mixed on the same bus.
+*/
+namespace DCProtocol
+{
+	enum EVersion
+	{
+		eV1					= 1,
+		eV2,
+		eCurrent			= eV2
 	};
 }
 
@@ -47,11 +107,15 @@ namespace DCController
 		eCheckGateStateResponses,	// Internal command, see below.
 		eFlash,						// Extended frame, no data
 		eStopFlash,					// Extended frame, no data
-		eSetID,						// Extended frame, data is the new ID
+		eSetID,						// Extended frame, data is the new ID + protocol version
 		eSetFactoryID,				// Extended frame, no data
 		// The timestamp is the date and time of when the software was compiled.
 		eRequestTimestamp,			// Extended frame, no data
-		eReplaceID					// Internal command, see below.
+		eReplaceID,					// Internal command, see below.
+		ePollGateStates,			// Extended frame to kBroadcastID, see below.
+		eGateSnapshot,				// Extended frame, data is the open + unresponsive gates
+		eRequestErrorCounters,		// Extended frame, no data
+		eCalibrate					// Extended frame, no data
 	};
 	
 	/*
@@ -63,6 +127,32 @@ namespace DCController
 	*	eReplaceID is used internally to set an unregistered gate sensor to the
 	*	ID of an existing gate that isn't responding.  This assumes the
 	*	unregistered gate sensor is replacing the existing gate sensor.
+	*
+	*	ePollGateStates requests the gate state of every registered gate with
+	*	one broadcast frame.  The data is the 4 byte gate base ID followed by
+	*	the 1 byte response slot in milliseconds and the 1 byte protocol
+	*	version of the controller.  Only sensors whose ID is
+	*	the base ID plus a gate index respond.  Each waits gate index times the
+	*	slot before sending its gate state so that the responses arrive spaced
+	*	out rather than all at once.
+	*
+	*	eGateSnapshot is the reply to DCSensor::eRequestSnapshot.  The data is
+	*	the controller's open gates bitmap followed by its unresponsive gates
+	*	bitmap, 4 bytes each, bit 0 is gate index 1.
+	*
+	*	eRequestErrorCounters is sent by a diagnostic tool to a sensor ID, to
+	*	kBroadcastID for all sensors, or to the controller ID.  Each replies
+	*	with DCSensor::eErrorCountersV2, the extended ID being the replier's ID
+	*	and the data the 8 byte MCP2515::SErrorCounters: the RX0OVR, RX1OVR,
+	*	TXEP and TXBO counts, then TEC, REC, and the maximum TEC and REC.
+	*
+	*	eCalibrate starts the Hall sensor calibration of the sensor it's sent
+	*	to.  The gate should be fully opened and closed during the sensor's
+	*	calibration period (its LED is magenta.)  The sensor then sets its
+	*	threshold midway between the highest and lowest values sampled and
+	*	saves it to EEPROM, unless the values are too close together (LED red.)
+	*	It replies with DCSensor::eCalibrationV2, the extended ID being the
+	*	sensor ID and the data a DCSensor::SHallCalibration.
 	*/
 }
 #endif // DCMessages_h
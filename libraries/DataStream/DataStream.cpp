@@ -26,6 +26,7 @@
 #else
 #include <avr/pgmspace.h>
 #include <EEPROM.h>
+#include "EEPROMTracer.h"
 #endif
 #include <string.h>
 
@@ -162,9 +163,10 @@ uint32_t DataStream_E::Read(
 #ifndef EEPROM_h
 	memcpy(outBuffer, mCurrent, bytesRead);
 #else
-	EEPtr e = (int)mCurrent;
+	EEPtr e = (int)(uintptr_t)mCurrent;
 	uint8_t *ptr = (uint8_t*)outBuffer;
 	for( int count = bytesRead ; count ; --count, ++e )  *ptr++ = *e;
+	EEPROM_TRACE_READ((uint16_t)(uintptr_t)mCurrent, bytesRead);
 #endif
 	mCurrent += bytesRead;
 	return(bytesRead);
@@ -179,9 +181,14 @@ uint32_t DataStream_E::Write(
 #ifndef EEPROM_h
 	memcpy((void*)mCurrent, inBuffer, bytesWritten);
 #else
-	EEPtr e = (int)mCurrent;
+	EEPtr e = (int)(uintptr_t)mCurrent;
 	const uint8_t *ptr = (const uint8_t*)inBuffer;
-	for( int count = bytesWritten ; count ; --count, ++e )  (*e).update( *ptr++ );
+	for( int count = bytesWritten ; count ; --count, ++e )
+	{
+		EEPROM_TRACE_UPDATE(e, *ptr);
+		(*e).update( *ptr++ );
+	}
+	EEPROM_TRACE_WRITE(bytesWritten);
 #endif
 	mCurrent += bytesWritten;
 	return(bytesWritten);
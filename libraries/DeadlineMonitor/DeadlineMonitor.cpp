@@ -0,0 +1,73 @@
+/*
+*	DeadlineMonitor.cpp, Copyright Jonathan Mackey 2021
+*	Lateness statistics for the controller's periodic tasks.  See
+*	DeadlineMonitor.h.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#include "DeadlineMonitor.h"
+
+DeadlineMonitor::STask	DeadlineMonitor::sTask[];
+
+/************************************ Ran *************************************/
+void DeadlineMonitor::Ran(
+	uint8_t		inTask,
+	uint32_t	inLate,
+	bool		inMissed)
+{
+	STask&	task = sTask[inTask];
+	task.count++;
+	task.sumLate += inLate;
+	if (inLate > task.maxLate)
+	{
+		task.maxLate = inLate < 0xFFFF ? inLate : 0xFFFF;
+	}
+	if (inMissed &&
+		task.misses != 0xFFFF)
+	{
+		task.misses++;
+	}
+}
+
+/*********************************** Reset ************************************/
+void DeadlineMonitor::Reset(void)
+{
+	memset(sTask, 0, sizeof(sTask));
+}
+
+/************************************ Dump ************************************/
+void DeadlineMonitor::Dump(
+	uint8_t						inTask,
+	const __FlashStringHelper*	inName)
+{
+	const STask&	task = sTask[inTask];
+	Serial.print(inName);
+	Serial.print(F(" (ms late) n="));
+	Serial.print(task.count);
+	if (task.count)
+	{
+		Serial.print(F(", avg="));
+		Serial.print(task.sumLate/task.count);
+		Serial.print(F(", max="));
+		Serial.print(task.maxLate);
+		Serial.print(F(", missed="));
+		Serial.print(task.misses);
+	}
+	Serial.println();
+}
@@ -0,0 +1,81 @@
+/*
+*	DeadlineMonitor.h, Copyright Jonathan Mackey 2021
+*	Lateness statistics for the controller's periodic tasks: how long after
+*	its period ended each MSPeriod driven task actually ran, the average and
+*	maximum lateness, and how often a task missed its deadline.
+*
+*	For a periodic task the deadline is the end of the following period, a
+*	task that runs a whole period late has effectively skipped a sample.
+*	Tasks that aren't periodic pass their own lateness and missed state to
+*	Ran.  Times are in milliseconds (simulated milliseconds on the host.)
+*
+*	The counts are always kept (about 12 bytes of RAM per task) so that the
+*	UI can show them.  They are cumulative since startup unless Reset is
+*	called.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef DeadlineMonitor_h
+#define DeadlineMonitor_h
+
+#include <Arduino.h>
+#include "MSPeriod.h"
+
+class DeadlineMonitor
+{
+public:
+	enum
+	{
+		eMaxTasks		= 5
+	};
+	struct STask
+	{
+		uint32_t	count;
+		uint32_t	sumLate;
+		uint16_t	maxLate;	// Saturates at 0xFFFF
+		uint16_t	misses;		// Saturates at 0xFFFF
+	};
+
+	static void				Ran(
+								uint8_t					inTask,
+								uint32_t				inLate,
+								bool					inMissed);
+	/*
+	*	RanPeriodic: Called when inPeriod has passed and the task is about to
+	*	run, before inPeriod is restarted.
+	*/
+	static inline void		RanPeriodic(
+								uint8_t					inTask,
+								const MSPeriod&			inPeriod)
+							{
+								uint32_t	late = inPeriod.ElapsedTime() - inPeriod.Get();
+								Ran(inTask, late, late >= inPeriod.Get());
+							}
+	static void				Reset(void);
+	static const STask&		Get(
+								uint8_t					inTask)
+								{return(sTask[inTask]);}
+	static void				Dump(
+								uint8_t					inTask,
+								const __FlashStringHelper*	inName);
+protected:
+	static STask	sTask[eMaxTasks];
+};
+
+#endif // DeadlineMonitor_h
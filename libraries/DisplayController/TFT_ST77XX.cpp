@@ -330,13 +330,19 @@ void TFT_ST77XX::FillPixels(
 {
 	uint8_t	msb = inFillColor >> 8;
 	uint8_t	lsb = inFillColor;
-	BeginTransaction();
-	for (; inPixelsToFill; inPixelsToFill--)
+	while (inPixelsToFill)
 	{
-		SPI.transfer(msb);
-		SPI.transfer(lsb);
+		uint16_t pixelsToWrite = inPixelsToFill > ePixelsPerTransaction ?
+									ePixelsPerTransaction : inPixelsToFill;
+		inPixelsToFill -= pixelsToWrite;
+		BeginTransaction();
+		for (; pixelsToWrite; pixelsToWrite--)
+		{
+			SPI.transfer(msb);
+			SPI.transfer(lsb);
+		}
+		EndTransaction();
 	}
-	EndTransaction();
 }
 
 /*********************************** MoveTo ***********************************/
@@ -411,10 +417,18 @@ void TFT_ST77XX::StreamCopy(
 {
 	BeginTransaction();
 	uint16_t	buffer[32];
+	uint16_t	pixelsWritten = 0;	// In this transaction
 	while (inPixelsToCopy)
 	{
+		if (pixelsWritten >= ePixelsPerTransaction)
+		{
+			EndTransaction();
+			BeginTransaction();
+			pixelsWritten = 0;
+		}
 		uint16_t pixelsToWrite = inPixelsToCopy > 32 ? 32 : inPixelsToCopy;
 		inPixelsToCopy -= pixelsToWrite;
+		pixelsWritten += pixelsToWrite;
 		inDataStream->Read(pixelsToWrite, buffer);
 		WriteData16(buffer, pixelsToWrite);
 	}
@@ -23,6 +23,7 @@
 #ifndef TFT_ST77XX_h
 #define TFT_ST77XX_h
 #include <SPI.h>
+#include "SPITracer.h"
 #include "DisplayController.h"
 
 class DataStream;
@@ -66,15 +67,26 @@ public:
 	*/
 	virtual void			WakeUp(void);
 
+	/*
+	*	ePixelsPerTransaction: About 256us of SPI at 8MHz.  Between
+	*	transactions the interrupts passed to SPI.usingInterrupt can run
+	*	(e.g. a CAN controller's receive interrupt.)  Raising CS doesn't end
+	*	a memory write (RAMWR), the next pixel data continues it.
+	*/
+	enum
+	{
+		ePixelsPerTransaction	= 128
+	};
+
 	/*
 	*	FillPixels: Sets a run of inPixelsToFill to inFillColor from the
-	*	current position and column clipping.
+	*	current position and column clipping.  FillPixels and StreamCopy
+	*	end the SPI transaction every ePixelsPerTransaction pixels.
 	*/
 	virtual void			FillPixels(
 								uint16_t				inPixelsToFill,
 								uint16_t				inFillColor);
 								
-	/*
 	/*
 	*	SetColumnRange: Sets a the absolute column clipping to inStartColumn to
 	*	inEndColumn.
@@ -175,6 +187,7 @@ protected:
 	inline void				BeginTransaction(void)
 							{
 								SPI.beginTransaction(mSPISettings);
+								SPI_TRACE_BEGIN(mCSPin);
 								if (mCSPin >= 0)
 								{
 									*mChipSelPortReg &= ~mChipSelBitMask;
@@ -187,6 +200,7 @@ protected:
 								{
 									*mChipSelPortReg |= mChipSelBitMask;
 								}
+								SPI_TRACE_END();
 								SPI.endTransaction();
 							}
 
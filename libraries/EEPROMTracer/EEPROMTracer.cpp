@@ -0,0 +1,141 @@
+/*
+*	EEPROMTracer.cpp, Copyright Jonathan Mackey 2021
+*	EEPROM access statistics for DataStream_E.  See EEPROMTracer.h.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#include "EEPROMTracer.h"
+#ifdef TRACE_EEPROM
+
+EEPROMTracer::SState	EEPROMTracer::sState;
+
+/************************************ Read ************************************/
+void EEPROMTracer::Read(
+	uint16_t	inAddress,
+	uint16_t	inLength)
+{
+	sState.readCalls++;
+	sState.readBytes += inLength;
+	for (; inLength; inLength--, inAddress++)
+	{
+		Increment(sState.block[(inAddress & E2END) >> eBlockShift].reads);
+	}
+}
+
+/*********************************** Write ************************************/
+/*
+*	Called at the end of DataStream_E::Write, after Update was called for
+*	each byte.
+*/
+void EEPROMTracer::Write(
+	uint16_t	inLength)
+{
+	uint16_t	blocking = (uint16_t)(((uint32_t)sState.pendingChanged * eByteWriteMicros)/1000);
+	sState.writeCalls++;
+	sState.writeBytes += inLength;
+	sState.changedBytes += sState.pendingChanged;
+	sState.blocking += blocking;
+	if (blocking > sState.maxBlocking)
+	{
+		sState.maxBlocking = blocking;
+	}
+	sState.pendingChanged = 0;
+}
+
+/*********************************** Reset ************************************/
+void EEPROMTracer::Reset(void)
+{
+	memset(&sState, 0, sizeof(SState));
+	sState.windowStart = millis();
+}
+
+/************************************ Dump ************************************/
+void EEPROMTracer::Dump(void)
+{
+	Serial.print(F("EEPROM "));
+	Serial.print(millis() - sState.windowStart);
+	Serial.println(F(" ms"));
+	Serial.print(F("  reads: n="));
+	Serial.print(sState.readCalls);
+	Serial.print(F(", bytes="));
+	Serial.println(sState.readBytes);
+	Serial.print(F("  writes: n="));
+	Serial.print(sState.writeCalls);
+	Serial.print(F(", bytes="));
+	Serial.print(sState.writeBytes);
+	Serial.print(F(", changed="));
+	Serial.print(sState.changedBytes);
+	Serial.print(F(", blocking ms="));
+	Serial.print(sState.blocking);
+	Serial.print(F(", max ms="));
+	Serial.println(sState.maxBlocking);
+	DumpHeatMap(false);
+	DumpHeatMap(true);
+}
+
+/******************************** DumpHeatMap *********************************/
+/*
+*	One character per block: '.' = 0, otherwise n where 2^(n-1) <= count <
+*	2^n, 1 to 9 then A to G.  Lines with no accesses aren't printed.
+*/
+void EEPROMTracer::DumpHeatMap(
+	bool	inWrites)
+{
+	Serial.print(inWrites ? F("  changed bytes per ") : F("  bytes read per "));
+	Serial.print(1 << eBlockShift);
+	Serial.println(F(" byte block"));
+	for (uint16_t line = 0; line < eNumBlocks; line += eBlocksPerLine)
+	{
+		uint16_t	lineEnd = line + eBlocksPerLine;
+		if (lineEnd > eNumBlocks)
+		{
+			lineEnd = eNumBlocks;
+		}
+		bool	accessed = false;
+		for (uint16_t i = line; i < lineEnd && !accessed; i++)
+		{
+			accessed = (inWrites ? sState.block[i].writes : sState.block[i].reads) != 0;
+		}
+		if (!accessed)
+		{
+			continue;
+		}
+		uint16_t	address = line << eBlockShift;
+		Serial.print(F("  "));
+		for (uint16_t digit = 0x1000; digit > 1 && address < digit; digit >>= 4)
+		{
+			Serial.print('0');
+		}
+		Serial.print(address, HEX);
+		Serial.print(' ');
+		for (uint16_t i = line; i < lineEnd; i++)
+		{
+			uint16_t	count = inWrites ? sState.block[i].writes : sState.block[i].reads;
+			uint8_t		level = 0;
+			for (; count; count >>= 1)
+			{
+				level++;
+			}
+			Serial.print(level ? "123456789ABCDEFG"[level-1] : '.');
+		}
+		Serial.println();
+	}
+}
+
+#endif // TRACE_EEPROM
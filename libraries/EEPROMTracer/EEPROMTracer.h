@@ -0,0 +1,136 @@
+/*
+*	EEPROMTracer.h, Copyright Jonathan Mackey 2021
+*	EEPROM access statistics for DataStream_E: the reads and the changed
+*	(written) bytes per block of EEPROM addresses, and the time the writes
+*	block.  Used to see how much EEPROM traffic and wear the Gates and
+*	GateSets linked lists cause.
+*
+*	Tracing is enabled by uncommenting TRACE_EEPROM below.  When it isn't
+*	defined the EEPROM_TRACE_xx macros compile to nothing and this header has
+*	no effect.  Only DataStream_E is traced, EEPROM.get/put are not.
+*
+*	The counts are kept per block of 2^EEPROM_TRACE_BLOCK_SHIFT addresses,
+*	32 bytes by default (256 bytes of RAM for the 2KB EEPROM of the
+*	ATmega644PA.)  The host build traces every address.  The counts saturate
+*	at 65535.
+*
+*	The write blocking time is estimated as eByteWriteMicros per changed
+*	byte, the erase and write time of the ATmega644PA.  The MCU waits for
+*	the previous byte before writing the next, so a Write of n changed bytes
+*	blocks for about n times this.  Unchanged bytes aren't written.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef EEPROMTracer_h
+#define EEPROMTracer_h
+
+//#define TRACE_EEPROM	1	// Also defined by the host build (DCHost/Makefile)
+
+#ifdef TRACE_EEPROM
+#include <Arduino.h>
+#include <EEPROM.h>
+
+#ifndef EEPROM_TRACE_BLOCK_SHIFT
+#define EEPROM_TRACE_BLOCK_SHIFT	5
+#endif
+
+#define EEPROM_TRACE_READ(a, n)		EEPROMTracer::Read(a, n)
+#define EEPROM_TRACE_UPDATE(e, v)	EEPROMTracer::Update((e).index, *(e) != (v))
+#define EEPROM_TRACE_WRITE(n)		EEPROMTracer::Write(n)
+
+class EEPROMTracer
+{
+public:
+	enum
+	{
+		eBlockShift			= EEPROM_TRACE_BLOCK_SHIFT,
+		eNumBlocks			= (E2END + 1) >> EEPROM_TRACE_BLOCK_SHIFT,
+		eBlocksPerLine		= 64,	// Of the Dump heat maps
+		eByteWriteMicros	= 3300
+	};
+	struct SBlock
+	{
+		uint16_t	reads;		// Bytes read
+		uint16_t	writes;		// Bytes changed
+	};
+	struct SState
+	{
+		SBlock		block[eNumBlocks];
+		uint32_t	readCalls;
+		uint32_t	readBytes;
+		uint32_t	writeCalls;
+		uint32_t	writeBytes;	// Passed to Write, changed or not
+		uint32_t	changedBytes;
+		uint32_t	blocking;	// Estimated, ms
+		uint16_t	maxBlocking;// Longest single Write, ms
+		uint16_t	pendingChanged;	// Changed bytes of the Write in progress
+		uint32_t	windowStart;// Of the summary period (set by Reset)
+	};
+
+	static void				Read(
+								uint16_t				inAddress,
+								uint16_t				inLength);
+	static inline void		Update(
+								uint16_t				inAddress,
+								bool					inChanged)
+							{
+								if (inChanged)
+								{
+									Increment(sState.block[(inAddress & E2END) >> eBlockShift].writes);
+									sState.pendingChanged++;
+								}
+							}
+	static void				Write(
+								uint16_t				inLength);
+	/*
+	*	Reset: Clears the counts and starts a new summary period.
+	*/
+	static void				Reset(void);
+	/*
+	*	Dump: Prints the totals for the period since the last Reset followed
+	*	by the read and write heat maps.
+	*/
+	static void				Dump(void);
+	/*
+	*	The host tools read and combine the counts.
+	*/
+	static SState&			State(void)
+								{return(sState);}
+protected:
+	static SState	sState;
+
+	static inline void		Increment(
+								uint16_t&				ioCount)
+							{
+								if (ioCount != 0xFFFF)
+								{
+									ioCount++;
+								}
+							}
+	static void				DumpHeatMap(
+								bool					inWrites);
+};
+
+#else
+#define EEPROM_TRACE_READ(a, n)
+#define EEPROM_TRACE_UPDATE(e, v)
+#define EEPROM_TRACE_WRITE(n)
+#endif // TRACE_EEPROM
+
+#endif // EEPROMTracer_h
@@ -0,0 +1,145 @@
+/*
+*	LoopProfiler.cpp, Copyright Jonathan Mackey 2021
+*	Per-section execution time statistics for the main loop.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#include "LoopProfiler.h"
+
+LoopProfiler::SSection	LoopProfiler::sSection[];
+uint32_t				LoopProfiler::sStart[];
+#ifndef __AVR__
+uint64_t				LoopProfiler::sSimStart[];
+#endif
+
+/************************************ End *************************************/
+void LoopProfiler::End(
+	uint8_t	inSection)
+{
+	uint32_t	elapsed = Ticks() - sStart[inSection];
+	SSection&	section = sSection[inSection];
+	section.count++;
+	section.sum += elapsed;
+	if (elapsed > section.max)
+	{
+		section.max = elapsed;
+	}
+#ifndef __AVR__
+	uint32_t	simElapsed = (uint32_t)(HostClock::Nanos() - sSimStart[inSection]);
+	section.simSum += simElapsed;
+	if (simElapsed > section.simMax)
+	{
+		section.simMax = simElapsed;
+	}
+#endif
+	uint8_t	bucket = 0;
+	for (elapsed >>= 1; elapsed && bucket < (eNumBuckets-1); elapsed >>= 1)
+	{
+		bucket++;
+	}
+	if (section.histogram[bucket] != (BucketCount)~0)
+	{
+		section.histogram[bucket]++;
+	}
+}
+
+/*********************************** Reset ************************************/
+void LoopProfiler::Reset(void)
+{
+	memset(sSection, 0, sizeof(sSection));
+}
+
+/********************************* Percentile *********************************/
+uint32_t LoopProfiler::Percentile(
+	uint8_t	inSection,
+	uint8_t	inPercent)
+{
+	const SSection&	section = sSection[inSection];
+	uint32_t	total = 0;
+	for (uint8_t i = 0; i < eNumBuckets; i++)
+	{
+		total += section.histogram[i];
+	}
+	uint32_t	threshold = (total * inPercent + 99)/100;
+	uint32_t	runningTotal = 0;
+	uint8_t		bucket = 0;
+	for (; bucket < eNumBuckets; bucket++)
+	{
+		runningTotal += section.histogram[bucket];
+		if (runningTotal >= threshold)
+		{
+			break;
+		}
+	}
+	return(bucket < (eNumBuckets-1) ? ((uint32_t)2 << bucket) - 1 : section.max);
+}
+
+/************************************ Dump ************************************/
+/*
+*	Prints one line of totals followed by one line per non-empty histogram
+*	bucket.
+*/
+void LoopProfiler::Dump(
+	uint8_t						inSection,
+	const __FlashStringHelper*	inName)
+{
+	const SSection&	section = sSection[inSection];
+	Serial.print(inName);
+#ifdef __AVR__
+	Serial.print(F(" (us) n="));
+#else
+	Serial.print(F(" (host ns) n="));
+#endif
+	Serial.print(section.count);
+	if (section.count)
+	{
+		Serial.print(F(", avg="));
+		Serial.print((uint32_t)(section.sum/section.count));
+		Serial.print(F(", p50<="));
+		Serial.print(Percentile(inSection, 50));
+		Serial.print(F(", p99<="));
+		Serial.print(Percentile(inSection, 99));
+		Serial.print(F(", max="));
+		Serial.print(section.max);
+	#ifndef __AVR__
+		Serial.print(F(", sim avg us="));
+		Serial.print((uint32_t)(section.simSum/section.count/1000));
+		Serial.print(F(", sim max us="));
+		Serial.print(section.simMax/1000);
+	#endif
+	}
+	Serial.println();
+	for (uint8_t i = 0; i < eNumBuckets; i++)
+	{
+		if (section.histogram[i])
+		{
+			if (i < (eNumBuckets-1))
+			{
+				Serial.print(F("  <"));
+				Serial.print((uint32_t)2 << i);
+			} else
+			{
+				Serial.print(F("  >="));
+				Serial.print((uint32_t)1 << i);
+			}
+			Serial.print('\t');
+			Serial.println(section.histogram[i]);
+		}
+	}
+}
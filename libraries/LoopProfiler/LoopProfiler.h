@@ -0,0 +1,115 @@
+/*
+*	LoopProfiler.h, Copyright Jonathan Mackey 2021
+*	Per-section execution time statistics for the main loop: call count, sum,
+*	max and a log2 histogram of the elapsed time of each call.
+*
+*	On the target the time unit is micros() (4us resolution on a 16MHz AVR.)
+*	On the host the time unit is nanoseconds of host CPU time and, in addition,
+*	the simulated time spent in delay() and on the SPI bus is accumulated so
+*	that a rough target equivalent can be reported.
+*
+*	The PROFILE_BEGIN/PROFILE_END macros compile to nothing unless
+*	PROFILE_LOOP is defined.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef LoopProfiler_h
+#define LoopProfiler_h
+
+#include <Arduino.h>
+#ifndef __AVR__
+#include <time.h>
+#endif
+
+#ifdef PROFILE_LOOP
+#define PROFILE_BEGIN(s)	LoopProfiler::Begin(s)
+#define PROFILE_END(s)		LoopProfiler::End(s)
+#else
+#define PROFILE_BEGIN(s)
+#define PROFILE_END(s)
+#endif
+
+class LoopProfiler
+{
+public:
+	enum
+	{
+		eMaxSections	= 6,
+		eNumBuckets		= 24	// bucket n holds times >= 2^n and < 2^(n+1)
+	};
+#ifdef __AVR__
+	typedef uint16_t	BucketCount;	// Saturates at 0xFFFF
+#else
+	typedef uint32_t	BucketCount;
+#endif
+	struct SSection
+	{
+		uint32_t	count;
+		uint32_t	max;
+		uint64_t	sum;
+	#ifndef __AVR__
+		uint64_t	simSum;		// Simulated (HostClock) nanoseconds
+		uint32_t	simMax;
+	#endif
+		BucketCount	histogram[eNumBuckets];
+	};
+
+	static inline uint32_t	Ticks(void)
+							{
+							#ifdef __AVR__
+								return(micros());
+							#else
+								struct timespec	ts;
+								clock_gettime(CLOCK_MONOTONIC, &ts);
+								return((uint32_t)((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec));
+							#endif
+							}
+	static inline void		Begin(
+								uint8_t					inSection)
+							{
+							#ifndef __AVR__
+								sSimStart[inSection] = HostClock::Nanos();
+							#endif
+								sStart[inSection] = Ticks();
+							}
+	static void				End(
+								uint8_t					inSection);
+	static void				Reset(void);
+	static const SSection&	Get(
+								uint8_t					inSection)
+								{return(sSection[inSection]);}
+	/*
+	*	Returns the upper bound of the bucket containing the inPercent
+	*	percentile of the samples.
+	*/
+	static uint32_t			Percentile(
+								uint8_t					inSection,
+								uint8_t					inPercent);
+	static void				Dump(
+								uint8_t					inSection,
+								const __FlashStringHelper*	inName);
+protected:
+	static SSection	sSection[eMaxSections];
+	static uint32_t	sStart[eMaxSections];
+#ifndef __AVR__
+	static uint64_t	sSimStart[eMaxSections];
+#endif
+};
+
+#endif // LoopProfiler_h
@@ -0,0 +1,194 @@
+/*
+*	CANBitTiming.h, Copyright Jonathan Mackey 2021
+*	Derives the MCP2515 CNF1, CNF2 and CNF3 bit timing registers from the
+*	oscillator frequency, the bit rate and the sample point.  The functions
+*	are constexpr so that a sketch's timing config is computed by the
+*	compiler, and the host tools can call them at run time.
+*
+*	A bit is 8 to 25 time quanta (TQ), TQ = 2 x (BRP + 1) / Fosc.  It's made
+*	of the sync segment (1 TQ), the propagation segment PRSEG (1 to 8), phase
+*	segment 1 PHSEG1 (1 to 8) and phase segment 2 PHSEG2 (2 to 8).  The bus
+*	is sampled at the end of PHSEG1.
+*
+*	The smallest prescaler (BRP) that gives an exact bit rate with at most
+*	kMaxTQ quanta is used.  The sample point is rounded to the nearest TQ and
+*	limited so that PHSEG2 is 2 to 8 TQ and no longer than PRSEG + PHSEG1.
+*	SJW is 1 TQ.  Valid returns false when no BRP gives the exact bit rate.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef CANBitTiming_h
+#define CANBitTiming_h
+
+#include <inttypes.h>
+
+/*
+*	The functions are single return statements (C++11 constexpr) for the
+*	Arduino AVR compiler.
+*/
+namespace CANBitTiming
+{
+	const uint8_t	kMinTQ = 8;
+	/*
+	*	Fewer quanta than the 25 allowed, so that a larger prescaler is
+	*	preferred.  At 8 MHz and 40 kbps this gives the 20 TQ, 60% timing the
+	*	sketches have always used.
+	*/
+	const uint8_t	kMaxTQ = 20;
+	const uint8_t	kMaxBRP = 63;
+
+	/*
+	*	The sample point is in tenths of a percent.  40 kbps samples early for
+	*	long cable runs, the faster profiles use the CANopen 87.5% (limited by
+	*	the minimum PHSEG2 when a bit has few quanta.)
+	*/
+	enum EProfile
+	{
+		e40kbps,
+		e125kbps,
+		e250kbps,
+		e500kbps,
+		eNumProfiles
+	};
+	struct SProfile
+	{
+		uint32_t	bitRate;
+		uint16_t	samplePoint;
+	};
+	constexpr SProfile	kProfile[] =
+	{
+		{40000, 600},
+		{125000, 875},
+		{250000, 875},
+		{500000, 875}
+	};
+
+	/*
+	*	The register values in the order they're written starting at CNF3,
+	*	see MCP2515::begin.
+	*/
+	struct SConfig
+	{
+		uint8_t	cnf[3];	// CNF3, CNF2, CNF1
+	};
+
+	constexpr uint8_t		Clamp(
+								int16_t					inValue,
+								int16_t					inMin,
+								int16_t					inMax)
+							{return(inValue < inMin ? inMin : (inValue > inMax ? inMax : inValue));}
+	/*
+	*	TQPerBit: The number of quanta per bit for inBRP, 0 if the bit rate
+	*	isn't exact.
+	*/
+	constexpr uint32_t		TQPerBit(
+								uint32_t				inOscFreq,
+								uint32_t				inBitRate,
+								uint8_t					inBRP)
+							{return(inOscFreq % (2UL * (inBRP + 1) * inBitRate) ? 0 :
+										inOscFreq / (2UL * (inBRP + 1) * inBitRate));}
+	/*
+	*	Prescaler: The BRP, or kMaxBRP + 1 if none fits.
+	*/
+	constexpr uint8_t		Prescaler(
+								uint32_t				inOscFreq,
+								uint32_t				inBitRate,
+								uint8_t					inBRP = 0)
+							{return((inBRP > kMaxBRP ||
+										(TQPerBit(inOscFreq, inBitRate, inBRP) >= kMinTQ &&
+										TQPerBit(inOscFreq, inBitRate, inBRP) <= kMaxTQ)) ? inBRP :
+											Prescaler(inOscFreq, inBitRate, inBRP + 1));}
+	constexpr bool			Valid(
+								uint32_t				inOscFreq,
+								uint32_t				inBitRate)
+							{return(Prescaler(inOscFreq, inBitRate) <= kMaxBRP);}
+	constexpr uint8_t		NumTQ(
+								uint32_t				inOscFreq,
+								uint32_t				inBitRate)
+							{return(TQPerBit(inOscFreq, inBitRate, Prescaler(inOscFreq, inBitRate)));}
+	/*
+	*	SampleTQ: Sync + PRSEG + PHSEG1 for inNumTQ quanta.
+	*/
+	constexpr uint8_t		SampleTQ(
+								uint8_t					inNumTQ,
+								uint16_t				inSamplePoint)
+							{return(Clamp(((uint32_t)inNumTQ * inSamplePoint + 500) / 1000,
+										inNumTQ - 8 > (inNumTQ + 1) / 2 ? inNumTQ - 8 : (inNumTQ + 1) / 2,
+										inNumTQ - 2 < 17 ? inNumTQ - 2 : 17));}
+	constexpr uint8_t		PhaseSeg1(
+								uint8_t					inSampleTQ)
+							{return(inSampleTQ / 2);}
+	constexpr uint8_t		PropSeg(
+								uint8_t					inSampleTQ)
+							{return(inSampleTQ - 1 - PhaseSeg1(inSampleTQ));}
+	/*
+	*	SamplePoint: The sample point actually used, in tenths of a percent.
+	*/
+	constexpr uint16_t		SamplePoint(
+								uint32_t				inOscFreq,
+								uint32_t				inBitRate,
+								uint16_t				inSamplePoint)
+							{return((uint32_t)SampleTQ(NumTQ(inOscFreq, inBitRate), inSamplePoint) * 1000 /
+										NumTQ(inOscFreq, inBitRate));}
+
+	/*
+	*	CNF1: SJW (bits 7:6, SJW - 1) and BRP.
+	*/
+	constexpr uint8_t		CNF1(
+								uint32_t				inOscFreq,
+								uint32_t				inBitRate)
+							{return(Prescaler(inOscFreq, inBitRate));}
+	/*
+	*	CNF2: BTLMODE (PHSEG2 set by CNF3), PHSEG1 - 1 and PRSEG - 1.
+	*/
+	constexpr uint8_t		CNF2(
+								uint32_t				inOscFreq,
+								uint32_t				inBitRate,
+								uint16_t				inSamplePoint)
+							{return(0x80 |
+										((PhaseSeg1(SampleTQ(NumTQ(inOscFreq, inBitRate), inSamplePoint)) - 1) << 3) |
+										(PropSeg(SampleTQ(NumTQ(inOscFreq, inBitRate), inSamplePoint)) - 1));}
+	/*
+	*	CNF3: PHSEG2 - 1, wake-up filter off, CLKOUT pin is the clock output.
+	*/
+	constexpr uint8_t		CNF3(
+								uint32_t				inOscFreq,
+								uint32_t				inBitRate,
+								uint16_t				inSamplePoint)
+							{return(NumTQ(inOscFreq, inBitRate) -
+										SampleTQ(NumTQ(inOscFreq, inBitRate), inSamplePoint) - 1);}
+	constexpr SConfig		Config(
+								uint32_t				inOscFreq,
+								uint32_t				inBitRate,
+								uint16_t				inSamplePoint)
+							{return(SConfig{{CNF3(inOscFreq, inBitRate, inSamplePoint),
+										CNF2(inOscFreq, inBitRate, inSamplePoint),
+										CNF1(inOscFreq, inBitRate)}});}
+	constexpr SConfig		Config(
+								uint32_t				inOscFreq,
+								EProfile				inProfile)
+							{return(Config(inOscFreq, kProfile[inProfile].bitRate,
+										kProfile[inProfile].samplePoint));}
+	constexpr bool			Valid(
+								uint32_t				inOscFreq,
+								EProfile				inProfile)
+							{return(Valid(inOscFreq, kProfile[inProfile].bitRate));}
+}
+
+#endif // CANBitTiming_h
@@ -0,0 +1,240 @@
+/*
+*	CANRecorder.cpp, Copyright Jonathan Mackey 2021
+*	Records the most recent CAN frames and MCP2515 error states in a small
+*	ring buffer.  See CANRecorder.h for the record and drain formats.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#include "CANRecorder.h"
+
+/******************************** CANRecorder *********************************/
+CANRecorder::CANRecorder(
+	uint8_t*	inBuffer,
+	uint16_t	inBufferSize)
+	: mBuffer(inBuffer), mBufferSize(inBufferSize)
+{
+	Clear();
+}
+
+/*********************************** Clear ************************************/
+void CANRecorder::Clear(void)
+{
+	mHead = 0;
+	mUsed = 0;
+	mOldestTime = 0;
+	mNewestTime = 0;
+	mRecorded = 0;
+	mOverwritten = 0;
+}
+
+/*********************************** Record ***********************************/
+void CANRecorder::Record(
+	CANFrame&	inCANFrame,
+	uint8_t		inFlags)
+{
+	const uint8_t*	raw = inCANFrame.GetRawFrame();
+	uint8_t	dataLen = inCANFrame.GetDataLen();
+	if (dataLen > 8)
+	{
+		dataLen = 8;
+	}
+	uint8_t	header[eHeaderSize];
+	header[0] = (raw[4] & 0x40) | inFlags | dataLen;
+	header[4] = raw[0];
+	header[5] = raw[1];
+	header[6] = raw[2];
+	header[7] = raw[3];
+	Append(header, inCANFrame.GetData(), dataLen);
+}
+
+/******************************** RecordError *********************************/
+void CANRecorder::RecordError(
+	uint8_t	inEFLG,
+	uint8_t	inCANINTE,
+	uint8_t	inCANINTF)
+{
+	uint8_t	header[eHeaderSize];
+	header[0] = eErrorFlag;
+	header[4] = inEFLG;
+	header[5] = inCANINTE;
+	header[6] = inCANINTF;
+	header[7] = 0;
+	Append(header, nullptr, 0);
+}
+
+/*********************************** Append ***********************************/
+/*
+*	Overwrites the oldest records as needed to make room for the new record.
+*	The time delta in inHeader[1..3] is set here.
+*/
+void CANRecorder::Append(
+	const uint8_t*	inHeader,
+	const uint8_t*	inData,
+	uint8_t			inDataLen)
+{
+	uint8_t	recordSize = eHeaderSize + inDataLen;
+	if (recordSize <= mBufferSize)
+	{
+		while ((mBufferSize - mUsed) < recordSize)
+		{
+			RemoveOldest();
+			mOverwritten++;
+		}
+		uint32_t	now = millis();
+		uint32_t	delta = 0;
+		if (mUsed)
+		{
+			delta = now - mNewestTime;
+			if (delta > eMaxDelta)
+			{
+				delta = eMaxDelta;
+			}
+		} else
+		{
+			mOldestTime = now;
+		}
+		mNewestTime = now;
+		uint16_t	index = (mHead + mUsed) % mBufferSize;
+		for (uint8_t i = 0; i < recordSize; i++)
+		{
+			uint8_t	thisByte;
+			switch (i)
+			{
+				case 1:
+					thisByte = (uint8_t)delta;
+					break;
+				case 2:
+					thisByte = (uint8_t)(delta >> 8);
+					break;
+				case 3:
+					thisByte = (uint8_t)(delta >> 16);
+					break;
+				default:
+					thisByte = i < eHeaderSize ? inHeader[i] : inData[i - eHeaderSize];
+					break;
+			}
+			mBuffer[index] = thisByte;
+			index++;
+			if (index == mBufferSize)
+			{
+				index = 0;
+			}
+		}
+		mUsed += recordSize;
+		mRecorded++;
+	}
+}
+
+/*********************************** Delta ************************************/
+/*
+*	Returns the time delta of the oldest record.
+*/
+uint32_t CANRecorder::Delta(void) const
+{
+	return(Peek(1) + ((uint32_t)Peek(2) << 8) + ((uint32_t)Peek(3) << 16));
+}
+
+/******************************** RemoveOldest ********************************/
+void CANRecorder::RemoveOldest(void)
+{
+	uint8_t	recordSize = RecordSize();
+	mHead = (mHead + recordSize) % mBufferSize;
+	mUsed -= recordSize;
+	if (mUsed)
+	{
+		mOldestTime += Delta();
+	}
+}
+
+/*********************************** Drain ************************************/
+uint16_t CANRecorder::Drain(
+	Print&		inOutput,
+	uint16_t	inMaxRecords)
+{
+	uint16_t	drained = 0;
+	for (; mUsed && drained < inMaxRecords; drained++)
+	{
+		uint8_t	out[eDrainRecordSize];
+		memset(out, 0, sizeof(out));
+		uint32_t	seconds = mOldestTime / 1000;
+		uint32_t	usec = (mOldestTime % 1000) * 1000;
+		uint32_t	canID;
+		uint8_t		flags = Peek(0);
+		if (flags & eErrorFlag)
+		{
+			uint8_t	eflg = Peek(4);
+			canID = eCAN_ERR_FLAG | eCAN_ERR_CRTL;
+			if (eflg & _BV(5))	// TXBO
+			{
+				canID |= eCAN_ERR_BUSOFF;
+			}
+			out[12] = 8;	// CAN_ERR_DLC
+			// RX0OVR, RX1OVR -> CAN_ERR_CRTL_RX_OVERFLOW,
+			// RXWAR..TXEP -> CAN_ERR_CRTL_RX_WARNING..CAN_ERR_CRTL_TX_PASSIVE
+			out[17] = ((eflg & 0xC0) ? 1 : 0) | ((eflg & 0x1E) << 1);
+			out[21] = eflg;
+			out[22] = Peek(5);
+			out[23] = Peek(6);
+		} else
+		{
+			uint8_t	raw[sizeof(CANFrame)];
+			uint8_t	dataLen = flags & 0x0F;
+			memset(raw, 0, sizeof(raw));
+			raw[4] = flags & ~eRecordFlagsMask;
+			for (uint8_t i = 0; i < 4; i++)
+			{
+				raw[i] = Peek(4 + i);
+			}
+			for (uint8_t i = 0; i < dataLen; i++)
+			{
+				raw[5 + i] = out[16 + i] = Peek(eHeaderSize + i);
+			}
+			CANFrame	canFrame;
+			canFrame.CopyToRaw(raw);
+			if (canFrame.IsExtended())
+			{
+				canID = eCAN_EFF_FLAG | ((uint32_t)canFrame.GetStandardID() << 18) |
+							canFrame.GetExtendedID();
+				if (canFrame.IsRemoteRequest())
+				{
+					canID |= eCAN_RTR_FLAG;
+				}
+			} else
+			{
+				canID = canFrame.GetStandardID();
+				if (canFrame.IsStandardRemoteRequest() ||
+					canFrame.IsRemoteRequest())
+				{
+					canID |= eCAN_RTR_FLAG;
+				}
+			}
+			out[12] = dataLen;
+			out[13] = (flags & eSentFlag) ? 1 : ((flags & eSendFailedFlag) ? 2 : 0);
+		}
+		for (uint8_t i = 0; i < 4; i++)
+		{
+			out[i] = (uint8_t)(seconds >> (i*8));
+			out[4 + i] = (uint8_t)(usec >> (i*8));
+			out[8 + i] = (uint8_t)(canID >> (i*8));
+		}
+		inOutput.write(out, eDrainRecordSize);
+		RemoveOldest();
+	}
+	return(drained);
+}
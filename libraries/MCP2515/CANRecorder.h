@@ -0,0 +1,132 @@
+/*
+*	CANRecorder.h, Copyright Jonathan Mackey 2021
+*	Records the most recent CAN frames and MCP2515 error states in a small
+*	ring buffer.  When the buffer is full the oldest records are overwritten.
+*
+*	Each record takes 8 bytes plus the frame's data bytes:
+*		0		raw[4] (RTR bit and DLC) plus the record flags below
+*		1..3	ms since the previous record, little endian, saturates at
+*				about 4.6 hours
+*		4..7	raw[0..3] of the frame (the MCP2515 ID registers) or, for an
+*				error record, EFLG, CANINTE and CANINTF.
+*		8..		the data bytes
+*
+*	Drain writes the oldest records in a binary candump compatible format,
+*	24 bytes per record, all little endian:
+*		uint32	seconds since the controller started
+*		uint32	microseconds
+*		struct can_frame (SocketCAN)
+*			uint32	can_id, CAN_EFF_FLAG (0x80000000), CAN_RTR_FLAG
+*					(0x40000000) and CAN_ERR_FLAG (0x20000000) as in SocketCAN
+*			uint8	len
+*			uint8	flags, not SocketCAN: 1 = sent by this node, 2 = send
+*					failed.  0 for received frames.
+*			uint8	reserved[2], 0
+*			uint8	data[8]
+*
+*	Error records are SocketCAN controller error frames (CAN_ERR_CRTL) with
+*	CAN_ERR_BUSOFF set when TXBO is set, data[1] containing the CAN_ERR_CRTL_xx
+*	flags corresponding to the EFLG bits, and data[5..7] containing EFLG,
+*	CANINTE and CANINTF.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef CANRecorder_h
+#define CANRecorder_h
+
+#include <Arduino.h>
+#include "CANFrame.h"
+
+class CANRecorder
+{
+public:
+	enum ERecordFlags	// Stored in the unused bits of raw[4]
+	{
+		eSentFlag			= 0x10,
+		eSendFailedFlag		= 0x20,
+		eErrorFlag			= 0x80,
+		eRecordFlagsMask	= 0xB0
+	};
+	enum
+	{
+		eHeaderSize			= 8,	// Record size excluding data
+		eDrainRecordSize	= 24,
+		eMaxDelta			= 0xFFFFFF
+	};
+	enum ECANID	// SocketCAN can_id flags and error classes
+	{
+		eCAN_EFF_FLAG		= 0x80000000,
+		eCAN_RTR_FLAG		= 0x40000000,
+		eCAN_ERR_FLAG		= 0x20000000,
+		eCAN_ERR_CRTL		= 0x00000004,
+		eCAN_ERR_BUSOFF		= 0x00000040
+	};
+							CANRecorder(
+								uint8_t*				inBuffer,
+								uint16_t				inBufferSize);
+	void					Clear(void);
+							/*
+							*	inFlags is 0 for a received frame,
+							*	eSentFlag or eSendFailedFlag
+							*/
+	void					Record(
+								CANFrame&				inCANFrame,
+								uint8_t					inFlags = 0);
+	void					RecordError(
+								uint8_t					inEFLG,
+								uint8_t					inCANINTE,
+								uint8_t					inCANINTF);
+	bool					IsEmpty(void) const
+								{return(mUsed == 0);}
+							/*
+							*	Writes and removes up to inMaxRecords of the
+							*	oldest records.  Returns the number of records
+							*	written.
+							*/
+	uint16_t				Drain(
+								Print&					inOutput,
+								uint16_t				inMaxRecords = 0xFFFF);
+	uint32_t				GetRecorded(void) const
+								{return(mRecorded);}
+	uint32_t				GetOverwritten(void) const
+								{return(mOverwritten);}
+protected:
+	uint8_t*	mBuffer;
+	uint16_t	mBufferSize;
+	uint16_t	mHead;		// Index of the oldest record
+	uint16_t	mUsed;		// Bytes used
+	uint32_t	mOldestTime;// ms, of the oldest record
+	uint32_t	mNewestTime;// ms, of the newest record
+	uint32_t	mRecorded;	// Since Clear, for diagnostics
+	uint32_t	mOverwritten;
+
+	inline uint8_t			Peek(
+								uint16_t				inOffset) const
+								{return(mBuffer[(mHead + inOffset) % mBufferSize]);}
+	uint8_t					RecordSize(void) const
+								{return(eHeaderSize + (Peek(0) & 0x0F));}
+	uint32_t				Delta(void) const;
+	void					RemoveOldest(void);
+	void					Append(
+								const uint8_t*			inHeader,
+								const uint8_t*			inData,
+								uint8_t					inDataLen);
+};
+
+#endif // CANRecorder_h
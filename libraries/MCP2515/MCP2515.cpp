@@ -78,6 +78,13 @@ void MCP2515::begin(
 	}
 
 	delayMicroseconds(32);	// Wait 128 OSC1 clock cycles
+	memset(mTxPriority, 0, sizeof(mTxPriority));
+	memset(&mErrorCounters, 0, sizeof(mErrorCounters));
+	mPrevEFLG = 0;
+	mBusOffStreak = 0;
+	mLastBusOff = 0;
+	mErrorPeriod.Set(eErrorSamplePeriod);
+	mErrorPeriod.Start();
 	// After reset the MCP2515 is in configuration mode.
 	// Set the configuration
 	WriteReg(eCNF3Reg, 3, inTimingConfig);
@@ -99,6 +106,21 @@ uint8_t MCP2515::GetStatus(void)
 	return(status);
 }
 
+/******************************** GetRxStatus *********************************/
+/*
+*	Bits 7:6 are set when RXB1/RXB0 hold a message, 4:3 the message type and
+*	2:0 the filter the message matched.
+*/
+uint8_t MCP2515::GetRxStatus(void)
+{
+	uint8_t	status;
+	BeginTransaction();
+	SPI.transfer(eRxStatusInst);
+	status = SPI.transfer(0);
+	EndTransaction();
+	return(status);
+}
+
 /********************************** ReadReg ***********************************/
 uint8_t MCP2515::ReadReg(
 	uint8_t	inReg)
@@ -112,6 +134,25 @@ uint8_t MCP2515::ReadReg(
 	return(regValue);
 }
 
+/********************************** ReadReg ***********************************/
+/*
+*	Read multiple sequential registers.
+*/
+void MCP2515::ReadReg(
+	uint8_t		inReg,
+	uint8_t		inDataLen,
+	uint8_t*	outData)
+{
+	BeginTransaction();
+	SPI.transfer(eReadInst);
+	SPI.transfer(inReg);
+	for (uint8_t i = 0; i < inDataLen; i++)
+	{
+		outData[i] = SPI.transfer(0);
+	}
+	EndTransaction();
+}
+
 /********************************** WriteReg **********************************/
 /*
 *	Write to multiple sequential registers.
@@ -182,9 +223,12 @@ void MCP2515::SetMode(
 /*
 *	Returns true if one of the 3 Tx buffers was filled and requested to be sent.
 *	Else false if all 3 are full and waiting to be sent.
+*	inPriority is the TXP, 0 to 3.  When more than one buffer is waiting the
+*	MCP2515 sends the highest priority first.
 */
 bool MCP2515::SendFrame(
-	CANFrame&	inCANFrame)
+	CANFrame&	inCANFrame,
+	uint8_t		inPriority)
 {
 	// Find the first available Tx buffer.
 	// The flag that determines if a buffer is available is TXREQ.
@@ -192,73 +236,215 @@ bool MCP2515::SendFrame(
 	uint8_t	status = GetStatus();
 	// eTXREQ_TXBnCTRL... = 2, 4, 6. mask = 4 0x10 0x40
 	uint8_t mask = _BV(eTXREQ_TXB0CTRL);
-	uint8_t	loadTxBuffInst = eLoadTx0IDBuffInst;
-	uint8_t	reqToSendBits = 1;
+	uint8_t	txBuffer = 0;
 	for (; mask <= 0x40 && (status & mask); mask <<= 2)
 	{
-		loadTxBuffInst += 2;
-		reqToSendBits <<= 1;
+		txBuffer++;
 	}
-	bool success = loadTxBuffInst <= eLoadTx2IDBuffInst;
+	bool success = txBuffer < 3;
 	if (success)
 	{
-		// Load the Tx buffer with the CAN frame
-		BeginTransaction();
-		SPI.transfer(loadTxBuffInst);
-		uint8_t	rawLength = inCANFrame.RawLength();
-		uint8_t*	rawFrame = inCANFrame.GetRawFrame();
-		for (uint8_t i = 0; i < rawLength; i++)
-		{
-			SPI.transfer(rawFrame[i]);
-		}
-		EndTransaction();
-		
-		// Tell the controller the Tx buffer is ready to be sent.
-		BeginTransaction();
-		SPI.transfer(eReqToSendInst + reqToSendBits);
-		EndTransaction();
+		LoadAndSend(txBuffer, inCANFrame, inPriority);
 	}
 	return(success);
 }
 
+/******************************** LoadAndSend *********************************/
+/*
+*	Loads Tx buffer inTxBuffer (0 to 2), which must not be waiting to be sent,
+*	and requests that it be sent.  This is the LOAD TX BUFFER instruction
+*	followed by RTS.  When the priority of the buffer changes, a WRITE starting
+*	at TXBnCTRL sets TXP and loads the frame in the same transaction.
+*/
+void MCP2515::LoadAndSend(
+	uint8_t		inTxBuffer,
+	CANFrame&	inCANFrame,
+	uint8_t		inPriority)
+{
+	uint8_t	rawLength = inCANFrame.RawLength();
+	uint8_t*	rawFrame = inCANFrame.GetRawFrame();
+	inPriority &= eTXP;
+	BeginTransaction();
+	if (inPriority == mTxPriority[inTxBuffer])
+	{
+		SPI.transfer(eLoadTx0IDBuffInst + inTxBuffer*2);
+	} else
+	{
+		mTxPriority[inTxBuffer] = inPriority;
+		SPI.transfer(eWriteInst);
+		SPI.transfer(eTXB0CTRLReg + inTxBuffer*0x10);
+		SPI.transfer(inPriority);
+	}
+	for (uint8_t i = 0; i < rawLength; i++)
+	{
+		SPI.transfer(rawFrame[i]);
+	}
+	EndTransaction();
+	
+	// Tell the controller the Tx buffer is ready to be sent.
+	BeginTransaction();
+	SPI.transfer(eReqToSendInst + _BV(inTxBuffer));
+	EndTransaction();
+}
+
 /******************************** ReceiveFrame ********************************/
 /*
 *	Returns true if one of the 2 Rx buffers was received.
 *	Else false if there are no Rx buffers ready to be received/read.
 *	This routine takes the first Rx buffer available (0, then 1)
+*
+*	RX STATUS tells which buffers hold a message in one status byte, then
+*	ReadRxBuffer reads the frame in one transaction.
 */
 bool MCP2515::ReceiveFrame(
 	CANFrame&	outCANFrame)
 {
-	uint8_t	status = GetStatus();
-	uint8_t mask = 1;
-	uint8_t	readRxBuffInst = eReadRx0IDBuffInst;
-	for (; mask <= 2 && (mask & status) == 0; mask <<= 1)
+	uint8_t	rxStatus = GetRxStatus();
+	bool success = (rxStatus & (_BV(eRXB0Full_RxStatus) | _BV(eRXB1Full_RxStatus))) != 0;
+	if (success)
 	{
-		readRxBuffInst += 4;
+		ReadRxBuffer((rxStatus & _BV(eRXB0Full_RxStatus)) ? 0 : 1, outCANFrame);
 	}
-	bool success = readRxBuffInst <= eReadRx1IDBuffInst;
-	if (success)
+	return(success);
+}
+
+/******************************** ReadRxBuffer ********************************/
+/*
+*	Reads Rx buffer inRxBuffer (0 or 1) using READ RX BUFFER: the ID, the DLC
+*	and only the data bytes the DLC calls for.  The MCP2515 clears the
+*	buffer's RXnIF flag when CS is raised.
+*/
+void MCP2515::ReadRxBuffer(
+	uint8_t		inRxBuffer,
+	CANFrame&	outCANFrame)
+{
+	BeginTransaction();
+	SPI.transfer(inRxBuffer ? eReadRx1IDBuffInst : eReadRx0IDBuffInst);
+	uint8_t*	rawFrame = outCANFrame.GetRawFrame();
+	uint8_t i = 0;
+	for (; i < 5; i++)
 	{
-		// Load the CAN frame with the Rx buffer
-		BeginTransaction();
-		SPI.transfer(readRxBuffInst);
-		uint8_t*	rawFrame = outCANFrame.GetRawFrame();
-		uint8_t i = 0;
-		for (; i < 5; i++)
+		rawFrame[i] = SPI.transfer(0);
+	}
+	// A DLC greater than 8 is valid on the bus but means 8 data bytes.
+	if ((rawFrame[4] & 0x0F) > 8)
+	{
+		rawFrame[4] = (rawFrame[4] & 0xF0) | 8;
+	}
+	// Read the data, if any
+	uint8_t	rawLength = outCANFrame.RawLength();
+	for (; i < rawLength; i++)
+	{
+		rawFrame[i] = SPI.transfer(0);
+	}
+	EndTransaction();	// Clears RXnIF
+}
+
+/**************************** UpdateErrorCounters *****************************/
+/*
+*	The error interrupt only occurs when an EFLG bit is newly set, and TXEP
+*	and TXBO clear without one, so the bits are compared to those of the last
+*	update (this or CheckErrorCounters.)
+*
+*	On bus off all pending transmissions are aborted.  The MCP2515 recovers
+*	by itself after 128 x 11 recessive bits, the backoff delays the resending
+*	of the aborted frames so that a node with a fault doesn't keep taking the
+*	bus down.  The backoff doubles for each bus off less than
+*	eBusOffStreakReset after the previous one.
+*/
+uint8_t MCP2515::UpdateErrorCounters(void)
+{
+	uint8_t	eflg = ReadReg(eEFLGReg);
+	uint8_t	newFlags = eflg & ~mPrevEFLG;
+	mPrevEFLG = eflg & ~(_BV(eRX0OVR) | _BV(eRX1OVR));
+	if (eflg & (_BV(eRX0OVR) | _BV(eRX1OVR)))
+	{
+		if (eflg & _BV(eRX0OVR))
 		{
-			rawFrame[i] = SPI.transfer(0);
+			Increment(mErrorCounters.rx0Overflows);
 		}
-		// Read the data, if any
-		uint8_t	rawLength = outCANFrame.RawLength();
-		for (; i < rawLength; i++)
+		if (eflg & _BV(eRX1OVR))
 		{
-			rawFrame[i] = SPI.transfer(0);
+			Increment(mErrorCounters.rx1Overflows);
 		}
-		EndTransaction();
-		ModifyReg(eCANINTFReg, readRxBuffInst == eReadRx0IDBuffInst ? _BV(eRX0IF) : _BV(eRX1IF), 0);
+		ModifyReg(eEFLGReg, _BV(eRX0OVR) | _BV(eRX1OVR), 0);
 	}
-	return(success);
+	if (newFlags & _BV(eTXEP))
+	{
+		Increment(mErrorCounters.txErrorPassive);
+	}
+	if (newFlags & _BV(eTXBO))
+	{
+		Increment(mErrorCounters.busOffs);
+		ModifyReg(eCANCTRLReg, _BV(eABAT), _BV(eABAT));
+		uint32_t	now = millis();
+		uint8_t		shift = mBusOffStreak & eBusOffShiftMask;
+		if ((uint32_t)(now - mLastBusOff) >= eBusOffStreakReset)
+		{
+			shift = 0;
+		}
+		mLastBusOff = now;
+		mErrorPeriod.Set((uint32_t)eBusOffBackoff << shift);
+		mErrorPeriod.Start();
+		if (shift < eMaxBusOffShift)
+		{
+			shift++;
+		}
+		mBusOffStreak = eBusOffHold | shift;
+	}
+	// TEC and REC are sequential, read both in one transaction.
+	ReadReg(eTECReg, 2, &mErrorCounters.tec);
+	if (mErrorCounters.tec > mErrorCounters.maxTEC)
+	{
+		mErrorCounters.maxTEC = mErrorCounters.tec;
+	}
+	if (mErrorCounters.rec > mErrorCounters.maxREC)
+	{
+		mErrorCounters.maxREC = mErrorCounters.rec;
+	}
+	return(eflg);
 }
 
-
+/***************************** CheckErrorCounters *****************************/
+/*
+*	When the hold ends ABAT is cleared and the buffers with ABTF set are
+*	requested to be sent again.  Requests made during the hold were also
+*	aborted so they're resent as well.
+*/
+uint8_t MCP2515::CheckErrorCounters(void)
+{
+	uint8_t	eflg = 0;
+	if (mErrorPeriod.Passed())
+	{
+		eflg = UpdateErrorCounters();
+		if ((mBusOffStreak & eBusOffHold) &&
+			!(eflg & _BV(eTXBO)))
+		{
+			mBusOffStreak &= ~eBusOffHold;
+			ModifyReg(eCANCTRLReg, _BV(eABAT), 0);
+			uint8_t	reqToSendBits = 0;
+			uint8_t	reqToSendBit = eReqToSendTXBO;
+			for (uint8_t txCtrlRegAddr = eTXB0CTRLReg;
+					txCtrlRegAddr <= eTXB2CTRLReg; txCtrlRegAddr += 0x10)
+			{
+				if (ReadReg(txCtrlRegAddr) & _BV(eABTF))
+				{
+					reqToSendBits |= reqToSendBit;
+				}
+				reqToSendBit <<= 1;
+			}
+			if (reqToSendBits)
+			{
+				BeginTransaction();
+				SPI.transfer(eReqToSendInst + reqToSendBits);
+				EndTransaction();
+			}
+		}
+		if (!(mBusOffStreak & eBusOffHold))
+		{
+			mErrorPeriod.Set(eErrorSamplePeriod);
+		}
+		mErrorPeriod.Start();
+	}
+	return(eflg);
+}
@@ -28,7 +28,9 @@
 #else
 #include <SPI.h>
 #endif
+#include "SPITracer.h"
 #include "CANFrame.h"
+#include "MSPeriod.h"
 
 class MCP2515
 {
@@ -38,6 +40,7 @@ public:
 								int8_t					inResetPin = -1);
 
 	uint8_t					GetStatus(void);
+	uint8_t					GetRxStatus(void);
 	enum EReqToSendMask
 	{
 		// Any combination of eReqToSendxxx is ORd with eReqToSendInst
@@ -45,6 +48,29 @@ public:
 		eReqToSendTXB1			= 0x02,
 		eReqToSendTXB2			= 0x04
 	};
+	/*
+	*	Error counters, see UpdateErrorCounters.  The counts saturate at 255.
+	*	8 bytes so that they fit in the data of one frame.
+	*/
+	struct SErrorCounters
+	{
+		uint8_t	rx0Overflows;	// RX0OVR, frames lost with RXB0 full
+		uint8_t	rx1Overflows;	// RX1OVR, frames lost with RXB1 full
+		uint8_t	txErrorPassive;	// TXEP, TEC reached 128
+		uint8_t	busOffs;		// TXBO, TEC passed 255
+		uint8_t	tec;			// Last sampled TEC, must precede rec
+		uint8_t	rec;			// Last sampled REC
+		uint8_t	maxTEC;
+		uint8_t	maxREC;
+	};
+	inline const SErrorCounters&	GetErrorCounters(void) const
+								{return(mErrorCounters);}
+	/*
+	*	True from bus off till the backoff period has passed and the MCP2515
+	*	is error active again.  Sends are aborted during this time.
+	*/
+	inline bool				BusOffHold(void) const
+								{return(mBusOffStreak & eBusOffHold);}
 protected:
 	enum EInstruction
 	{
@@ -72,6 +98,8 @@ protected:
 			eTXREQ_TXB2CTRL,
 			eTX2IF_CANINTF,
 		eRxStatusInst			= 0xB0,
+			eRXB0Full_RxStatus	= 6,	// Bits 7:6, message in RXB0/RXB1
+			eRXB1Full_RxStatus,
 		eBitModifyInst			= 0x05
 	};
 	enum ERegs
@@ -103,6 +131,7 @@ protected:
 				eRxB0Interrupt	= 0x0C,
 				eRxB1Interrupt	= 0x0E,
 		eCANCTRLReg				= 0x0F,	// Control
+			eABAT				= 4,	// Abort All Pending Transmissions bit
 		eTECReg					= 0x1C,	// Transmit Error Counter
 		eRECReg,						// Receive Error Counter
 		eCNF3Reg				= 0x28,	// (CM)
@@ -136,8 +165,11 @@ protected:
 			eRX0OVR,
 			eRX1OVR,
 		eTXB0CTRLReg			= 0x30,	// Transmit Buffer 0 Control
+			eTXP				= 0x03,	// Transmit Buffer Priority >> This is a Mask
 			eTXREQ				= 3,	// Message Transmit Request bit
 			eTXERR,						// Transmission Error Detected bit
+			eMLOA,						// Message Lost Arbitration bit
+			eABTF,						// Message Aborted Flag bit
 		eTXB1CTRLReg			= 0x40,
 			//eTXREQ			= 3,	// Message Transmit Request bit
 			//eTXERR,					// Transmission Error Detected bit
@@ -151,6 +183,15 @@ protected:
 			eRXM				= 0x60,	// Filters on/off 0/1 >> This is a Mask
 		eRXB1CTRLReg			= 0x70,
 	};
+	enum EErrorTiming
+	{
+		eErrorSamplePeriod		= 1000,	// ms, TEC/REC/EFLG sampling
+		eBusOffBackoff			= 100,	// ms, doubled per consecutive bus off
+		eMaxBusOffShift			= 6,	// Backoff is at most 6.4 seconds
+		eBusOffStreakReset		= 60000,// ms without a bus off
+		eBusOffHold				= 0x80,	// mBusOffStreak flag
+		eBusOffShiftMask		= 0x0F
+	};
 
 	uint8_t		mCSPin;
 	uint8_t		mResetPin;
@@ -159,6 +200,12 @@ protected:
 #endif
 	uint8_t		mChipSelBitMask;
 	volatile uint8_t*	mChipSelPortReg;
+	uint8_t		mTxPriority[3];	// TXP of each Tx buffer, see LoadAndSend
+	SErrorCounters	mErrorCounters;
+	uint8_t		mPrevEFLG;		// Error state bits at the last update
+	uint8_t		mBusOffStreak;	// Consecutive bus offs | eBusOffHold
+	uint32_t	mLastBusOff;
+	MSPeriod	mErrorPeriod;	// Sample period, or the backoff when held
 
 
 	void					begin(	
@@ -171,12 +218,14 @@ protected:
 							#else
 								SPI.setDataMode(SPI_MODE0);
 							#endif
+								SPI_TRACE_BEGIN(mCSPin);
 								*mChipSelPortReg &= ~mChipSelBitMask;
 							}
 
 	inline void				EndTransaction(void)
 							{
 								*mChipSelPortReg |= mChipSelBitMask;
+								SPI_TRACE_END();
 							#ifdef SPI_HAS_TRANSACTION
 								SPI.endTransaction();
 							#endif
@@ -185,6 +234,10 @@ protected:
 
 	uint8_t					ReadReg(
 								uint8_t					inReg);
+	void					ReadReg(
+								uint8_t					inReg,
+								uint8_t					inDataLen,
+								uint8_t*				outData);
 	void					WriteReg(
 								uint8_t					inReg,
 								uint8_t					inData);
@@ -199,8 +252,39 @@ protected:
 	void					SetMode(
 								uint8_t					inMode);
 	bool					SendFrame(
-								CANFrame&				inCANFrame);
+								CANFrame&				inCANFrame,
+								uint8_t					inPriority = 0);
+	void					LoadAndSend(
+								uint8_t					inTxBuffer,
+								CANFrame&				inCANFrame,
+								uint8_t					inPriority);
 	bool					ReceiveFrame(
 								CANFrame&				outCANFrame);
+	void					ReadRxBuffer(
+								uint8_t					inRxBuffer,
+								CANFrame&				outCANFrame);
+	/*
+	*	UpdateErrorCounters: Reads EFLG, TEC and REC, counts the newly set
+	*	TXEP and TXBO bits and the RXnOVR bits (clearing them), and starts the
+	*	bus off backoff.  Returns the EFLG value read.  Called when the error
+	*	interrupt occurs, the caller clears ERRIF.
+	*/
+	uint8_t					UpdateErrorCounters(void);
+	/*
+	*	CheckErrorCounters: Called from the loop.  Samples the counters every
+	*	eErrorSamplePeriod and ends the bus off hold once the backoff passed
+	*	and the MCP2515 has recovered, resending the aborted frames.  Returns
+	*	the EFLG value read, or 0 when not sampled, so that the caller can
+	*	account for the RXnOVR bits it cleared.
+	*/
+	uint8_t					CheckErrorCounters(void);
+	static inline void		Increment(
+								uint8_t&				ioCount)
+							{
+								if (ioCount != 0xFF)
+								{
+									ioCount++;
+								}
+							}
 };
 #endif // MCP2515_h
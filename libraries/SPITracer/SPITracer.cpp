@@ -0,0 +1,146 @@
+/*
+*	SPITracer.cpp, Copyright Jonathan Mackey 2021
+*	Per chip select SPI bus statistics.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#include "SPITracer.h"
+#ifdef TRACE_SPI
+
+SPITraceClass		SPITrace;
+// Slot 0 is for the bytes transferred outside of a traced transaction.
+SPITracer::SState	SPITracer::sState = {{{eUntraced}}, 1};
+
+/************************************ Find ************************************/
+/*
+*	Returns the index of the device with inCSPin, adding it if there's room.
+*	Returns 0 (untraced) when there isn't.
+*/
+uint8_t SPITracer::Find(
+	uint8_t	inCSPin)
+{
+	uint8_t	index = 1;
+	for (; index < sState.numDevices; index++)
+	{
+		if (sState.device[index].csPin == inCSPin)
+		{
+			return(index);
+		}
+	}
+	if (index < eMaxDevices)
+	{
+		sState.numDevices++;
+		memset(&sState.device[index], 0, sizeof(SDevice));
+		sState.device[index].csPin = inCSPin;
+	} else
+	{
+		index = 0;
+	}
+	return(index);
+}
+
+/*********************************** Begin ************************************/
+void SPITracer::Begin(
+	uint8_t	inCSPin)
+{
+	sState.current = Find(inCSPin);
+	sState.device[sState.current].transactions++;
+	sState.start = micros();
+}
+
+/********************************** SetName ***********************************/
+void SPITracer::SetName(
+	uint8_t						inCSPin,
+	const __FlashStringHelper*	inName)
+{
+	sState.device[Find(inCSPin)].name = inName;
+}
+
+/************************************ Get *************************************/
+const SPITracer::SDevice* SPITracer::Get(
+	uint8_t	inCSPin)
+{
+	for (uint8_t i = 0; i < sState.numDevices; i++)
+	{
+		if (sState.device[i].csPin == inCSPin)
+		{
+			return(&sState.device[i]);
+		}
+	}
+	return(nullptr);
+}
+
+/*********************************** Reset ************************************/
+void SPITracer::Reset(void)
+{
+	for (uint8_t i = 0; i < sState.numDevices; i++)
+	{
+		SDevice&	device = sState.device[i];
+		device.transactions = 0;
+		device.bytes = 0;
+		device.held = 0;
+		device.maxHeld = 0;
+	}
+	sState.windowStart = micros();
+}
+
+/************************************ Dump ************************************/
+/*
+*	The bus percentage is the held time as a percentage of the time since the
+*	last Reset.
+*/
+void SPITracer::Dump(void)
+{
+	uint32_t	window = micros() - sState.windowStart;
+	Serial.print(F("SPI "));
+	Serial.print(window/1000);
+	Serial.println(F(" ms"));
+	for (uint8_t i = 0; i < sState.numDevices; i++)
+	{
+		const SDevice&	device = sState.device[i];
+		if (i == 0 && device.bytes == 0)
+		{
+			continue;
+		}
+		Serial.print(F("  "));
+		if (device.name)
+		{
+			Serial.print(device.name);
+		} else if (i == 0)
+		{
+			Serial.print(F("untraced"));
+		} else
+		{
+			Serial.print(F("CS "));
+			Serial.print(device.csPin);
+		}
+		Serial.print(F(": n="));
+		Serial.print(device.transactions);
+		Serial.print(F(", bytes="));
+		Serial.print(device.bytes);
+		Serial.print(F(", held us="));
+		Serial.print(device.held);
+		Serial.print(F(", max us="));
+		Serial.print(device.maxHeld);
+		Serial.print(F(", bus %="));
+		Serial.println(window ? (uint32_t)(((uint64_t)device.held * 100)/window) : 0);
+	}
+}
+
+#endif // TRACE_SPI
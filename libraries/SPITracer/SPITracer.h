@@ -0,0 +1,157 @@
+/*
+*	SPITracer.h, Copyright Jonathan Mackey 2021
+*	Per chip select SPI bus statistics: the number of transactions, the bytes
+*	transferred and the time the bus was held (from BeginTransaction to
+*	EndTransaction.)  Used to see how the devices sharing the bus, in
+*	particular the display and the MCP2515, compete for it.
+*
+*	Tracing is enabled by uncommenting TRACE_SPI below.  When it isn't
+*	defined the SPI_TRACE_BEGIN/SPI_TRACE_END macros compile to nothing and
+*	this header has no effect.  When it is defined, SPI in every file that
+*	includes this header refers to SPITrace, a subclass of SPIClass that counts
+*	the bytes transferred.  Only the drivers that include this header are
+*	traced (TFT_ST77XX, MCP2515 and BMP280SPI), SdFat and RFM69 are not.
+*	Bytes transferred by a traced driver outside of a transaction are counted
+*	as "untraced".
+*
+*	The time unit is micros(), on the host it's simulated time.  Not
+*	supported on the ATtiny (tinySPI.)
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef SPITracer_h
+#define SPITracer_h
+
+//#define TRACE_SPI	1	// Also defined by the host build (DCHost/Makefile)
+
+#if defined(__AVR_ATtiny24__) || defined(__AVR_ATtiny44__) || defined(__AVR_ATtiny84__)
+#undef TRACE_SPI
+#endif
+
+#ifdef TRACE_SPI
+#include <SPI.h>
+
+#define SPI_TRACE_BEGIN(p)	SPITracer::Begin(p)
+#define SPI_TRACE_END()		SPITracer::End()
+
+class SPITracer
+{
+public:
+	enum
+	{
+		eMaxDevices		= 8,
+		eUntraced		= 0xFF	// csPin of the untraced bytes slot
+	};
+	struct SDevice
+	{
+		uint8_t		csPin;
+		const __FlashStringHelper*	name;
+		uint32_t	transactions;
+		uint32_t	bytes;
+		uint32_t	held;		// us
+		uint32_t	maxHeld;	// Longest single transaction
+	};
+	struct SState
+	{
+		SDevice		device[eMaxDevices];
+		uint8_t		numDevices;
+		uint8_t		current;	// Index of the device in a transaction
+		uint32_t	start;		// Of the current transaction
+		uint32_t	windowStart;// Of the summary period (set by Reset)
+	};
+
+	static void				Begin(
+								uint8_t					inCSPin);
+	static inline void		End(void)
+							{
+								SDevice&	device = sState.device[sState.current];
+								uint32_t	held = micros() - sState.start;
+								device.held += held;
+								if (held > device.maxHeld)
+								{
+									device.maxHeld = held;
+								}
+								sState.current = 0;
+							}
+	static inline void		AddBytes(
+								uint16_t				inBytes)
+								{sState.device[sState.current].bytes += inBytes;}
+	/*
+	*	SetName: Optional name printed by Dump in place of the pin number.
+	*/
+	static void				SetName(
+								uint8_t					inCSPin,
+								const __FlashStringHelper*	inName);
+	/*
+	*	Reset: Clears the counts and starts a new summary period.  The device
+	*	names are kept.
+	*/
+	static void				Reset(void);
+	/*
+	*	Dump: Prints one line per device for the period since the last Reset.
+	*/
+	static void				Dump(void);
+	static const SDevice*	Get(
+								uint8_t					inCSPin);
+	/*
+	*	The host build saves and restores the state when switching between
+	*	simulated MCUs.
+	*/
+	static SState&			State(void)
+								{return(sState);}
+protected:
+	static SState	sState;
+
+	static uint8_t			Find(
+								uint8_t					inCSPin);
+};
+
+class SPITraceClass : public SPIClass
+{
+public:
+	inline static uint8_t	transfer(
+								uint8_t					inData)
+							{
+								SPITracer::AddBytes(1);
+								return(SPIClass::transfer(inData));
+							}
+	inline static uint16_t	transfer16(
+								uint16_t				inData)
+							{
+								SPITracer::AddBytes(2);
+								return(SPIClass::transfer16(inData));
+							}
+	inline static void		transfer(
+								void*					ioBuffer,
+								size_t					inCount)
+							{
+								SPITracer::AddBytes((uint16_t)inCount);
+								SPIClass::transfer(ioBuffer, inCount);
+							}
+};
+
+extern SPITraceClass SPITrace;
+#define SPI SPITrace
+
+#else
+#define SPI_TRACE_BEGIN(p)
+#define SPI_TRACE_END()
+#endif // TRACE_SPI
+
+#endif // SPITracer_h
@@ -24,9 +24,7 @@
 #define SerialUtils_h
 
 #include <time.h>
-#ifdef __MACH__
 #include <inttypes.h>
-#endif
 
 class SerialUtils
 {